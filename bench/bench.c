@@ -0,0 +1,876 @@
+/* Measures the speed of the parser, the lexer, the tape recorder and the
+   generator on a synthetic corpus that is generated at startup, so runs
+   on different machines see exactly the same input.
+
+   usage: bench [-c] [-t seconds] [-s scale] [-j results.json] [corpus...]
+
+   Every workload is repeated for the given time (0.5s by default) and
+   the fastest run is reported.  Allocations and peak memory are taken
+   from one extra run with an allocation tracker.
+
+   With -c the parser is instead fed chunks of 1, 2, 4, ... bytes up to
+   the whole document, which shows what tokens that span chunks cost:
+   the throughput is plotted against the chunk size next to the number
+   of times and bytes the lexer had to copy into its buffer, which are
+   only counted by a library built with JHN_STATS and shown as n/a (null
+   in the JSON) otherwise. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <johanson.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* growable output buffer for the corpus generators */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} text_t;
+
+static void
+text_append(text_t *t, const char *str, size_t len)
+{
+    if (t->len + len + 1 > t->cap) {
+        while (t->len + len + 1 > t->cap) {
+            t->cap = t->cap ? t->cap * 2 : 4096;
+        }
+        t->data = realloc(t->data, t->cap);
+    }
+    memcpy(t->data + t->len, str, len);
+    t->len += len;
+    t->data[t->len] = 0;
+}
+
+static void
+text_puts(text_t *t, const char *str)
+{
+    text_append(t, str, strlen(str));
+}
+
+static void
+text_printf(text_t *t, const char *fmt, ...)
+{
+    char buf[256];
+    int n;
+    va_list ap;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    text_append(t, buf, (size_t)n);
+}
+
+/* the corpus has to be the same everywhere, so no rand() */
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static unsigned int
+rng(unsigned int n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (unsigned int)(rng_state % n);
+}
+
+static const char *const words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+    "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+    "et", "dolore", "magna", "aliqua", "caf\xc3\xa9", "na\xc3\xafve",
+    "\xe6\x97\xa5\xe6\x9c\xac", "\\\"quoted\\\"", "line\\nbreak",
+    "\\u00e9t\\u00e9", "\xf0\x9f\x98\x80"
+};
+
+#define NUM_WORDS (sizeof(words) / sizeof(words[0]))
+
+static void
+put_sentence(text_t *t, unsigned int n)
+{
+    unsigned int i;
+
+    text_puts(t, "\"");
+    for (i = 0; i < n; i++) {
+        if (i) {
+            text_puts(t, " ");
+        }
+        text_puts(t, words[rng(NUM_WORDS)]);
+    }
+    text_puts(t, "\"");
+}
+
+/* statuses of a social network, a mix of everything with many keys */
+static void
+gen_twitter(text_t *t, unsigned int scale)
+{
+    unsigned int i, j, n = 2000 * scale;
+
+    text_puts(t, "{\"statuses\":[");
+    for (i = 0; i < n; i++) {
+        text_printf(t, "%s{\"id\":%llu,\"id_str\":\"%llu\",\"text\":",
+                    i ? "," : "", 505874924095815681ULL + i,
+                    505874924095815681ULL + i);
+        put_sentence(t, 5 + rng(20));
+        text_printf(t, ",\"truncated\":false,\"in_reply_to_status_id\":%s,"
+                    "\"user\":{\"id\":%u,\"name\":",
+                    rng(3) ? "null" : "505864943636197376", rng(1000000));
+        put_sentence(t, 2);
+        text_printf(t, ",\"screen_name\":\"user%u\",\"location\":\"\","
+                    "\"followers_count\":%u,\"friends_count\":%u,"
+                    "\"verified\":%s,\"profile_background_color\":"
+                    "\"C0DEED\",\"default_profile\":true},"
+                    "\"entities\":{\"hashtags\":[",
+                    rng(100000), rng(100000), rng(5000),
+                    rng(10) ? "false" : "true");
+        for (j = rng(4); j > 0; j--) {
+            text_printf(t, "{\"text\":\"tag%u\",\"indices\":[%u,%u]}%s",
+                        rng(1000), rng(100), rng(140), j > 1 ? "," : "");
+        }
+        text_printf(t, "],\"urls\":[],\"user_mentions\":[]},"
+                    "\"retweet_count\":%u,\"favorite_count\":%u,"
+                    "\"favorited\":false,\"retweeted\":false,"
+                    "\"lang\":\"ja\"}", rng(1000), rng(1000));
+    }
+    text_puts(t, "],\"search_metadata\":{\"completed_in\":0.087,"
+              "\"max_id\":505874924095815681,\"count\":100}}");
+}
+
+/* a GeoJSON outline, nearly nothing but floating point numbers */
+static void
+gen_canada(text_t *t, unsigned int scale)
+{
+    unsigned int i, j, n = 40 * scale;
+
+    text_puts(t, "{\"type\":\"FeatureCollection\",\"features\":[{\"type\":"
+              "\"Feature\",\"properties\":{\"name\":\"Canada\"},"
+              "\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[");
+    for (i = 0; i < n; i++) {
+        text_puts(t, i ? ",[" : "[");
+        for (j = 0; j < 1000; j++) {
+            text_printf(t, "%s[%.15g,%.15g]", j ? "," : "",
+                        -65.0 - rng(1000000) / 12345.678901,
+                        43.0 + rng(1000000) / 98765.4321);
+        }
+        text_puts(t, "]");
+    }
+    text_puts(t, "]}}]}");
+}
+
+/* a ticketing catalog, lots of small objects with integer ids */
+static void
+gen_citm(text_t *t, unsigned int scale)
+{
+    unsigned int i, j, n = 2000 * scale;
+
+    text_puts(t, "{\"areaNames\":{");
+    for (i = 0; i < 200; i++) {
+        text_printf(t, "%s\"%u\":\"Area %u\"", i ? "," : "",
+                    205705993 + i, i);
+    }
+    text_puts(t, "},\"events\":{");
+    for (i = 0; i < n; i++) {
+        text_printf(t, "%s\"%u\":{\"description\":null,\"id\":%u,"
+                    "\"logo\":\"/images/UE0AAAAACEKo%uQAAAAVDSVRN\","
+                    "\"name\":", i ? "," : "", 138586341 + i,
+                    138586341 + i, rng(100));
+        put_sentence(t, 3);
+        text_puts(t, ",\"subTopicIds\":[");
+        for (j = 0; j < 4; j++) {
+            text_printf(t, "%s%u", j ? "," : "", 337184262 + rng(100));
+        }
+        text_puts(t, "],\"subjectCode\":null,\"subtitle\":null,"
+                  "\"topicIds\":[324846099,107888604]}");
+    }
+    text_puts(t, "},\"performances\":[");
+    for (i = 0; i < n; i++) {
+        text_printf(t, "%s{\"eventId\":%u,\"id\":%u,\"logo\":null,"
+                    "\"name\":null,\"prices\":[", i ? "," : "",
+                    138586341 + rng(n), 339887544 + i);
+        for (j = 0; j < 3; j++) {
+            text_printf(t, "%s{\"amount\":%u,\"audienceSubCategoryId\":"
+                        "337100890,\"seatCategoryId\":%u}",
+                        j ? "," : "", 10000 + rng(90000), 338937295 + j);
+        }
+        text_printf(t, "],\"seatCategories\":[],\"seatMapImage\":null,"
+                    "\"start\":%llu,\"venueCode\":\"PLEYEL_PLEYEL\"}",
+                    1372616400000ULL + rng(1000000) * 1000ULL);
+    }
+    text_puts(t, "]}");
+}
+
+/* deeply nested maps and arrays, exercises the state stack */
+static void
+gen_deep(text_t *t, unsigned int scale)
+{
+    unsigned int i, j, n = 400 * scale, depth = 500;
+
+    text_puts(t, "[");
+    for (i = 0; i < n; i++) {
+        text_puts(t, i ? "," : "");
+        for (j = 0; j < depth; j++) {
+            text_puts(t, j & 1 ? "[" : "{\"k\":");
+        }
+        text_printf(t, "%u", i);
+        for (j = depth; j > 0; j--) {
+            text_puts(t, (j - 1) & 1 ? "]" : "}");
+        }
+    }
+    text_puts(t, "]");
+}
+
+/* long strings with escapes and multi byte characters */
+static void
+gen_strings(text_t *t, unsigned int scale)
+{
+    unsigned int i, n = 2000 * scale;
+
+    text_puts(t, "[");
+    for (i = 0; i < n; i++) {
+        text_puts(t, i ? "," : "");
+        put_sentence(t, 100 + rng(400));
+    }
+    text_puts(t, "]");
+}
+
+/* newline delimited log records, many small documents */
+static unsigned int
+gen_ndjson(text_t *t, unsigned int scale)
+{
+    unsigned int i, n = 20000 * scale;
+
+    for (i = 0; i < n; i++) {
+        text_printf(t, "{\"ts\":%llu,\"level\":\"%s\",\"latency\":%.3f,"
+                    "\"status\":%u,\"msg\":", 1700000000000ULL + i * 17ULL,
+                    rng(10) ? "info" : "warn", rng(100000) / 1000.0,
+                    rng(20) ? 200 : 503);
+        put_sentence(t, 4 + rng(8));
+        text_puts(t, "}\n");
+    }
+    return n;
+}
+
+typedef struct {
+    const char *name;
+    text_t text;
+    /* number of top level values */
+    unsigned int docs;
+    unsigned int multiple;
+    /* tokens the lexer sees, used for ns/token */
+    size_t tokens;
+} corpus_t;
+
+/* callbacks that do nothing, so the parser is all that is measured */
+static int
+cb_null(void *ctx)
+{
+    (void)ctx;
+    return 1;
+}
+
+static int
+cb_bool(void *ctx, int v)
+{
+    (void)ctx; (void)v;
+    return 1;
+}
+
+static int
+cb_integer(void *ctx, long long v)
+{
+    (void)ctx; (void)v;
+    return 1;
+}
+
+static int
+cb_double(void *ctx, double v)
+{
+    (void)ctx; (void)v;
+    return 1;
+}
+
+static int
+cb_string(void *ctx, const char *s, size_t l)
+{
+    (void)ctx; (void)s; (void)l;
+    return 1;
+}
+
+static const jhn_parser_callbacks_t count_callbacks = {
+    cb_null, cb_bool, cb_integer, cb_double, NULL, cb_string,
+    cb_null, cb_string, cb_null, cb_null, cb_null,
+    NULL, NULL, NULL, NULL
+};
+
+static int
+parse_with(jhn_parser_t *p, const corpus_t *c)
+{
+    int ok;
+
+    if (c->multiple) {
+        jhn_parser_config(p, jhn_allow_multiple_values, 1);
+    }
+    ok = jhn_parser_parse(p, c->text.data, c->text.len)
+             == jhn_parser_status_ok &&
+         jhn_parser_finish(p) == jhn_parser_status_ok;
+    jhn_parser_free(p);
+    return ok;
+}
+
+static int
+run_parse(const corpus_t *c, jhn_alloc_funcs_t *afs, void *state)
+{
+    (void)state;
+    return parse_with(jhn_parser_alloc(&count_callbacks, afs, NULL), c);
+}
+
+/* state of the chunk size sweep */
+typedef struct {
+    size_t chunk;
+    jhn_parser_stats_t stats;
+} chunked_t;
+
+static int
+run_chunked(const corpus_t *c, jhn_alloc_funcs_t *afs, void *state)
+{
+    jhn_parser_t *p = jhn_parser_alloc(&count_callbacks, afs, NULL);
+    chunked_t *ch = state;
+    size_t off, n;
+    int ok = 1;
+
+    if (c->multiple) {
+        jhn_parser_config(p, jhn_allow_multiple_values, 1);
+    }
+    for (off = 0; ok && off < c->text.len; off += n) {
+        n = c->text.len - off < ch->chunk ? c->text.len - off : ch->chunk;
+        ok = jhn_parser_parse(p, c->text.data + off, n)
+                 == jhn_parser_status_ok;
+    }
+    ok = ok && jhn_parser_finish(p) == jhn_parser_status_ok;
+    jhn_parser_get_stats(p, &ch->stats);
+    jhn_parser_free(p);
+    return ok;
+}
+
+/* whether the library keeps the statistics, which it only does if
+   built with JHN_STATS.  Every parse lexes at least one token. */
+static int
+stats_counted(const jhn_parser_stats_t *stats)
+{
+    size_t i;
+
+    for (i = 0; i < JHN_TOKEN_STATS; i++) {
+        if (stats->tokens[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+run_lex(const corpus_t *c, jhn_alloc_funcs_t *afs, void *state)
+{
+    jhn_lexer_t *lex = jhn_lexer_alloc(afs, 0, 1);
+    size_t offset = 0, *tokens = state;
+    const char *buf;
+    size_t len;
+    jhn_tok_t tok;
+
+    *tokens = 0;
+    for (;;) {
+        tok = jhn_lexer_lex(lex, c->text.data, c->text.len, &offset,
+                            &buf, &len);
+        if (tok == jhn_tok_eof || tok == jhn_tok_error) {
+            break;
+        }
+        (*tokens)++;
+    }
+    jhn_lexer_free(lex);
+    return tok == jhn_tok_eof;
+}
+
+static int
+run_tape(const corpus_t *c, jhn_alloc_funcs_t *afs, void *state)
+{
+    jhn_tape_t *tape = jhn_tape_alloc(afs);
+    int ok;
+
+    (void)state;
+    ok = parse_with(jhn_tape_recorder_alloc(tape, afs), c);
+    jhn_tape_free(tape);
+    return ok;
+}
+
+/* the generator is fed from a tape recorded up front so that only
+   generating is measured.  Every top level value gets a fresh start,
+   which NDJSON needs. */
+typedef struct {
+    jhn_gen_t *gen;
+    unsigned int depth;
+} feed_t;
+
+static int
+feed_done(feed_t *f, jhn_gen_status_t s)
+{
+    if (f->depth == 0) {
+        jhn_gen_reset(f->gen, "\n");
+    }
+    return s == jhn_gen_status_ok;
+}
+
+static int
+feed_null(void *ctx)
+{
+    feed_t *f = ctx;
+    return feed_done(f, jhn_gen_null(f->gen));
+}
+
+static int
+feed_bool(void *ctx, int v)
+{
+    feed_t *f = ctx;
+    return feed_done(f, jhn_gen_bool(f->gen, v));
+}
+
+static int
+feed_integer(void *ctx, long long v)
+{
+    feed_t *f = ctx;
+    return feed_done(f, jhn_gen_integer(f->gen, v));
+}
+
+static int
+feed_double(void *ctx, double v)
+{
+    feed_t *f = ctx;
+    return feed_done(f, jhn_gen_double(f->gen, v));
+}
+
+static int
+feed_string(void *ctx, const char *s, size_t l)
+{
+    feed_t *f = ctx;
+    return feed_done(f, jhn_gen_string(f->gen, s, l));
+}
+
+static int
+feed_key(void *ctx, const char *s, size_t l)
+{
+    feed_t *f = ctx;
+    return jhn_gen_string(f->gen, s, l) == jhn_gen_status_ok;
+}
+
+static int
+feed_start_map(void *ctx)
+{
+    feed_t *f = ctx;
+    f->depth++;
+    return jhn_gen_map_open(f->gen) == jhn_gen_status_ok;
+}
+
+static int
+feed_end_map(void *ctx)
+{
+    feed_t *f = ctx;
+    f->depth--;
+    return feed_done(f, jhn_gen_map_close(f->gen));
+}
+
+static int
+feed_start_array(void *ctx)
+{
+    feed_t *f = ctx;
+    f->depth++;
+    return jhn_gen_array_open(f->gen) == jhn_gen_status_ok;
+}
+
+static int
+feed_end_array(void *ctx)
+{
+    feed_t *f = ctx;
+    f->depth--;
+    return feed_done(f, jhn_gen_array_close(f->gen));
+}
+
+static const jhn_parser_callbacks_t feed_callbacks = {
+    feed_null, feed_bool, feed_integer, feed_double, NULL, feed_string,
+    feed_start_map, feed_key, feed_end_map, feed_start_array,
+    feed_end_array, NULL, NULL, NULL, NULL
+};
+
+static int
+run_gen(const corpus_t *c, jhn_alloc_funcs_t *afs, void *state)
+{
+    feed_t f;
+    int ok;
+
+    (void)c;
+    f.gen = jhn_gen_alloc(afs);
+    f.depth = 0;
+    ok = jhn_tape_replay(state, &feed_callbacks, &f) == jhn_parser_status_ok;
+    jhn_gen_free(f.gen);
+    return ok;
+}
+
+typedef int (*workload_fn)(const corpus_t *c, jhn_alloc_funcs_t *afs,
+                           void *state);
+
+typedef struct {
+    const char *name;
+    workload_fn run;
+} workload_t;
+
+static const workload_t workloads[] = {
+    { "parse", run_parse },
+    { "lex", run_lex },
+    { "tape", run_tape },
+    { "gen", run_gen }
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+typedef struct {
+    const char *corpus;
+    const char *workload;
+    size_t bytes;
+    size_t tokens;
+    unsigned int docs;
+    unsigned int runs;
+    double best;
+    double allocs_per_doc;
+    size_t peak;
+    /* the size of the chunks the input was passed in and what the lexer
+       copied because of that */
+    size_t chunk;
+    size_t buffer_appends;
+    size_t buffer_bytes;
+    /* zero if the library does not count them */
+    int counted;
+} result_t;
+
+/* a sweep of chunk sizes stops after 1 << 63 at the latest */
+#define MAX_RESULTS_PER_CORPUS 64
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+measure(const corpus_t *c, const workload_t *w, void *state,
+        double seconds, result_t *r)
+{
+    jhn_tracker_t *tracker = jhn_tracker_alloc(NULL);
+    jhn_alloc_report_t report;
+    double start, end, t;
+    int ok;
+
+    ok = w->run(c, jhn_tracker_funcs(tracker), state);
+    jhn_tracker_get_report(tracker, &report);
+    jhn_tracker_free(tracker);
+    if (!ok) {
+        return 0;
+    }
+
+    r->corpus = c->name;
+    r->workload = w->name;
+    r->bytes = c->text.len;
+    r->tokens = c->tokens;
+    r->docs = c->docs;
+    r->allocs_per_doc = (double)report.mallocs / c->docs;
+    r->peak = report.peak_bytes;
+    /* nothing is copied if all of it arrives at once */
+    r->chunk = c->text.len;
+    r->buffer_appends = 0;
+    r->buffer_bytes = 0;
+    r->counted = 1;
+    r->runs = 0;
+    r->best = 1e30;
+
+    start = now();
+    do {
+        t = now();
+        w->run(c, NULL, state);
+        end = now();
+        if (end - t < r->best) {
+            r->best = end - t;
+        }
+        r->runs++;
+    } while (end - start < seconds);
+
+    return 1;
+}
+
+static void
+print_result(const result_t *r)
+{
+    printf("%-8s %-6s %9.1f MB/s %7.2f ns/token %9.2f allocs/doc "
+           "%10lu peak bytes\n",
+           r->corpus, r->workload, r->bytes / r->best / 1e6,
+           r->best * 1e9 / r->tokens, r->allocs_per_doc,
+           (unsigned long)r->peak);
+}
+
+/* one line per chunk size with a bar for the throughput */
+static void
+print_sweep(const result_t *results, size_t count)
+{
+    double mbps, max = 0;
+    size_t i;
+    int bar;
+
+    for (i = 0; i < count; i++) {
+        mbps = results[i].bytes / results[i].best / 1e6;
+        if (mbps > max) {
+            max = mbps;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        const result_t *r = &results[i];
+        char appends[24] = "n/a", copied[24] = "n/a";
+
+        if (r->counted) {
+            sprintf(appends, "%lu", (unsigned long)r->buffer_appends);
+            sprintf(copied, "%lu", (unsigned long)r->buffer_bytes);
+        }
+        mbps = r->bytes / r->best / 1e6;
+        printf("%-8s %9lu B %8.1f MB/s %9s appends %10s copied |",
+               r->corpus, (unsigned long)r->chunk, mbps, appends, copied);
+        for (bar = (int)(mbps / max * 30 + 0.5); bar > 0; bar--) {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+static void
+gen_key(jhn_gen_t *g, const char *key)
+{
+    jhn_gen_string(g, key, strlen(key));
+}
+
+static int
+write_json(const char *path, const result_t *results, size_t count)
+{
+    jhn_gen_t *g = jhn_gen_alloc(NULL);
+    const char *buf;
+    size_t i, len;
+    FILE *f;
+
+    jhn_gen_config(g, jhn_gen_beautify, 1);
+    jhn_gen_map_open(g);
+    gen_key(g, "results");
+    jhn_gen_array_open(g);
+    for (i = 0; i < count; i++) {
+        const result_t *r = &results[i];
+        jhn_gen_map_open(g);
+        gen_key(g, "corpus");
+        gen_key(g, r->corpus);
+        gen_key(g, "workload");
+        gen_key(g, r->workload);
+        gen_key(g, "bytes");
+        jhn_gen_integer(g, (long long)r->bytes);
+        gen_key(g, "tokens");
+        jhn_gen_integer(g, (long long)r->tokens);
+        gen_key(g, "documents");
+        jhn_gen_integer(g, r->docs);
+        gen_key(g, "runs");
+        jhn_gen_integer(g, r->runs);
+        gen_key(g, "seconds");
+        jhn_gen_double(g, r->best);
+        gen_key(g, "mb_per_s");
+        jhn_gen_double(g, r->bytes / r->best / 1e6);
+        gen_key(g, "ns_per_token");
+        jhn_gen_double(g, r->best * 1e9 / r->tokens);
+        gen_key(g, "allocs_per_doc");
+        jhn_gen_double(g, r->allocs_per_doc);
+        gen_key(g, "peak_bytes");
+        jhn_gen_integer(g, (long long)r->peak);
+        gen_key(g, "chunk");
+        jhn_gen_integer(g, (long long)r->chunk);
+        gen_key(g, "buffer_appends");
+        if (r->counted) {
+            jhn_gen_integer(g, (long long)r->buffer_appends);
+        } else {
+            jhn_gen_null(g);
+        }
+        gen_key(g, "buffer_bytes");
+        if (r->counted) {
+            jhn_gen_integer(g, (long long)r->buffer_bytes);
+        } else {
+            jhn_gen_null(g);
+        }
+        jhn_gen_map_close(g);
+    }
+    jhn_gen_array_close(g);
+    jhn_gen_map_close(g);
+
+    jhn_gen_get_buf(g, &buf, &len);
+    f = fopen(path, "w");
+    if (f) {
+        fwrite(buf, 1, len, f);
+        fclose(f);
+    }
+    jhn_gen_free(g);
+    return f != NULL;
+}
+
+static size_t
+run_workloads(corpus_t *c, double seconds, result_t *results)
+{
+    size_t n = 0, w, tokens;
+    jhn_tape_t *tape;
+    void *state;
+
+    /* the generator replays this recording */
+    tape = jhn_tape_alloc(NULL);
+    parse_with(jhn_tape_recorder_alloc(tape, NULL), c);
+
+    for (w = 0; w < NUM_WORKLOADS; w++) {
+        state = workloads[w].run == run_gen ? (void *)tape
+              : workloads[w].run == run_lex ? (void *)&tokens
+              : NULL;
+        if (!measure(c, &workloads[w], state, seconds, &results[n])) {
+            fprintf(stderr, "%s %s: failed\n", c->name, workloads[w].name);
+            n = 0;
+            break;
+        }
+        print_result(&results[n]);
+        n++;
+    }
+    jhn_tape_free(tape);
+    return n;
+}
+
+static size_t
+run_sweep(corpus_t *c, double seconds, result_t *results)
+{
+    static const workload_t chunked = { "chunked", run_chunked };
+    size_t n = 0;
+    chunked_t ch;
+
+    for (ch.chunk = 1; ; ch.chunk *= 2) {
+        if (ch.chunk > c->text.len) {
+            ch.chunk = c->text.len;
+        }
+        if (!measure(c, &chunked, &ch, seconds, &results[n])) {
+            fprintf(stderr, "%s chunked %lu: failed\n", c->name,
+                    (unsigned long)ch.chunk);
+            return 0;
+        }
+        results[n].chunk = ch.chunk;
+        results[n].buffer_appends = ch.stats.buffer_appends;
+        results[n].buffer_bytes = ch.stats.buffer_bytes;
+        results[n].counted = stats_counted(&ch.stats);
+        n++;
+        if (ch.chunk == c->text.len) {
+            break;
+        }
+    }
+    print_sweep(results, n);
+    return n;
+}
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "usage: %s [-c] [-t seconds] [-s scale] [-j results.json] "
+            "[corpus...]\n"
+            "corpora: twitter canada citm deep strings ndjson\n",
+            progname);
+    exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+    corpus_t corpora[] = {
+        { "twitter", { NULL, 0, 0 }, 1, 0, 0 },
+        { "canada", { NULL, 0, 0 }, 1, 0, 0 },
+        { "citm", { NULL, 0, 0 }, 1, 0, 0 },
+        { "deep", { NULL, 0, 0 }, 1, 0, 0 },
+        { "strings", { NULL, 0, 0 }, 1, 0, 0 },
+        { "ndjson", { NULL, 0, 0 }, 1, 1, 0 }
+    };
+    const size_t num_corpora = sizeof(corpora) / sizeof(corpora[0]);
+    result_t *results;
+    size_t num_results = 0, i, n;
+    const char *json_path = NULL;
+    double seconds = 0.5;
+    unsigned int scale = 1;
+    int a, selected = 0, sweep = 0, failed = 0;
+    char *wanted;
+
+    wanted = calloc(num_corpora, 1);
+    for (a = 1; a < argc; a++) {
+        if (!strcmp(argv[a], "-c")) {
+            sweep = 1;
+        } else if (!strcmp(argv[a], "-t") && a + 1 < argc) {
+            seconds = atof(argv[++a]);
+        } else if (!strcmp(argv[a], "-s") && a + 1 < argc) {
+            scale = (unsigned int)atoi(argv[++a]);
+            if (scale == 0) {
+                usage(argv[0]);
+            }
+        } else if (!strcmp(argv[a], "-j") && a + 1 < argc) {
+            json_path = argv[++a];
+        } else {
+            for (i = 0; i < num_corpora; i++) {
+                if (!strcmp(argv[a], corpora[i].name)) {
+                    wanted[i] = 1;
+                    selected = 1;
+                    break;
+                }
+            }
+            if (i == num_corpora) {
+                usage(argv[0]);
+            }
+        }
+    }
+
+    gen_twitter(&corpora[0].text, scale);
+    gen_canada(&corpora[1].text, scale);
+    gen_citm(&corpora[2].text, scale);
+    gen_deep(&corpora[3].text, scale);
+    gen_strings(&corpora[4].text, scale);
+    corpora[5].docs = gen_ndjson(&corpora[5].text, scale);
+
+    results = malloc(num_corpora * MAX_RESULTS_PER_CORPUS *
+                     sizeof(result_t));
+    for (i = 0; i < num_corpora; i++) {
+        corpus_t *c = &corpora[i];
+        size_t tokens;
+
+        if (selected && !wanted[i]) {
+            continue;
+        }
+        run_lex(c, NULL, &tokens);
+        c->tokens = tokens;
+        if (sweep) {
+            n = run_sweep(c, seconds, results + num_results);
+        } else {
+            n = run_workloads(c, seconds, results + num_results);
+        }
+        failed |= n == 0;
+        num_results += n;
+    }
+
+    if (json_path && !write_json(json_path, results, num_results)) {
+        fprintf(stderr, "cannot write %s\n", json_path);
+        failed = 1;
+    }
+
+    for (i = 0; i < num_corpora; i++) {
+        free(corpora[i].text.data);
+    }
+    free(results);
+    free(wanted);
+
+    return failed;
+}
@@ -0,0 +1,395 @@
+/* Compares the C++ bindings, JHN_FIELDS with from_json() and
+   to_json(), against what would be written by hand on top of the C
+   API for the same structs: parser callbacks that switch on the key
+   and jhn_gen_* calls member by member.
+
+   usage: bench-bind [-t seconds] [-n orders]
+
+   The orders are generated at startup, encoded by both sides and the
+   outputs compared, then each workload is repeated for the given time
+   (0.5s by default) and the fastest run is reported. */
+
+#include <johanson.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+struct item {
+    std::string sku;
+    int qty = 0;
+    double price = 0;
+};
+JHN_FIELDS(item, sku, qty, price)
+
+struct order {
+    long long id = 0;
+    std::string customer;
+    double total = 0;
+    bool paid = false;
+    std::vector<item> items;
+};
+JHN_FIELDS(order, id, customer, total, paid, items)
+
+std::vector<order>
+make_orders(size_t count)
+{
+    std::vector<order> orders(count);
+
+    for (size_t i = 0; i < count; i++) {
+        order &o = orders[i];
+        o.id = static_cast<long long>(i) * 7919;
+        o.customer = "customer-" + std::to_string(i % 977);
+        o.total = static_cast<double>(i) * 1.25;
+        o.paid = i % 2;
+        for (int j = 0; j < 3; j++) {
+            o.items.push_back({"SKU-" + std::to_string(i + j), j + 1,
+                               j * 2.5 + 0.99});
+        }
+    }
+    return orders;
+}
+
+/* the hand-written decoder: the members are numbered and the key
+   selects the one the next value goes into */
+enum member_id {
+    m_none, m_id, m_customer, m_total, m_paid, m_items, m_sku, m_qty,
+    m_price
+};
+
+struct hand_decoder {
+    std::vector<order> *out;
+    int depth = 0;
+    bool in_items = false;
+    member_id member = m_none;
+
+    order &current() { return out->back(); }
+    item &current_item() { return out->back().items.back(); }
+};
+
+hand_decoder &
+self(void *ctx)
+{
+    return *static_cast<hand_decoder *>(ctx);
+}
+
+int
+hand_bool(void *ctx, int b)
+{
+    if (self(ctx).member == m_paid) {
+        self(ctx).current().paid = b != 0;
+    }
+    return 1;
+}
+
+int
+hand_integer(void *ctx, long long i)
+{
+    hand_decoder &d = self(ctx);
+
+    switch (d.member) {
+    case m_id: d.current().id = i; break;
+    case m_total: d.current().total = static_cast<double>(i); break;
+    case m_qty: d.current_item().qty = static_cast<int>(i); break;
+    case m_price: d.current_item().price = static_cast<double>(i); break;
+    default: break;
+    }
+    return 1;
+}
+
+int
+hand_double(void *ctx, double v)
+{
+    hand_decoder &d = self(ctx);
+
+    if (d.member == m_total) {
+        d.current().total = v;
+    } else if (d.member == m_price) {
+        d.current_item().price = v;
+    }
+    return 1;
+}
+
+int
+hand_string(void *ctx, const char *str, size_t len)
+{
+    hand_decoder &d = self(ctx);
+
+    if (d.member == m_customer) {
+        d.current().customer.assign(str, len);
+    } else if (d.member == m_sku) {
+        d.current_item().sku.assign(str, len);
+    }
+    return 1;
+}
+
+int
+hand_map_key(void *ctx, const char *str, size_t len)
+{
+    hand_decoder &d = self(ctx);
+    std::string_view key(str, len);
+
+    if (d.in_items) {
+        d.member = key == "sku" ? m_sku : key == "qty" ? m_qty
+                 : key == "price" ? m_price : m_none;
+    } else {
+        d.member = key == "id" ? m_id : key == "customer" ? m_customer
+                 : key == "total" ? m_total : key == "paid" ? m_paid
+                 : key == "items" ? m_items : m_none;
+    }
+    return 1;
+}
+
+int
+hand_start_map(void *ctx)
+{
+    hand_decoder &d = self(ctx);
+
+    if (++d.depth == 1) {
+        d.out->emplace_back();
+    } else if (d.in_items) {
+        d.current().items.emplace_back();
+    }
+    return 1;
+}
+
+int
+hand_end_map(void *ctx)
+{
+    self(ctx).depth--;
+    return 1;
+}
+
+int
+hand_start_array(void *ctx)
+{
+    hand_decoder &d = self(ctx);
+
+    d.in_items = d.depth == 1 && d.member == m_items;
+    return 1;
+}
+
+int
+hand_end_array(void *ctx)
+{
+    self(ctx).in_items = false;
+    return 1;
+}
+
+const jhn_parser_callbacks_t hand_callbacks = {
+    nullptr,
+    hand_bool,
+    hand_integer,
+    hand_double,
+    nullptr,
+    hand_string,
+    hand_start_map,
+    hand_map_key,
+    hand_end_map,
+    hand_start_array,
+    hand_end_array,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr
+};
+
+bool
+hand_decode(const std::string &json, std::vector<order> &out)
+{
+    hand_decoder d;
+    jhn_parser_t *p;
+    bool ok;
+
+    d.out = &out;
+    p = jhn_parser_alloc(&hand_callbacks, nullptr, &d);
+    ok = jhn_parser_parse(p, json.data(), json.size()) ==
+             jhn_parser_status_ok &&
+         jhn_parser_finish(p) == jhn_parser_status_ok;
+    jhn_parser_free(p);
+    return ok;
+}
+
+void
+gen_key(jhn_gen_t *g, const char *key)
+{
+    jhn_gen_string(g, key, std::strlen(key));
+}
+
+void
+hand_encode(jhn_gen_t *g, const std::vector<order> &orders)
+{
+    jhn_gen_array_open(g);
+    for (const order &o : orders) {
+        jhn_gen_map_open(g);
+        gen_key(g, "id");
+        jhn_gen_integer(g, o.id);
+        gen_key(g, "customer");
+        jhn_gen_string(g, o.customer.data(), o.customer.size());
+        gen_key(g, "total");
+        jhn_gen_double(g, o.total);
+        gen_key(g, "paid");
+        jhn_gen_bool(g, o.paid);
+        gen_key(g, "items");
+        jhn_gen_array_open(g);
+        for (const item &i : o.items) {
+            jhn_gen_map_open(g);
+            gen_key(g, "sku");
+            jhn_gen_string(g, i.sku.data(), i.sku.size());
+            gen_key(g, "qty");
+            jhn_gen_integer(g, i.qty);
+            gen_key(g, "price");
+            jhn_gen_double(g, i.price);
+            jhn_gen_map_close(g);
+        }
+        jhn_gen_array_close(g);
+        jhn_gen_map_close(g);
+    }
+    jhn_gen_array_close(g);
+}
+
+std::string
+output(jhn_gen_t *g)
+{
+    const char *buf;
+    size_t len;
+
+    jhn_gen_get_buf(g, &buf, &len);
+    return std::string(buf, len);
+}
+
+double
+now()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* the fastest of the runs of f in the given time */
+template <class F>
+double
+best_of(double seconds, F f)
+{
+    double best = 1e30;
+    double start = now();
+    double end;
+
+    do {
+        double t = now();
+        f();
+        end = now();
+        if (end - t < best) {
+            best = end - t;
+        }
+    } while (end - start < seconds);
+    return best;
+}
+
+void
+print_pair(const char *what, size_t bytes, size_t count, double bound,
+           double hand)
+{
+    std::printf("%-6s bind %8.1f MB/s %7.1f ns/order\n", what,
+                bytes / bound / 1e6, bound * 1e9 / count);
+    std::printf("%-6s hand %8.1f MB/s %7.1f ns/order   bind/hand %.2f\n",
+                what, bytes / hand / 1e6, hand * 1e9 / count, bound / hand);
+}
+
+void
+usage(const char *progname)
+{
+    std::fprintf(stderr, "usage: %s [-t seconds] [-n orders]\n", progname);
+    std::exit(1);
+}
+
+} /* namespace */
+
+int
+main(int argc, char **argv)
+{
+    double seconds = 0.5;
+    size_t count = 100000;
+    std::vector<order> orders;
+    std::vector<order> decoded;
+    std::string json;
+    jhn_gen_t *g;
+    double bound, hand;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "-t") && i + 1 < argc) {
+            seconds = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "-n") && i + 1 < argc) {
+            count = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    orders = make_orders(count);
+    g = jhn_gen_alloc(nullptr);
+
+    /* both sides have to agree before their speed means anything */
+    johanson::to_json(g, orders);
+    json = output(g);
+    jhn_gen_clear(g);
+    jhn_gen_reset(g, nullptr);
+    hand_encode(g, orders);
+    if (output(g) != json) {
+        std::fprintf(stderr, "the encoders disagree\n");
+        return 1;
+    }
+    if (!johanson::from_json(json, decoded)) {
+        std::fprintf(stderr, "from_json failed\n");
+        return 1;
+    }
+    jhn_gen_clear(g);
+    jhn_gen_reset(g, nullptr);
+    johanson::to_json(g, decoded);
+    if (output(g) != json) {
+        std::fprintf(stderr, "from_json lost something\n");
+        return 1;
+    }
+    decoded.clear();
+    if (!hand_decode(json, decoded)) {
+        std::fprintf(stderr, "the hand-written decoder failed\n");
+        return 1;
+    }
+    jhn_gen_clear(g);
+    jhn_gen_reset(g, nullptr);
+    johanson::to_json(g, decoded);
+    if (output(g) != json) {
+        std::fprintf(stderr, "the hand-written decoder lost something\n");
+        return 1;
+    }
+
+    bound = best_of(seconds, [&] {
+        jhn_gen_clear(g);
+        jhn_gen_reset(g, nullptr);
+        johanson::to_json(g, orders);
+    });
+    hand = best_of(seconds, [&] {
+        jhn_gen_clear(g);
+        jhn_gen_reset(g, nullptr);
+        hand_encode(g, orders);
+    });
+    print_pair("encode", json.size(), count, bound, hand);
+
+    bound = best_of(seconds, [&] {
+        decoded.clear();
+        johanson::from_json(json, decoded);
+    });
+    hand = best_of(seconds, [&] {
+        decoded.clear();
+        hand_decode(json, decoded);
+    });
+    print_pair("decode", json.size(), count, bound, hand);
+
+    jhn_gen_free(g);
+    return 0;
+}
@@ -0,0 +1,49 @@
+solution "johanson-bench"
+	configurations { "release" }
+	location ( "solutions" )
+	platforms { "native" }
+
+project "bench"
+	targetname "bench"
+	language "C"
+	kind "ConsoleApp"
+	flags { "ExtraWarnings", "OptimizeSpeed" }
+	includedirs {
+		"../include",
+	}
+
+	files {
+		"*.c",
+	}
+
+	links { "johanson" }
+	libdirs { "../build/native" }
+
+	-- IDE specific configuration
+	configuration "vs*"
+		defines { "_CRT_SECURE_NO_WARNINGS" }
+
+project "bench-bind"
+	targetname "bench-bind"
+	language "C++"
+	kind "ConsoleApp"
+	flags { "ExtraWarnings", "OptimizeSpeed" }
+	includedirs {
+		"../include",
+	}
+
+	files {
+		"*.cpp",
+	}
+
+	if not os.is('windows') then
+		buildoptions { "-std=c++17" }
+	end
+
+	links { "johanson" }
+	libdirs { "../build/native" }
+
+	-- IDE specific configuration
+	configuration "vs*"
+		defines { "_CRT_SECURE_NO_WARNINGS" }
+		buildoptions { "/std:c++17" }
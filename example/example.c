@@ -99,7 +99,11 @@ static jhn_parser_callbacks_t callbacks = {
     on_map_key,
     on_end_map,
     on_start_array,
-    on_end_array
+    on_end_array,
+    NULL,
+    NULL,
+    NULL,
+    NULL
 };
 
 static void
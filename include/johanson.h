@@ -60,6 +60,58 @@ typedef struct {
     void *ctx;
 } jhn_alloc_funcs_t;
 
+/* An allocation tracker provides allocation routines that forward to
+   other ones and keep count of what passes through them.  Hand them to
+   a parser, generator or any other handle to see how much memory it
+   takes, for instance to check it against a budget.  Every block
+   carries a small header with its size, so blocks allocated through a
+   tracker must be freed through the same tracker. */
+JHN_HAS_ALLOC typedef struct jhn_tracker_s jhn_tracker_t;
+
+/* what was allocated through a tracker */
+typedef struct {
+    /* the calls to each routine.  A realloc of NULL counts as a malloc
+       and a realloc to zero bytes as a free. */
+    size_t mallocs;
+    size_t reallocs;
+    size_t frees;
+    /* the blocks and bytes allocated but not freed yet */
+    size_t live_blocks;
+    size_t live_bytes;
+    /* the most bytes that were live at the same time and the size of
+       the largest block */
+    size_t peak_bytes;
+    size_t largest_block;
+    /* all bytes requested, with the growth of reallocs */
+    size_t total_bytes;
+    /* the reallocs that grew a block and the bytes they added.  A
+       buffer that grows by doubling shows up as many grows of one
+       block, see longest_chain. */
+    size_t grows;
+    size_t grow_bytes;
+    /* the most reallocs a single block went through */
+    size_t longest_chain;
+} jhn_alloc_report_t;
+
+/* allocate a tracker that forwards to afs, or to malloc, realloc and
+   free if afs is NULL */
+JHN_API jhn_tracker_t *jhn_tracker_alloc(const jhn_alloc_funcs_t *afs);
+
+/* free the tracker.  Blocks still allocated through it can not be
+   freed afterwards. */
+JHN_API void jhn_tracker_free(jhn_tracker_t *t);
+
+/* the tracking allocation routines, valid as long as the tracker */
+JHN_API jhn_alloc_funcs_t *jhn_tracker_funcs(jhn_tracker_t *t);
+
+/* get what was allocated since the tracker was allocated or reset */
+JHN_API void jhn_tracker_get_report(const jhn_tracker_t *t,
+                                    jhn_alloc_report_t *report);
+
+/* start counting anew.  The blocks that are live stay accounted for
+   and the peak starts out at their size. */
+JHN_API void jhn_tracker_reset(jhn_tracker_t *t);
+
 
 /* generator status codes */
 typedef enum {
@@ -69,12 +121,15 @@ typedef enum {
        jhn_gen_string was called.  If you get this, you probably did
       something wrong. */
     jhn_gen_keys_must_be_strings,
-    /* Johanson's maximum generation depth was exceeded.  see
-       JHN_MAX_DEPTH in gen.c.  This is an implementation detail that
-       might be lifted in the future. */
+    /* Johanson's maximum generation depth was exceeded.  The generator
+       nests without limit unless the library was compiled with
+       JHN_MAX_DEPTH defined, see gen.c. */
     jhn_max_depth_exceeded,
     /* A generator function (jhn_gen_XXX) was called while in an error
-       state.  If you get this, you probably do something wrong. */
+       state.  If you get this, you probably do something wrong.  Also
+       returned when there is no memory to open another array or map,
+       which leaves the generator in the error state until it is reset
+       with jhn_gen_reset. */
     jhn_gen_in_error_state,
     /* A complete JSON document has been generated. */
     jhn_gen_generation_complete,
@@ -85,8 +140,27 @@ typedef enum {
       buffer to get from */
     jhn_gen_no_buf,
     /* returned from jhn_gen_string() when the jhn_gen_validate_utf8
-       option is enabled and an invalid was passed by client code. */
-    jhn_gen_invalid_string
+       option is enabled and an invalid was passed by client code, and
+       from jhn_gen_raw_value() when it was passed an empty fragment. */
+    jhn_gen_invalid_string,
+    /* returned from jhn_gen_flush() if writing to the file descriptor
+       set with jhn_gen_output_fd failed. */
+    jhn_gen_write_failed,
+    /* the value did not fit into the buffer set with
+       jhn_gen_output_buffer.  Nothing of it was written and the
+       generator state is unchanged.  Consume the buffer, call
+       jhn_gen_clear() and call the same function again. */
+    jhn_gen_buffer_full,
+    /* returned from jhn_gen_flush() if the file descriptor set with
+       jhn_gen_output_fd is non-blocking and could not take all output.
+       Nothing is lost, wait until it is writable and call
+       jhn_gen_flush() again. */
+    jhn_gen_write_would_block,
+    /* the value does not fit into the buffer set with
+       jhn_gen_output_buffer even if it is empty, so retrying after
+       jhn_gen_clear() is pointless.  Like with jhn_gen_buffer_full
+       nothing was written and the generator state is unchanged. */
+    jhn_gen_value_too_large
 } jhn_gen_status_t;
 
 JHN_HAS_ALLOC typedef struct jhn_gen_s jhn_gen_t;
@@ -125,7 +199,37 @@ typedef enum {
        escape '/' in generated JSON strings.  The escaping of the solidus
        is useful when embedding JSON in HTML where it might otherwise be
        used to escape a script tag. */
-    jhn_gen_escape_solidus = 0x10
+    jhn_gen_escape_solidus = 0x10,
+    /* Write the generated json directly to a file descriptor instead of
+       the internal buffer.  Output is collected in a small number of
+       pieces which are written out with a single writev() call.  Large
+       strings and numbers that need no escaping are not copied, they
+       are written straight from the memory passed to jhn_gen_string()
+       before that function returns.  Call jhn_gen_flush() to write out
+       what is still pending, the file descriptor is never closed.
+
+       The file descriptor may be non-blocking.  Output it does not
+       take is copied and kept in memory until a later jhn_gen_flush()
+       gets it written, so a generator that keeps generating while the
+       descriptor is full grows without bound.  If there is no memory
+       for the sink jhn_gen_config() returns zero and the generator
+       keeps its current output.
+
+       example:
+         jhn_gen_config(g, jhn_gen_output_fd, fileno(stdout)); */
+    jhn_gen_output_fd = 0x20,
+    /* Generate into a caller provided buffer instead of the internal
+       one.  Takes a char pointer and the size_t capacity of the buffer.
+       No memory is allocated for the output and the buffer is never
+       grown.  One byte is reserved for the terminating null byte.  If a
+       value does not fit, jhn_gen_buffer_full (or
+       jhn_gen_value_too_large) is returned and nothing of the value is
+       written.  jhn_gen_get_buf() and jhn_gen_clear()
+       work on the buffer like they do on the internal one.
+
+       example:
+         jhn_gen_config(g, jhn_gen_output_buffer, frame, sizeof(frame)); */
+    jhn_gen_output_buffer = 0x40
 } jhn_gen_option_t;
 
 /* allow the modification of generator options subsequent to handle
@@ -137,6 +241,13 @@ JHN_API int jhn_gen_config(jhn_gen_t *g, jhn_gen_option_t opt, ...);
    in which case the system malloc/realloc/free functions are used. */
 JHN_API jhn_gen_t *jhn_gen_alloc(const jhn_alloc_funcs_t *alloc_funcs);
 
+/* allocate a generator handle that generates into the given caller
+   owned buffer.  This is a shortcut for jhn_gen_alloc() followed by
+   setting jhn_gen_output_buffer, except that no internal buffer is
+   allocated in the first place. */
+JHN_API jhn_gen_t *jhn_gen_alloc_into(const jhn_alloc_funcs_t *alloc_funcs,
+                                      char *buf, size_t cap);
+
 /* free a previously allocated generator handle */
 JHN_API void jhn_gen_free(jhn_gen_t *handle);
 
@@ -155,6 +266,18 @@ JHN_API jhn_gen_status_t jhn_gen_number(jhn_gen_t *hand,
 JHN_API jhn_gen_status_t jhn_gen_string(jhn_gen_t *hand,
                                         const char *str,
                                         size_t len);
+/* splices an already serialized JSON value (a fragment generated
+   earlier, for instance) into the output as is.  Separators and
+   indentation around the value are handled like for any other value but
+   the fragment itself is not checked or reformatted.  A fragment that
+   starts with a double quote may also be used as map key.  An empty
+   fragment is refused with jhn_gen_invalid_string.
+
+   To validate a fragment once, for instance before caching it, run it
+   through a jhn_parser_t allocated with NULL callbacks. */
+JHN_API jhn_gen_status_t jhn_gen_raw_value(jhn_gen_t *hand,
+                                           const char *json,
+                                           size_t len);
 JHN_API jhn_gen_status_t jhn_gen_null(jhn_gen_t *hand);
 JHN_API jhn_gen_status_t jhn_gen_bool(jhn_gen_t *hand, int boolean);
 JHN_API jhn_gen_status_t jhn_gen_map_open(jhn_gen_t *hand);
@@ -162,6 +285,36 @@ JHN_API jhn_gen_status_t jhn_gen_map_close(jhn_gen_t *hand);
 JHN_API jhn_gen_status_t jhn_gen_array_open(jhn_gen_t *hand);
 JHN_API jhn_gen_status_t jhn_gen_array_close(jhn_gen_t *hand);
 
+/* a map key that was quoted and escaped ahead of time.  Keys that are
+   generated over and over again can be encoded once with
+   jhn_gen_key_alloc() and then written with jhn_gen_key() which skips
+   all escaping and validation. */
+JHN_HAS_ALLOC typedef struct jhn_gen_key_s jhn_gen_key_t;
+
+/* encodes a key with the options currently set on the generator (see
+   jhn_gen_escape_solidus and jhn_gen_validate_utf8).  The key can be
+   used with any generator that uses the same options.  Returns NULL if
+   the key is not valid UTF8 and jhn_gen_validate_utf8 is set. */
+JHN_API jhn_gen_key_t *jhn_gen_key_alloc(jhn_gen_t *hand,
+                                         const char *str,
+                                         size_t len);
+
+/* free a key allocated with jhn_gen_key_alloc */
+JHN_API void jhn_gen_key_free(jhn_gen_key_t *key);
+
+/* generates a pre-encoded key.  This works like jhn_gen_string() and can
+   also be used for string values. */
+JHN_API jhn_gen_status_t jhn_gen_key(jhn_gen_t *hand,
+                                     const jhn_gen_key_t *key);
+
+/* generates a key that the caller quoted and escaped, such as the
+   literal "\"id\"".  Like jhn_gen_key() nothing is escaped or
+   validated, which makes this the cheapest way to write keys that are
+   known at compile time. */
+JHN_API jhn_gen_status_t jhn_gen_encoded_key(jhn_gen_t *hand,
+                                             const char *encoded,
+                                             size_t len);
+
 /* access the null terminated generator buffer.  If incrementally
    outputing JSON, one should call jhn_gen_clear to clear the
    buffer.  This allows stream generation.  This is not useful at all
@@ -175,6 +328,13 @@ JHN_API jhn_gen_status_t jhn_gen_get_buf(jhn_gen_t *hand,
    intended to enable incremental JSON outputing. */
 JHN_API void jhn_gen_clear(jhn_gen_t *hand);
 
+/* writes out all output that is still pending.  This is only needed
+   if jhn_gen_output_fd is used.  Returns jhn_gen_write_would_block if
+   a non-blocking file descriptor did not take all of it.  Once writing
+   failed this function returns jhn_gen_write_failed and all further
+   output is discarded. */
+JHN_API jhn_gen_status_t jhn_gen_flush(jhn_gen_t *hand);
+
 /* Reset the generator state.  Allows a client to generate multiple
    json entities in a stream. The "sep" string will be inserted to
    separate the previously generated entity from the current,
@@ -185,8 +345,26 @@ JHN_API void jhn_gen_clear(jhn_gen_t *hand);
    A good separator is \n for instance.
 
    Note: this call will not clear jhn's output buffer.  This
-   may be accomplished explicitly by calling jhn_gen_clear() */
-JHN_API void jhn_gen_reset(jhn_gen_t *hand, const char *sep);
+   may be accomplished explicitly by calling jhn_gen_clear()
+
+   With jhn_gen_output_buffer the separator is written like a value:
+   if it does not fit jhn_gen_buffer_full or jhn_gen_value_too_large
+   is returned and the generator is not reset. */
+JHN_API jhn_gen_status_t jhn_gen_reset(jhn_gen_t *hand, const char *sep);
+
+/* what a generator produced since it was allocated.  Only counted if
+   the library was built with JHN_STATS, zero otherwise. */
+typedef struct {
+    /* the values generated, map keys and containers included */
+    size_t values;
+    /* the bytes passed to the print function */
+    size_t bytes;
+    /* the deepest nesting of arrays and maps */
+    size_t max_depth;
+} jhn_gen_stats_t;
+
+/* fills in stats for the generator */
+JHN_API void jhn_gen_get_stats(jhn_gen_t *hand, jhn_gen_stats_t *stats);
 
 
 /* error codes returned from this interface */
@@ -197,7 +375,11 @@ typedef enum {
     jhn_parser_status_client_cancelled,
     /* An error occured during the parse.  Call jhn_parser_get_error for
        more information about the encountered error */
-    jhn_parser_status_error
+    jhn_parser_status_error,
+    /* a client callback called jhn_parser_pause.  The parse stopped
+       right after the event that callback reported, see
+       jhn_parser_pause */
+    jhn_parser_status_paused
 } jhn_parser_status_t;
 
 /* attain a human readable, english, string for an error.  This error string
@@ -206,6 +388,90 @@ JHN_API const char *jhn_parser_status_to_string(jhn_parser_status_t code);
 
 JHN_HAS_ALLOC typedef struct jhn_parser_s jhn_parser_t;
 
+/* A key set maps a fixed list of map keys to their index in the list
+   using a minimal perfect hash, so a known key is identified with one
+   hash and one compare instead of a chain of string compares.  Build it
+   once and use it with the jhn_key_set parser option. */
+JHN_HAS_ALLOC typedef struct jhn_keyset_s jhn_keyset_t;
+
+/* builds a key set from count keys.  If lens is NULL the keys are zero
+   terminated.  The keys are copied.  Returns NULL if a key occurs more
+   than once or memory ran out. */
+JHN_API jhn_keyset_t *jhn_keyset_alloc(const char *const *keys,
+                                       const size_t *lens, size_t count,
+                                       jhn_alloc_funcs_t *afs);
+
+/* free a key set */
+JHN_API void jhn_keyset_free(jhn_keyset_t *ks);
+
+/* the number of keys in the set */
+JHN_API size_t jhn_keyset_count(const jhn_keyset_t *ks);
+
+/* the index of the key in the list the set was built from, -1 if it is
+   not in the set */
+JHN_API int jhn_keyset_lookup(const jhn_keyset_t *ks, const char *key,
+                              size_t len);
+
+/* A schema compiled for validation during the parse (see
+   jhn_validate_schema).  Schemas are written in a subset of JSON
+   Schema:
+
+     type                          a type name or a list of them
+     properties                    the schemas of the values of keys
+     required                      keys that have to be present
+     additionalProperties          false or the schema of other keys
+     items                         the schema of all array items
+     minimum, maximum,
+     exclusiveMinimum,
+     exclusiveMaximum              number ranges, in either the number
+                                   or the draft 4 boolean form
+     minLength, maxLength          string lengths in characters
+     minItems, maxItems            array lengths
+     enum                          the allowed values, which have
+                                   to be null, booleans, numbers or
+                                   strings
+
+   Schemas can be nested and true and false are accepted as schemas.
+   All other keywords are ignored. */
+JHN_HAS_ALLOC typedef struct jhn_schema_s jhn_schema_t;
+
+/* compiles a schema from its JSON text.  Returns NULL if the text is
+   not valid JSON or a supported keyword has an invalid value. */
+JHN_API jhn_schema_t *jhn_schema_alloc(const char *schema, size_t len,
+                                       jhn_alloc_funcs_t *afs);
+
+/* free a compiled schema */
+JHN_API void jhn_schema_free(jhn_schema_t *schema);
+
+/* An intern table keeps a single copy of every distinct string handed
+   to it.  Interned strings never move, so they can be compared by
+   pointer and kept for as long as the table lives.  They are zero
+   terminated and carry their hash, which is the same for equal strings
+   within a process but must not be stored or sent elsewhere.  The
+   table only grows; clear it to release the strings. */
+JHN_HAS_ALLOC typedef struct jhn_intern_s jhn_intern_t;
+
+/* allocate an empty intern table */
+JHN_API jhn_intern_t *jhn_intern_alloc(jhn_alloc_funcs_t *afs);
+
+/* free the table and all strings in it */
+JHN_API void jhn_intern_free(jhn_intern_t *in);
+
+/* release all strings.  Pointers returned earlier become invalid. */
+JHN_API void jhn_intern_clear(jhn_intern_t *in);
+
+/* the number of distinct strings in the table */
+JHN_API size_t jhn_intern_count(const jhn_intern_t *in);
+
+/* the interned copy of str, added if it is not in the table yet.
+   NULL if there was no memory to add it. */
+JHN_API const char *jhn_intern(jhn_intern_t *in, const char *str,
+                               size_t len);
+
+/* the hash and length of a string returned by jhn_intern() */
+JHN_API unsigned long long jhn_interned_hash(const char *interned);
+JHN_API size_t jhn_interned_len(const char *interned);
+
 /* Johanson is an event driven parser.  this means as json elements are
    parsed, you are called back to do something with the data.  The
    functions in this table indicate the various events for which
@@ -252,10 +518,32 @@ typedef struct {
 
     int (*jhn_start_array)(void *ctx);
     int (*jhn_end_array)(void *ctx);
+
+    /** Optional streaming of strings that span multiple chunks.  If
+     *  jhn_string_chunk is set, string values that are not contained
+     *  in a single chunk are not buffered in full but reported as they
+     *  are lexed: jhn_string_begin, then any number of jhn_string_chunk
+     *  calls with the unescaped contents and finally jhn_string_end.
+     *  This keeps the memory use bounded by the chunk size.  Strings
+     *  that are lexed in one piece are still reported through
+     *  jhn_string and map keys are always reported as a whole through
+     *  jhn_map_key.  jhn_string_begin and jhn_string_end may be NULL. */
+    int (*jhn_string_begin)(void *ctx);
+    int (*jhn_string_chunk)(void *ctx, const char *string_val,
+                            size_t string_len);
+    int (*jhn_string_end)(void *ctx);
+
+    /** If set, map keys are reported here instead of through
+     *  jhn_map_key, along with their index in the key set configured
+     *  with jhn_key_set.  The index is -1 for keys that are not in the
+     *  set or if no key set is configured. */
+    int (*jhn_map_key_id)(void *ctx, int key_id, const char *key,
+                          size_t string_len);
 } jhn_parser_callbacks_t;
 
 /* allocate a parser handle.  The allocation functions can be left out in
-   which case the system malloc/realloc/free functions are used. */
+   which case the system malloc/realloc/free functions are used.
+   Returns NULL if the handle cannot be allocated. */
 JHN_API jhn_parser_t *jhn_parser_alloc(const jhn_parser_callbacks_t *callbacks,
                                        jhn_alloc_funcs_t *afs,
                                        void *ctx);
@@ -299,7 +587,61 @@ typedef enum {
        if called whilst in the middle of parsing a value
        jhn will enter an error state (premature EOF).  Setting this
        flag suppresses that check and the corresponding error. */
-    jhn_allow_partial_values = 0x10
+    jhn_allow_partial_values = 0x10,
+    /* Pass strings and map keys to the callbacks exactly as they appear
+       in the JSON text (without the quotes) instead of unescaping them. */
+    jhn_raw_strings = 0x20,
+    /* Look up map keys in a key set (const jhn_keyset_t *, NULL to
+       unset) and report their index to the jhn_map_key_id callback.
+       The key set is not owned by the parser and has to stay alive
+       while the parser uses it.
+
+       example:
+         jhn_parser_config(h, jhn_key_set, keys); */
+    jhn_key_set = 0x40,
+    /* Intern all map keys in the given table (jhn_intern_t *, NULL to
+       unset) and pass the interned copies to jhn_map_key and
+       jhn_map_key_id.  The pointers stay valid after the callback
+       returns, equal keys get the same pointer and their hash is
+       available through jhn_interned_hash().  The table is not owned
+       by the parser and can be shared by many parsers that are not used
+       at the same time.  The parse fails with "out of memory" if a key
+       cannot be added to the table. */
+    jhn_intern_keys = 0x80,
+    /* Validate the input against a schema (const jhn_schema_t *, NULL
+       to unset) while it is parsed.  Every value is checked before it
+       is passed to the callbacks and the parse fails with
+       jhn_parser_status_error at the first violation;
+       jhn_parser_get_error() describes it.  The schema is not owned by
+       the parser and can be shared by any number of parsers. */
+    jhn_validate_schema = 0x100,
+    /* The limits below bound what a parser takes for hostile input.
+       Each takes a size_t argument, zero removes the limit (the
+       default).  A parse that goes past one fails with
+       jhn_parser_status_error and jhn_parser_get_exceeded_limit()
+       tells which one it was.
+
+       example:
+         jhn_parser_config(h, jhn_max_depth, (size_t) 64); */
+    /* the deepest nesting of arrays and maps.  The callback for the
+       array or map that would go deeper is not called. */
+    jhn_max_depth = 0x200,
+    /* the most bytes of a single token, see jhn_lexer_max_token_size.
+       This bounds the parts of tokens the lexer buffers across chunks
+       and the size of the strings passed to the callbacks. */
+    jhn_max_token_size = 0x400,
+    /* the most bytes of input.  The input is parsed up to the limit,
+       the error offset is where it ran out. */
+    jhn_max_bytes = 0x800,
+    /* the most bytes the parser, its lexer, buffers and schema
+       validator may allocate.  This is checked after every token, so a
+       single allocation can go past it.  Together with
+       jhn_max_token_size and jhn_max_depth it keeps the memory a parse
+       takes predictable.  The parser only keeps count of its memory
+       once this is set, so it has to be set before the first call to
+       jhn_parser_parse(), jhn_parser_config() returns zero after
+       that. */
+    jhn_max_memory = 0x1000
 } jhn_parser_option;
 
 /* allow the modification of parser options (any of the options mentioned
@@ -353,6 +695,240 @@ JHN_API char *jhn_parser_get_error(jhn_parser_t *hand, int verbose,
    was encountered. */
 JHN_API size_t jhn_parser_get_bytes_consumed(jhn_parser_t *hand);
 
+/* Ask the parser to stop after the event that is being reported.  Only
+   meaningful when called from within a callback: the current call to
+   jhn_parser_parse (or jhn_parser_finish) then returns
+   jhn_parser_status_paused instead of moving on to the next token.
+
+   The parser state is left intact, so the parse is resumed by passing
+   the rest of the chunk, starting at jhn_parser_get_bytes_consumed
+   bytes into it, to jhn_parser_parse.  A paused jhn_parser_finish is
+   resumed by calling jhn_parser_finish again.  This turns the push
+   parser into one that hands out a single event at a time without
+   copying the input. */
+JHN_API void jhn_parser_pause(jhn_parser_t *hand);
+
+/* the limit (jhn_max_depth, jhn_max_token_size, jhn_max_bytes or
+   jhn_max_memory) that stopped the parse, zero if the parse did not
+   run into one */
+JHN_API jhn_parser_option jhn_parser_get_exceeded_limit(jhn_parser_t *hand);
+
+
+/* allocates a parser that copies what it parses to the output of the
+   given generator, to minify or beautify JSON depending on whether the
+   generator is configured with jhn_gen_beautify.  The tokens go
+   straight from the lexer to the output: strings and numbers are
+   copied as they are written without decoding and encoding them again,
+   only the whitespace is changed.  The output looks like what the
+   jhn_gen_* calls for the same values produce, but the state of the
+   generator is neither checked nor changed.  With
+   jhn_allow_multiple_values the values are separated by newlines.
+
+   Parse with jhn_parser_parse() and jhn_parser_finish() as usual and
+   free with jhn_parser_free().  The generator is not owned by the
+   parser.  If the generator writes into a buffer that runs full the
+   parse is cancelled (jhn_parser_status_client_cancelled). */
+JHN_API jhn_parser_t *jhn_reformat_alloc(jhn_gen_t *gen,
+                                         jhn_alloc_funcs_t *afs);
+
+/* A tape is a compact binary recording of the events of a parse.  Once
+   recorded it can be replayed into any number of callback tables or
+   generators without lexing and validating the JSON text again.
+   Strings are stored unescaped and numbers in binary, so a tape can
+   only record numbers that fit a long long or a double. */
+JHN_HAS_ALLOC typedef struct jhn_tape_s jhn_tape_t;
+
+/* allocate an empty tape, NULL if there is no memory for it */
+JHN_API jhn_tape_t *jhn_tape_alloc(jhn_alloc_funcs_t *afs);
+
+/* free a tape */
+JHN_API void jhn_tape_free(jhn_tape_t *tape);
+
+/* allocates a parser that appends everything it parses to the tape.
+   Parse with jhn_parser_parse() and jhn_parser_finish() as usual.  If
+   the parse fails the tape holds the events up to the error and should
+   be cleared. */
+JHN_API jhn_parser_t *jhn_tape_recorder_alloc(jhn_tape_t *tape,
+                                              jhn_alloc_funcs_t *afs);
+
+/* calls the callbacks for every event on the tape in the order they
+   were recorded.  Numbers are reported like the parser would report
+   them.  If jhn_number is set it receives them formatted so that they
+   convert back to the same value but not necessarily in the way they
+   were originally written.  Map keys go to jhn_map_key_id if it is
+   set, with the index -1 as there is no key set.  Strings go to
+   jhn_string, or as a single fragment to jhn_string_begin,
+   jhn_string_chunk and jhn_string_end if only jhn_string_chunk is set.
+   Returns jhn_parser_status_client_cancelled if a callback returns
+   zero. */
+JHN_API jhn_parser_status_t jhn_tape_replay(const jhn_tape_t *tape,
+                                            const jhn_parser_callbacks_t *cb,
+                                            void *ctx);
+
+/* generates the recorded events with the given generator.  Stops at and
+   returns the first status that is not jhn_gen_status_ok. */
+JHN_API jhn_gen_status_t jhn_tape_replay_gen(const jhn_tape_t *tape,
+                                             jhn_gen_t *gen);
+
+/* access the recorded bytes */
+JHN_API void jhn_tape_get_buf(const jhn_tape_t *tape, const char **buf,
+                              size_t *len);
+
+/* remove all events from the tape */
+JHN_API void jhn_tape_clear(jhn_tape_t *tape);
+
+/* An image is a self contained, position independent form of a tape
+   that can be written to disk and later mapped into memory and queried
+   in place, without parsing anything.  The image starts with a header
+   holding a key chosen by the writer, for example the modification
+   time of the source file, and a checksum of the contents, so that
+   stale or damaged images are detected by jhn_image_check().  Every map
+   and array records where it ends so that lookups can skip over
+   values.  All fields are little endian, so images can be shared
+   between machines.
+
+   Values inside an image are referred to by their byte offset from the
+   start of the image; zero means there is no value. */
+typedef enum {
+    jhn_image_none,
+    jhn_image_null,
+    jhn_image_bool,
+    jhn_image_integer,
+    jhn_image_double,
+    jhn_image_string,
+    jhn_image_map,
+    jhn_image_array
+} jhn_image_type_t;
+
+/* writes the tape as an image to the print callback, possibly in many
+   pieces.  The tape has to hold a single complete value.  Returns zero
+   and prints nothing if it does not, for instance if it is empty or
+   was recorded with jhn_allow_multiple_values and holds several. */
+JHN_API int jhn_tape_write_image(const jhn_tape_t *tape,
+                                 unsigned long long key,
+                                 jhn_print_t print, void *ctx);
+
+/* checks that len bytes at image hold an image written with the given
+   key and that its checksum matches.  This reads the whole image.  All
+   other jhn_image functions expect an image that passed this check. */
+JHN_API int jhn_image_check(const void *image, size_t len,
+                            unsigned long long key);
+
+/* the top level value of the image */
+JHN_API size_t jhn_image_root(const void *image);
+
+/* the type of value v.  Map keys are reported as strings. */
+JHN_API jhn_image_type_t jhn_image_type(const void *image, size_t v);
+
+/* iterate over the contents of a map or array.  jhn_image_first()
+   returns the first entry and jhn_image_next() the one after v, zero at
+   the end of the container.  The entries of a map alternate between
+   keys and values. */
+JHN_API size_t jhn_image_first(const void *image, size_t container);
+JHN_API size_t jhn_image_next(const void *image, size_t v);
+
+/* the value for key in the map, zero if there is none.  Keys are
+   compared byte by byte. */
+JHN_API size_t jhn_image_lookup(const void *image, size_t map,
+                                const char *key, size_t len);
+
+/* the value at index in the array, zero if there is none */
+JHN_API size_t jhn_image_index(const void *image, size_t array,
+                               size_t index);
+
+/* value accessors.  They return zero (NULL for strings) if v has the
+   wrong type, except that jhn_image_get_double() also converts
+   integers.  Strings point into the image and are not zero
+   terminated. */
+JHN_API int jhn_image_get_bool(const void *image, size_t v);
+JHN_API long long jhn_image_get_integer(const void *image, size_t v);
+JHN_API double jhn_image_get_double(const void *image, size_t v);
+JHN_API const char *jhn_image_get_string(const void *image, size_t v,
+                                         size_t *len);
+
+/* like jhn_tape_replay() and jhn_tape_replay_gen() for value v and
+   everything it contains */
+JHN_API jhn_parser_status_t jhn_image_replay(const void *image, size_t v,
+                                             const jhn_parser_callbacks_t *cb,
+                                             void *ctx);
+JHN_API jhn_gen_status_t jhn_image_replay_gen(const void *image, size_t v,
+                                              jhn_gen_t *gen);
+
+/* binary encodings the encoder can produce */
+typedef enum {
+    /* CBOR (RFC 8949).  Maps, arrays and strings that span multiple
+       input chunks are written with indefinite lengths so that nothing
+       needs to be buffered. */
+    jhn_encoding_cbor,
+    /* MessagePack.  Since MessagePack needs to know the number of
+       entries of a map or array up front each top level value is
+       collected before it is written out.  Maps and arrays always use
+       the map32 / array32 headers. */
+    jhn_encoding_msgpack
+} jhn_encoding_t;
+
+/* An encoder turns the events of a parse into a binary encoding.  Like
+   the generator it collects its output in an internal buffer unless a
+   print callback is set. */
+JHN_HAS_ALLOC typedef struct jhn_encoder_s jhn_encoder_t;
+
+/* allocate an encoder for the given encoding, NULL if there is no
+   memory for it */
+JHN_API jhn_encoder_t *jhn_encoder_alloc(jhn_encoding_t encoding,
+                                         jhn_alloc_funcs_t *afs);
+
+/* free an encoder */
+JHN_API void jhn_encoder_free(jhn_encoder_t *enc);
+
+/* write the output to a print callback instead of the internal buffer.
+   With MessagePack the callback is invoked once per top level value. */
+JHN_API void jhn_encoder_set_print(jhn_encoder_t *enc, jhn_print_t print,
+                                   void *ctx);
+
+/* access and clear the internal output buffer.  With MessagePack the
+   buffer only holds valid output once the top level value is complete. */
+JHN_API void jhn_encoder_get_buf(jhn_encoder_t *enc, const char **buf,
+                                 size_t *len);
+JHN_API void jhn_encoder_clear(jhn_encoder_t *enc);
+
+/* allocates a parser that encodes everything it parses with the given
+   encoder.  The encoder is not owned by the parser.  Numbers are
+   converted so they have to fit a long long or a double.  A string or
+   container too large for MessagePack's 32 bit lengths cancels the
+   parse (jhn_parser_status_client_cancelled). */
+JHN_API jhn_parser_t *jhn_encoder_parser_alloc(jhn_encoder_t *enc,
+                                               jhn_alloc_funcs_t *afs);
+
+/* Decodes CBOR and feeds it to a generator, the counterpart of
+   jhn_encoder_t.  Input may be passed in chunks of any size.  Byte
+   strings become unpadded base64url strings, tags are ignored and
+   infinity and NaN become null.  Non string map keys are converted to
+   strings.  Multiple top level values (a CBOR sequence) are separated
+   by a newline.  Text strings are only checked for valid UTF8 if the
+   generator has jhn_gen_validate_utf8 set. */
+JHN_HAS_ALLOC typedef struct jhn_cbor_decoder_s jhn_cbor_decoder_t;
+
+/* allocates a decoder writing to the given generator, which is not
+   owned by the decoder.  NULL if there is no memory for it. */
+JHN_API jhn_cbor_decoder_t *jhn_cbor_decoder_alloc(jhn_gen_t *gen,
+                                                   jhn_alloc_funcs_t *afs);
+
+/* free a decoder */
+JHN_API void jhn_cbor_decoder_free(jhn_cbor_decoder_t *dec);
+
+/* decode the next chunk of CBOR */
+JHN_API jhn_parser_status_t jhn_cbor_decoder_parse(jhn_cbor_decoder_t *dec,
+                                                   const unsigned char *data,
+                                                   size_t len);
+
+/* signals the end of the input.  Fails if the input ended in the middle
+   of a value. */
+JHN_API jhn_parser_status_t jhn_cbor_decoder_finish(jhn_cbor_decoder_t *dec);
+
+/* describes why decoding failed, NULL if it did not.  The string is
+   statically allocated. */
+JHN_API const char *jhn_cbor_decoder_get_error(jhn_cbor_decoder_t *dec);
+
 
 typedef enum {
     jhn_tok_bool,
@@ -369,17 +945,65 @@ typedef enum {
     jhn_tok_double,
     jhn_tok_string,
     jhn_tok_string_with_escapes,
-    jhn_tok_comment
+    jhn_tok_comment,
+    /* only produced with jhn_lexer_stream_strings, see there */
+    jhn_tok_string_fragment,
+    jhn_tok_string_fragment_with_escapes,
+    /* the number of token types, not a token */
+    jhn_tok_count
 } jhn_tok_t;
 
+/* the room for token counts in jhn_lexer_stats_t and
+   jhn_parser_stats_t.  More than there are token types, so that adding
+   one does not change the size of the structures. */
+#define JHN_TOKEN_STATS 32
+
 JHN_HAS_ALLOC typedef struct jhn_lexer_s jhn_lexer_t;
 
 /* allocates a lexer handle.  The allcoators can be left at NULL in which
-   case the system allocator (malloc/realloc/free) functions are used. */
+   case the system allocator (malloc/realloc/free) functions are used.
+   NULL if there is no memory for it. */
 JHN_API jhn_lexer_t *jhn_lexer_alloc(jhn_alloc_funcs_t *alloc,
                                      unsigned int allow_comments,
                                      unsigned int validate_utf8);
 
+/* configuration parameters for the lexer, these may be passed to
+   jhn_lexer_config() along with option specific argument(s).  In general,
+   all configuration parameters default to *off*. */
+typedef enum {
+    /* Normally a string that spans multiple chunks is buffered until it
+       is complete.  With this enabled the lexer instead hands out what
+       it has of the string as jhn_tok_string_fragment (or
+       jhn_tok_string_fragment_with_escapes) when it runs out of data
+       and only keeps the few bytes of an incomplete escape sequence or
+       utf8 character.  The first fragment includes the opening quote
+       (which is skipped in the reported data like for regular strings)
+       and might be empty.  The token that finishes such a string is a
+       regular jhn_tok_string / jhn_tok_string_with_escapes which only
+       reports the remaining part of the string.  Fragments never split
+       escape sequences, surrogate pairs or utf8 characters so each of
+       them can be unescaped on its own.
+
+       example:
+         jhn_lexer_config(l, jhn_lexer_stream_strings, 1); */
+    jhn_lexer_stream_strings = 0x01,
+    /* the most bytes a token may have, a size_t argument, zero for no
+       limit (the default).  A longer token is a jhn_lexer_token_too_large
+       error once its first max + 1 bytes are seen, so the lexer never
+       buffers more than that.  The bytes of a string include its quotes
+       and escapes and the fragments of a streamed string count
+       together.
+
+       example:
+         jhn_lexer_config(l, jhn_lexer_max_token_size, (size_t) 65536); */
+    jhn_lexer_max_token_size = 0x02
+} jhn_lexer_option;
+
+/* allow the modification of lexer options.
+
+   returns zero in case of errors, non-zero otherwise */
+JHN_API int jhn_lexer_config(jhn_lexer_t *lexer, jhn_lexer_option opt, ...);
+
 /* frees a lexer handle */
 JHN_API void jhn_lexer_free(jhn_lexer_t * lexer);
 
@@ -407,10 +1031,24 @@ JHN_API jhn_tok_t jhn_lexer_lex(jhn_lexer_t *lexer, const char *json_text,
                                 size_t length, size_t *offset,
                                 const char **out_buf, size_t *out_len);
 
-/* have a peek at the next token, but don't move the lexer forward */
+/* have a peek at the next token, but don't move the lexer forward.  The
+   peeked token is remembered, so if the next call to jhn_lexer_lex is
+   made with the same text, length and offset it returns the token
+   without lexing it again.
+
+   The token is only recognized by the text pointer, length and offset,
+   not by the contents.  If the text is overwritten with new input while
+   a peeked token is pending (a read buffer that is refilled in place,
+   for instance), call jhn_lexer_discard_peek() before passing it to the
+   lexer again or the old token is handed out. */
 JHN_API jhn_tok_t jhn_lexer_peek(jhn_lexer_t *lexer, const char *json_text,
                                  size_t length, size_t offset);
 
+/* forgets the token remembered by jhn_lexer_peek() and puts the lexer
+   back into the state it had before the peek.  Does nothing if there is
+   no such token. */
+JHN_API void jhn_lexer_discard_peek(jhn_lexer_t *lexer);
+
 /* indicates a finish to the lexer.  This is necessary because integers for
    instance do not have a clear end so it is necessary to instruct the lexer
    that an end has been reached. */
@@ -441,7 +1079,8 @@ typedef enum {
     jhn_lexer_missing_integer_after_decimal,
     jhn_lexer_missing_integer_after_exponent,
     jhn_lexer_missing_integer_after_minus,
-    jhn_lexer_unallowed_comment
+    jhn_lexer_unallowed_comment,
+    jhn_lexer_token_too_large
 } jhn_lexer_error_t;
 
 /* converts the given lexer error into a string.  This string is statically
@@ -462,6 +1101,65 @@ JHN_API size_t jhn_lexer_current_line(jhn_lexer_t *lexer);
    \n or \r */
 JHN_API size_t jhn_lexer_current_char(jhn_lexer_t *lexer);
 
+/* what the lexer did since it was allocated.  Only counted if the
+   library was built with JHN_STATS (premake4 --with-stats), zero
+   otherwise. */
+typedef struct {
+    /* how often part of a token was copied into the lexer's buffer to
+       be completed with the next chunk */
+    size_t buffer_appends;
+    /* the number of bytes copied that way */
+    size_t buffer_bytes;
+    /* the tokens handed out by jhn_lexer_lex, indexed by jhn_tok_t.
+       Each fragment of a streamed string counts on its own, a peeked
+       token once it is lexed.  The entries from jhn_tok_count on are
+       zero. */
+    size_t tokens[JHN_TOKEN_STATS];
+} jhn_lexer_stats_t;
+
+/* get the statistics since the lexer was allocated */
+JHN_API void jhn_lexer_get_stats(jhn_lexer_t *lexer,
+                                 jhn_lexer_stats_t *stats);
+
+/* what a parser did since it was allocated.  The fields below bytes
+   are only filled in if the library was built with JHN_STATS
+   (premake4 --with-stats), they are zero otherwise. */
+typedef struct {
+    /* the time spent in jhn_parser_parse and jhn_parser_finish, split
+       into the time spent in the callbacks and the rest.  They come
+       first and are followed by an even number of counters, so no ABI
+       pads the structure differently. */
+    double callback_seconds;
+    double library_seconds;
+    /* the chunks passed to jhn_parser_parse and the bytes consumed of
+       them.  A chunk that is passed again for the rest of it after
+       jhn_parser_pause counts once. */
+    size_t chunks;
+    size_t bytes;
+    /* how often part of a token that continues in the next chunk was
+       copied into the lexer's buffer and the number of bytes copied.
+       These grow as chunks get smaller, see jhn_lexer_lex. */
+    size_t buffer_appends;
+    size_t buffer_bytes;
+    /* the tokens lexed, see jhn_lexer_stats_t.  Strings that had to be
+       unescaped are the ones counted as jhn_tok_string_with_escapes
+       and jhn_tok_string_fragment_with_escapes. */
+    size_t tokens[JHN_TOKEN_STATS];
+    /* the bytes of unescaped strings and keys written to the parser's
+       decode buffer */
+    size_t decode_bytes;
+    /* the calls to the allocation functions made by the parser, its
+       lexer and schema validator and the bytes requested by them */
+    size_t allocs;
+    size_t alloc_bytes;
+    /* the deepest nesting of arrays and maps seen */
+    size_t max_depth;
+} jhn_parser_stats_t;
+
+/* fills in stats for the parse so far */
+JHN_API void jhn_parser_get_stats(jhn_parser_t *hand,
+                                  jhn_parser_stats_t *stats);
+
 
 /* frees ptr with the appropriate allocation function provided through the
    struct that is the first argument.  The allocators struct either needs
@@ -0,0 +1,2147 @@
+#ifndef JOHANSON_HPP_INCLUDED
+#define JOHANSON_HPP_INCLUDED
+
+/* Header only C++ (17 or later) layer on top of johanson.h.
+
+   johanson::parse() runs the parse loop as a template instantiated for
+   the handler type, on top of the lexer.  Events are delivered by
+   calling member functions of the handler directly, so they can be
+   inlined, and events the handler has no member function for are not
+   processed at all: a handler without on_string never has its strings
+   unescaped, one without on_integer never has its integers converted.
+
+   A handler may have any of these members:
+
+     on_null()
+     on_bool(bool)
+     on_integer(long long)
+     on_double(double)
+     on_number(std::string_view)      replaces on_integer and on_double
+     on_string(std::string_view)
+     on_start_map()
+     on_key(std::string_view)
+     on_end_map()
+     on_start_array()
+     on_end_array()
+
+   They may return void or something convertible to bool, in which case
+   returning false cancels the parse like a callback returning zero
+   does.  Strings are views into the input where possible and into a
+   buffer that is reused otherwise, they are only valid during the
+   call.  Numbers are handled like jhn_parser_t handles them.
+
+   johanson::document builds a tree of johanson::value from a JSON text
+   with jhn_parser_t, allocating everything from a
+   std::pmr::memory_resource:
+
+     std::pmr::monotonic_buffer_resource pool;
+     johanson::document doc(&pool);
+     if (doc.parse(json))
+         use(doc["items"][0]["name"].as_string());
+
+   With C++20 coroutines johanson::reader is available as well, a pull
+   style interface for input that arrives in chunks:
+
+     event ev = co_await reader.next();
+
+   suspends the coroutine when the input pushed so far is used up and
+   resumes it from reader.push() or reader.finish(). */
+
+#include <johanson.h>
+
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <cassert>
+#include <coroutine>
+#define JHN_HAS_COROUTINES 1
+#endif
+#endif
+
+namespace johanson {
+
+/* the outcome of a parse */
+struct result {
+    jhn_parser_status_t status = jhn_parser_status_ok;
+    /* statically allocated description of the error, nullptr if there
+       was none */
+    const char *error = nullptr;
+    /* offset of the error in the input, or the length of the input */
+    size_t offset = 0;
+
+    explicit operator bool() const { return status == jhn_parser_status_ok; }
+};
+
+namespace detail {
+
+#define JHN_DETAIL_HAS(name, args)                                          \
+    template <class H, class = void>                                        \
+    struct has_##name : std::false_type {};                                 \
+    template <class H>                                                      \
+    struct has_##name<H, std::void_t<decltype(                              \
+        std::declval<H &>().name args)>> : std::true_type {};               \
+    template <class H>                                                      \
+    inline constexpr bool has_##name##_v = has_##name<H>::value;
+
+JHN_DETAIL_HAS(on_null, ())
+JHN_DETAIL_HAS(on_bool, (true))
+JHN_DETAIL_HAS(on_integer, (0LL))
+JHN_DETAIL_HAS(on_double, (0.0))
+JHN_DETAIL_HAS(on_number, (std::string_view()))
+JHN_DETAIL_HAS(on_string, (std::string_view()))
+JHN_DETAIL_HAS(on_start_map, ())
+JHN_DETAIL_HAS(on_key, (std::string_view()))
+JHN_DETAIL_HAS(on_end_map, ())
+JHN_DETAIL_HAS(on_start_array, ())
+JHN_DETAIL_HAS(on_end_array, ())
+
+#undef JHN_DETAIL_HAS
+
+/* calls f and converts its result to "continue parsing" */
+template <class F>
+inline bool
+call(F &&f)
+{
+    if constexpr (std::is_void_v<decltype(f())>) {
+        f();
+        return true;
+    } else {
+        return static_cast<bool>(f());
+    }
+}
+
+inline unsigned int
+hex_digits(const char *p)
+{
+    unsigned int v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v = (v << 4) | static_cast<unsigned int>(
+            c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    return v;
+}
+
+inline void
+append_utf8(std::string &out, unsigned int cp)
+{
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xc0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xe0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x200000) {
+        out += static_cast<char>(0xf0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+        out += '?';
+    }
+}
+
+/* unescapes a string token the way the parser does */
+inline std::string_view
+unescape(std::string_view s, std::string &out)
+{
+    size_t beg = 0;
+    size_t end = 0;
+
+    out.clear();
+    while (end < s.size()) {
+        if (s[end] != '\\') {
+            end++;
+            continue;
+        }
+        out.append(s.data() + beg, end - beg);
+        switch (s[++end]) {
+            case 'r': out += '\r'; break;
+            case 'n': out += '\n'; break;
+            case 'f': out += '\f'; break;
+            case 'b': out += '\b'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned int cp = hex_digits(s.data() + end + 1);
+                end += 4;
+                if ((cp & 0xfc00) == 0xd800) {
+                    if (end + 2 < s.size() && s[end + 1] == '\\' &&
+                        s[end + 2] == 'u') {
+                        unsigned int low = hex_digits(s.data() + end + 3);
+                        cp = ((cp & 0x3f) << 10) |
+                             ((((cp >> 6) & 0xf) + 1) << 16) |
+                             (low & 0x3ff);
+                        end += 6;
+                    } else {
+                        out += '?';
+                        break;
+                    }
+                }
+                append_utf8(out, cp);
+                break;
+            }
+            default: out += s[end]; break;
+        }
+        beg = ++end;
+    }
+    out.append(s.data() + beg, end - beg);
+    return out;
+}
+
+/* same semantics as the parser's integer conversion, sets overflow
+   instead of errno */
+inline long long
+to_integer(std::string_view s, bool &overflow)
+{
+    const long long max_mul = LLONG_MAX / 10 + LLONG_MAX % 10;
+    long long ret = 0;
+    bool negative = false;
+    size_t i = 0;
+
+    overflow = false;
+    if (s[i] == '-') {
+        negative = true;
+        i++;
+    }
+    for (; i < s.size(); i++) {
+        long long d = s[i] - '0';
+        if (ret > max_mul || LLONG_MAX - ret * 10 < d) {
+            overflow = true;
+            return negative ? LLONG_MIN : LLONG_MAX;
+        }
+        ret = ret * 10 + d;
+    }
+    return negative ? -ret : ret;
+}
+
+inline double
+to_double(std::string_view s, bool &overflow)
+{
+    char small[64];
+    std::string large;
+    const char *str = small;
+    double d;
+
+    if (s.size() < sizeof(small)) {
+        std::memcpy(small, s.data(), s.size());
+        small[s.size()] = 0;
+    } else {
+        large.assign(s);
+        str = large.c_str();
+    }
+    errno = 0;
+    d = std::strtod(str, nullptr);
+    overflow = (d == HUGE_VAL || d == -HUGE_VAL) && errno == ERANGE;
+    return d;
+}
+
+struct lexer_holder {
+    jhn_lexer_t *lexer;
+
+    explicit lexer_holder(unsigned int flags)
+        : lexer(jhn_lexer_alloc(nullptr, flags & jhn_allow_comments,
+                                !(flags & jhn_dont_validate_strings))) {}
+    ~lexer_holder() { jhn_lexer_free(lexer); }
+    lexer_holder(const lexer_holder &) = delete;
+    lexer_holder &operator=(const lexer_holder &) = delete;
+};
+
+enum class state : unsigned char {
+    start,
+    complete,
+    map_start,
+    map_need_key,
+    map_sep,
+    map_need_val,
+    map_got_val,
+    array_start,
+    array_need_val,
+    array_got_val
+};
+
+} /* namespace detail */
+
+/* parses a complete JSON text and reports its events to handler.  The
+   jhn_allow_comments, jhn_dont_validate_strings,
+   jhn_allow_trailing_garbage and jhn_allow_multiple_values parser
+   options may be passed in flags. */
+template <class Handler>
+result
+parse(std::string_view json, Handler &handler, unsigned int flags = 0)
+{
+    using detail::state;
+    detail::lexer_holder lex(flags);
+    std::vector<state> stack;
+    std::string scratch;
+    const char *text = json.data();
+    size_t len = json.size();
+    size_t offset = 0;
+    bool at_end = false;
+    result res;
+
+    stack.reserve(32);
+    stack.push_back(state::start);
+
+    auto fail = [&](jhn_parser_status_t status, const char *error) {
+        res.status = status;
+        res.error = error;
+        res.offset = at_end ? json.size() : offset;
+        return res;
+    };
+#define JHN_DETAIL_EMIT(has, expr)                                          \
+    if constexpr (has) {                                                    \
+        if (!detail::call([&] { return expr; })) {                          \
+            return fail(jhn_parser_status_client_cancelled,                 \
+                        "client cancelled parse via callback return value"); \
+        }                                                                   \
+    }
+
+    for (;;) {
+        const char *buf;
+        size_t buf_len;
+        jhn_tok_t tok;
+
+        if (stack.back() == state::complete &&
+            (flags & (jhn_allow_multiple_values |
+                      jhn_allow_trailing_garbage)) ==
+            jhn_allow_trailing_garbage) {
+            break;
+        }
+        tok = jhn_lexer_lex(lex.lexer, text, len, &offset, &buf, &buf_len);
+        state &s = stack.back();
+
+        if (tok == jhn_tok_eof) {
+            if (at_end) {
+                break;
+            }
+            /* a space ends a number at the very end of the input */
+            at_end = true;
+            text = " ";
+            len = 1;
+            offset = 0;
+            continue;
+        }
+        if (tok == jhn_tok_error) {
+            return fail(jhn_parser_status_error,
+                        jhn_lexer_error_to_string(
+                            jhn_lexer_get_error(lex.lexer)));
+        }
+
+        if (s == state::complete) {
+            if (flags & jhn_allow_multiple_values) {
+                s = state::start;
+            } else {
+                return fail(jhn_parser_status_error, "trailing garbage");
+            }
+        }
+
+        switch (s) {
+        case state::start:
+        case state::map_need_val:
+        case state::array_start:
+        case state::array_need_val: {
+            state push = state::start;
+
+            switch (tok) {
+            case jhn_tok_string:
+                JHN_DETAIL_EMIT(detail::has_on_string_v<Handler>,
+                    handler.on_string(std::string_view(buf, buf_len)))
+                break;
+            case jhn_tok_string_with_escapes:
+                JHN_DETAIL_EMIT(detail::has_on_string_v<Handler>,
+                    handler.on_string(detail::unescape(
+                        std::string_view(buf, buf_len), scratch)))
+                break;
+            case jhn_tok_bool:
+                JHN_DETAIL_EMIT(detail::has_on_bool_v<Handler>,
+                    handler.on_bool(*buf == 't'))
+                break;
+            case jhn_tok_null:
+                JHN_DETAIL_EMIT(detail::has_on_null_v<Handler>,
+                    handler.on_null())
+                break;
+            case jhn_tok_left_bracket:
+                JHN_DETAIL_EMIT(detail::has_on_start_map_v<Handler>,
+                    handler.on_start_map())
+                push = state::map_start;
+                break;
+            case jhn_tok_left_brace:
+                JHN_DETAIL_EMIT(detail::has_on_start_array_v<Handler>,
+                    handler.on_start_array())
+                push = state::array_start;
+                break;
+            case jhn_tok_integer:
+                if constexpr (detail::has_on_number_v<Handler>) {
+                    JHN_DETAIL_EMIT(true,
+                        handler.on_number(std::string_view(buf, buf_len)))
+                } else if constexpr (detail::has_on_integer_v<Handler>) {
+                    bool overflow;
+                    long long i = detail::to_integer(
+                        std::string_view(buf, buf_len), overflow);
+                    if (overflow) {
+                        offset = offset >= buf_len ? offset - buf_len : 0;
+                        return fail(jhn_parser_status_error,
+                                    "integer overflow");
+                    }
+                    JHN_DETAIL_EMIT(true, handler.on_integer(i))
+                }
+                break;
+            case jhn_tok_double:
+                if constexpr (detail::has_on_number_v<Handler>) {
+                    JHN_DETAIL_EMIT(true,
+                        handler.on_number(std::string_view(buf, buf_len)))
+                } else if constexpr (detail::has_on_double_v<Handler>) {
+                    bool overflow;
+                    double d = detail::to_double(
+                        std::string_view(buf, buf_len), overflow);
+                    if (overflow) {
+                        offset = offset >= buf_len ? offset - buf_len : 0;
+                        return fail(jhn_parser_status_error,
+                                    "numeric (floating point) overflow");
+                    }
+                    JHN_DETAIL_EMIT(true, handler.on_double(d))
+                }
+                break;
+            case jhn_tok_right_brace:
+                if (s == state::array_start) {
+                    JHN_DETAIL_EMIT(detail::has_on_end_array_v<Handler>,
+                        handler.on_end_array())
+                    stack.pop_back();
+                    continue;
+                }
+                return fail(jhn_parser_status_error,
+                            "unallowed token at this point in JSON text");
+            default:
+                return fail(jhn_parser_status_error,
+                            "unallowed token at this point in JSON text");
+            }
+            /* got a value, the transition depends on where it was */
+            if (s == state::start) {
+                s = state::complete;
+            } else if (s == state::map_need_val) {
+                s = state::map_got_val;
+            } else {
+                s = state::array_got_val;
+            }
+            if (push != state::start) {
+                stack.push_back(push);
+            }
+            break;
+        }
+        case state::map_start:
+        case state::map_need_key:
+            if (tok == jhn_tok_string) {
+                JHN_DETAIL_EMIT(detail::has_on_key_v<Handler>,
+                    handler.on_key(std::string_view(buf, buf_len)))
+                s = state::map_sep;
+            } else if (tok == jhn_tok_string_with_escapes) {
+                JHN_DETAIL_EMIT(detail::has_on_key_v<Handler>,
+                    handler.on_key(detail::unescape(
+                        std::string_view(buf, buf_len), scratch)))
+                s = state::map_sep;
+            } else if (tok == jhn_tok_right_bracket &&
+                       s == state::map_start) {
+                JHN_DETAIL_EMIT(detail::has_on_end_map_v<Handler>,
+                    handler.on_end_map())
+                stack.pop_back();
+            } else {
+                return fail(jhn_parser_status_error,
+                            "invalid object key (must be a string)");
+            }
+            break;
+        case state::map_sep:
+            if (tok != jhn_tok_colon) {
+                return fail(jhn_parser_status_error,
+                            "object key and value must be separated by "
+                            "a colon (':')");
+            }
+            s = state::map_need_val;
+            break;
+        case state::map_got_val:
+            if (tok == jhn_tok_right_bracket) {
+                JHN_DETAIL_EMIT(detail::has_on_end_map_v<Handler>,
+                    handler.on_end_map())
+                stack.pop_back();
+            } else if (tok == jhn_tok_comma) {
+                s = state::map_need_key;
+            } else {
+                return fail(jhn_parser_status_error,
+                            "after key and value, inside map, I expect "
+                            "',' or '}'");
+            }
+            break;
+        case state::array_got_val:
+            if (tok == jhn_tok_right_brace) {
+                JHN_DETAIL_EMIT(detail::has_on_end_array_v<Handler>,
+                    handler.on_end_array())
+                stack.pop_back();
+            } else if (tok == jhn_tok_comma) {
+                s = state::array_need_val;
+            } else {
+                return fail(jhn_parser_status_error,
+                            "after array element, I expect ',' or ']'");
+            }
+            break;
+        case state::complete:
+            break;
+        }
+    }
+#undef JHN_DETAIL_EMIT
+
+    if (stack.back() != state::complete) {
+        return fail(jhn_parser_status_error, "premature EOF");
+    }
+    res.offset = json.size();
+    return res;
+}
+
+namespace detail {
+
+/* the C interface does not pass the size to free and realloc, so every
+   block carries a header that remembers it.  Failures are reported the
+   way malloc and realloc report them, no exception may get into the C
+   code. */
+struct pmr_funcs {
+    /* keeps the blocks aligned for any type */
+    static constexpr size_t header = alignof(std::max_align_t);
+
+    static void *
+    allocate(void *ctx, size_t sz) noexcept
+    {
+        auto *mr = static_cast<std::pmr::memory_resource *>(ctx);
+        char *p;
+
+        if (sz > SIZE_MAX - header) {
+            return nullptr;
+        }
+        try {
+            p = static_cast<char *>(
+                mr->allocate(header + sz, alignof(std::max_align_t)));
+        } catch (...) {
+            return nullptr;
+        }
+        std::memcpy(p, &sz, sizeof(sz));
+        return p + header;
+    }
+
+    static void
+    deallocate(void *ctx, void *ptr) noexcept
+    {
+        if (ptr) {
+            auto *mr = static_cast<std::pmr::memory_resource *>(ctx);
+            char *p = static_cast<char *>(ptr) - header;
+            size_t sz;
+            std::memcpy(&sz, p, sizeof(sz));
+            mr->deallocate(p, header + sz, alignof(std::max_align_t));
+        }
+    }
+
+    static void *
+    reallocate(void *ctx, void *ptr, size_t sz) noexcept
+    {
+        void *n;
+
+        /* like realloc, a size of zero frees the block */
+        if (ptr && sz == 0) {
+            deallocate(ctx, ptr);
+            return nullptr;
+        }
+        /* and the block is kept if there is no room for the new one */
+        n = allocate(ctx, sz);
+        if (!n) {
+            return nullptr;
+        }
+        if (ptr) {
+            size_t old;
+            std::memcpy(&old, static_cast<char *>(ptr) - header,
+                        sizeof(old));
+            std::memcpy(n, ptr, old < sz ? old : sz);
+            deallocate(ctx, ptr);
+        }
+        return n;
+    }
+};
+
+} /* namespace detail */
+
+/* jhn_alloc_funcs_t that allocate from a std::pmr::memory_resource,
+   which has to outlive everything allocated through them */
+inline jhn_alloc_funcs_t
+alloc_funcs(std::pmr::memory_resource *mr)
+{
+    jhn_alloc_funcs_t afs;
+    afs.malloc_func = detail::pmr_funcs::allocate;
+    afs.realloc_func = detail::pmr_funcs::reallocate;
+    afs.free_func = detail::pmr_funcs::deallocate;
+    afs.ctx = mr;
+    return afs;
+}
+
+struct member;
+
+namespace detail {
+struct dom_builder;
+}
+
+/* A parsed JSON value, see document.  Values are small and trivially
+   copyable, containers point at their elements.  Lookups on a value of
+   the wrong type, out of range indices and missing keys give a null
+   value, so lookups can be chained: doc["a"]["b"][0]. */
+class value {
+public:
+    enum class kind : unsigned char {
+        null,
+        boolean,
+        integer,
+        number,
+        string,
+        array,
+        object
+    };
+
+    /* objects with up to this many members are searched linearly,
+       larger ones get a hash index */
+    static constexpr size_t small_object_max = 8;
+
+    kind type() const { return kind_; }
+    bool is_null() const { return kind_ == kind::null; }
+    bool is_bool() const { return kind_ == kind::boolean; }
+    bool is_integer() const { return kind_ == kind::integer; }
+    bool is_number() const
+    {
+        return kind_ == kind::integer || kind_ == kind::number;
+    }
+    bool is_string() const { return kind_ == kind::string; }
+    bool is_array() const { return kind_ == kind::array; }
+    bool is_object() const { return kind_ == kind::object; }
+
+    bool as_bool() const { return kind_ == kind::boolean && u_.b; }
+    long long as_integer() const
+    {
+        return kind_ == kind::integer ? u_.i : 0;
+    }
+    double
+    as_double() const
+    {
+        return kind_ == kind::number ? u_.d
+             : kind_ == kind::integer ? static_cast<double>(u_.i) : 0.0;
+    }
+    std::string_view
+    as_string() const
+    {
+        return kind_ == kind::string ? std::string_view(u_.s, size_)
+                                     : std::string_view();
+    }
+
+    /* number of elements or members, 0 for everything else */
+    size_t
+    size() const
+    {
+        return kind_ == kind::array || kind_ == kind::object ? size_ : 0;
+    }
+
+    template <class T>
+    struct range {
+        const T *first;
+        const T *last;
+
+        const T *begin() const { return first; }
+        const T *end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+    };
+
+    /* the elements of an array, empty for everything else */
+    range<value>
+    elements() const
+    {
+        const value *a = kind_ == kind::array ? u_.a : nullptr;
+        return {a, a + size()};
+    }
+
+    /* the members of an object in document order, empty for everything
+       else */
+    range<member> members() const;
+
+    const value &
+    operator[](size_t i) const
+    {
+        return kind_ == kind::array && i < size_ ? u_.a[i] : null_value();
+    }
+
+    /* the value of the first member named key, nullptr if there is
+       none */
+    const value *find(std::string_view key) const;
+
+    const value &
+    operator[](std::string_view key) const
+    {
+        const value *v = find(key);
+        return v ? *v : null_value();
+    }
+
+private:
+    friend class document;
+    friend struct detail::dom_builder;
+
+    static const value &
+    null_value()
+    {
+        static const value v;
+        return v;
+    }
+
+    kind kind_ = kind::null;
+    /* string length, number of elements or members */
+    size_t size_ = 0;
+    union {
+        bool b;
+        long long i;
+        double d;
+        const char *s;
+        const value *a;
+        const member *o;
+    } u_ = {};
+};
+
+struct member {
+    std::string_view key;
+    johanson::value value;
+};
+
+inline value::range<member>
+value::members() const
+{
+    const member *o = kind_ == kind::object ? u_.o : nullptr;
+    return {o, o + size()};
+}
+
+namespace detail {
+
+/* FNV-1a, only used to place keys in the hash index of an object */
+inline uint32_t
+key_hash(std::string_view key)
+{
+    uint32_t h = 2166136261u;
+    for (char c : key) {
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return h;
+}
+
+/* whether s lies within text, strings that do not were copied into the
+   resource */
+inline bool
+within(std::string_view text, std::string_view s)
+{
+    std::less_equal<const char *> le;
+    return s.empty() || (le(text.data(), s.data()) &&
+                         le(s.data() + s.size(), text.data() + text.size()));
+}
+
+/* number of slots in the hash index of an object with n members, a
+   power of two that keeps it at most half full */
+inline size_t
+index_slots(size_t n)
+{
+    size_t cap = 16;
+    while (cap < 2 * n) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+/* the slots follow the members in the same allocation, they hold the
+   index of a member plus one, 0 marks a free slot */
+inline size_t
+object_bytes(size_t n)
+{
+    return n * sizeof(member) +
+        (n > value::small_object_max ? index_slots(n) * sizeof(uint32_t)
+                                     : 0);
+}
+
+} /* namespace detail */
+
+inline const value *
+value::find(std::string_view key) const
+{
+    if (kind_ != kind::object) {
+        return nullptr;
+    }
+    if (size_ <= small_object_max) {
+        for (size_t i = 0; i < size_; i++) {
+            if (u_.o[i].key == key) {
+                return &u_.o[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    const uint32_t *slots = reinterpret_cast<const uint32_t *>(u_.o + size_);
+    size_t mask = detail::index_slots(size_) - 1;
+    for (size_t s = detail::key_hash(key) & mask; slots[s];
+         s = (s + 1) & mask) {
+        const member &m = u_.o[slots[s] - 1];
+        if (m.key == key) {
+            return &m.value;
+        }
+    }
+    return nullptr;
+}
+
+namespace detail {
+
+/* collects the events of a jhn_parser_t into values.  The elements of
+   open containers wait on one stack and are moved into an allocation of
+   the exact size once the container ends.  An exception from the
+   memory resource cancels the parse in the callback it was thrown in,
+   with nothing lost that was allocated before. */
+struct dom_builder {
+    struct frame {
+        size_t first;
+        bool is_object;
+        /* the key of the container itself, if it is a member */
+        std::string_view key;
+    };
+
+    std::pmr::memory_resource *mr;
+    /* the input, strings within it are not copied */
+    const char *text;
+    size_t length;
+    std::pmr::vector<member> pending;
+    std::pmr::vector<frame> frames;
+    std::string_view key;
+    /* whether key was set by the last event and is not part of a
+       member or frame yet */
+    bool key_owned = false;
+    bool out_of_memory = false;
+    value root;
+
+    dom_builder(std::pmr::memory_resource *r, std::string_view json)
+        : mr(r), text(json.data()), length(json.size()), pending(r),
+          frames(r) {}
+
+    static dom_builder &self(void *ctx)
+    {
+        return *static_cast<dom_builder *>(ctx);
+    }
+
+    std::string_view
+    keep(const char *str, size_t len)
+    {
+        /* the parser points into the input unless it had to unescape */
+        std::string_view s(len ? str : "", len);
+        if (within(std::string_view(text, length), s)) {
+            return s;
+        }
+        char *copy = static_cast<char *>(mr->allocate(len, 1));
+        std::memcpy(copy, str, len);
+        return std::string_view(copy, len);
+    }
+
+    /* makes sure the next add() does not allocate, so that a value is
+       not lost once memory was allocated for it */
+    void
+    room()
+    {
+        if (!frames.empty() && pending.size() == pending.capacity()) {
+            pending.reserve(pending.capacity() * 2 + 16);
+        }
+    }
+
+    int
+    add(const value &v)
+    {
+        if (frames.empty()) {
+            root = v;
+        } else {
+            pending.push_back(member{key, v});
+        }
+        key_owned = false;
+        return 1;
+    }
+
+    int
+    start(bool is_object)
+    {
+        frames.push_back(frame{pending.size(), is_object, key});
+        key_owned = false;
+        return 1;
+    }
+
+    int
+    end()
+    {
+        frame f = frames.back();
+        size_t n = pending.size() - f.first;
+        value v;
+
+        /* an empty container needs room for itself in its parent */
+        if (n == 0 && frames.size() > 1) {
+            room();
+        }
+        v.size_ = n;
+        if (f.is_object) {
+            v.kind_ = value::kind::object;
+            member *o = static_cast<member *>(
+                mr->allocate(object_bytes(n), alignof(member)));
+            std::uninitialized_copy(pending.begin() + f.first,
+                                    pending.end(), o);
+            if (n > value::small_object_max) {
+                index(o, n);
+            }
+            v.u_.o = o;
+        } else {
+            v.kind_ = value::kind::array;
+            value *a = static_cast<value *>(
+                mr->allocate(n * sizeof(value), alignof(value)));
+            for (size_t i = 0; i < n; i++) {
+                new (a + i) value(pending[f.first + i].value);
+            }
+            v.u_.a = a;
+        }
+        frames.pop_back();
+        pending.resize(f.first);
+        key = f.key;
+        return add(v);
+    }
+
+    /* runs the part of a callback that allocates */
+    template <class F>
+    static int
+    guard(void *ctx, F f)
+    {
+        try {
+            return f(self(ctx));
+        } catch (...) {
+            self(ctx).out_of_memory = true;
+            return 0;
+        }
+    }
+
+    /* fills in the hash index of an object, duplicate keys keep
+       pointing at their first occurrence like in the linear search */
+    static void
+    index(member *o, size_t n)
+    {
+        uint32_t *slots = reinterpret_cast<uint32_t *>(o + n);
+        size_t mask = index_slots(n) - 1;
+
+        std::memset(slots, 0, (mask + 1) * sizeof(uint32_t));
+        for (size_t i = 0; i < n; i++) {
+            size_t s = key_hash(o[i].key) & mask;
+            while (slots[s] && o[slots[s] - 1].key != o[i].key) {
+                s = (s + 1) & mask;
+            }
+            if (!slots[s]) {
+                slots[s] = static_cast<uint32_t>(i + 1);
+            }
+        }
+    }
+
+    static const jhn_parser_callbacks_t *
+    callbacks()
+    {
+        static const jhn_parser_callbacks_t cbs = {
+            [](void *ctx) {
+                return guard(ctx, [](dom_builder &b) {
+                    return b.add(value());
+                });
+            },
+            [](void *ctx, int b) {
+                return guard(ctx, [b](dom_builder &d) {
+                    value v;
+                    v.kind_ = value::kind::boolean;
+                    v.u_.b = b != 0;
+                    return d.add(v);
+                });
+            },
+            [](void *ctx, long long i) {
+                return guard(ctx, [i](dom_builder &b) {
+                    value v;
+                    v.kind_ = value::kind::integer;
+                    v.u_.i = i;
+                    return b.add(v);
+                });
+            },
+            [](void *ctx, double d) {
+                return guard(ctx, [d](dom_builder &b) {
+                    value v;
+                    v.kind_ = value::kind::number;
+                    v.u_.d = d;
+                    return b.add(v);
+                });
+            },
+            nullptr,
+            [](void *ctx, const char *str, size_t len) {
+                return guard(ctx, [str, len](dom_builder &b) {
+                    value v;
+                    b.room();
+                    std::string_view s = b.keep(str, len);
+                    v.kind_ = value::kind::string;
+                    v.size_ = s.size();
+                    v.u_.s = s.data();
+                    return b.add(v);
+                });
+            },
+            [](void *ctx) {
+                return guard(ctx, [](dom_builder &b) {
+                    return b.start(true);
+                });
+            },
+            [](void *ctx, const char *str, size_t len) {
+                return guard(ctx, [str, len](dom_builder &b) {
+                    b.key = b.keep(str, len);
+                    b.key_owned = true;
+                    return 1;
+                });
+            },
+            [](void *ctx) {
+                return guard(ctx, [](dom_builder &b) {
+                    return b.end();
+                });
+            },
+            [](void *ctx) {
+                return guard(ctx, [](dom_builder &b) {
+                    return b.start(false);
+                });
+            },
+            [](void *ctx) {
+                return guard(ctx, [](dom_builder &b) {
+                    return b.end();
+                });
+            },
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr
+        };
+        return &cbs;
+    }
+};
+
+} /* namespace detail */
+
+/* Owns the values parsed from one JSON text.  Everything, the values,
+   unescaped strings and the parser itself, is allocated from the
+   memory resource, so with a std::pmr::monotonic_buffer_resource per
+   request a document costs no heap allocations at all.  Strings
+   without escapes are views into the input, which therefore has to
+   outlive the document. */
+class document {
+public:
+    explicit document(std::pmr::memory_resource *mr =
+                          std::pmr::get_default_resource())
+        : mr_(mr), error_(mr) {}
+    ~document() { clear(); }
+    document(const document &) = delete;
+    document &operator=(const document &) = delete;
+
+    /* parses json with a jhn_parser_t, replacing the current contents.
+       The jhn_allow_comments, jhn_dont_validate_strings and
+       jhn_allow_trailing_garbage parser options may be passed in
+       flags.  The error of the result is valid until the next parse. */
+    result
+    parse(std::string_view json, unsigned int flags = 0)
+    {
+        static const unsigned int options[] = {
+            jhn_allow_comments, jhn_dont_validate_strings,
+            jhn_allow_trailing_garbage
+        };
+        jhn_alloc_funcs_t afs = alloc_funcs(mr_);
+        detail::dom_builder b(mr_, json);
+        jhn_parser_t *p;
+        result res;
+
+        clear();
+        p = jhn_parser_alloc(detail::dom_builder::callbacks(), &afs, &b);
+        if (!p) {
+            res.status = jhn_parser_status_error;
+            res.error = "out of memory";
+            return res;
+        }
+        for (unsigned int opt : options) {
+            if (flags & opt) {
+                jhn_parser_config(p, jhn_parser_option(opt), 1);
+            }
+        }
+        res.status = jhn_parser_parse(p, json.data(), json.size());
+        res.offset = jhn_parser_get_bytes_consumed(p);
+        if (res.status == jhn_parser_status_ok) {
+            res.status = jhn_parser_finish(p);
+            res.offset = json.size();
+        }
+        text_ = json;
+        if (res.status != jhn_parser_status_ok) {
+            char *msg = nullptr;
+
+            if (b.out_of_memory) {
+                res.status = jhn_parser_status_error;
+            } else {
+                msg = jhn_parser_get_error(p, 0, json.data(), json.size());
+            }
+            error_ = msg ? msg : "out of memory";
+            if (msg) {
+                jhn_free(&afs, msg);
+            }
+            res.error = error_.c_str();
+            discard(b);
+        }
+        jhn_parser_free(p);
+
+        root_ = b.root;
+        if (!res) {
+            clear();
+        }
+        return res;
+    }
+
+    const value &root() const { return root_; }
+    const value &operator[](std::string_view key) const
+    {
+        return root_[key];
+    }
+    const value &operator[](size_t i) const { return root_[i]; }
+
+    std::pmr::memory_resource *resource() const { return mr_; }
+
+    /* returns all memory of the values to the resource */
+    void
+    clear()
+    {
+        release(root_);
+        root_ = value();
+        text_ = std::string_view();
+    }
+
+private:
+    /* releases the open containers of a failed parse and the key that
+       waits for its value, without allocating anything.  The keys of
+       array elements and of frames in arrays are left over from an
+       enclosing object and belong to it. */
+    void
+    discard(detail::dom_builder &b)
+    {
+        for (size_t j = 0; j < b.frames.size(); j++) {
+            const detail::dom_builder::frame &f = b.frames[j];
+            size_t last = j + 1 < b.frames.size() ? b.frames[j + 1].first
+                                                  : b.pending.size();
+
+            if (j > 0 && b.frames[j - 1].is_object) {
+                release_string(f.key);
+            }
+            for (size_t i = f.first; i < last; i++) {
+                if (f.is_object) {
+                    release_string(b.pending[i].key);
+                }
+                release(b.pending[i].value);
+            }
+        }
+        if (b.key_owned) {
+            release_string(b.key);
+        }
+        b.frames.clear();
+        b.pending.clear();
+    }
+
+    void
+    release_string(std::string_view s)
+    {
+        if (!detail::within(text_, s)) {
+            mr_->deallocate(const_cast<char *>(s.data()), s.size(), 1);
+        }
+    }
+
+    void
+    release(const value &v)
+    {
+        switch (v.kind_) {
+        case value::kind::string:
+            release_string(v.as_string());
+            break;
+        case value::kind::array:
+            for (const value &e : v.elements()) {
+                release(e);
+            }
+            mr_->deallocate(const_cast<value *>(v.u_.a),
+                            v.size_ * sizeof(value), alignof(value));
+            break;
+        case value::kind::object:
+            for (const member &m : v.members()) {
+                release_string(m.key);
+                release(m.value);
+            }
+            mr_->deallocate(const_cast<member *>(v.u_.o),
+                            detail::object_bytes(v.size_), alignof(member));
+            break;
+        default:
+            break;
+        }
+    }
+
+    std::pmr::memory_resource *mr_;
+    value root_;
+    std::string_view text_;
+    std::pmr::string error_;
+};
+
+/* Binding of C++ types to JSON.  JHN_FIELDS(Type, member...) lists the
+   members of a struct that map to the keys of a JSON object, named
+   like the members:
+
+     struct order { long long id; double price; std::vector<item> items; };
+     JHN_FIELDS(order, id, price, items)
+
+   It has to appear at namespace scope in the namespace of the type.
+   Then johanson::from_json() fills a value of the type straight from
+   the events of johanson::parse(), without an intermediate DOM, and
+   johanson::to_json() writes one to a jhn_gen_t.  Keys are matched
+   with a table that is computed at compile time and written from
+   string literals that are quoted at compile time.
+
+   Members can be bool, integers, floating point numbers, std::string,
+   std::optional and std::vector of supported types and types with
+   JHN_FIELDS.  Unknown keys are skipped, missing keys leave the member
+   untouched.  Up to 32 members are supported. */
+
+#define JHN_DETAIL_EXPAND(x) x
+#define JHN_DETAIL_FE_1(m, a) m(a)
+#define JHN_DETAIL_FE_2(m, a, ...)                                          \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_1(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_3(m, a, ...)                                          \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_2(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_4(m, a, ...)                                          \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_3(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_5(m, a, ...)                                          \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_4(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_6(m, a, ...)                                          \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_5(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_7(m, a, ...)                                          \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_6(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_8(m, a, ...)                                          \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_7(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_9(m, a, ...)                                          \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_8(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_10(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_9(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_11(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_10(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_12(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_11(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_13(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_12(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_14(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_13(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_15(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_14(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_16(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_15(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_17(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_16(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_18(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_17(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_19(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_18(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_20(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_19(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_21(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_20(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_22(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_21(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_23(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_22(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_24(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_23(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_25(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_24(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_26(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_25(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_27(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_26(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_28(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_27(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_29(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_28(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_30(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_29(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_31(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_30(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_32(m, a, ...)                                         \
+    m(a), JHN_DETAIL_EXPAND(JHN_DETAIL_FE_31(m, __VA_ARGS__))
+#define JHN_DETAIL_FE_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11,    \
+    _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, \
+    _26, _27, _28, _29, _30, _31, _32, n, ...) n
+#define JHN_DETAIL_FOR_EACH(m, ...)                                        \
+    JHN_DETAIL_EXPAND(JHN_DETAIL_FE_PICK(__VA_ARGS__,                       \
+        JHN_DETAIL_FE_32, JHN_DETAIL_FE_31, JHN_DETAIL_FE_30,               \
+        JHN_DETAIL_FE_29, JHN_DETAIL_FE_28, JHN_DETAIL_FE_27,               \
+        JHN_DETAIL_FE_26, JHN_DETAIL_FE_25, JHN_DETAIL_FE_24,               \
+        JHN_DETAIL_FE_23, JHN_DETAIL_FE_22, JHN_DETAIL_FE_21,               \
+        JHN_DETAIL_FE_20, JHN_DETAIL_FE_19, JHN_DETAIL_FE_18,               \
+        JHN_DETAIL_FE_17, JHN_DETAIL_FE_16, JHN_DETAIL_FE_15,               \
+        JHN_DETAIL_FE_14, JHN_DETAIL_FE_13, JHN_DETAIL_FE_12,               \
+        JHN_DETAIL_FE_11, JHN_DETAIL_FE_10, JHN_DETAIL_FE_9,                \
+        JHN_DETAIL_FE_8, JHN_DETAIL_FE_7, JHN_DETAIL_FE_6, JHN_DETAIL_FE_5, \
+        JHN_DETAIL_FE_4, JHN_DETAIL_FE_3, JHN_DETAIL_FE_2, JHN_DETAIL_FE_1) \
+        (m, __VA_ARGS__))
+#define JHN_DETAIL_FIELD(m)                                                 \
+    johanson::detail::field(#m, "\"" #m "\"", &jhn_fields_type::m)
+
+#define JHN_FIELDS(Type, ...)                                               \
+    constexpr auto                                                          \
+    jhn_fields(const Type *)                                                \
+    {                                                                       \
+        using jhn_fields_type = Type;                                       \
+        return std::make_tuple(                                             \
+            JHN_DETAIL_FOR_EACH(JHN_DETAIL_FIELD, __VA_ARGS__));            \
+    }
+
+namespace detail {
+
+template <class T, class M>
+struct field_desc {
+    /* the key and the key quoted for jhn_gen_encoded_key */
+    std::string_view name;
+    std::string_view encoded;
+    M T::*member;
+};
+
+template <class T, class M>
+constexpr field_desc<T, M>
+field(std::string_view name, std::string_view encoded, M T::*member)
+{
+    return {name, encoded, member};
+}
+
+template <class T, class = void>
+struct has_fields : std::false_type {};
+template <class T>
+struct has_fields<T, std::void_t<decltype(
+    jhn_fields(static_cast<const T *>(nullptr)))>> : std::true_type {};
+
+template <class T>
+constexpr auto
+fields_of()
+{
+    return jhn_fields(static_cast<const T *>(nullptr));
+}
+
+/* maps keys to member indices with one hash and one comparison.  The
+   hash only looks at the length and three characters, the multiplier
+   and the table size are searched at compile time until all names of
+   the type land in different slots.  If there is no such pair the
+   names are searched linearly. */
+constexpr unsigned int
+ceil_log2(size_t n)
+{
+    unsigned int b = 0;
+    while ((size_t(1) << b) < n) {
+        b++;
+    }
+    return b;
+}
+
+template <size_t N>
+struct key_table {
+    /* at most four slots per name */
+    static constexpr unsigned int max_bits = ceil_log2(N) + 2;
+
+    std::string_view names[N] = {};
+    uint32_t multiplier = 0;
+    unsigned int bits = 0;
+    bool linear = true;
+    short slots[size_t(1) << max_bits] = {};
+
+    static constexpr uint32_t
+    hash(std::string_view key, uint32_t multiplier, unsigned int bits)
+    {
+        uint32_t x = static_cast<uint32_t>(key.size());
+        if (!key.empty()) {
+            x |= uint32_t(static_cast<unsigned char>(key[0])) << 8 |
+                 uint32_t(static_cast<unsigned char>(key[key.size() / 2]))
+                     << 16 |
+                 uint32_t(static_cast<unsigned char>(key.back())) << 24;
+        }
+        x = (x ^ (x >> 15)) * multiplier;
+        return x >> (32 - bits);
+    }
+
+    constexpr bool
+    try_build(uint32_t m, unsigned int b)
+    {
+        for (size_t i = 0; i < (size_t(1) << b); i++) {
+            slots[i] = -1;
+        }
+        for (size_t i = 0; i < N; i++) {
+            uint32_t h = hash(names[i], m, b);
+            if (slots[h] >= 0) {
+                return false;
+            }
+            slots[h] = static_cast<short>(i);
+        }
+        multiplier = m;
+        bits = b;
+        linear = false;
+        return true;
+    }
+
+    constexpr int
+    find(std::string_view key) const
+    {
+        if (linear) {
+            for (size_t i = 0; i < N; i++) {
+                if (names[i] == key) {
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        }
+        int i = slots[hash(key, multiplier, bits)];
+        return i >= 0 && names[i] == key ? i : -1;
+    }
+};
+
+template <size_t N>
+constexpr key_table<N>
+make_key_table(const std::string_view (&names)[N])
+{
+    key_table<N> t;
+
+    for (size_t i = 0; i < N; i++) {
+        t.names[i] = names[i];
+    }
+    for (unsigned int b = ceil_log2(N); b <= key_table<N>::max_bits; b++) {
+        uint32_t m = 0x9e3779b1u;
+        for (int k = 0; k < 64; k++) {
+            if (b > 0 && t.try_build(m, b)) {
+                return t;
+            }
+            m = m * 0x2545f491u + 0x61c88647u;
+        }
+    }
+    t.linear = true;
+    return t;
+}
+
+template <class T>
+struct bound {
+    static constexpr auto fields = fields_of<T>();
+    static constexpr size_t count = std::tuple_size_v<decltype(fields)>;
+
+    template <size_t... I>
+    static constexpr key_table<count>
+    table(std::index_sequence<I...>)
+    {
+        const std::string_view names[] = {std::get<I>(fields).name...};
+        return make_key_table(names);
+    }
+
+    static constexpr key_table<count> keys =
+        table(std::make_index_sequence<count>());
+};
+
+class bind_decoder;
+
+/* how a value of one type is stored when an event arrives.  The
+   functions return an error message or nullptr. */
+struct slot_ops {
+    const char *(*null)(void *obj);
+    const char *(*boolean)(void *obj, bool b);
+    const char *(*integer)(void *obj, long long i);
+    const char *(*number)(void *obj, double d);
+    const char *(*string)(void *obj, std::string_view s);
+    const char *(*start_map)(void *obj, bind_decoder &d);
+    const char *(*start_array)(void *obj, bind_decoder &d);
+};
+
+/* an open object or array that is being filled in */
+struct bind_frame {
+    void *obj;
+    /* the slot for the next value and how to store it, nullptr if the
+       value is to be skipped */
+    void *(*next)(bind_frame &f, const slot_ops **ops);
+    /* objects only, selects the member the next value goes into */
+    int field;
+    int (*find)(std::string_view key);
+};
+
+/* the events a type accepts, everything else is an error */
+struct binding_base {
+    static const char *wrong() { return "value has the wrong type"; }
+
+    static const char *null(void *) { return wrong(); }
+    static const char *boolean(void *, bool) { return wrong(); }
+    static const char *integer(void *, long long) { return wrong(); }
+    static const char *number(void *, double) { return wrong(); }
+    static const char *string(void *, std::string_view) { return wrong(); }
+    static const char *start_map(void *, bind_decoder &) { return wrong(); }
+    static const char *start_array(void *, bind_decoder &) { return wrong(); }
+};
+
+template <class T, class = void>
+struct binding;
+
+template <class T>
+struct ops_of {
+    using B = binding<T>;
+    static constexpr slot_ops ops = {
+        B::null, B::boolean, B::integer, B::number, B::string,
+        B::start_map, B::start_array
+    };
+};
+
+/* the handler for parse() that does the work of from_json() */
+class bind_decoder {
+public:
+    bind_decoder(void *root, const slot_ops *ops)
+        : root_(root), root_ops_(ops) {}
+
+    const char *error() const { return error_; }
+
+    void push(const bind_frame &f) { frames_.push_back(f); }
+
+    bool
+    on_null()
+    {
+        return store([](auto o, void *s) { return o->null(s); });
+    }
+    bool
+    on_bool(bool b)
+    {
+        return store([b](auto o, void *s) { return o->boolean(s, b); });
+    }
+    bool
+    on_integer(long long i)
+    {
+        return store([i](auto o, void *s) { return o->integer(s, i); });
+    }
+    bool
+    on_double(double d)
+    {
+        return store([d](auto o, void *s) { return o->number(s, d); });
+    }
+    bool
+    on_string(std::string_view str)
+    {
+        return store([str](auto o, void *s) { return o->string(s, str); });
+    }
+    bool
+    on_key(std::string_view key)
+    {
+        if (skip_ == 0) {
+            bind_frame &f = frames_.back();
+            f.field = f.find(key);
+        }
+        return true;
+    }
+    bool
+    on_start_map()
+    {
+        return open([this](auto o, void *s) {
+            return o->start_map(s, *this);
+        });
+    }
+    bool
+    on_start_array()
+    {
+        return open([this](auto o, void *s) {
+            return o->start_array(s, *this);
+        });
+    }
+    bool on_end_map() { return close(); }
+    bool on_end_array() { return close(); }
+
+private:
+    void *
+    target(const slot_ops **ops)
+    {
+        if (frames_.empty()) {
+            *ops = root_ops_;
+            return root_;
+        }
+        return frames_.back().next(frames_.back(), ops);
+    }
+
+    template <class F>
+    bool
+    store(F f)
+    {
+        const slot_ops *ops;
+        void *slot;
+
+        if (skip_) {
+            return true;
+        }
+        slot = target(&ops);
+        if (slot) {
+            error_ = f(ops, slot);
+        }
+        return error_ == nullptr;
+    }
+
+    template <class F>
+    bool
+    open(F f)
+    {
+        const slot_ops *ops;
+        void *slot;
+
+        if (skip_) {
+            skip_++;
+            return true;
+        }
+        slot = target(&ops);
+        if (!slot) {
+            skip_ = 1;
+            return true;
+        }
+        error_ = f(ops, slot);
+        return error_ == nullptr;
+    }
+
+    bool
+    close()
+    {
+        if (skip_) {
+            skip_--;
+        } else {
+            frames_.pop_back();
+        }
+        return true;
+    }
+
+    void *root_;
+    const slot_ops *root_ops_;
+    std::vector<bind_frame> frames_;
+    /* depth of the unknown member that is being skipped */
+    size_t skip_ = 0;
+    const char *error_ = nullptr;
+};
+
+/* types with JHN_FIELDS */
+template <class T>
+struct binding<T, std::enable_if_t<has_fields<T>::value>> : binding_base {
+    using bt = bound<T>;
+
+    template <size_t I>
+    static void *
+    member(void *obj, const slot_ops **ops)
+    {
+        using M = std::remove_reference_t<decltype(
+            static_cast<T *>(obj)->*std::get<I>(bt::fields).member)>;
+        *ops = &ops_of<M>::ops;
+        return &(static_cast<T *>(obj)->*std::get<I>(bt::fields).member);
+    }
+
+    template <size_t... I>
+    static void *
+    next_member(bind_frame &f, const slot_ops **ops,
+                std::index_sequence<I...>)
+    {
+        using getter = void *(*)(void *, const slot_ops **);
+        static constexpr getter getters[] = {&member<I>...};
+        return f.field >= 0 ? getters[f.field](f.obj, ops) : nullptr;
+    }
+
+    static void *
+    next(bind_frame &f, const slot_ops **ops)
+    {
+        return next_member(f, ops, std::make_index_sequence<bt::count>());
+    }
+
+    static int find(std::string_view key) { return bt::keys.find(key); }
+
+    static const char *
+    start_map(void *obj, bind_decoder &d)
+    {
+        d.push(bind_frame{obj, next, -1, find});
+        return nullptr;
+    }
+
+    template <size_t... I>
+    static jhn_gen_status_t
+    encode_members(jhn_gen_t *g, const T &v, std::index_sequence<I...>)
+    {
+        jhn_gen_status_t s = jhn_gen_status_ok;
+        ((s == jhn_gen_status_ok &&
+          ((s = jhn_gen_encoded_key(g, std::get<I>(bt::fields).encoded.data(),
+                                    std::get<I>(bt::fields).encoded.size()))
+               == jhn_gen_status_ok) &&
+          ((s = binding<std::remove_cv_t<std::remove_reference_t<
+                decltype(v.*std::get<I>(bt::fields).member)>>>::encode(
+                g, v.*std::get<I>(bt::fields).member)) == jhn_gen_status_ok)),
+         ...);
+        return s;
+    }
+
+    static jhn_gen_status_t
+    encode(jhn_gen_t *g, const T &v)
+    {
+        jhn_gen_status_t s = jhn_gen_map_open(g);
+        if (s == jhn_gen_status_ok) {
+            s = encode_members(g, v, std::make_index_sequence<bt::count>());
+        }
+        return s == jhn_gen_status_ok ? jhn_gen_map_close(g) : s;
+    }
+};
+
+template <>
+struct binding<bool> : binding_base {
+    static const char *
+    boolean(void *obj, bool b)
+    {
+        *static_cast<bool *>(obj) = b;
+        return nullptr;
+    }
+
+    static jhn_gen_status_t
+    encode(jhn_gen_t *g, bool v)
+    {
+        return jhn_gen_bool(g, v);
+    }
+};
+
+template <class T>
+struct binding<T, std::enable_if_t<std::is_integral_v<T> &&
+                                   !std::is_same_v<T, bool>>>
+    : binding_base {
+    static const char *
+    integer(void *obj, long long i)
+    {
+        if constexpr (std::is_unsigned_v<T>) {
+            if (i < 0 || static_cast<unsigned long long>(i) >
+                         std::numeric_limits<T>::max()) {
+                return "integer out of range";
+            }
+        } else if constexpr (sizeof(T) < sizeof(long long)) {
+            if (i < std::numeric_limits<T>::min() ||
+                i > std::numeric_limits<T>::max()) {
+                return "integer out of range";
+            }
+        }
+        *static_cast<T *>(obj) = static_cast<T>(i);
+        return nullptr;
+    }
+
+    static jhn_gen_status_t
+    encode(jhn_gen_t *g, T v)
+    {
+        if constexpr (std::is_unsigned_v<T> &&
+                      sizeof(T) >= sizeof(long long)) {
+            if (v > static_cast<T>(LLONG_MAX)) {
+                std::string s = std::to_string(v);
+                return jhn_gen_number(g, s.data(), s.size());
+            }
+        }
+        return jhn_gen_integer(g, static_cast<long long>(v));
+    }
+};
+
+template <class T>
+struct binding<T, std::enable_if_t<std::is_floating_point_v<T>>>
+    : binding_base {
+    static const char *
+    integer(void *obj, long long i)
+    {
+        *static_cast<T *>(obj) = static_cast<T>(i);
+        return nullptr;
+    }
+
+    static const char *
+    number(void *obj, double d)
+    {
+        *static_cast<T *>(obj) = static_cast<T>(d);
+        return nullptr;
+    }
+
+    static jhn_gen_status_t
+    encode(jhn_gen_t *g, T v)
+    {
+        return jhn_gen_double(g, static_cast<double>(v));
+    }
+};
+
+template <>
+struct binding<std::string> : binding_base {
+    static const char *
+    string(void *obj, std::string_view s)
+    {
+        static_cast<std::string *>(obj)->assign(s.data(), s.size());
+        return nullptr;
+    }
+
+    static jhn_gen_status_t
+    encode(jhn_gen_t *g, const std::string &v)
+    {
+        return jhn_gen_string(g, v.data(), v.size());
+    }
+};
+
+template <class T>
+struct binding<std::optional<T>> : binding_base {
+    using B = binding<T>;
+
+    static std::optional<T> &self(void *obj)
+    {
+        return *static_cast<std::optional<T> *>(obj);
+    }
+    static void *value(void *obj) { return &self(obj).emplace(); }
+
+    static const char *
+    null(void *obj)
+    {
+        self(obj).reset();
+        return nullptr;
+    }
+    static const char *
+    boolean(void *obj, bool b)
+    {
+        return B::boolean(value(obj), b);
+    }
+    static const char *
+    integer(void *obj, long long i)
+    {
+        return B::integer(value(obj), i);
+    }
+    static const char *
+    number(void *obj, double d)
+    {
+        return B::number(value(obj), d);
+    }
+    static const char *
+    string(void *obj, std::string_view s)
+    {
+        return B::string(value(obj), s);
+    }
+    static const char *
+    start_map(void *obj, bind_decoder &d)
+    {
+        return B::start_map(value(obj), d);
+    }
+    static const char *
+    start_array(void *obj, bind_decoder &d)
+    {
+        return B::start_array(value(obj), d);
+    }
+
+    static jhn_gen_status_t
+    encode(jhn_gen_t *g, const std::optional<T> &v)
+    {
+        return v ? B::encode(g, *v) : jhn_gen_null(g);
+    }
+};
+
+template <class T>
+struct binding<std::vector<T>> : binding_base {
+    static void *
+    next(bind_frame &f, const slot_ops **ops)
+    {
+        *ops = &ops_of<T>::ops;
+        return &static_cast<std::vector<T> *>(f.obj)->emplace_back();
+    }
+
+    static const char *
+    start_array(void *obj, bind_decoder &d)
+    {
+        static_cast<std::vector<T> *>(obj)->clear();
+        d.push(bind_frame{obj, next, -1, nullptr});
+        return nullptr;
+    }
+
+    static jhn_gen_status_t
+    encode(jhn_gen_t *g, const std::vector<T> &v)
+    {
+        jhn_gen_status_t s = jhn_gen_array_open(g);
+        for (size_t i = 0; s == jhn_gen_status_ok && i < v.size(); i++) {
+            s = binding<T>::encode(g, v[i]);
+        }
+        return s == jhn_gen_status_ok ? jhn_gen_array_close(g) : s;
+    }
+};
+
+} /* namespace detail */
+
+/* parses json into out, see JHN_FIELDS.  The flags are those of
+   parse().  On errors out may be partially filled in. */
+template <class T>
+result
+from_json(std::string_view json, T &out, unsigned int flags = 0)
+{
+    detail::bind_decoder d(&out, &detail::ops_of<T>::ops);
+    result res = parse(json, d, flags);
+    if (d.error()) {
+        res.status = jhn_parser_status_error;
+        res.error = d.error();
+    }
+    return res;
+}
+
+/* writes v as the next value of g, see JHN_FIELDS */
+template <class T>
+jhn_gen_status_t
+to_json(jhn_gen_t *g, const T &v)
+{
+    return detail::binding<T>::encode(g, v);
+}
+
+#ifdef JHN_HAS_COROUTINES
+
+enum class event_type : unsigned char {
+    null_value,
+    bool_value,
+    integer_value,
+    double_value,
+    string_value,
+    key,
+    start_map,
+    end_map,
+    start_array,
+    end_array,
+    /* the input is complete, all values have been read */
+    end,
+    /* the input is invalid, reader::error() says why */
+    error
+};
+
+/* a single event handed out by reader::next().  Only the member that
+   belongs to the type is set, the string of string_value and key
+   events is only valid until next() is called again. */
+struct event {
+    event_type type = event_type::end;
+    bool boolean = false;
+    long long integer = 0;
+    double number = 0;
+    std::string_view string;
+};
+
+/* Pull parser for coroutines.  This drives a jhn_parser_t that pauses
+   after every event, so the input is neither copied nor buffered
+   beyond what the parser buffers itself, and a chunk is only consumed
+   as far as events are asked for.
+
+     johanson::reader r;
+     consume(r);                  // coroutine, co_await r.next() ...
+     while (read_some(buf))
+         r.push(buf);             // resumes consume() until buf is used
+     r.finish();                  // up
+
+   push() must only be called once the previous chunk is used up, that
+   is while a coroutine waits in next() or before the first next().
+   The chunk has to stay valid until then.  After end or error every
+   further next() returns the same event again.  The parser options of
+   jhn_parser_config that take a boolean may be passed in flags. */
+class reader {
+public:
+    explicit reader(unsigned int flags = 0)
+        : parser_(jhn_parser_alloc(callbacks(), nullptr, this))
+    {
+        if (!parser_) {
+            /* every next() returns this */
+            error_ = "out of memory";
+            done_ = true;
+            current_.type = event_type::error;
+            return;
+        }
+        for (unsigned int opt = 1; opt <= jhn_raw_strings;
+             opt <<= 1) {
+            if (flags & opt) {
+                jhn_parser_config(parser_, jhn_parser_option(opt), 1);
+            }
+        }
+    }
+    ~reader() { jhn_parser_free(parser_); }
+    reader(const reader &) = delete;
+    reader &operator=(const reader &) = delete;
+
+    void
+    push(std::string_view chunk)
+    {
+        assert(chunk_.empty());
+        chunk_ = chunk;
+        resume();
+    }
+
+    void
+    finish()
+    {
+        finished_ = true;
+        resume();
+    }
+
+    struct awaiter {
+        reader &r;
+
+        bool await_ready() { return r.produce(); }
+        void await_suspend(std::coroutine_handle<> h) { r.waiting_ = h; }
+        event await_resume() { return r.current_; }
+    };
+
+    /* the next event, suspends until more input is pushed if the
+       current chunk is used up */
+    awaiter next() { return awaiter{*this}; }
+
+    /* describes the error once next() returned an error event */
+    const std::string &error() const { return error_; }
+
+private:
+    /* tries to produce the next event in current_, false if more input
+       is needed first */
+    bool
+    produce()
+    {
+        jhn_parser_status_t stat;
+
+        if (done_) {
+            return true;
+        }
+        if (!chunk_.empty()) {
+            stat = jhn_parser_parse(parser_, chunk_.data(), chunk_.size());
+            if (stat == jhn_parser_status_paused) {
+                chunk_.remove_prefix(jhn_parser_get_bytes_consumed(parser_));
+                return true;
+            }
+            if (stat != jhn_parser_status_ok) {
+                return fail(chunk_);
+            }
+            /* everything was used, or is ignored trailing garbage */
+            chunk_ = std::string_view();
+        }
+        if (!finished_) {
+            return false;
+        }
+        stat = jhn_parser_finish(parser_);
+        if (stat == jhn_parser_status_paused) {
+            return true;
+        }
+        if (stat != jhn_parser_status_ok) {
+            return fail(std::string_view());
+        }
+        done_ = true;
+        current_ = event();
+        return true;
+    }
+
+    bool
+    fail(std::string_view chunk)
+    {
+        char *msg = jhn_parser_get_error(parser_, 0, chunk.data(),
+                                         chunk.size());
+        error_ = msg;
+        jhn_free(parser_, msg);
+        done_ = true;
+        current_ = event();
+        current_.type = event_type::error;
+        return true;
+    }
+
+    void
+    resume()
+    {
+        if (waiting_ && produce()) {
+            std::exchange(waiting_, nullptr).resume();
+        }
+    }
+
+    /* starts an event of the given type, which the callback fills in */
+    event &
+    emit(event_type type)
+    {
+        current_ = event();
+        current_.type = type;
+        jhn_parser_pause(parser_);
+        return current_;
+    }
+
+    static reader &self(void *ctx) { return *static_cast<reader *>(ctx); }
+
+    static const jhn_parser_callbacks_t *
+    callbacks()
+    {
+        static const jhn_parser_callbacks_t cbs = {
+            [](void *ctx) {
+                self(ctx).emit(event_type::null_value);
+                return 1;
+            },
+            [](void *ctx, int b) {
+                self(ctx).emit(event_type::bool_value).boolean = b != 0;
+                return 1;
+            },
+            [](void *ctx, long long i) {
+                self(ctx).emit(event_type::integer_value).integer = i;
+                return 1;
+            },
+            [](void *ctx, double d) {
+                self(ctx).emit(event_type::double_value).number = d;
+                return 1;
+            },
+            nullptr,
+            [](void *ctx, const char *str, size_t len) {
+                self(ctx).emit(event_type::string_value).string =
+                    std::string_view(str, len);
+                return 1;
+            },
+            [](void *ctx) {
+                self(ctx).emit(event_type::start_map);
+                return 1;
+            },
+            [](void *ctx, const char *str, size_t len) {
+                self(ctx).emit(event_type::key).string =
+                    std::string_view(str, len);
+                return 1;
+            },
+            [](void *ctx) {
+                self(ctx).emit(event_type::end_map);
+                return 1;
+            },
+            [](void *ctx) {
+                self(ctx).emit(event_type::start_array);
+                return 1;
+            },
+            [](void *ctx) {
+                self(ctx).emit(event_type::end_array);
+                return 1;
+            },
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr
+        };
+        return &cbs;
+    }
+
+    jhn_parser_t *parser_;
+    std::string_view chunk_;
+    bool finished_ = false;
+    bool done_ = false;
+    event current_;
+    std::string error_;
+    std::coroutine_handle<> waiting_;
+};
+
+#endif /* JHN_HAS_COROUTINES */
+
+} /* namespace johanson */
+
+#endif
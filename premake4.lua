@@ -27,6 +27,21 @@ project "johanson"
 		buildoptions { "-fvisibility=hidden" }
 	end
 
+	if _OPTIONS["with-stats"] then
+		defines { "JHN_STATS" }
+	end
+
+	if _OPTIONS["with-usdt"] then
+		defines { "JHN_ENABLE_USDT" }
+	end
+
+	if _OPTIONS["with-profile"] then
+		defines { "JHN_PROFILE" }
+		if not os.is('windows') then
+			buildoptions { "-fno-omit-frame-pointer" }
+		end
+	end
+
 	-- debug/release configurations
 	configuration "debug"
 		targetsuffix "-d"
@@ -53,3 +68,18 @@ newoption {
 	value = "PATH",
 	description = "Set the output location for the generated files"
 }
+
+newoption {
+	trigger = "with-stats",
+	description = "Keep the counters reported by jhn_parser_get_stats"
+}
+
+newoption {
+	trigger = "with-usdt",
+	description = "Add static tracepoints for perf and bpftrace (needs sys/sdt.h)"
+}
+
+newoption {
+	trigger = "with-profile",
+	description = "Keep frame pointers and the hot functions out of line"
+}
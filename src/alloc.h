@@ -9,4 +9,23 @@
 
 void jhn__set_default_alloc_funcs(jhn_alloc_funcs_t * yaf);
 
+/* allocation routines that need the size of the blocks they free keep
+   it in a header in front of every block.  The union keeps the memory
+   after the header aligned for any type. */
+typedef union {
+    struct {
+        size_t size;
+        /* how often the block was reallocated */
+        size_t reallocs;
+    } info;
+    long double d;
+    long long l;
+    void *p;
+} jhn__alloc_header_t;
+
+#define JHN__HEADER_SIZE sizeof(jhn__alloc_header_t)
+#define JHN__HEADER_OF(ptr) \
+    ((jhn__alloc_header_t *) ((char *) (ptr) - JHN__HEADER_SIZE))
+#define JHN__BLOCK_OF(hdr) ((void *) ((char *) (hdr) + JHN__HEADER_SIZE))
+
 #endif
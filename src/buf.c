@@ -1,6 +1,7 @@
 #include "common.h"
 
 #include "buf.h"
+#include "trace.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -16,18 +17,26 @@ struct jhn__buf_s {
 };
 
 
-static void
+/* makes room for want more bytes and the terminating zero, zero if
+   memory ran out, which leaves the buffer as it was */
+static int
 ensure_available(jhn__buf_t *buf, size_t want)
 {
     size_t need;
-    
+    char *data;
+
     assert(buf != NULL);
 
     /* first call */
     if (buf->data == NULL) {
+        data = JO_MALLOC(buf->alloc, JHN_BUF_INIT_SIZE);
+        if (!data) {
+            return 0;
+        }
+        buf->data = data;
         buf->len = JHN_BUF_INIT_SIZE;
-        buf->data = JO_MALLOC(buf->alloc, buf->len);
         buf->data[0] = 0;
+        JHN__TRACE2(buf__grow, buf, buf->len);
     }
 
     need = buf->len;
@@ -37,15 +46,24 @@ ensure_available(jhn__buf_t *buf, size_t want)
     }
 
     if (need != buf->len) {
-        buf->data = JO_REALLOC(buf->alloc, buf->data, need);
+        data = JO_REALLOC(buf->alloc, buf->data, need);
+        if (!data) {
+            return 0;
+        }
+        buf->data = data;
         buf->len = need;
+        JHN__TRACE2(buf__grow, buf, need);
     }
+    return 1;
 }
 
 jhn__buf_t *
 jhn__buf_alloc(jhn_alloc_funcs_t * alloc)
 {
     jhn__buf_t *b = JO_MALLOC(alloc, sizeof(struct jhn__buf_s));
+    if (!b) {
+        return NULL;
+    }
     memset(b, 0, sizeof(struct jhn__buf_s));
     b->alloc = alloc;
     return b;
@@ -64,7 +82,9 @@ jhn__buf_free(jhn__buf_t *buf)
 void
 jhn__buf_append(jhn__buf_t *buf, const void *data, size_t len)
 {
-    ensure_available(buf, len);
+    if (!ensure_available(buf, len)) {
+        return;
+    }
     if (len > 0) {
         assert(data);
         memcpy(buf->data + buf->used, data, len);
@@ -73,6 +93,12 @@ jhn__buf_append(jhn__buf_t *buf, const void *data, size_t len)
     }
 }
 
+int
+jhn__buf_reserve(jhn__buf_t *buf, size_t len)
+{
+    return ensure_available(buf, len);
+}
+
 void
 jhn__buf_clear(jhn__buf_t *buf)
 {
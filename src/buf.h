@@ -13,9 +13,14 @@ jhn__buf_t *jhn__buf_alloc(jhn_alloc_funcs_t *alloc);
 /* free the buffer */
 void jhn__buf_free(jhn__buf_t *buf);
 
-/* append a number of bytes to the buffer */
+/* append a number of bytes to the buffer, nothing is appended if
+   memory ran out */
 void jhn__buf_append(jhn__buf_t *buf, const void *data, size_t len);
 
+/* make room to append len bytes without allocating, zero if memory ran
+   out */
+int jhn__buf_reserve(jhn__buf_t *buf, size_t len);
+
 /* empty the buffer */
 void jhn__buf_clear(jhn__buf_t *buf);
 
@@ -3,7 +3,11 @@
 
 #include "common.h"
 
-#define JHN_BS_INC 128
+#include <string.h>
+
+/* the first few entries of a stack live inside the struct itself so
+   that shallow documents never allocate */
+#define JHN_BS_INLINE_SIZE 16
 
 typedef struct jhn_bytestack_t {
     /* memory allocation routines.  This needs to be first in the struct
@@ -12,19 +16,21 @@ typedef struct jhn_bytestack_t {
     unsigned char *stack;
     size_t size;
     size_t used;
+    unsigned char inline_stack[JHN_BS_INLINE_SIZE];
 } jhn__bytestack_t;
 
-/* initialize a bytestack */
+/* initialize a bytestack.  The stack points into itself afterwards so
+   it must not be moved once initialized. */
 #define jhn__bs_init(obs, _yaf) do {                        \
-    (obs).stack = NULL;                                     \
-    (obs).size = 0;                                         \
+    (obs).stack = (obs).inline_stack;                       \
+    (obs).size = JHN_BS_INLINE_SIZE;                        \
     (obs).used = 0;                                         \
     (obs).af = (_yaf);                                      \
 } while (0)
 
-/* initialize a bytestack */
+/* free a bytestack */
 #define jhn__bs_free(obs) do {                              \
-    if ((obs).stack) {                                      \
+    if ((obs).stack != (obs).inline_stack) {                \
         (obs).af->free_func((obs).af->ctx, (obs).stack);    \
     }                                                       \
 } while (0)
@@ -32,20 +38,48 @@ typedef struct jhn_bytestack_t {
 #define jhn__bs_current(obs) \
     (assert((obs).used > 0), (obs).stack[(obs).used - 1])
 
+#define jhn__bs_full(obs) ((obs).used == (obs).size)
+
+/* doubles the size of the stack, moving it to the heap the first time
+   the inline segment runs out.  The stack is left as it was if memory
+   ran out. */
+#define jhn__bs_grow(obs) do {                              \
+    size_t _size = (obs).size * 2;                          \
+    unsigned char *_stack;                                  \
+    if ((obs).stack == (obs).inline_stack) {                \
+        _stack = (obs).af->malloc_func((obs).af->ctx,       \
+            _size);                                         \
+        if (_stack) {                                       \
+            memcpy(_stack, (obs).inline_stack, (obs).used); \
+        }                                                   \
+    } else {                                                \
+        _stack = (obs).af->realloc_func((obs).af->ctx,      \
+            (void *) (obs).stack, _size);                   \
+    }                                                       \
+    if (_stack) {                                           \
+        (obs).stack = _stack;                               \
+        (obs).size = _size;                                 \
+    }                                                       \
+} while (0)
+
+/* pushes a byte.  It is dropped if the stack is full and cannot grow,
+   callers that need to know grow a full stack first and check
+   jhn__bs_full. */
 #define jhn__bs_push(obs, byte) do {                        \
     if (((obs).size - (obs).used) == 0) {                   \
-        (obs).size += JHN_BS_INC;                           \
-        (obs).stack = (obs).af->realloc_func((obs).af->ctx, \
-            (void *) (obs).stack, (obs).size);              \
+        jhn__bs_grow(obs);                                  \
+    }                                                       \
+    if (!jhn__bs_full(obs)) {                               \
+        (obs).stack[((obs).used)++] = (byte);               \
     }                                                       \
-    (obs).stack[((obs).used)++] = (byte);                   \
 } while (0)
 
+
 /* removes the top item of the stack, returns nothing */
 #define jhn__bs_pop(obs) do { ((obs).used)--; } while (0)
 
 #define jhn__bs_set(obs, byte)                              \
-    (obs).stack[((obs).used) - 1] = (byte);
+    (obs).stack[((obs).used) - 1] = (byte)
 
 
 #endif
@@ -0,0 +1,482 @@
+#include "common.h"
+
+#include "alloc.h"
+#include "buf.h"
+#include "encode.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Decodes CBOR (RFC 8949) into generator calls.  Input can arrive in
+   chunks of any size; an item that is cut off at the end of a chunk is
+   kept until the rest of it arrives.  Byte strings are written as
+   unpadded base64url strings, tags are skipped and non-finite floats
+   become null since JSON has no way to express them. */
+
+/* an open array or map */
+typedef struct {
+    /* items left in a definite length container */
+    unsigned long long remaining;
+    int indefinite;
+    int is_map;
+    /* items seen so far, in maps keys are at even positions */
+    unsigned long long seen;
+} cbor_level;
+
+struct jhn_cbor_decoder_s {
+    /* memory allocation routines.  This needs to be first in the struct
+       so that jhn_free() works! */
+    jhn_alloc_funcs_t alloc;
+
+    jhn_gen_t *gen;
+    /* the start of an item that did not fit the previous chunk */
+    jhn__buf_t *carry;
+    /* the pieces of an indefinite length string */
+    jhn__buf_t *text;
+    jhn__buf_t *scratch;
+    /* major type of the indefinite length string being collected */
+    int in_string;
+    size_t values;
+
+    cbor_level *stack;
+    size_t depth;
+    size_t stack_size;
+
+    const char *error;
+};
+
+jhn_cbor_decoder_t *
+jhn_cbor_decoder_alloc(jhn_gen_t *gen, jhn_alloc_funcs_t *afs)
+{
+    jhn_cbor_decoder_t *dec = NULL;
+    jhn_alloc_funcs_t afs_buffer;
+
+    if (!afs) {
+        jhn__set_default_alloc_funcs(&afs_buffer);
+        afs = &afs_buffer;
+    }
+
+    dec = JO_MALLOC(afs, sizeof(struct jhn_cbor_decoder_s));
+    if (!dec)
+        return NULL;
+
+    memset(dec, 0, sizeof(struct jhn_cbor_decoder_s));
+    dec->alloc = *afs;
+    dec->gen = gen;
+    dec->carry = jhn__buf_alloc(&(dec->alloc));
+    dec->text = jhn__buf_alloc(&(dec->alloc));
+    dec->scratch = jhn__buf_alloc(&(dec->alloc));
+    if (!dec->carry || !dec->text || !dec->scratch) {
+        jhn_cbor_decoder_free(dec);
+        return NULL;
+    }
+
+    return dec;
+}
+
+void
+jhn_cbor_decoder_free(jhn_cbor_decoder_t *dec)
+{
+    if (dec) {
+        if (dec->carry) {
+            jhn__buf_free(dec->carry);
+        }
+        if (dec->text) {
+            jhn__buf_free(dec->text);
+        }
+        if (dec->scratch) {
+            jhn__buf_free(dec->scratch);
+        }
+        if (dec->stack) {
+            JO_FREE(&(dec->alloc), dec->stack);
+        }
+        JO_FREE(&(dec->alloc), dec);
+    }
+}
+
+const char *
+jhn_cbor_decoder_get_error(jhn_cbor_decoder_t *dec)
+{
+    return dec->error;
+}
+
+/* results of decoding a single item */
+#define ITEM_ERROR -1
+#define ITEM_NEED_MORE 0
+#define ITEM_OK 1
+
+#define FAIL(msg) do { dec->error = (msg); return ITEM_ERROR; } while (0)
+
+#define GEN_CHK(expr) do {                                  \
+    if ((expr) != jhn_gen_status_ok) {                      \
+        FAIL("generator error");                            \
+    }                                                       \
+} while (0)
+
+static int
+is_key(jhn_cbor_decoder_t *dec)
+{
+    cbor_level *top;
+    if (dec->depth == 0) {
+        return 0;
+    }
+    top = &(dec->stack[dec->depth - 1]);
+    return top->is_map && (top->seen % 2) == 0;
+}
+
+/* called after every complete item, closes definite length containers
+   that are full */
+static int
+item_done(jhn_cbor_decoder_t *dec)
+{
+    while (dec->depth > 0) {
+        cbor_level *top = &(dec->stack[dec->depth - 1]);
+        top->seen++;
+        if (top->indefinite || --(top->remaining) > 0) {
+            return ITEM_OK;
+        }
+        dec->depth--;
+        GEN_CHK(top->is_map ? jhn_gen_map_close(dec->gen)
+                            : jhn_gen_array_close(dec->gen));
+    }
+    dec->values++;
+    return ITEM_OK;
+}
+
+/* scalars in key position are turned into strings */
+static int
+emit_number(jhn_cbor_decoder_t *dec, const char *num, size_t len)
+{
+    if (is_key(dec)) {
+        GEN_CHK(jhn_gen_string(dec->gen, num, len));
+    } else {
+        GEN_CHK(jhn_gen_number(dec->gen, num, len));
+    }
+    return item_done(dec);
+}
+
+static int
+emit_literal(jhn_cbor_decoder_t *dec, const char *lit)
+{
+    if (is_key(dec)) {
+        GEN_CHK(jhn_gen_string(dec->gen, lit, strlen(lit)));
+    } else if (lit[0] == 'n') {
+        GEN_CHK(jhn_gen_null(dec->gen));
+    } else {
+        GEN_CHK(jhn_gen_bool(dec->gen, lit[0] == 't'));
+    }
+    return item_done(dec);
+}
+
+static int
+emit_double(jhn_cbor_decoder_t *dec, double d)
+{
+    char num[32];
+    if (d != d || d == HUGE_VAL || d == -HUGE_VAL) {
+        return emit_literal(dec, "null");
+    }
+    return emit_number(dec, num, jhn__double_format(num, d));
+}
+
+static int
+emit_half(jhn_cbor_decoder_t *dec, unsigned int half)
+{
+    int exp = (half >> 10) & 0x1f;
+    int mant = half & 0x3ff;
+    double d;
+
+    if (exp == 31) {
+        /* infinity or NaN */
+        return emit_literal(dec, "null");
+    } else if (exp == 0) {
+        d = ldexp(mant, -24);
+    } else {
+        d = ldexp(mant + 1024, exp - 25);
+    }
+    return emit_double(dec, (half & 0x8000) ? -d : d);
+}
+
+static int
+emit_string(jhn_cbor_decoder_t *dec, int major, const char *str,
+            size_t len)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    if (major == 2) {
+        const unsigned char *b = (const unsigned char *) str;
+        char out[4];
+        size_t i;
+
+        jhn__buf_clear(dec->scratch);
+        for (i = 0; i + 2 < len; i += 3) {
+            out[0] = alphabet[b[i] >> 2];
+            out[1] = alphabet[((b[i] & 0x03) << 4) | (b[i + 1] >> 4)];
+            out[2] = alphabet[((b[i + 1] & 0x0f) << 2) | (b[i + 2] >> 6)];
+            out[3] = alphabet[b[i + 2] & 0x3f];
+            jhn__buf_append(dec->scratch, out, 4);
+        }
+        if (len - i == 1) {
+            out[0] = alphabet[b[i] >> 2];
+            out[1] = alphabet[(b[i] & 0x03) << 4];
+            jhn__buf_append(dec->scratch, out, 2);
+        } else if (len - i == 2) {
+            out[0] = alphabet[b[i] >> 2];
+            out[1] = alphabet[((b[i] & 0x03) << 4) | (b[i + 1] >> 4)];
+            out[2] = alphabet[(b[i + 1] & 0x0f) << 2];
+            jhn__buf_append(dec->scratch, out, 3);
+        }
+        str = jhn__buf_data(dec->scratch);
+        len = jhn__buf_len(dec->scratch);
+    }
+    GEN_CHK(jhn_gen_string(dec->gen, str, len));
+    return item_done(dec);
+}
+
+static int
+push_level(jhn_cbor_decoder_t *dec, int is_map, int indefinite,
+           unsigned long long count)
+{
+    cbor_level *level;
+
+    if (dec->depth == dec->stack_size) {
+        size_t size = dec->stack_size ? dec->stack_size * 2 : 16;
+        cbor_level *stack = JO_REALLOC(&(dec->alloc), dec->stack,
+                                       size * sizeof(cbor_level));
+        if (!stack) {
+            FAIL("out of memory");
+        }
+        dec->stack = stack;
+        dec->stack_size = size;
+    }
+    GEN_CHK(is_map ? jhn_gen_map_open(dec->gen)
+                   : jhn_gen_array_open(dec->gen));
+    level = &(dec->stack[dec->depth++]);
+    level->is_map = is_map;
+    level->indefinite = indefinite;
+    level->remaining = is_map ? count * 2 : count;
+    level->seen = 0;
+
+    if (!indefinite && count == 0) {
+        dec->depth--;
+        GEN_CHK(is_map ? jhn_gen_map_close(dec->gen)
+                       : jhn_gen_array_close(dec->gen));
+        return item_done(dec);
+    }
+    return ITEM_OK;
+}
+
+static int
+decode_break(jhn_cbor_decoder_t *dec)
+{
+    cbor_level *top;
+
+    if (dec->in_string) {
+        int major = dec->in_string;
+        dec->in_string = 0;
+        return emit_string(dec, major, jhn__buf_data(dec->text),
+                           jhn__buf_len(dec->text));
+    }
+    if (dec->depth == 0 || !dec->stack[dec->depth - 1].indefinite) {
+        FAIL("unexpected break");
+    }
+    top = &(dec->stack[--dec->depth]);
+    if (top->is_map && (top->seen % 2) != 0) {
+        FAIL("map key without value");
+    }
+    GEN_CHK(top->is_map ? jhn_gen_map_close(dec->gen)
+                        : jhn_gen_array_close(dec->gen));
+    return item_done(dec);
+}
+
+/* decodes the item at the start of data.  On success *used is set to
+   the number of bytes it took. */
+static int
+decode_item(jhn_cbor_decoder_t *dec, const unsigned char *data, size_t len,
+            size_t *used)
+{
+    int major = data[0] >> 5;
+    int info = data[0] & 0x1f;
+    unsigned long long val = 0;
+    size_t head = 1;
+    int indefinite = 0;
+    char num[32];
+
+    if (data[0] == 0xff) {
+        *used = 1;
+        return decode_break(dec);
+    }
+
+    if (info < 24) {
+        val = info;
+    } else if (info <= 27) {
+        size_t i, size = (size_t) 1 << (info - 24);
+        if (len < 1 + size) {
+            return ITEM_NEED_MORE;
+        }
+        for (i = 0; i < size; i++) {
+            val = (val << 8) | data[1 + i];
+        }
+        head += size;
+    } else if (info == 31 && major >= 2 && major <= 5) {
+        indefinite = 1;
+    } else {
+        FAIL("invalid additional information");
+    }
+
+    /* inside an indefinite length string only definite length strings
+       of the same type may follow */
+    if (dec->in_string) {
+        if (major != dec->in_string || indefinite) {
+            FAIL("invalid chunk in indefinite length string");
+        }
+        if (len - head < val) {
+            return ITEM_NEED_MORE;
+        }
+        jhn__buf_append(dec->text, data + head, (size_t) val);
+        *used = head + (size_t) val;
+        return ITEM_OK;
+    }
+
+    /* a new document after a complete one */
+    if (dec->depth == 0 && dec->values > 0 && major != 6) {
+        GEN_CHK(jhn_gen_reset(dec->gen, "\n"));
+        dec->values = 0;
+    }
+
+    *used = head;
+    switch (major) {
+        case 0:
+            if (val <= LLONG_MAX && !is_key(dec)) {
+                GEN_CHK(jhn_gen_integer(dec->gen, (long long) val));
+                return item_done(dec);
+            }
+            return emit_number(dec, num, sprintf(num, "%llu", val));
+        case 1:
+            if (val <= LLONG_MAX && !is_key(dec)) {
+                GEN_CHK(jhn_gen_integer(dec->gen, -1 - (long long) val));
+                return item_done(dec);
+            }
+            if (val == ULLONG_MAX) {
+                return emit_number(dec, "-18446744073709551616", 21);
+            }
+            return emit_number(dec, num, sprintf(num, "-%llu", val + 1));
+        case 2:
+        case 3:
+            if (indefinite) {
+                dec->in_string = major;
+                jhn__buf_clear(dec->text);
+                return ITEM_OK;
+            }
+            if (len - head < val) {
+                return ITEM_NEED_MORE;
+            }
+            *used = head + (size_t) val;
+            return emit_string(dec, major, (const char *) data + head,
+                               (size_t) val);
+        case 4:
+        case 5:
+            if (is_key(dec)) {
+                FAIL("unsupported map key");
+            }
+            return push_level(dec, major == 5, indefinite, val);
+        case 6:
+            /* the tagged item follows, the tag itself is dropped */
+            return ITEM_OK;
+        default:
+            switch (info) {
+                case 20:
+                    return emit_literal(dec, "false");
+                case 21:
+                    return emit_literal(dec, "true");
+                case 25:
+                    return emit_half(dec, (unsigned int) val);
+                case 26: {
+                    unsigned int bits = (unsigned int) val;
+                    float f;
+                    memcpy(&f, &bits, sizeof(f));
+                    return emit_double(dec, f);
+                }
+                case 27: {
+                    double d;
+                    memcpy(&d, &val, sizeof(d));
+                    return emit_double(dec, d);
+                }
+                default:
+                    /* null, undefined and unassigned simple values */
+                    return emit_literal(dec, "null");
+            }
+    }
+}
+
+/* decodes as many complete items as possible, returns the number of
+   bytes used or (size_t) -1 on errors */
+static size_t
+decode_items(jhn_cbor_decoder_t *dec, const unsigned char *data, size_t len)
+{
+    size_t pos = 0;
+    size_t used;
+    int rv;
+
+    while (pos < len) {
+        rv = decode_item(dec, data + pos, len - pos, &used);
+        if (rv == ITEM_ERROR) {
+            return (size_t) -1;
+        } else if (rv == ITEM_NEED_MORE) {
+            break;
+        }
+        pos += used;
+    }
+    return pos;
+}
+
+jhn_parser_status_t
+jhn_cbor_decoder_parse(jhn_cbor_decoder_t *dec, const unsigned char *data,
+                       size_t len)
+{
+    size_t used;
+
+    if (dec->error) {
+        return jhn_parser_status_error;
+    }
+
+    if (jhn__buf_len(dec->carry) == 0) {
+        used = decode_items(dec, data, len);
+        if (used == (size_t) -1) {
+            return jhn_parser_status_error;
+        }
+        jhn__buf_append(dec->carry, data + used, len - used);
+    } else {
+        size_t carry_len;
+        char *carry;
+
+        jhn__buf_append(dec->carry, data, len);
+        carry = (char *) jhn__buf_data(dec->carry);
+        carry_len = jhn__buf_len(dec->carry);
+        used = decode_items(dec, (const unsigned char *) carry, carry_len);
+        if (used == (size_t) -1) {
+            return jhn_parser_status_error;
+        }
+        if (used > 0) {
+            memmove(carry, carry + used, carry_len - used);
+            jhn__buf_truncate(dec->carry, carry_len - used);
+        }
+    }
+
+    return jhn_parser_status_ok;
+}
+
+jhn_parser_status_t
+jhn_cbor_decoder_finish(jhn_cbor_decoder_t *dec)
+{
+    if (dec->error) {
+        return jhn_parser_status_error;
+    }
+    if (jhn__buf_len(dec->carry) > 0 || dec->depth > 0 || dec->in_string) {
+        dec->error = "premature end of input";
+        return jhn_parser_status_error;
+    }
+    return jhn_parser_status_ok;
+}
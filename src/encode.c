@@ -224,3 +224,20 @@ jhn__string_validate_utf8(const char *str, size_t len)
     
     return 1;
 }
+
+size_t
+jhn__double_format(char *buf, double d)
+{
+    size_t len;
+    int precision = 15;
+
+    do {
+        len = sprintf(buf, "%.*g", precision, d);
+    } while (precision++ < 17 && strtod(buf, NULL) != d);
+    /* make sure it still reads as a double */
+    if (strspn(buf, "0123456789-") == len) {
+        strcpy(buf + len, ".0");
+        len += 2;
+    }
+    return len;
+}
@@ -12,4 +12,8 @@ void jhn__string_decode(jhn__buf_t *buf, const char *str, size_t length);
 
 int jhn__string_validate_utf8(const char *s, size_t len);
 
+/* formats a finite double with the fewest digits that convert back to
+   the same value.  buf needs room for at least 32 bytes. */
+size_t jhn__double_format(char *buf, double d);
+
 #endif
@@ -7,18 +7,21 @@
 
 #include "buf.h"
 #include "encode.h"
+#include "sink.h"
+#include "bytestack.h"
+#include "gen.h"
+#include "stats.h"
+#include "trace.h"
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
 #include <stdarg.h>
 
-/* the maximum depth the generator supports.  This is compiled into the
-   library at the moment. */
-#ifndef JHN_MAX_DEPTH
-#  define JHN_MAX_DEPTH 255
-#endif
+/* the generator nests as deep as memory allows.  JHN_MAX_DEPTH can be
+   defined at compile time to restore a fixed limit. */
 
 
 typedef enum {
@@ -32,20 +35,129 @@ typedef enum {
     jhn_gen_error
 } jhn_gen_state;
 
+/* a caller provided buffer we generate into (jhn_gen_output_buffer) */
+typedef struct {
+    char *data;
+    size_t cap;
+    size_t used;
+    /* set when a write did not fit */
+    int full;
+    /* the bytes of the writes that did not fit */
+    size_t dropped;
+} jhn_gen_fixed_buf;
+
 struct jhn_gen_s {
     /* memory allocation routines.  This needs to be first in the struct
        so that jhn_free() works! */
     jhn_alloc_funcs_t alloc;
 
     unsigned int flags;
-    unsigned int depth;
     const char *indent_string;
     size_t indent_string_len;
-    jhn_gen_state state[JHN_MAX_DEPTH];
+    /* a newline followed by indent_string repeated indent_cache_depth
+       times, so that indenting a line takes a single print */
+    char *indent_cache;
+    size_t indent_cache_depth;
+    /* one jhn_gen_state per open container plus the document itself */
+    jhn__bytestack_t state_stack;
     jhn_print_t print;
     void *ctx;
+    jhn_gen_fixed_buf fixed;
+    /* the counters behind jhn_gen_get_stats, only kept with JHN_STATS */
+    size_t values;
+    size_t bytes;
+    size_t max_depth;
+};
+
+struct jhn_gen_key_s {
+    /* memory allocation routines.  This needs to be first in the struct
+       so that jhn_free() works! */
+    jhn_alloc_funcs_t alloc;
+
+    /* the quoted and escaped key */
+    char *data;
+    size_t len;
 };
 
+/* the state of the generator before a value is generated */
+typedef struct {
+    size_t used;
+    size_t depth;
+    jhn_gen_state state;
+    jhn_gen_state parent_state;
+    /* the stats counters, which the value must not change either */
+    size_t values;
+    size_t bytes;
+    size_t max_depth;
+} jhn_gen_checkpoint;
+
+static void
+fixed_buf_append(jhn_gen_fixed_buf *fb, const void *data, size_t len)
+{
+    /* we always keep room for the terminating null byte */
+    if (fb->full || len >= fb->cap - fb->used) {
+        fb->full = fb->full || len > 0;
+        fb->dropped += len;
+        return;
+    }
+    memcpy(fb->data + fb->used, data, len);
+    fb->used += len;
+    fb->data[fb->used] = 0;
+}
+
+#define USES_BUF(g) ((g)->print == (jhn_print_t)&jhn__buf_append)
+#define USES_FDSINK(g) ((g)->print == (jhn_print_t)&jhn__fdsink_append)
+#define USES_FIXED_BUF(g) ((g)->print == (jhn_print_t)&fixed_buf_append)
+
+#ifdef JHN_STATS
+/* passes output on to the print function, counting it */
+static void
+print_counted(void *ctx, const char *str, size_t len)
+{
+    jhn_gen_t *g = (jhn_gen_t *) ctx;
+    g->bytes += len;
+    g->print(g->ctx, str, len);
+}
+#  define PRINT_FUNC(g) ((jhn_print_t) &print_counted)
+#  define PRINT_CTX(g) ((void *) (g))
+#else
+#  define PRINT_FUNC(g) ((g)->print)
+#  define PRINT_CTX(g) ((g)->ctx)
+#endif
+
+/* all output goes through here */
+#define PRINT(g, str, len) PRINT_FUNC(g)(PRINT_CTX(g), (str), (len))
+
+/* frees whatever internal output the generator writes to */
+static void
+release_output(jhn_gen_t *g)
+{
+    if (USES_BUF(g)) {
+        jhn__buf_free((jhn__buf_t *)g->ctx);
+    } else if (USES_FDSINK(g)) {
+        jhn__fdsink_free((jhn__fdsink_t *)g->ctx);
+    }
+    g->print = NULL;
+    g->ctx = NULL;
+}
+
+/* forgets the cached indentation, for instance when the indent string
+   changes.  The fd sink might still reference it so that is written
+   out first. */
+static void
+drop_indent_cache(jhn_gen_t *g)
+{
+    if (USES_FDSINK(g) &&
+        jhn__fdsink_has_references((jhn__fdsink_t *)g->ctx)) {
+        jhn__fdsink_flush((jhn__fdsink_t *)g->ctx);
+    }
+    if (g->indent_cache) {
+        JO_FREE(&(g->alloc), g->indent_cache);
+    }
+    g->indent_cache = NULL;
+    g->indent_cache_depth = 0;
+}
+
 int
 jhn_gen_config(jhn_gen_t *g, jhn_gen_option_t opt, ...)
 {
@@ -62,15 +174,42 @@ jhn_gen_config(jhn_gen_t *g, jhn_gen_option_t opt, ...)
             break;
         case jhn_gen_indent_string: {
             const char *indent = va_arg(ap, const char *);
+            drop_indent_cache(g);
             g->indent_string = indent;
             g->indent_string_len = strlen(indent);
             break;
         }
         case jhn_gen_print_callback:
-            jhn__buf_free(g->ctx);
+            release_output(g);
             g->print = va_arg(ap, const jhn_print_t);
             g->ctx = va_arg(ap, void *);
             break;
+        case jhn_gen_output_buffer:
+            release_output(g);
+            g->fixed.data = va_arg(ap, char *);
+            g->fixed.cap = va_arg(ap, size_t);
+            g->fixed.used = 0;
+            g->fixed.full = 0;
+            g->fixed.dropped = 0;
+            if (g->fixed.cap > 0) {
+                g->fixed.data[0] = 0;
+            }
+            g->print = (jhn_print_t)&fixed_buf_append;
+            g->ctx = &(g->fixed);
+            break;
+        case jhn_gen_output_fd: {
+            int fd = va_arg(ap, int);
+            jhn__fdsink_t *sink = jhn__fdsink_alloc(&(g->alloc), fd);
+            /* without a sink the current output stays */
+            if (!sink) {
+                rv = 0;
+                break;
+            }
+            release_output(g);
+            g->print = (jhn_print_t)&jhn__fdsink_append;
+            g->ctx = sink;
+            break;
+        }
         default:
             rv = 0;
     }
@@ -82,8 +221,8 @@ jhn_gen_config(jhn_gen_t *g, jhn_gen_option_t opt, ...)
 
 
 
-jhn_gen_t *
-jhn_gen_alloc(const jhn_alloc_funcs_t *afs)
+static jhn_gen_t *
+alloc_gen(const jhn_alloc_funcs_t *afs)
 {
     jhn_gen_t *g = NULL;
     jhn_alloc_funcs_t afs_buffer;
@@ -102,61 +241,87 @@ jhn_gen_alloc(const jhn_alloc_funcs_t *afs)
     /* copy in pointers to allocation routines */
     g->alloc = *afs;
 
-    g->print = (jhn_print_t)&jhn__buf_append;
-    g->ctx = jhn__buf_alloc(&(g->alloc));
     g->indent_string = "  ";
     g->indent_string_len = 2;
 
+    jhn__bs_init(g->state_stack, &(g->alloc));
+    jhn__bs_push(g->state_stack, jhn_gen_start);
+
+    return g;
+}
+
+jhn_gen_t *
+jhn_gen_alloc(const jhn_alloc_funcs_t *afs)
+{
+    jhn_gen_t *g = alloc_gen(afs);
+    if (!g)
+        return NULL;
+
+    g->print = (jhn_print_t)&jhn__buf_append;
+    g->ctx = jhn__buf_alloc(&(g->alloc));
+
+    return g;
+}
+
+jhn_gen_t *
+jhn_gen_alloc_into(const jhn_alloc_funcs_t *afs, char *buf, size_t cap)
+{
+    jhn_gen_t *g = alloc_gen(afs);
+    if (!g)
+        return NULL;
+
+    jhn_gen_config(g, jhn_gen_output_buffer, buf, cap);
+
     return g;
 }
 
 void
-jhn_gen_reset(jhn_gen_t *g, const char *sep)
+jhn_gen_get_stats(jhn_gen_t *g, jhn_gen_stats_t *stats)
 {
-    g->depth = 0;
-    memset(&(g->state), 0, sizeof(g->state));
-    if (sep != NULL) {
-        g->print(g->ctx, sep, strlen(sep));
-    }
+    stats->values = g->values;
+    stats->bytes = g->bytes;
+    stats->max_depth = g->max_depth;
 }
 
 void
 jhn_gen_free(jhn_gen_t *g)
 {
     if (g) {
-        if (g->print == (jhn_print_t)&jhn__buf_append) {
-            jhn__buf_free((jhn__buf_t *)g->ctx);
-        }
+        release_output(g);
+        drop_indent_cache(g);
+        jhn__bs_free(g->state_stack);
         JO_FREE(&(g->alloc), g);
     }
 }
 
+/* the state of the innermost open container and how many are open */
+#define STATE ((jhn_gen_state) jhn__bs_current(g->state_stack))
+#define SET_STATE(s) jhn__bs_set(g->state_stack, (unsigned char) (s))
+#define DEPTH (g->state_stack.used - 1)
+
 #define INSERT_SEP do {                                                 \
-    if (g->state[g->depth] == jhn_gen_map_key ||                        \
-        g->state[g->depth] == jhn_gen_in_array) {                       \
-        g->print(g->ctx, ",", 1);                                       \
-        if ((g->flags & jhn_gen_beautify)) g->print(g->ctx, "\n", 1);   \
-    } else if (g->state[g->depth] == jhn_gen_map_val) {                 \
-        g->print(g->ctx, ":", 1);                                       \
-        if ((g->flags & jhn_gen_beautify)) g->print(g->ctx, " ", 1);    \
+    if (STATE == jhn_gen_map_key ||                                     \
+        STATE == jhn_gen_in_array) {                                    \
+        PRINT(g, ",", 1);                                               \
+    } else if (STATE == jhn_gen_map_val) {                              \
+        if ((g->flags & jhn_gen_beautify)) PRINT(g, ": ", 2);           \
+        else PRINT(g, ":", 1);                                          \
+    } else if (STATE == jhn_gen_start) {                                \
+        JHN__TRACE1(gen__start, g);                                     \
    }                                                                    \
 } while (0)
 
+/* when beautifying every value in a container starts on a new line */
 #define INSERT_WHITESPACE do {                                          \
-    if ((g->flags & jhn_gen_beautify)) {                                \
-        if (g->state[g->depth] != jhn_gen_map_val) {                    \
-            unsigned int _i;                                            \
-            for (_i=0;_i<g->depth;_i++)                                 \
-                g->print(g->ctx,                                        \
-                         g->indent_string,                              \
-                         g->indent_string_len);                         \
-        }                                                               \
+    if ((g->flags & jhn_gen_beautify) &&                                \
+        STATE != jhn_gen_map_val && STATE != jhn_gen_start) {           \
+        print_newline_indent(g, DEPTH);                                 \
     }                                                                   \
 } while (0)
 
 #define ENSURE_NOT_KEY do {                             \
-    if (g->state[g->depth] == jhn_gen_map_key ||        \
-        g->state[g->depth] == jhn_gen_map_start)  {     \
+    if (STATE == jhn_gen_map_key ||                     \
+        STATE == jhn_gen_map_start)  {                  \
         return jhn_gen_keys_must_be_strings;            \
     }                                                   \
 } while (0)
@@ -164,45 +329,192 @@ jhn_gen_free(jhn_gen_t *g)
 /* check that we're not complete, or in error state.  in a valid state
  * to be generating */
 #define ENSURE_VALID_STATE do {                             \
-    if (g->state[g->depth] == jhn_gen_error) {              \
+    if (STATE == jhn_gen_error) {                           \
         return jhn_gen_in_error_state;                      \
-    } else if (g->state[g->depth] == jhn_gen_complete) {    \
+    } else if (STATE == jhn_gen_complete) {                 \
         return jhn_gen_generation_complete;                 \
     }                                                       \
 } while (0)
 
-#define INCREMENT_DEPTH do { \
-    if (++(g->depth) >= JHN_MAX_DEPTH) return jhn_max_depth_exceeded; \
+#ifdef JHN_MAX_DEPTH
+#  define CHECK_MAX_DEPTH do {                                      \
+    if (DEPTH + 1 >= JHN_MAX_DEPTH) return jhn_max_depth_exceeded;  \
 } while (0)
+#else
+#  define CHECK_MAX_DEPTH do {} while (0)
+#endif
 
-#define DECREMENT_DEPTH do { \
-    if (--(g->depth) >= JHN_MAX_DEPTH) return jhn_gen_generation_complete; \
+/* opens a container in the given state.  Running out of memory for
+   the state stack leaves the generator in the error state. */
+#define INCREMENT_DEPTH(s) do {                                     \
+    CHECK_MAX_DEPTH;                                                \
+    if (jhn__bs_full(g->state_stack)) {                             \
+        jhn__bs_grow(g->state_stack);                               \
+        if (jhn__bs_full(g->state_stack)) {                         \
+            SET_STATE(jhn_gen_error);                               \
+            return jhn_gen_in_error_state;                          \
+        }                                                           \
+    }                                                               \
+    jhn__bs_push(g->state_stack, (unsigned char) (s));              \
+    JHN__STAT(if (DEPTH > g->max_depth) g->max_depth = DEPTH);      \
+} while (0)
+
+#define DECREMENT_DEPTH do {                                        \
+    if (DEPTH == 0) return jhn_gen_generation_complete;             \
+    jhn__bs_pop(g->state_stack);                                    \
 } while (0)
 
 #define APPENDED_ATOM do {                          \
-    switch (g->state[g->depth]) {                   \
+    JHN__STAT(g->values++);                         \
+    switch (STATE) {                                \
         case jhn_gen_start:                         \
-            g->state[g->depth] = jhn_gen_complete;  \
+            SET_STATE(jhn_gen_complete);            \
+            JHN__TRACE1(gen__end, g);               \
             break;                                  \
         case jhn_gen_map_start:                     \
         case jhn_gen_map_key:                       \
-            g->state[g->depth] = jhn_gen_map_val;   \
+            SET_STATE(jhn_gen_map_val);             \
             break;                                  \
         case jhn_gen_array_start:                   \
-            g->state[g->depth] = jhn_gen_in_array;  \
+            SET_STATE(jhn_gen_in_array);            \
             break;                                  \
         case jhn_gen_map_val:                       \
-            g->state[g->depth] = jhn_gen_map_key;   \
+            SET_STATE(jhn_gen_map_key);             \
             break;                                  \
         default:                                    \
             break;                                  \
     }                                               \
 } while (0)
 
+/* large strings are handed to the fd sink without copying them, so
+   they have to be written out before we return to the caller */
+#define FLUSH_REFERENCES do {                                   \
+    if (USES_FDSINK(g) &&                                       \
+        jhn__fdsink_has_references((jhn__fdsink_t *)g->ctx))    \
+        jhn__fdsink_flush((jhn__fdsink_t *)g->ctx);             \
+} while (0)
+
+static void
+print_newline_indent(jhn_gen_t *g, size_t depth)
+{
+    size_t len = g->indent_string_len;
+
+    if (g->indent_cache == NULL || depth > g->indent_cache_depth) {
+        size_t i, new_depth = g->indent_cache_depth * 2;
+        char *cache;
+        if (new_depth < depth) {
+            new_depth = depth < 8 ? 8 : depth;
+        }
+        /* the fd sink must not keep a reference to the old cache */
+        FLUSH_REFERENCES;
+        cache = JO_REALLOC(&(g->alloc), g->indent_cache,
+                           1 + new_depth * len);
+        if (!cache) {
+            /* the old cache stays, this line is printed level by
+               level */
+            PRINT(g, "\n", 1);
+            for (i = 0; i < depth; i++) {
+                PRINT(g, g->indent_string, len);
+            }
+            return;
+        }
+        JHN__TRACE2(gen__indent, g, 1 + new_depth * len);
+        g->indent_cache = cache;
+        g->indent_cache[0] = '\n';
+        for (i = g->indent_cache_depth; i < new_depth; i++) {
+            memcpy(g->indent_cache + 1 + i * len, g->indent_string, len);
+        }
+        g->indent_cache_depth = new_depth;
+    }
+    PRINT(g, g->indent_cache, 1 + depth * len);
+}
+
+/* closes a container in beautify mode.  Empty containers get an empty
+   line between their braces. */
+static void
+print_close_indent(jhn_gen_t *g, jhn_gen_state closed)
+{
+    if (closed == jhn_gen_map_start || closed == jhn_gen_array_start) {
+        PRINT(g, "\n", 1);
+    }
+    print_newline_indent(g, DEPTH);
+}
+
+/* with a fixed output buffer a value is either generated completely
+   or not at all.  SAVE_STATE remembers the state before anything is
+   written, RETURN_STATUS undoes everything if the buffer ran full.
+   Other outputs never run full, so they skip the checkpoint.  It has
+   to come last among the declarations. */
+#define SAVE_STATE jhn_gen_checkpoint _cp;                          \
+    if (USES_FIXED_BUF(g)) {                                        \
+        save_state(g, &_cp);                                        \
+    }
+#define RETURN_STATUS return restore_if_full(g, &_cp)
+
+static void
+save_state(jhn_gen_t *g, jhn_gen_checkpoint *cp)
+{
+    cp->used = g->fixed.used;
+    cp->depth = DEPTH;
+    cp->state = STATE;
+    cp->parent_state = DEPTH > 0 ?
+        (jhn_gen_state) g->state_stack.stack[DEPTH - 1] : jhn_gen_start;
+    cp->values = g->values;
+    cp->bytes = g->bytes;
+    cp->max_depth = g->max_depth;
+}
+
+static jhn_gen_status_t
+restore_if_full(jhn_gen_t *g, const jhn_gen_checkpoint *cp)
+{
+    size_t needed;
+
+    if (!USES_FIXED_BUF(g) || !g->fixed.full) {
+        return jhn_gen_status_ok;
+    }
+    /* what the value takes, with the null byte, in an empty buffer */
+    needed = g->fixed.used - cp->used + g->fixed.dropped + 1;
+    g->fixed.full = 0;
+    g->fixed.dropped = 0;
+    g->fixed.used = cp->used;
+    g->values = cp->values;
+    g->bytes = cp->bytes;
+    g->max_depth = cp->max_depth;
+    if (g->fixed.cap > 0) {
+        g->fixed.data[g->fixed.used] = 0;
+    }
+    /* a container opened by the value is dropped again, one closed by
+       it is still in memory above the top of the stack */
+    g->state_stack.used = cp->depth + 1;
+    SET_STATE(cp->state);
+    if (cp->depth > 0) {
+        g->state_stack.stack[cp->depth - 1] = (unsigned char) cp->parent_state;
+    }
+    return needed > g->fixed.cap ? jhn_gen_value_too_large
+                                 : jhn_gen_buffer_full;
+}
+
+jhn_gen_status_t
+jhn_gen_reset(jhn_gen_t *g, const char *sep)
+{
+    jhn_gen_status_t status;
+    SAVE_STATE;
+    if (sep != NULL) {
+        PRINT(g, sep, strlen(sep));
+    }
+    /* the state is only reset once the separator is written */
+    status = restore_if_full(g, &_cp);
+    if (status == jhn_gen_status_ok) {
+        g->state_stack.used = 1;
+        jhn__bs_set(g->state_stack, jhn_gen_start);
+    }
+    return status;
+}
+
 #define FINAL_NEWLINE do { \
     if ((g->flags & jhn_gen_beautify) &&            \
-        g->state[g->depth] == jhn_gen_complete)     \
-        g->print(g->ctx, "\n", 1);                  \
+        STATE == jhn_gen_complete)     \
+        PRINT(g, "\n", 1);                          \
 } while (0)
 
 jhn_gen_status_t
@@ -210,12 +522,13 @@ jhn_gen_integer(jhn_gen_t *g, long long int number)
 {
     char i[32];
     size_t len;
+    SAVE_STATE;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
     len = sprintf(i, "%lld", number);
-    g->print(g->ctx, i, len);
+    PRINT(g, i, len);
     APPENDED_ATOM;
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    RETURN_STATUS;
 }
 
 #if defined(_WIN32) || defined(WIN32)
@@ -233,6 +546,7 @@ jhn_gen_double(jhn_gen_t *g, double number)
 {
     char i[32];
     size_t len;
+    SAVE_STATE;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY;
     if (isnan(number) || isinf(number)) {
         return jhn_gen_invalid_number;
@@ -242,25 +556,49 @@ jhn_gen_double(jhn_gen_t *g, double number)
     if (strspn(i, "0123456789-") == len) {
         strcat(i, ".0");
     }
-    g->print(g->ctx, i, len);
+    PRINT(g, i, len);
     APPENDED_ATOM;
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_number(jhn_gen_t *g, const char *s, size_t l)
 {
+    SAVE_STATE;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
-    g->print(g->ctx, s, l);
+    PRINT(g, s, l);
     APPENDED_ATOM;
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    FLUSH_REFERENCES;
+    RETURN_STATUS;
+}
+
+jhn_gen_status_t
+jhn_gen_raw_value(jhn_gen_t *g, const char *json, size_t len)
+{
+    SAVE_STATE;
+    ENSURE_VALID_STATE;
+    /* nothing would leave a separator without a value */
+    if (len == 0) {
+        return jhn_gen_invalid_string;
+    }
+    /* only a string can be spliced in as a key */
+    if (json[0] != '"') {
+        ENSURE_NOT_KEY;
+    }
+    INSERT_SEP; INSERT_WHITESPACE;
+    PRINT(g, json, len);
+    APPENDED_ATOM;
+    FINAL_NEWLINE;
+    FLUSH_REFERENCES;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_string(jhn_gen_t *g, const char *str, size_t len)
 {
+    SAVE_STATE;
     // if validation is enabled, check that the string is valid utf8
     // XXX: This checking could be done a little faster, in the same pass as
     // the string encoding
@@ -270,102 +608,172 @@ jhn_gen_string(jhn_gen_t *g, const char *str, size_t len)
         }
     }
     ENSURE_VALID_STATE; INSERT_SEP; INSERT_WHITESPACE;
-    g->print(g->ctx, "\"", 1);
-    jhn__string_encode(g->print, g->ctx, str, len, g->flags & jhn_gen_escape_solidus);
-    g->print(g->ctx, "\"", 1);
+    PRINT(g, "\"", 1);
+    jhn__string_encode(PRINT_FUNC(g), PRINT_CTX(g), str, len,
+                       g->flags & jhn_gen_escape_solidus);
+    PRINT(g, "\"", 1);
     APPENDED_ATOM;
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    FLUSH_REFERENCES;
+    RETURN_STATUS;
+}
+
+jhn_gen_key_t *
+jhn_gen_key_alloc(jhn_gen_t *g, const char *str, size_t len)
+{
+    jhn__buf_t *buf;
+    jhn_gen_key_t *key;
+    size_t encoded_len;
+
+    if (g->flags & jhn_gen_validate_utf8) {
+        if (!jhn__string_validate_utf8(str, len)) {
+            return NULL;
+        }
+    }
+
+    buf = jhn__buf_alloc(&(g->alloc));
+    jhn__buf_append(buf, "\"", 1);
+    jhn__string_encode((jhn_print_t)&jhn__buf_append, buf, str, len,
+                       g->flags & jhn_gen_escape_solidus);
+    jhn__buf_append(buf, "\"", 1);
+    encoded_len = jhn__buf_len(buf);
+
+    /* the encoded key is stored right behind the handle */
+    key = JO_MALLOC(&(g->alloc), sizeof(jhn_gen_key_t) + encoded_len);
+    if (key) {
+        key->alloc = g->alloc;
+        key->len = encoded_len;
+        key->data = (char *)(key + 1);
+        memcpy(key->data, jhn__buf_data(buf), encoded_len);
+    }
+    jhn__buf_free(buf);
+
+    return key;
+}
+
+void
+jhn_gen_key_free(jhn_gen_key_t *key)
+{
+    if (key) {
+        JO_FREE(&(key->alloc), key);
+    }
+}
+
+jhn_gen_status_t
+jhn_gen_key(jhn_gen_t *g, const jhn_gen_key_t *key)
+{
+    return jhn_gen_encoded_key(g, key->data, key->len);
+}
+
+jhn_gen_status_t
+jhn_gen_encoded_key(jhn_gen_t *g, const char *encoded, size_t len)
+{
+    SAVE_STATE;
+    ENSURE_VALID_STATE; INSERT_SEP; INSERT_WHITESPACE;
+    PRINT(g, encoded, len);
+    APPENDED_ATOM;
+    FINAL_NEWLINE;
+    FLUSH_REFERENCES;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_null(jhn_gen_t *g)
 {
+    SAVE_STATE;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
-    g->print(g->ctx, "null", 4);
+    PRINT(g, "null", 4);
     APPENDED_ATOM;
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_bool(jhn_gen_t *g, int boolean)
 {
+    SAVE_STATE;
 	ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
     if (boolean) {
-        g->print(g->ctx, "true", 4);
+        PRINT(g, "true", 4);
     } else {
-        g->print(g->ctx, "false", 5);
+        PRINT(g, "false", 5);
     }
     APPENDED_ATOM;
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_map_open(jhn_gen_t *g)
 {
+    SAVE_STATE;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
-    INCREMENT_DEPTH;
+    INCREMENT_DEPTH(jhn_gen_map_start);
 
-    g->state[g->depth] = jhn_gen_map_start;
-    g->print(g->ctx, "{", 1);
-    if ((g->flags & jhn_gen_beautify)) {
-        g->print(g->ctx, "\n", 1);
-    }
+    PRINT(g, "{", 1);
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_map_close(jhn_gen_t *g)
 {
+    jhn_gen_state closed;
+    SAVE_STATE;
     ENSURE_VALID_STATE;
+    closed = STATE;
     DECREMENT_DEPTH;
 
     if ((g->flags & jhn_gen_beautify)) {
-        g->print(g->ctx, "\n", 1);
+        print_close_indent(g, closed);
     }
     APPENDED_ATOM;
-    INSERT_WHITESPACE;
-    g->print(g->ctx, "}", 1);
+    PRINT(g, "}", 1);
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_array_open(jhn_gen_t *g)
 {
+    SAVE_STATE;
     ENSURE_VALID_STATE; ENSURE_NOT_KEY; INSERT_SEP; INSERT_WHITESPACE;
-    INCREMENT_DEPTH;
-    g->state[g->depth] = jhn_gen_array_start;
-    g->print(g->ctx, "[", 1);
-    if ((g->flags & jhn_gen_beautify)) {
-        g->print(g->ctx, "\n", 1);
-    }
+    INCREMENT_DEPTH(jhn_gen_array_start);
+    PRINT(g, "[", 1);
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_array_close(jhn_gen_t *g)
 {
+    jhn_gen_state closed;
+    SAVE_STATE;
     ENSURE_VALID_STATE;
+    closed = STATE;
     DECREMENT_DEPTH;
     if ((g->flags & jhn_gen_beautify)) {
-        g->print(g->ctx, "\n", 1);
+        print_close_indent(g, closed);
     }
     APPENDED_ATOM;
-    INSERT_WHITESPACE;
-    g->print(g->ctx, "]", 1);
+    PRINT(g, "]", 1);
     FINAL_NEWLINE;
-    return jhn_gen_status_ok;
+    RETURN_STATUS;
 }
 
 jhn_gen_status_t
 jhn_gen_get_buf(jhn_gen_t *g, const char **buf, size_t *len)
 {
-    if (g->print != (jhn_print_t)&jhn__buf_append) {
+    if (USES_FIXED_BUF(g)) {
+        if (buf) {
+            *buf = g->fixed.data;
+        }
+        if (len) {
+            *len = g->fixed.used;
+        }
+        return jhn_gen_status_ok;
+    }
+    if (!USES_BUF(g)) {
         return jhn_gen_no_buf;
     }
     if (buf) {
@@ -380,7 +788,61 @@ jhn_gen_get_buf(jhn_gen_t *g, const char **buf, size_t *len)
 void
 jhn_gen_clear(jhn_gen_t *g)
 {
-    if (g->print == (jhn_print_t)&jhn__buf_append) {
+    if (USES_BUF(g)) {
         jhn__buf_clear((jhn__buf_t *)g->ctx);
+    } else if (USES_FIXED_BUF(g)) {
+        g->fixed.used = 0;
+        g->fixed.full = 0;
+        g->fixed.dropped = 0;
+        if (g->fixed.cap > 0) {
+            g->fixed.data[0] = 0;
+        }
+    }
+}
+
+jhn_gen_status_t
+jhn_gen_flush(jhn_gen_t *g)
+{
+    if (!USES_FDSINK(g)) {
+        return jhn_gen_status_ok;
     }
+    switch (jhn__fdsink_flush((jhn__fdsink_t *)g->ctx)) {
+        case jhn__fdsink_blocked:
+            return jhn_gen_write_would_block;
+        case jhn__fdsink_failed:
+            return jhn_gen_write_failed;
+        default:
+            return jhn_gen_status_ok;
+    }
+}
+
+void
+jhn__gen_printer(jhn_gen_t *g, jhn_print_t *print, void **ctx)
+{
+    *print = PRINT_FUNC(g);
+    *ctx = PRINT_CTX(g);
+}
+
+int
+jhn__gen_beautify(jhn_gen_t *g)
+{
+    return (g->flags & jhn_gen_beautify) != 0;
+}
+
+void
+jhn__gen_newline_indent(jhn_gen_t *g, size_t depth)
+{
+    print_newline_indent(g, depth);
+}
+
+void
+jhn__gen_flush_references(jhn_gen_t *g)
+{
+    FLUSH_REFERENCES;
+}
+
+int
+jhn__gen_full(jhn_gen_t *g)
+{
+    return USES_FIXED_BUF(g) && g->fixed.full;
 }
@@ -0,0 +1,25 @@
+#ifndef JHN_GEN_H_INCLUDED
+#define JHN_GEN_H_INCLUDED
+
+#include "common.h"
+
+/* the raw output routines the reformatter (reformat.c) copies tokens
+   through.  They neither check nor change the state of the generator. */
+
+/* the print function and context all output of g goes through */
+void jhn__gen_printer(jhn_gen_t *g, jhn_print_t *print, void **ctx);
+
+/* whether g beautifies its output */
+int jhn__gen_beautify(jhn_gen_t *g);
+
+/* prints a newline followed by the indentation of depth levels */
+void jhn__gen_newline_indent(jhn_gen_t *g, size_t depth);
+
+/* writes out what the fd sink still references instead of having
+   copied it, before the printed text goes away */
+void jhn__gen_flush_references(jhn_gen_t *g);
+
+/* whether output was lost because a fixed output buffer ran full */
+int jhn__gen_full(jhn_gen_t *g);
+
+#endif
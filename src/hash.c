@@ -0,0 +1,42 @@
+#include "common.h"
+
+#include "hash.h"
+
+#include <string.h>
+
+#define HASH_M1 0x9e3779b97f4a7c15ULL
+#define HASH_M2 0xbf58476d1ce4e5b9ULL
+
+unsigned long long
+jhn__hash_mix(unsigned long long h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+unsigned long long
+jhn__hash(const void *data, size_t len, unsigned long long seed)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    unsigned long long h = seed ^ ((unsigned long long) len * HASH_M1);
+    unsigned long long v;
+
+    while (len >= 8) {
+        memcpy(&v, p, 8);
+        v *= HASH_M2;
+        h = (h ^ (v ^ (v >> 31))) * HASH_M1;
+        p += 8;
+        len -= 8;
+    }
+    if (len) {
+        v = 0;
+        memcpy(&v, p, len);
+        v *= HASH_M2;
+        h = (h ^ (v ^ (v >> 31))) * HASH_M1;
+    }
+    return jhn__hash_mix(h);
+}
@@ -0,0 +1,15 @@
+#ifndef JHN_HASH_H_INCLUDED
+#define JHN_HASH_H_INCLUDED
+
+#include "common.h"
+
+/* a fast 64 bit hash of len bytes.  Different seeds give independent
+   hashes.  The result depends on the byte order of the machine so it
+   must not be stored. */
+unsigned long long jhn__hash(const void *data, size_t len,
+                             unsigned long long seed);
+
+/* mixes the bits of h, usable to derive a second hash from the first */
+unsigned long long jhn__hash_mix(unsigned long long h);
+
+#endif
@@ -0,0 +1,211 @@
+#include "common.h"
+
+#include "alloc.h"
+#include "hash.h"
+
+#include <string.h>
+
+/* Interned strings live in large blocks that are never moved, so their
+   addresses stay valid until the table is cleared or freed.  Every
+   string is preceded by an entry header holding its hash and length
+   and followed by a terminating zero.  An open addressing table of
+   entry pointers finds the strings again. */
+
+#define INTERN_BLOCK_SIZE 16384
+#define INTERN_INIT_TABLE 256
+#define INTERN_ALIGN(n) (((n) + 7) & ~(size_t) 7)
+
+typedef struct intern_block_s {
+    struct intern_block_s *next;
+    size_t used;
+    size_t size;
+} intern_block;
+
+typedef struct {
+    unsigned long long hash;
+    size_t len;
+} intern_entry;
+
+struct jhn_intern_s {
+    /* memory allocation routines.  This needs to be first in the struct
+       so that jhn_free() works! */
+    jhn_alloc_funcs_t alloc;
+
+    /* table_size is a power of two and at most half of it is used */
+    intern_entry **table;
+    size_t table_size;
+    size_t count;
+    intern_block *blocks;
+};
+
+#define BLOCK_DATA(b) ((char *) (b) + INTERN_ALIGN(sizeof(intern_block)))
+#define ENTRY_STRING(e) ((char *) (e) + INTERN_ALIGN(sizeof(intern_entry)))
+
+jhn_intern_t *
+jhn_intern_alloc(jhn_alloc_funcs_t *afs)
+{
+    jhn_intern_t *in = NULL;
+    jhn_alloc_funcs_t afs_buffer;
+
+    if (!afs) {
+        jhn__set_default_alloc_funcs(&afs_buffer);
+        afs = &afs_buffer;
+    }
+
+    in = JO_MALLOC(afs, sizeof(struct jhn_intern_s));
+    if (!in)
+        return NULL;
+
+    in->alloc = *afs;
+    in->table = NULL;
+    in->table_size = 0;
+    in->count = 0;
+    in->blocks = NULL;
+
+    return in;
+}
+
+void
+jhn_intern_clear(jhn_intern_t *in)
+{
+    while (in->blocks) {
+        intern_block *next = in->blocks->next;
+        JO_FREE(&(in->alloc), in->blocks);
+        in->blocks = next;
+    }
+    if (in->table) {
+        memset(in->table, 0, in->table_size * sizeof(intern_entry *));
+    }
+    in->count = 0;
+}
+
+void
+jhn_intern_free(jhn_intern_t *in)
+{
+    if (in) {
+        jhn_intern_clear(in);
+        if (in->table) {
+            JO_FREE(&(in->alloc), in->table);
+        }
+        JO_FREE(&(in->alloc), in);
+    }
+}
+
+size_t
+jhn_intern_count(const jhn_intern_t *in)
+{
+    return in->count;
+}
+
+/* doubles the table, zero if that failed and it stays as it is */
+static int
+grow_table(jhn_intern_t *in)
+{
+    size_t size = in->table_size ? in->table_size * 2 : INTERN_INIT_TABLE;
+    intern_entry **table = JO_MALLOC(&(in->alloc),
+                                     size * sizeof(intern_entry *));
+    size_t i;
+
+    if (!table) {
+        return 0;
+    }
+    memset(table, 0, size * sizeof(intern_entry *));
+    for (i = 0; i < in->table_size; i++) {
+        intern_entry *e = in->table[i];
+        if (e) {
+            size_t j = (size_t) e->hash & (size - 1);
+            while (table[j]) {
+                j = (j + 1) & (size - 1);
+            }
+            table[j] = e;
+        }
+    }
+    if (in->table) {
+        JO_FREE(&(in->alloc), in->table);
+    }
+    in->table = table;
+    in->table_size = size;
+    return 1;
+}
+
+/* a copy of str in a block, NULL if no block could be allocated */
+static intern_entry *
+new_entry(jhn_intern_t *in, const char *str, size_t len)
+{
+    size_t need = INTERN_ALIGN(INTERN_ALIGN(sizeof(intern_entry)) + len + 1);
+    intern_block *b = in->blocks;
+    intern_entry *e;
+
+    if (!b || b->size - b->used < need) {
+        size_t size = need > INTERN_BLOCK_SIZE ? need : INTERN_BLOCK_SIZE;
+        b = JO_MALLOC(&(in->alloc),
+                      INTERN_ALIGN(sizeof(intern_block)) + size);
+        if (!b) {
+            return NULL;
+        }
+        b->used = 0;
+        b->size = size;
+        /* keep the fuller block in front when a large string gets a
+           block of its own */
+        if (in->blocks && need > INTERN_BLOCK_SIZE) {
+            b->next = in->blocks->next;
+            in->blocks->next = b;
+        } else {
+            b->next = in->blocks;
+            in->blocks = b;
+        }
+    }
+    e = (intern_entry *) (BLOCK_DATA(b) + b->used);
+    b->used += need;
+    e->len = len;
+    memcpy(ENTRY_STRING(e), str, len);
+    ENTRY_STRING(e)[len] = 0;
+    return e;
+}
+
+const char *
+jhn_intern(jhn_intern_t *in, const char *str, size_t len)
+{
+    unsigned long long hash = jhn__hash(str, len, 0);
+    intern_entry *e;
+    size_t i;
+
+    if (2 * (in->count + 1) > in->table_size && !grow_table(in)) {
+        return NULL;
+    }
+    i = (size_t) hash & (in->table_size - 1);
+    while ((e = in->table[i]) != NULL) {
+        if (e->hash == hash && e->len == len &&
+            memcmp(ENTRY_STRING(e), str, len) == 0) {
+            return ENTRY_STRING(e);
+        }
+        i = (i + 1) & (in->table_size - 1);
+    }
+    e = new_entry(in, str, len);
+    if (!e) {
+        return NULL;
+    }
+    e->hash = hash;
+    in->table[i] = e;
+    in->count++;
+    return ENTRY_STRING(e);
+}
+
+static const intern_entry *
+entry_of(const char *interned)
+{
+    return (const intern_entry *)
+        (interned - INTERN_ALIGN(sizeof(intern_entry)));
+}
+
+unsigned long long
+jhn_interned_hash(const char *interned)
+{
+    return entry_of(interned)->hash;
+}
+
+size_t
+jhn_interned_len(const char *interned)
+{
+    return entry_of(interned)->len;
+}
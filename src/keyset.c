@@ -0,0 +1,322 @@
+#include "common.h"
+
+#include "alloc.h"
+#include "hash.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The key set is a minimal perfect hash built with the hash and
+   displace method.  Every key is hashed into one of a few buckets and
+   every bucket gets a displacement pair (d0, d1) chosen such that
+
+       slot = (f1 + d0 * f2 + d1) % count
+
+   sends the keys of all buckets to distinct slots.  Buckets are placed
+   largest first while there is still room.  A lookup costs one hash,
+   one table access and one compare to reject unknown keys. */
+
+#define KEYS_PER_BUCKET 4
+#define MAX_SEEDS 64
+#define SECOND_HASH 0x2545f4914f6cdd1dULL
+
+struct jhn_keyset_s {
+    /* memory allocation routines.  This needs to be first in the struct
+       so that jhn_free() works! */
+    jhn_alloc_funcs_t alloc;
+
+    unsigned long long seed;
+    size_t count;
+    size_t buckets;
+    /* where each key starts in data, count + 1 entries */
+    size_t *offsets;
+    /* the displacement pair of each bucket */
+    unsigned int *displace;
+    /* the key stored in each slot */
+    unsigned int *slot_key;
+    char *data;
+};
+
+typedef struct {
+    size_t bucket;
+    size_t f1;
+    size_t f2;
+} key_hash;
+
+typedef struct {
+    size_t size;
+    size_t bucket;
+} bucket_size;
+
+static void
+hash_key(const jhn_keyset_t *ks, const char *key, size_t len, key_hash *kh)
+{
+    unsigned long long h = jhn__hash(key, len, ks->seed);
+    unsigned long long h2 = jhn__hash_mix(h ^ SECOND_HASH);
+
+    kh->bucket = (size_t) (h % ks->buckets);
+    kh->f1 = (size_t) ((h >> 32) % ks->count);
+    kh->f2 = (size_t) (h2 % ks->count);
+}
+
+static size_t
+slot_of(const jhn_keyset_t *ks, const key_hash *kh, unsigned int d0,
+        unsigned int d1)
+{
+    return (size_t) (((unsigned long long) kh->f1 +
+                      (unsigned long long) d0 * kh->f2 + d1) % ks->count);
+}
+
+static int
+compare_sizes(const void *a, const void *b)
+{
+    const bucket_size *x = (const bucket_size *) a;
+    const bucket_size *y = (const bucket_size *) b;
+
+    if (x->size != y->size) {
+        return x->size < y->size ? 1 : -1;
+    }
+    return x->bucket < y->bucket ? -1 : x->bucket > y->bucket;
+}
+
+/* scratch space used while building */
+typedef struct {
+    key_hash *hashes;
+    /* the keys sorted by bucket, bucket b owns the keys from
+       start[b] to start[b + 1] */
+    size_t *members;
+    size_t *start;
+    bucket_size *sizes;
+    unsigned char *taken;
+    size_t *slots;
+} build_state;
+
+static void
+free_build_state(jhn_alloc_funcs_t *afs, build_state *bs)
+{
+    if (bs->hashes) JO_FREE(afs, bs->hashes);
+    if (bs->members) JO_FREE(afs, bs->members);
+    if (bs->start) JO_FREE(afs, bs->start);
+    if (bs->sizes) JO_FREE(afs, bs->sizes);
+    if (bs->taken) JO_FREE(afs, bs->taken);
+    if (bs->slots) JO_FREE(afs, bs->slots);
+}
+
+static int
+key_equals(const jhn_keyset_t *ks, size_t a, size_t b)
+{
+    size_t len = ks->offsets[a + 1] - ks->offsets[a];
+
+    return len == ks->offsets[b + 1] - ks->offsets[b] &&
+           memcmp(ks->data + ks->offsets[a], ks->data + ks->offsets[b],
+                  len) == 0;
+}
+
+/* tries to place all keys with the current seed.  Returns 1 on
+   success, 0 if another seed should be tried and -1 if there are
+   duplicate keys. */
+static int
+place_keys(jhn_keyset_t *ks, build_state *bs)
+{
+    size_t n = ks->count;
+    size_t i;
+    size_t j;
+    size_t k;
+    size_t b;
+
+    for (i = 0; i < n; i++) {
+        hash_key(ks, ks->data + ks->offsets[i],
+                 ks->offsets[i + 1] - ks->offsets[i], &(bs->hashes[i]));
+    }
+
+    /* sort the keys into their buckets */
+    memset(bs->start, 0, (ks->buckets + 1) * sizeof(size_t));
+    for (i = 0; i < n; i++) {
+        bs->start[bs->hashes[i].bucket + 1]++;
+    }
+    for (b = 0; b < ks->buckets; b++) {
+        bs->sizes[b].size = bs->start[b + 1];
+        bs->sizes[b].bucket = b;
+        bs->start[b + 1] += bs->start[b];
+    }
+    for (i = 0; i < n; i++) {
+        b = bs->hashes[i].bucket;
+        bs->members[bs->start[b] + --bs->sizes[b].size] = i;
+    }
+    for (b = 0; b < ks->buckets; b++) {
+        bs->sizes[b].size = bs->start[b + 1] - bs->start[b];
+    }
+
+    /* keys with identical hashes can never be separated */
+    for (b = 0; b < ks->buckets; b++) {
+        for (i = bs->start[b]; i < bs->start[b + 1]; i++) {
+            for (j = i + 1; j < bs->start[b + 1]; j++) {
+                const key_hash *x = &(bs->hashes[bs->members[i]]);
+                const key_hash *y = &(bs->hashes[bs->members[j]]);
+                if (x->f1 == y->f1 && x->f2 == y->f2) {
+                    return key_equals(ks, bs->members[i], bs->members[j])
+                        ? -1 : 0;
+                }
+            }
+        }
+    }
+
+    qsort(bs->sizes, ks->buckets, sizeof(bucket_size), compare_sizes);
+    memset(bs->taken, 0, n);
+    memset(ks->displace, 0, 2 * ks->buckets * sizeof(unsigned int));
+
+    for (k = 0; k < ks->buckets && bs->sizes[k].size; k++) {
+        size_t first;
+        size_t size = bs->sizes[k].size;
+        unsigned int d0;
+        unsigned int d1;
+        int placed = 0;
+
+        b = bs->sizes[k].bucket;
+        first = bs->start[b];
+        for (d0 = 0; d0 < n && !placed; d0++) {
+            for (d1 = 0; d1 < n && !placed; d1++) {
+                for (i = 0; i < size; i++) {
+                    const key_hash *kh = &(bs->hashes[bs->members[first + i]]);
+                    size_t s = slot_of(ks, kh, d0, d1);
+
+                    if (bs->taken[s]) {
+                        break;
+                    }
+                    for (j = 0; j < i; j++) {
+                        if (bs->slots[j] == s) {
+                            break;
+                        }
+                    }
+                    if (j < i) {
+                        break;
+                    }
+                    bs->slots[i] = s;
+                }
+                if (i == size) {
+                    for (i = 0; i < size; i++) {
+                        bs->taken[bs->slots[i]] = 1;
+                        ks->slot_key[bs->slots[i]] =
+                            (unsigned int) bs->members[first + i];
+                    }
+                    ks->displace[2 * b] = d0;
+                    ks->displace[2 * b + 1] = d1;
+                    placed = 1;
+                }
+            }
+        }
+        if (!placed) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+jhn_keyset_t *
+jhn_keyset_alloc(const char *const *keys, const size_t *lens, size_t count,
+                 jhn_alloc_funcs_t *afs)
+{
+    jhn_keyset_t *ks = NULL;
+    jhn_alloc_funcs_t afs_buffer;
+    build_state bs;
+    size_t buckets = count / KEYS_PER_BUCKET + 1;
+    size_t bytes = 0;
+    size_t size;
+    size_t i;
+    int rv = 0;
+
+    if (!afs) {
+        jhn__set_default_alloc_funcs(&afs_buffer);
+        afs = &afs_buffer;
+    }
+    if (count > INT_MAX) {
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        bytes += lens ? lens[i] : strlen(keys[i]);
+    }
+
+    /* everything goes into a single block, largest alignment first */
+    size = sizeof(struct jhn_keyset_s) + (count + 1) * sizeof(size_t) +
+           (2 * buckets + count) * sizeof(unsigned int) + bytes;
+    ks = JO_MALLOC(afs, size);
+    if (!ks) {
+        return NULL;
+    }
+    ks->alloc = *afs;
+    ks->seed = 0;
+    ks->count = count;
+    ks->buckets = buckets;
+    ks->offsets = (size_t *) (ks + 1);
+    ks->displace = (unsigned int *) (ks->offsets + count + 1);
+    ks->slot_key = ks->displace + 2 * buckets;
+    ks->data = (char *) (ks->slot_key + count);
+
+    ks->offsets[0] = 0;
+    for (i = 0; i < count; i++) {
+        size_t len = lens ? lens[i] : strlen(keys[i]);
+        memcpy(ks->data + ks->offsets[i], keys[i], len);
+        ks->offsets[i + 1] = ks->offsets[i] + len;
+    }
+    if (count == 0) {
+        return ks;
+    }
+
+    bs.hashes = JO_MALLOC(afs, count * sizeof(key_hash));
+    bs.members = JO_MALLOC(afs, count * sizeof(size_t));
+    bs.start = JO_MALLOC(afs, (buckets + 1) * sizeof(size_t));
+    bs.sizes = JO_MALLOC(afs, buckets * sizeof(bucket_size));
+    bs.taken = JO_MALLOC(afs, count);
+    bs.slots = JO_MALLOC(afs, count * sizeof(size_t));
+
+    if (bs.hashes && bs.members && bs.start && bs.sizes && bs.taken &&
+        bs.slots) {
+        for (i = 0; i < MAX_SEEDS && rv == 0; i++) {
+            ks->seed = i;
+            rv = place_keys(ks, &bs);
+        }
+    }
+
+    free_build_state(afs, &bs);
+
+    if (rv != 1) {
+        JO_FREE(afs, ks);
+        return NULL;
+    }
+    return ks;
+}
+
+void
+jhn_keyset_free(jhn_keyset_t *ks)
+{
+    if (ks) {
+        JO_FREE(&(ks->alloc), ks);
+    }
+}
+
+size_t
+jhn_keyset_count(const jhn_keyset_t *ks)
+{
+    return ks->count;
+}
+
+int
+jhn_keyset_lookup(const jhn_keyset_t *ks, const char *key, size_t len)
+{
+    key_hash kh;
+    size_t id;
+
+    if (ks->count == 0) {
+        return -1;
+    }
+    hash_key(ks, key, len, &kh);
+    id = ks->slot_key[slot_of(ks, &kh, ks->displace[2 * kh.bucket],
+                              ks->displace[2 * kh.bucket + 1])];
+    if (ks->offsets[id + 1] - ks->offsets[id] != len ||
+        memcmp(ks->data + ks->offsets[id], key, len) != 0) {
+        return -1;
+    }
+    return (int) id;
+}
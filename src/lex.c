@@ -2,11 +2,14 @@
 
 #include "buf.h"
 #include "encode.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdarg.h>
 
 
 /* Impact of the stream parsing feature on the lexer:
@@ -27,6 +30,10 @@
    read_chr's responsibility is to handle pulling all chars from the buffer
    before pulling chars from input text */
 
+/* fails to compile if the counts do not fit into jhn_lexer_stats_t */
+typedef char jhn__token_stats_fit[jhn_tok_count <= JHN_TOKEN_STATS ? 1
+                                                                   : -1];
+
 struct jhn_lexer_s {
     /* memory allocation routines.  This needs to be first in the struct
        so that jhn_free() works! */
@@ -50,11 +57,70 @@ struct jhn_lexer_s {
     /* are we using the lex buf? */
     unsigned int buf_in_use;
 
+    /* how often and how much input was copied into buf and the tokens
+       handed out, only counted with JHN_STATS */
+    size_t buf_appends;
+    size_t buf_bytes;
+    size_t tokens[jhn_tok_count];
+
     /* shall we allow comments? */
     unsigned int allow_comments;
 
     /* shall we validate utf8 inside strings? */
     unsigned int validate_utf8;
+
+    /* shall strings that span chunks be handed out in fragments? */
+    unsigned int stream_strings;
+
+    /* the most bytes a token may have, (size_t) -1 if there is no
+       limit */
+    size_t max_token_size;
+
+    /* in string streaming mode: are we in the middle of a string whose
+       beginning was already handed out as a fragment? */
+    unsigned int in_string;
+
+    /* the end of the part of the string lexed so far that can be handed
+       out as a fragment (it does not end in the middle of an escape
+       sequence, surrogate pair or utf8 character) and whether the
+       string lexed so far contains escapes */
+    size_t str_safe;
+    unsigned int str_escapes;
+
+    /* the bytes after str_safe which have to be lexed again together
+       with the next chunk.  This is never longer than an escaped
+       surrogate pair. */
+    char str_tail[16];
+    size_t str_tail_len;
+
+    /* the bytes of the string in the earlier fragments, without the
+       tail.  Checked against max_token_size. */
+    size_t str_len;
+
+    /* a token lexed by jhn_lexer_peek.  The next call to jhn_lexer_lex
+       with the same text, length and offset hands it out without lexing
+       it a second time. */
+    unsigned int peek_valid;
+    jhn_tok_t peek_tok;
+    const char *peek_text;
+    size_t peek_length;
+    size_t peek_offset;
+    size_t peek_end_offset;
+    const char *peek_buf;
+    size_t peek_len;
+
+    /* the lexer state from before the peek.  Restored if the peeked
+       token is not consumed by the next lex. */
+    size_t peek_saved_buf_len;
+    size_t peek_saved_buf_off;
+    unsigned int peek_saved_buf_in_use;
+    jhn_lexer_error_t peek_saved_error;
+    unsigned int peek_saved_in_string;
+    char peek_saved_str_tail[16];
+    size_t peek_saved_str_tail_len;
+    size_t peek_saved_str_len;
+    size_t peek_saved_buf_appends;
+    size_t peek_saved_buf_bytes;
 };
 
 #define read_chr(lxr, txt, off)                      \
@@ -64,6 +130,23 @@ struct jhn_lexer_s {
 
 #define unread_chr(lxr, off) ((*(off) > 0) ? (*(off))-- : ((lxr)->buf_off--))
 
+/* the number of bytes of the current token read so far, no matter if
+   they came from the buffer or from the json text */
+#define token_pos(lxr, off, start) \
+    (((lxr)->buf_in_use ? (lxr)->buf_off : 0) + (*(off) - (start)))
+
+/* copies part of a token into buf because it continues in the next
+   chunk */
+static void
+buf_carry(jhn_lexer_t *lexer, const char *data, size_t len)
+{
+    if (len) {
+        JHN__STAT(lexer->buf_appends++; lexer->buf_bytes += len);
+        JHN__TRACE3(lexer__carry, lexer, len, jhn__buf_len(lexer->buf) + len);
+    }
+    jhn__buf_append(lexer->buf, data, len);
+}
+
 jhn_lexer_t *
 jhn_lexer_alloc(jhn_alloc_funcs_t *alloc,
                 unsigned int allow_comments, unsigned int validate_utf8)
@@ -75,14 +158,49 @@ jhn_lexer_alloc(jhn_alloc_funcs_t *alloc,
         alloc = &afs_buffer;
     }
     lxr = JO_MALLOC(alloc, sizeof(jhn_lexer_t));
+    if (!lxr) {
+        return NULL;
+    }
     memset((void *) lxr, 0, sizeof(jhn_lexer_t));
-    lxr->buf = jhn__buf_alloc(alloc);
+    lxr->alloc = *alloc;
+    /* the buffer keeps a pointer to the allocators, so it has to point
+       to our copy and not to the (possibly stack allocated) argument */
+    lxr->buf = jhn__buf_alloc(&lxr->alloc);
+    if (!lxr->buf) {
+        JO_FREE(alloc, lxr);
+        return NULL;
+    }
     lxr->allow_comments = allow_comments;
     lxr->validate_utf8 = validate_utf8;
-    lxr->alloc = *alloc;
+    lxr->max_token_size = (size_t) -1;
     return lxr;
 }
 
+int
+jhn_lexer_config(jhn_lexer_t *lxr, jhn_lexer_option opt, ...)
+{
+    int rv = 1;
+    va_list ap;
+    va_start(ap, opt);
+
+    switch (opt) {
+        case jhn_lexer_stream_strings:
+            lxr->stream_strings = va_arg(ap, int) ? 1 : 0;
+            break;
+        case jhn_lexer_max_token_size:
+            lxr->max_token_size = va_arg(ap, size_t);
+            if (lxr->max_token_size == 0) {
+                lxr->max_token_size = (size_t) -1;
+            }
+            break;
+        default:
+            rv = 0;
+    }
+    va_end(ap);
+
+    return rv;
+}
+
 void
 jhn_lexer_free(jhn_lexer_t *lxr)
 {
@@ -223,7 +341,7 @@ if (*offset >= length) { \
  *  review.  return the number of chars that are uninteresting and can
  *  be skipped.
  * (lth) hi world, any thoughts on how to make this routine faster? */
-static size_t
+static JHN__PROFILED size_t
 jhn_string_scan(const char * buf, size_t len, int utf8check)
 {
     char mask = IJC|NFP|(utf8check ? NUC : 0);
@@ -237,10 +355,15 @@ jhn_string_scan(const char * buf, size_t len, int utf8check)
 
 static jhn_tok_t
 jhn_lexer_string(jhn_lexer_t *lexer, const char * json_text,
-                 size_t length, size_t * offset)
+                 size_t length, size_t * offset, size_t start_off)
 {
     jhn_tok_t tok = jhn_tok_error;
     int has_escapes = 0;
+    /* non zero if the escape sequence, surrogate pair or utf8 character
+       starting at unit_start was not completed yet.  This is used to
+       find a place to split the string when streaming strings. */
+    int pending = 0;
+    size_t unit_start = 0;
 
     while (1) {
         char cur_chr;
@@ -250,16 +373,22 @@ jhn_lexer_string(jhn_lexer_t *lexer, const char * json_text,
         {
             const char * p;
             size_t len;
+            size_t skip = 0;
 
             if ((lexer->buf_in_use && jhn__buf_len(lexer->buf) &&
                  lexer->buf_off < jhn__buf_len(lexer->buf))) {
                 p = jhn__buf_data(lexer->buf) + (lexer->buf_off);
                 len = jhn__buf_len(lexer->buf) - lexer->buf_off;
-                lexer->buf_off += jhn_string_scan(p, len, lexer->validate_utf8);
+                skip = jhn_string_scan(p, len, lexer->validate_utf8);
+                lexer->buf_off += skip;
             } else if (*offset < length) {
                 p = json_text + *offset;
                 len = length - *offset;
-                *offset += jhn_string_scan(p, len, lexer->validate_utf8);
+                skip = jhn_string_scan(p, len, lexer->validate_utf8);
+                *offset += skip;
+            }
+            if (skip > 0) {
+                pending = 0;
             }
         }
 
@@ -274,13 +403,20 @@ jhn_lexer_string(jhn_lexer_t *lexer, const char * json_text,
         }
         /* backslash escapes a set of control chars, */
         else if (cur_chr == '\\') {
+            /* the second half of a surrogate pair completes the unit */
+            int second_half = pending;
             has_escapes = 1;
+            if (!pending) {
+                unit_start = token_pos(lexer, offset, start_off) - 1;
+                pending = 1;
+            }
             STR_CHECK_EOF;
 
             /* special case \u */
             cur_chr = read_chr(lexer, json_text, offset);
             if (cur_chr == 'u') {
                 unsigned int i = 0;
+                int high_surrogate = 1;
 
                 for (i = 0; i < 4; i++) {
                     STR_CHECK_EOF;
@@ -291,12 +427,21 @@ jhn_lexer_string(jhn_lexer_t *lexer, const char * json_text,
                         lexer->error = jhn_lexer_string_invalid_hex_char;
                         goto finish_string_lex;
                     }
+                    /* \uD800 - \uDBFF needs the following escape */
+                    if (i == 0 && cur_chr != 'd' && cur_chr != 'D') {
+                        high_surrogate = 0;
+                    } else if (i == 1 && !strchr("89abAB", cur_chr)) {
+                        high_surrogate = 0;
+                    }
                 }
+                pending = !second_half && high_surrogate;
             } else if (!(char_lookup_table[(unsigned char)cur_chr] & VEC)) {
                 /* back up to offending char */
                 unread_chr(lexer, offset);
                 lexer->error = jhn_lexer_string_invalid_escaped_char;
                 goto finish_string_lex;
+            } else {
+                pending = 0;
             }
         }
         /* when not validating UTF8 it's a simple table lookup to determine
@@ -309,8 +454,13 @@ jhn_lexer_string(jhn_lexer_t *lexer, const char * json_text,
         }
         /* when in validate UTF8 mode we need to do some extra work */
         else if (lexer->validate_utf8) {
-            jhn_tok_t t = jhn_lexer_utf8_char(lexer, json_text, length,
-                                              offset, cur_chr);
+            jhn_tok_t t;
+            if (!pending) {
+                unit_start = token_pos(lexer, offset, start_off) - 1;
+                pending = 1;
+            }
+            t = jhn_lexer_utf8_char(lexer, json_text, length,
+                                    offset, cur_chr);
 
             if (t == jhn_tok_eof) {
                 tok = jhn_tok_eof;
@@ -319,10 +469,21 @@ jhn_lexer_string(jhn_lexer_t *lexer, const char * json_text,
                 lexer->error = jhn_lexer_string_invalid_utf8;
                 goto finish_string_lex;
             }
+            pending = 0;
         }
         /* accept it, and move on */
+        else {
+            pending = 0;
+        }
     }
   finish_string_lex:
+    /* remember where a fragment could end in case we ran out of data */
+    if (tok == jhn_tok_eof) {
+        lexer->str_safe = pending ? unit_start
+                                  : token_pos(lexer, offset, start_off);
+    }
+    lexer->str_escapes = has_escapes;
+
     /* tell our buddy, the parser, wether he needs to process this string
      * again */
     if (has_escapes && tok == jhn_tok_string) {
@@ -462,16 +623,115 @@ jhn_lexer_comment(jhn_lexer_t *lexer, const char *json_text,
     return tok;
 }
 
-jhn_tok_t
-jhn_lexer_lex(jhn_lexer_t *lexer, const char *json_text,
-              size_t length, size_t *offset,
-              const char **out_buf, size_t *out_len)
+/* reads a byte of the current token, which might partially be in the
+   buffer and partially in the json text */
+static unsigned char
+token_byte(jhn_lexer_t *lexer, const char *json_text, size_t start_off,
+           size_t pos)
+{
+    size_t buf_len = lexer->buf_in_use ? jhn__buf_len(lexer->buf) : 0;
+    if (pos < buf_len) {
+        return (unsigned char)jhn__buf_data(lexer->buf)[pos];
+    }
+    return (unsigned char)json_text[start_off + pos - buf_len];
+}
+
+/* hands out the complete part of a string that ran into the end of the
+   json text and remembers the rest for the next chunk. */
+static jhn_tok_t
+string_fragment(jhn_lexer_t *lexer, const char *json_text, size_t *offset,
+                size_t start_off, int resumed_string,
+                const char **out_buf, size_t *out_len)
+{
+    size_t total = token_pos(lexer, offset, start_off);
+    size_t safe = lexer->str_safe;
+    /* a fresh string starts with the opening quote */
+    size_t skip = resumed_string ? 0 : 1;
+    const char *data;
+    size_t i;
+
+    /* without utf8 validation the string scanner does not stop at
+       multi byte characters, so make sure we do not split one. */
+    for (i = 1; i <= 3 && safe >= skip + i; i++) {
+        unsigned char c = token_byte(lexer, json_text, start_off, safe - i);
+        if ((c & 0xc0) == 0xc0) {
+            if ((c >= 0xf0 ? 4u : c >= 0xe0 ? 3u : 2u) > i) {
+                safe -= i;
+            }
+            break;
+        } else if ((c & 0xc0) != 0x80) {
+            break;
+        }
+    }
+    if (safe < skip) {
+        safe = skip;
+    }
+
+    if (lexer->buf_in_use) {
+        buf_carry(lexer, json_text + start_off, *offset - start_off);
+        data = jhn__buf_data(lexer->buf);
+    } else {
+        data = json_text + start_off;
+    }
+
+    assert(total - safe <= sizeof(lexer->str_tail));
+    memcpy(lexer->str_tail, data + safe, total - safe);
+    lexer->str_tail_len = total - safe;
+    lexer->str_len += safe;
+    lexer->buf_in_use = 0;
+    lexer->in_string = 1;
+
+    /* only the first fragment has to be reported even if it is empty,
+       it tells the caller that a string started. */
+    if (resumed_string && safe == skip) {
+        return jhn_tok_eof;
+    }
+
+    if (out_buf) {
+        *out_buf = data + skip;
+    }
+    if (out_len) {
+        *out_len = safe - skip;
+    }
+    return lexer->str_escapes ? jhn_tok_string_fragment_with_escapes
+                              : jhn_tok_string_fragment;
+}
+
+static jhn_tok_t
+lex_token(jhn_lexer_t *lexer, const char *json_text,
+          size_t length, size_t *offset,
+          const char **out_buf, size_t *out_len)
 {
     jhn_tok_t tok = jhn_tok_error;
     char c;
     size_t start_off = *offset;
     const char *report_buf = NULL;
     size_t report_len = 0;
+    /* set if we continue a string that was handed out in fragments */
+    int resumed_string = 0;
+    int lexing_string = 0;
+
+    if (lexer->in_string) {
+        if (*offset >= length) {
+            if (out_buf) {
+                *out_buf = NULL;
+            }
+            if (out_len) {
+                *out_len = 0;
+            }
+            return jhn_tok_eof;
+        }
+        /* the unfinished tail of the last fragment is read from the
+           buffer before the new text */
+        jhn__buf_clear(lexer->buf);
+        buf_carry(lexer, lexer->str_tail, lexer->str_tail_len);
+        lexer->buf_in_use = lexer->str_tail_len > 0;
+        lexer->buf_off = 0;
+        resumed_string = lexing_string = 1;
+        tok = jhn_lexer_string(lexer, json_text, length, offset, start_off);
+        goto lexed;
+    }
+    lexer->str_len = 0;
 
     for (;;) {
         assert(*offset <= length);
@@ -560,8 +820,9 @@ jhn_lexer_lex(jhn_lexer_t *lexer, const char *json_text,
             goto lexed;
         }
         case '"': {
+            lexing_string = 1;
             tok = jhn_lexer_string(lexer, (const char *)json_text,
-                                 length, offset);
+                                   length, offset, start_off);
             goto lexed;
         }
         case '-':
@@ -610,12 +871,31 @@ jhn_lexer_lex(jhn_lexer_t *lexer, const char *json_text,
 
 
   lexed:
+    /* a token that grows too large is not lexed any further, so the
+       buffer never holds more than max_token_size bytes of it */
+    if (tok != jhn_tok_error && token_pos(lexer, offset, start_off) >
+                                lexer->max_token_size - lexer->str_len) {
+        lexer->error = jhn_lexer_token_too_large;
+        lexer->buf_in_use = 0;
+        tok = jhn_tok_error;
+    }
+
+    /* in string streaming mode a string that runs into the end of the
+       chunk is not buffered.  Everything up to the last complete
+       character is handed out as fragment and only the rest is kept
+       for the next chunk. */
+    if (tok == jhn_tok_eof && lexing_string && lexer->stream_strings &&
+        (resumed_string || !lexer->buf_in_use)) {
+        return string_fragment(lexer, json_text, offset, start_off,
+                               resumed_string, out_buf, out_len);
+    }
+
     /* need to append to buffer if the buffer is in use or
        if it's an EOF token */
     if (tok == jhn_tok_eof || lexer->buf_in_use) {
         if (!lexer->buf_in_use) jhn__buf_clear(lexer->buf);
         lexer->buf_in_use = 1;
-        jhn__buf_append(lexer->buf, json_text + start_off, *offset - start_off);
+        buf_carry(lexer, json_text + start_off, *offset - start_off);
         lexer->buf_off = 0;
 
         if (tok != jhn_tok_eof) {
@@ -628,8 +908,15 @@ jhn_lexer_lex(jhn_lexer_t *lexer, const char *json_text,
         report_len = *offset - start_off;
     }
 
-    /* special case for strings. skip the quotes. */
-    if (tok == jhn_tok_string || tok == jhn_tok_string_with_escapes) {
+    /* special case for strings. skip the quotes.  A string that was
+       started in an earlier fragment only has the closing one. */
+    if (resumed_string) {
+        lexer->in_string = 0;
+        if (tok == jhn_tok_string || tok == jhn_tok_string_with_escapes) {
+            assert(report_len >= 1);
+            report_len--;
+        }
+    } else if (tok == jhn_tok_string || tok == jhn_tok_string_with_escapes) {
         assert(report_len >= 2);
         report_buf++;
         report_len -= 2;
@@ -646,6 +933,60 @@ jhn_lexer_lex(jhn_lexer_t *lexer, const char *json_text,
     return tok;
 }
 
+/* throws away a peeked token that was not consumed and puts the lexer
+   back into the state it had before the peek. */
+static void
+discard_peek(jhn_lexer_t *lexer)
+{
+    lexer->peek_valid = 0;
+    lexer->buf_off = lexer->peek_saved_buf_off;
+    lexer->buf_in_use = lexer->peek_saved_buf_in_use;
+    lexer->error = lexer->peek_saved_error;
+    lexer->in_string = lexer->peek_saved_in_string;
+    lexer->str_tail_len = lexer->peek_saved_str_tail_len;
+    lexer->str_len = lexer->peek_saved_str_len;
+    memcpy(lexer->str_tail, lexer->peek_saved_str_tail,
+           lexer->str_tail_len);
+    /* what the peek carried over is carried again by the next lex */
+    JHN__STAT(lexer->buf_appends = lexer->peek_saved_buf_appends;
+              lexer->buf_bytes = lexer->peek_saved_buf_bytes);
+    /* the buffer contents only matter if a token was being buffered */
+    if (lexer->buf_in_use) {
+        jhn__buf_truncate(lexer->buf, lexer->peek_saved_buf_len);
+    }
+}
+
+#define IS_PEEKED(lxr, txt, len, off) \
+    ((lxr)->peek_valid && (lxr)->peek_text == (txt) && \
+     (lxr)->peek_length == (len) && (lxr)->peek_offset == (off))
+
+JHN__PROFILED jhn_tok_t
+jhn_lexer_lex(jhn_lexer_t *lexer, const char *json_text,
+              size_t length, size_t *offset,
+              const char **out_buf, size_t *out_len)
+{
+    jhn_tok_t tok;
+
+    if (lexer->peek_valid) {
+        if (IS_PEEKED(lexer, json_text, length, *offset)) {
+            lexer->peek_valid = 0;
+            *offset = lexer->peek_end_offset;
+            if (out_buf) {
+                *out_buf = lexer->peek_buf;
+            }
+            if (out_len) {
+                *out_len = lexer->peek_len;
+            }
+            JHN__STAT(lexer->tokens[lexer->peek_tok]++);
+            return lexer->peek_tok;
+        }
+        discard_peek(lexer);
+    }
+    tok = lex_token(lexer, json_text, length, offset, out_buf, out_len);
+    JHN__STAT(lexer->tokens[tok]++);
+    return tok;
+}
+
 const char *
 jhn_lexer_error_to_string(jhn_lexer_error_t error)
 {
@@ -677,6 +1018,8 @@ jhn_lexer_error_to_string(jhn_lexer_error_t error)
     case jhn_lexer_unallowed_comment:
         return "probable comment found in input text, comments are "
                "not enabled.";
+    case jhn_lexer_token_too_large:
+        return "token exceeds the maximum size.";
     default:
         return "unknown error code";
     }
@@ -699,24 +1042,59 @@ size_t jhn_lexer_current_char(jhn_lexer_t *lexer)
     return lexer->char_off;
 }
 
+void
+jhn_lexer_get_stats(jhn_lexer_t *lexer, jhn_lexer_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->buffer_appends = lexer->buf_appends;
+    stats->buffer_bytes = lexer->buf_bytes;
+    memcpy(stats->tokens, lexer->tokens, sizeof(lexer->tokens));
+}
+
 jhn_tok_t jhn_lexer_peek(jhn_lexer_t *lexer, const char *json_text,
                          size_t length, size_t offset)
 {
-    const char *out_buf;
-    size_t out_len;
-    size_t buf_len = jhn__buf_len(lexer->buf);
-    size_t buf_off = lexer->buf_off;
-    unsigned int buf_in_use = lexer->buf_in_use;
-    jhn_tok_t tok;
-
-    tok = jhn_lexer_lex(lexer, json_text, length, &offset,
-                        &out_buf, &out_len);
+    /* peeking twice at the same spot is free */
+    if (IS_PEEKED(lexer, json_text, length, offset)) {
+        return lexer->peek_tok;
+    }
+    if (lexer->peek_valid) {
+        discard_peek(lexer);
+    }
 
-    lexer->buf_off = buf_off;
-    lexer->buf_in_use = buf_in_use;
-    jhn__buf_truncate(lexer->buf, buf_len);
+    /* instead of undoing the lex we keep its results around so that
+       the following jhn_lexer_lex does not have to scan the token
+       again.  Only if the caller lexes somewhere else the old state
+       is restored. */
+    lexer->peek_saved_buf_len = jhn__buf_len(lexer->buf);
+    lexer->peek_saved_buf_off = lexer->buf_off;
+    lexer->peek_saved_buf_in_use = lexer->buf_in_use;
+    lexer->peek_saved_error = lexer->error;
+    lexer->peek_saved_in_string = lexer->in_string;
+    lexer->peek_saved_str_tail_len = lexer->str_tail_len;
+    lexer->peek_saved_str_len = lexer->str_len;
+    JHN__STAT(lexer->peek_saved_buf_appends = lexer->buf_appends;
+              lexer->peek_saved_buf_bytes = lexer->buf_bytes);
+    memcpy(lexer->peek_saved_str_tail, lexer->str_tail,
+           lexer->str_tail_len);
+
+    lexer->peek_text = json_text;
+    lexer->peek_length = length;
+    lexer->peek_offset = offset;
+    lexer->peek_tok = lex_token(lexer, json_text, length, &offset,
+                                &lexer->peek_buf, &lexer->peek_len);
+    lexer->peek_end_offset = offset;
+    lexer->peek_valid = 1;
+
+    return lexer->peek_tok;
+}
 
-    return tok;
+void
+jhn_lexer_discard_peek(jhn_lexer_t *lexer)
+{
+    if (lexer->peek_valid) {
+        discard_peek(lexer);
+    }
 }
 
 jhn_tok_t
@@ -725,7 +1103,11 @@ jhn_lexer_finalize(jhn_lexer_t *lexer, size_t offset)
     /* finalizing means ending with some whitespace.  This is enough to
        inform the regular lexing algorithm that we have found the end of
        a token (this really is only an issue if we are lexing numbers
-       which are impossible to detect the end of otherwise. */
+       which are impossible to detect the end of otherwise.  A string
+       that is being streamed is never finished by that. */
+    if (lexer->in_string) {
+        return jhn_tok_eof;
+    }
     return jhn_lexer_lex(lexer, " ", 1, &offset, NULL, NULL);
 }
 
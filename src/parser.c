@@ -1,6 +1,17 @@
+/* clock_gettime for the JHN_STATS timers, which strict C modes hide.
+   This has to come before any system header. */
+#if defined(JHN_STATS) && !defined(_POSIX_C_SOURCE)
+#  define _POSIX_C_SOURCE 199309L
+#endif
+
 #include "common.h"
+#include "alloc.h"
 #include "encode.h"
 #include "bytestack.h"
+#include "parser.h"
+#include "schema.h"
+#include "stats.h"
+#include "trace.h"
 
 #include <stdlib.h>
 #include <limits.h>
@@ -12,44 +23,112 @@
 #include <assert.h>
 #include <math.h>
 
+#ifdef JHN_STATS
+#  if defined(_WIN32) || defined(WIN32)
+#    include <windows.h>
+#  else
+#    include <time.h>
+#  endif
+#endif
+
 #define MAX_VALUE_TO_MULTIPLY ((LLONG_MAX / 10) + (LLONG_MAX % 10))
 
-typedef enum {
-    parser_state_start = 0,
-    parser_state_parse_complete,
-    parser_state_parse_error,
-    parser_state_lexical_error,
-    parser_state_map_start,
-    parser_state_map_sep,
-    parser_state_map_need_val,
-    parser_state_map_got_val,
-    parser_state_map_need_key,
-    parser_state_array_start,
-    parser_state_array_got_val,
-    parser_state_array_need_val,
-    parser_state_got_value,
-} parser_state;
-
-struct jhn_parser_s {
-    /* memory allocation routines.  This needs to be first in the struct
-       so that jhn_free() works! */
-    jhn_alloc_funcs_t alloc;
-
-    const jhn_parser_callbacks_t *callbacks;
-    void *ctx;
-    jhn_lexer_t *lexer;
-    const char *parse_error;
-    /* the number of bytes consumed from the last client buffer,
-       in the case of an error this will be an error offset, in the
-       case of an error this can be used as the error offset */
-    size_t bytes_consumed;
-    /* temporary storage for decoded strings */
-    jhn__buf_t *decode_buf;
-    /* a stack of states.  access with parser_state_XXX routines */
-    jhn__bytestack_t state_stack;
-    /* bitfield */
-    unsigned int flags;
-};
+/* the routines behind mem_alloc once memory is tracked, see
+   track_memory().  The size of each block is kept in a header in front
+   of it, see alloc.h. */
+static void parser_free(void *ctx, void *ptr);
+
+static void *
+parser_malloc(void *ctx, size_t sz)
+{
+    jhn_parser_t *hand = (jhn_parser_t *) ctx;
+    jhn__alloc_header_t *hdr = JO_MALLOC(&(hand->alloc),
+                                         JHN__HEADER_SIZE + sz);
+
+    if (!hdr) {
+        return NULL;
+    }
+    hdr->info.size = sz;
+    hand->memory += sz;
+    JHN__STAT(hand->allocs++; hand->alloc_bytes += sz);
+    JHN__TRACE3(parser__malloc, hand, sz, hand->memory);
+    return JHN__BLOCK_OF(hdr);
+}
+
+static void *
+parser_realloc(void *ctx, void *ptr, size_t sz)
+{
+    jhn_parser_t *hand = (jhn_parser_t *) ctx;
+    jhn__alloc_header_t *hdr;
+    size_t old;
+
+    if (!ptr) {
+        return parser_malloc(ctx, sz);
+    }
+    if (sz == 0) {
+        parser_free(ctx, ptr);
+        return NULL;
+    }
+    old = JHN__HEADER_OF(ptr)->info.size;
+    hdr = JO_REALLOC(&(hand->alloc), JHN__HEADER_OF(ptr),
+                     JHN__HEADER_SIZE + sz);
+    if (!hdr) {
+        return NULL;
+    }
+    hdr->info.size = sz;
+    hand->memory = hand->memory - old + sz;
+    JHN__STAT(hand->allocs++; hand->alloc_bytes += sz);
+    JHN__TRACE3(parser__realloc, hand, sz, hand->memory);
+    return JHN__BLOCK_OF(hdr);
+}
+
+static void
+parser_free(void *ctx, void *ptr)
+{
+    jhn_parser_t *hand = (jhn_parser_t *) ctx;
+
+    if (ptr) {
+        size_t sz = JHN__HEADER_OF(ptr)->info.size;
+        hand->memory -= sz;
+        JHN__TRACE3(parser__free, hand, sz, hand->memory);
+        JO_FREE(&(hand->alloc), JHN__HEADER_OF(ptr));
+    }
+}
+
+#ifdef JHN_STATS
+/* a monotonic clock in seconds */
+static double
+stats_clock(void)
+{
+#if defined(_WIN32) || defined(WIN32)
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (double) now.QuadPart / (double) freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* ends the callback started at callback_started and passes on its
+   return value */
+static int
+stats_callback_done(jhn_parser_t *hand, int rv)
+{
+    hand->callback_seconds += stats_clock() - hand->callback_started;
+    return rv;
+}
+
+/* calls into the client, x is the call of a callback */
+#  define USER_CALL(hand, x)                                        \
+    ((hand)->callback_started = stats_clock(),                      \
+     stats_callback_done((hand), (x)))
+#else
+#  define USER_CALL(hand, x) (x)
+#endif
+
 
 
 /* same semantics as strtol */
@@ -176,8 +255,172 @@ render_error_string(jhn_parser_t *hand, const char *json_text,
     }                                                               \
 } while (0)
 
+/* calls a callback and checks for client cancelation */
+#define _CB_CHK(x) _CC_CHK(USER_CALL(hand, x))
 
+/* stops the parse because the limit set with opt was exceeded */
+jhn_parser_status_t
+jhn__parser_limit_exceeded(jhn_parser_t *hand, jhn_parser_option opt,
+                           const char *msg)
+{
+    jhn__bs_set(hand->state_stack, parser_state_parse_error);
+    hand->parse_error = msg;
+    hand->exceeded = opt;
+    return jhn_parser_status_error;
+}
+
+#define _SCHEMA_CHK(x) do {                                         \
+    if (hand->validator) {                                          \
+        const char *violation = (x);                                \
+        if (violation) {                                            \
+            jhn__bs_set(hand->state_stack, parser_state_parse_error); \
+            hand->parse_error = violation;                          \
+            return jhn_parser_status_error;                         \
+        }                                                           \
+    }                                                               \
+} while (0)
+
+/* stops the parse because an allocation failed */
 static jhn_parser_status_t
+out_of_memory(jhn_parser_t *hand)
+{
+    jhn__bs_set(hand->state_stack, parser_state_parse_error);
+    hand->parse_error = "out of memory";
+    return jhn_parser_status_error;
+}
+
+#define _MEM_CHK(x) do {                                            \
+    if (!(x)) {                                                     \
+        return out_of_memory(hand);                                 \
+    }                                                               \
+} while (0)
+
+/* returns the status of a helper that reports events unless it is ok */
+#define _STATUS_CHK(x) do {                                         \
+    jhn_parser_status_t _status = (x);                              \
+    if (_status != jhn_parser_status_ok) {                          \
+        return _status;                                             \
+    }                                                               \
+} while (0)
+
+/* unescapes a string into the decode_buf, after what is already there.
+   Zero if memory ran out. */
+static int
+decode_unescaped(jhn_parser_t *hand, const char *buf, size_t buf_len)
+{
+    /* unescaping never makes a string longer */
+    if (!jhn__buf_reserve(hand->decode_buf, buf_len)) {
+        return 0;
+    }
+    /* counts by how much the buffer grew */
+    JHN__STAT(hand->decode_bytes -= jhn__buf_len(hand->decode_buf));
+    jhn__string_decode(hand->decode_buf, buf, buf_len);
+    JHN__STAT(hand->decode_bytes += jhn__buf_len(hand->decode_buf));
+    return 1;
+}
+
+/* copies text into the decode_buf, after what is already there.  Zero
+   if memory ran out. */
+static int
+decode_append(jhn_parser_t *hand, const char *buf, size_t buf_len)
+{
+    if (!jhn__buf_reserve(hand->decode_buf, buf_len)) {
+        return 0;
+    }
+    JHN__STAT(hand->decode_bytes += buf_len);
+    jhn__buf_append(hand->decode_buf, buf, buf_len);
+    return 1;
+}
+
+/* passes a fragment of a streamed string to the client.  With
+   jhn_raw_strings the client gets it as written, but the validator
+   always sees it unescaped. */
+static jhn_parser_status_t
+string_chunk(jhn_parser_t *hand, const char *buf, size_t buf_len,
+             int has_escapes)
+{
+    const char *text = buf;
+    size_t text_len = buf_len;
+
+    if (buf_len == 0) {
+        return jhn_parser_status_ok;
+    }
+    if (has_escapes &&
+        (hand->validator || !(hand->flags & jhn_raw_strings))) {
+        jhn__buf_clear(hand->decode_buf);
+        _MEM_CHK(decode_unescaped(hand, buf, buf_len));
+        text = jhn__buf_data(hand->decode_buf);
+        text_len = jhn__buf_len(hand->decode_buf);
+    }
+    if (hand->validator) {
+        jhn__validate_string_part(hand->validator, text, text_len);
+    }
+    if (!(hand->flags & jhn_raw_strings)) {
+        buf = text;
+        buf_len = text_len;
+    }
+    _CB_CHK(hand->callbacks->jhn_string_chunk(hand->ctx, buf, buf_len));
+    return jhn_parser_status_ok;
+}
+
+/* ends a streamed string, after its last fragment was passed on */
+static int
+string_end(jhn_parser_t *hand)
+{
+    hand->in_string = 0;
+    if (hand->callbacks->jhn_string_end) {
+        return USER_CALL(hand, hand->callbacks->jhn_string_end(hand->ctx));
+    }
+    return 1;
+}
+
+/* whether the client wants to see map keys */
+#define WANTS_KEYS(hand) ((hand)->callbacks &&                          \
+                          ((hand)->callbacks->jhn_map_key ||            \
+                           (hand)->callbacks->jhn_map_key_id))
+
+/* passes a map key to the client, with its index in the key set if
+   the client asked for one */
+static jhn_parser_status_t
+report_key(jhn_parser_t *hand, const char *key, size_t len)
+{
+    const jhn_parser_callbacks_t *cb = hand->callbacks;
+
+    if (hand->intern) {
+        key = jhn_intern(hand->intern, key, len);
+        _MEM_CHK(key);
+    }
+    if (cb->jhn_map_key_id) {
+        int id = hand->keyset ? jhn_keyset_lookup(hand->keyset, key, len)
+                              : -1;
+        _CB_CHK(cb->jhn_map_key_id(hand->ctx, id, key, len));
+    } else {
+        _CB_CHK(cb->jhn_map_key(hand->ctx, key, len));
+    }
+    return jhn_parser_status_ok;
+}
+
+/* with jhn_raw_strings escaped keys are passed on undecoded, so they
+   are treated like keys without escapes.  raw_key_escapes remembers
+   that they had some for the validator. */
+static jhn_tok_t
+raw_token(jhn_parser_t *hand, jhn_tok_t tok)
+{
+    if (hand->flags & jhn_raw_strings) {
+        if (tok == jhn_tok_string_with_escapes ||
+            tok == jhn_tok_string_fragment_with_escapes) {
+            hand->raw_key_escapes = 1;
+        }
+        if (tok == jhn_tok_string_with_escapes) {
+            return jhn_tok_string;
+        } else if (tok == jhn_tok_string_fragment_with_escapes) {
+            return jhn_tok_string_fragment;
+        }
+    }
+    return tok;
+}
+
+static JHN__PROFILED jhn_parser_status_t
 do_parse(jhn_parser_t *hand, const char *json_text, size_t length)
 {
     jhn_tok_t tok;
@@ -188,6 +431,13 @@ do_parse(jhn_parser_t *hand, const char *json_text, size_t length)
     *offset = 0;
 
 around_again:
+    if (hand->paused) {
+        hand->paused = 0;
+        return jhn_parser_status_paused;
+    }
+    if (hand->memory > hand->max_memory_limit && !hand->exceeded) {
+        _LIMIT_ERROR(jhn_max_memory, "maximum memory exceeded");
+    }
     switch (jhn__bs_current(hand->state_stack)) {
     case parser_state_parse_complete:
         if (hand->flags & jhn_allow_multiple_values) {
@@ -232,48 +482,103 @@ around_again:
         case jhn_tok_error:
             jhn__bs_set(hand->state_stack, parser_state_lexical_error);
             goto around_again;
+        case jhn_tok_string_fragment:
+        case jhn_tok_string_fragment_with_escapes:
+            /* the string is not complete yet so we stay in this state */
+            if (!hand->in_string) {
+                _SCHEMA_CHK(jhn__validate_string_begin(hand->validator));
+                hand->in_string = 1;
+                if (hand->callbacks->jhn_string_begin) {
+                    _CB_CHK(hand->callbacks->jhn_string_begin(hand->ctx));
+                }
+            }
+            _STATUS_CHK(string_chunk(hand, buf, buf_len,
+                        tok == jhn_tok_string_fragment_with_escapes));
+            goto around_again;
         case jhn_tok_string:
+            _REFORMAT(jhn__reformat_token(hand, json_text, length,
+                                          buf - 1, buf_len + 2));
+            if (hand->in_string) {
+                _STATUS_CHK(string_chunk(hand, buf, buf_len, 0));
+                _SCHEMA_CHK(jhn__validate_string_end(hand->validator));
+                _CC_CHK(string_end(hand));
+                break;
+            }
+            _SCHEMA_CHK(jhn__validate_string(hand->validator, buf, buf_len,
+                                             0));
             if (hand->callbacks && hand->callbacks->jhn_string) {
-                _CC_CHK(hand->callbacks->jhn_string(hand->ctx,
+                _CB_CHK(hand->callbacks->jhn_string(hand->ctx,
                                                     buf, buf_len));
             }
             break;
         case jhn_tok_string_with_escapes:
+            _REFORMAT(jhn__reformat_token(hand, json_text, length,
+                                          buf - 1, buf_len + 2));
+            if (hand->in_string) {
+                _STATUS_CHK(string_chunk(hand, buf, buf_len, 1));
+                _SCHEMA_CHK(jhn__validate_string_end(hand->validator));
+                _CC_CHK(string_end(hand));
+                break;
+            }
+            _SCHEMA_CHK(jhn__validate_string(hand->validator, buf, buf_len,
+                                             1));
             if (hand->callbacks && hand->callbacks->jhn_string) {
+                if (hand->flags & jhn_raw_strings) {
+                    _CB_CHK(hand->callbacks->jhn_string(hand->ctx,
+                                                        buf, buf_len));
+                    break;
+                }
                 jhn__buf_clear(hand->decode_buf);
-                jhn__string_decode(hand->decode_buf, buf, buf_len);
-                _CC_CHK(hand->callbacks->jhn_string(
+                _MEM_CHK(decode_unescaped(hand, buf, buf_len));
+                _CB_CHK(hand->callbacks->jhn_string(
                         hand->ctx, jhn__buf_data(hand->decode_buf),
                         jhn__buf_len(hand->decode_buf)));
             }
             break;
         case jhn_tok_bool:
+            _REFORMAT(jhn__reformat_token(hand, json_text, length,
+                                          buf, buf_len));
+            _SCHEMA_CHK(jhn__validate_bool(hand->validator,
+                                           *buf == 't'));
             if (hand->callbacks && hand->callbacks->jhn_boolean) {
-                _CC_CHK(hand->callbacks->jhn_boolean(hand->ctx,
+                _CB_CHK(hand->callbacks->jhn_boolean(hand->ctx,
                                                      *buf == 't'));
             }
             break;
         case jhn_tok_null:
+            _REFORMAT(jhn__reformat_token(hand, json_text, length,
+                                          buf, buf_len));
+            _SCHEMA_CHK(jhn__validate_null(hand->validator));
             if (hand->callbacks && hand->callbacks->jhn_null) {
-                _CC_CHK(hand->callbacks->jhn_null(hand->ctx));
+                _CB_CHK(hand->callbacks->jhn_null(hand->ctx));
             }
             break;
         case jhn_tok_left_bracket:
+            _DEPTH_CHK;
+            _SCHEMA_CHK(jhn__validate_start(hand->validator, 1));
+            _REFORMAT(jhn__reformat_open(hand, "{"));
             if (hand->callbacks && hand->callbacks->jhn_start_map) {
-                _CC_CHK(hand->callbacks->jhn_start_map(hand->ctx));
+                _CB_CHK(hand->callbacks->jhn_start_map(hand->ctx));
             }
             stateToPush = parser_state_map_start;
             break;
         case jhn_tok_left_brace:
+            _DEPTH_CHK;
+            _SCHEMA_CHK(jhn__validate_start(hand->validator, 0));
+            _REFORMAT(jhn__reformat_open(hand, "["));
             if (hand->callbacks && hand->callbacks->jhn_start_array) {
-                _CC_CHK(hand->callbacks->jhn_start_array(hand->ctx));
+                _CB_CHK(hand->callbacks->jhn_start_array(hand->ctx));
             }
             stateToPush = parser_state_array_start;
             break;
         case jhn_tok_integer:
+            _REFORMAT(jhn__reformat_token(hand, json_text, length,
+                                          buf, buf_len));
+            _SCHEMA_CHK(jhn__validate_number(hand->validator, buf, buf_len,
+                                             1));
             if (hand->callbacks) {
                 if (hand->callbacks->jhn_number) {
-                    _CC_CHK(hand->callbacks->jhn_number(
+                    _CB_CHK(hand->callbacks->jhn_number(
                                 hand->ctx,(const char *)buf, buf_len));
                 } else if (hand->callbacks->jhn_integer) {
                     long long int i = 0;
@@ -289,20 +594,24 @@ around_again:
                         else *offset = 0;
                         goto around_again;
                     }
-                    _CC_CHK(hand->callbacks->jhn_integer(hand->ctx,
+                    _CB_CHK(hand->callbacks->jhn_integer(hand->ctx,
                                                           i));
                 }
             }
             break;
         case jhn_tok_double:
+            _REFORMAT(jhn__reformat_token(hand, json_text, length,
+                                          buf, buf_len));
+            _SCHEMA_CHK(jhn__validate_number(hand->validator, buf, buf_len,
+                                             0));
             if (hand->callbacks) {
                 if (hand->callbacks->jhn_number) {
-                    _CC_CHK(hand->callbacks->jhn_number(
+                    _CB_CHK(hand->callbacks->jhn_number(
                                 hand->ctx, (const char *) buf, buf_len));
                 } else if (hand->callbacks->jhn_double) {
                     double d = 0.0;
                     jhn__buf_clear(hand->decode_buf);
-                    jhn__buf_append(hand->decode_buf, buf, buf_len);
+                    _MEM_CHK(decode_append(hand, buf, buf_len));
                     buf = jhn__buf_data(hand->decode_buf);
                     errno = 0;
                     d = strtod((char *) buf, NULL);
@@ -318,7 +627,7 @@ around_again:
                         else *offset = 0;
                         goto around_again;
                     }
-                    _CC_CHK(hand->callbacks->jhn_double(hand->ctx,
+                    _CB_CHK(hand->callbacks->jhn_double(hand->ctx,
                                                          d));
                 }
             }
@@ -326,12 +635,14 @@ around_again:
         case jhn_tok_right_brace: {
             if (jhn__bs_current(hand->state_stack) ==
                 parser_state_array_start) {
+                _SCHEMA_CHK(jhn__validate_end(hand->validator));
+                _REFORMAT(jhn__reformat_close(hand, "]"));
                 if (hand->callbacks &&
                     hand->callbacks->jhn_end_array)
                 {
-                    _CC_CHK(hand->callbacks->jhn_end_array(hand->ctx));
+                    _CB_CHK(hand->callbacks->jhn_end_array(hand->ctx));
                 }
-                jhn__bs_pop(hand->state_stack);
+                _POP_STATE;
                 goto around_again;
             }
             /* intentional fall-through */
@@ -352,6 +663,11 @@ around_again:
         {
             parser_state s = jhn__bs_current(hand->state_stack);
             if (s == parser_state_start || s == parser_state_got_value) {
+                JHN__TRACE2(doc__start, hand, hand->consumed + *offset);
+                if (stateToPush == parser_state_start) {
+                    JHN__TRACE2(doc__end, hand, hand->consumed + *offset);
+                    _REFORMAT(jhn__reformat_scalar_end(hand));
+                }
                 jhn__bs_set(hand->state_stack, parser_state_parse_complete);
             } else if (s == parser_state_map_need_val) {
                 jhn__bs_set(hand->state_stack, parser_state_map_got_val);
@@ -360,7 +676,13 @@ around_again:
             }
         }
         if (stateToPush != parser_state_start) {
+            if (jhn__bs_full(hand->state_stack)) {
+                jhn__bs_grow(hand->state_stack);
+                _MEM_CHK(!jhn__bs_full(hand->state_stack));
+            }
             jhn__bs_push(hand->state_stack, stateToPush);
+            JHN__STAT(if (hand->state_stack.used - 1 > hand->max_depth)
+                          hand->max_depth = hand->state_stack.used - 1);
         }
 
         goto around_again;
@@ -372,24 +694,56 @@ around_again:
          * a comma, and a string key _must_ follow */
         tok = jhn_lexer_lex(hand->lexer, json_text, length,
                            offset, &buf, &buf_len);
+        tok = raw_token(hand, tok);
+        /* printed before a validator gets to decode it */
+        if (tok == jhn_tok_string || tok == jhn_tok_string_with_escapes) {
+            _REFORMAT(jhn__reformat_token(hand, json_text, length,
+                                          buf - 1, buf_len + 2));
+        }
         switch (tok) {
             case jhn_tok_eof:
                 return jhn_parser_status_ok;
             case jhn_tok_error:
                 jhn__bs_set(hand->state_stack, parser_state_lexical_error);
                 goto around_again;
+            case jhn_tok_string_fragment:
+            case jhn_tok_string_fragment_with_escapes:
+                /* keys are collected and reported as a whole */
+                if (!hand->in_string) {
+                    hand->in_string = 1;
+                    jhn__buf_clear(hand->decode_buf);
+                }
+                if (tok == jhn_tok_string_fragment_with_escapes) {
+                    _MEM_CHK(decode_unescaped(hand, buf, buf_len));
+                } else {
+                    _MEM_CHK(decode_append(hand, buf, buf_len));
+                }
+                goto around_again;
             case jhn_tok_string_with_escapes:
-                if (hand->callbacks && hand->callbacks->jhn_map_key) {
+                if (hand->in_string) {
+                    _MEM_CHK(decode_unescaped(hand, buf, buf_len));
+                    buf = jhn__buf_data(hand->decode_buf);
+                    buf_len = jhn__buf_len(hand->decode_buf);
+                    hand->in_string = 0;
+                } else if (WANTS_KEYS(hand) || hand->validator) {
                     jhn__buf_clear(hand->decode_buf);
-                    jhn__string_decode(hand->decode_buf, buf, buf_len);
+                    _MEM_CHK(decode_unescaped(hand, buf, buf_len));
                     buf = jhn__buf_data(hand->decode_buf);
                     buf_len = jhn__buf_len(hand->decode_buf);
                 }
                 /* intentional fall-through */
             case jhn_tok_string:
-                if (hand->callbacks && hand->callbacks->jhn_map_key) {
-                    _CC_CHK(hand->callbacks->jhn_map_key(hand->ctx, buf,
-                                                          buf_len));
+                if (hand->in_string) {
+                    _MEM_CHK(decode_append(hand, buf, buf_len));
+                    buf = jhn__buf_data(hand->decode_buf);
+                    buf_len = jhn__buf_len(hand->decode_buf);
+                    hand->in_string = 0;
+                }
+                _SCHEMA_CHK(jhn__validate_key(hand->validator, buf, buf_len,
+                                              hand->raw_key_escapes));
+                hand->raw_key_escapes = 0;
+                if (WANTS_KEYS(hand)) {
+                    _STATUS_CHK(report_key(hand, buf, buf_len));
                 }
                 jhn__bs_set(hand->state_stack, parser_state_map_sep);
                 goto around_again;
@@ -397,12 +751,15 @@ around_again:
                 if (jhn__bs_current(hand->state_stack) ==
                     parser_state_map_start)
                 {
+                    _SCHEMA_CHK(jhn__validate_end(hand->validator));
+                    _REFORMAT(jhn__reformat_close(hand, "}"));
                     if (hand->callbacks && hand->callbacks->jhn_end_map) {
-                        _CC_CHK(hand->callbacks->jhn_end_map(hand->ctx));
+                        _CB_CHK(hand->callbacks->jhn_end_map(hand->ctx));
                     }
-                    jhn__bs_pop(hand->state_stack);
+                    _POP_STATE;
                     goto around_again;
                 }
+                /* fall through */
             default:
                 jhn__bs_set(hand->state_stack, parser_state_parse_error);
                 hand->parse_error =
@@ -415,6 +772,7 @@ around_again:
                            offset, &buf, &buf_len);
         switch (tok) {
             case jhn_tok_colon:
+                _REFORMAT(jhn__reformat_separator(hand, tok));
                 jhn__bs_set(hand->state_stack, parser_state_map_need_val);
                 goto around_again;
             case jhn_tok_eof:
@@ -434,12 +792,15 @@ around_again:
                            offset, &buf, &buf_len);
         switch (tok) {
             case jhn_tok_right_bracket:
+                _SCHEMA_CHK(jhn__validate_end(hand->validator));
+                _REFORMAT(jhn__reformat_close(hand, "}"));
                 if (hand->callbacks && hand->callbacks->jhn_end_map) {
-                    _CC_CHK(hand->callbacks->jhn_end_map(hand->ctx));
+                    _CB_CHK(hand->callbacks->jhn_end_map(hand->ctx));
                 }
-                jhn__bs_pop(hand->state_stack);
+                _POP_STATE;
                 goto around_again;
             case jhn_tok_comma:
+                _REFORMAT(jhn__reformat_separator(hand, tok));
                 jhn__bs_set(hand->state_stack, parser_state_map_need_key);
                 goto around_again;
             case jhn_tok_eof:
@@ -462,12 +823,15 @@ around_again:
                             offset, &buf, &buf_len);
         switch (tok) {
             case jhn_tok_right_brace:
+                _SCHEMA_CHK(jhn__validate_end(hand->validator));
+                _REFORMAT(jhn__reformat_close(hand, "]"));
                 if (hand->callbacks && hand->callbacks->jhn_end_array) {
-                    _CC_CHK(hand->callbacks->jhn_end_array(hand->ctx));
+                    _CB_CHK(hand->callbacks->jhn_end_array(hand->ctx));
                 }
-                jhn__bs_pop(hand->state_stack);
+                _POP_STATE;
                 goto around_again;
             case jhn_tok_comma:
+                _REFORMAT(jhn__reformat_separator(hand, tok));
                 jhn__bs_set(hand->state_stack, parser_state_array_need_val);
                 goto around_again;
             case jhn_tok_eof:
@@ -487,11 +851,37 @@ around_again:
     return jhn_parser_status_error;
 }
 
+/* a chunk through do_parse, for a reformatter also the end of it */
+static jhn_parser_status_t
+parse_chunk(jhn_parser_t *hand, const char *json_text, size_t length)
+{
+    jhn_parser_status_t status = do_parse(hand, json_text, length);
+
+    if (hand->reformat) {
+        status = jhn__reformat_done(hand, status);
+    }
+    return status;
+}
+
 static jhn_parser_status_t
 do_finish(jhn_parser_t *hand)
 {
     jhn_parser_status_t stat;
-    stat = do_parse(hand, " ",1);
+
+    /* feeding more data into a string that is being streamed would
+       only add to its contents, the input just ended in the middle */
+    if (hand->in_string &&
+        jhn__bs_current(hand->state_stack) != parser_state_parse_error &&
+        jhn__bs_current(hand->state_stack) != parser_state_lexical_error) {
+        if (!(hand->flags & jhn_allow_partial_values)) {
+            jhn__bs_set(hand->state_stack, parser_state_parse_error);
+            hand->parse_error = "premature EOF";
+            return jhn_parser_status_error;
+        }
+        return jhn_parser_status_ok;
+    }
+
+    stat = parse_chunk(hand, " ",1);
 
     if (stat != jhn_parser_status_ok) {
         return stat;
@@ -524,11 +914,75 @@ jhn_parser_status_to_string(jhn_parser_status_t stat)
         return "client canceled parse";
     case jhn_parser_status_error:
         return "parse error";
+    case jhn_parser_status_paused:
+        return "parse paused";
     default:
         return "unknown";
     }
 }
 
+/* the header and the bookkeeping of the routines above cost on every
+   allocation, so mem_alloc only goes through them when something looks
+   at the numbers: jhn_max_memory or the statistics.  Otherwise it is a
+   copy of alloc. */
+#ifdef JHN_STATS
+#  define JHN__TRACK_MEMORY 1
+#else
+#  define JHN__TRACK_MEMORY 0
+#endif
+
+static void
+set_tracking_funcs(jhn_parser_t *hand)
+{
+    hand->mem_alloc.malloc_func = parser_malloc;
+    hand->mem_alloc.realloc_func = parser_realloc;
+    hand->mem_alloc.free_func = parser_free;
+    hand->mem_alloc.ctx = hand;
+}
+
+/* switches mem_alloc to the tracking routines for jhn_max_memory.
+   Before the first parse only the decode buffer and the validator were
+   allocated, they are allocated again through the new routines.  Zero
+   if the parse has started or an allocation failed, mem_alloc is left
+   as it was then. */
+static int
+track_memory(jhn_parser_t *hand)
+{
+    jhn_alloc_funcs_t plain = hand->mem_alloc;
+    jhn__buf_t *decode_buf;
+    jhn__validator_t *validator = NULL;
+
+    if (hand->mem_alloc.malloc_func == parser_malloc) {
+        return 1;
+    }
+    if (hand->lexer) {
+        return 0;
+    }
+    set_tracking_funcs(hand);
+    decode_buf = jhn__buf_alloc(&(hand->mem_alloc));
+    if (decode_buf && hand->validator) {
+        validator = jhn__validator_alloc(
+            &(hand->mem_alloc), jhn__validator_schema(hand->validator));
+    }
+    if (!decode_buf || (hand->validator && !validator)) {
+        if (decode_buf) {
+            jhn__buf_free(decode_buf);
+        }
+        hand->mem_alloc = plain;
+        return 0;
+    }
+
+    /* the old blocks refer to mem_alloc as well, so it has to be the
+       plain routines while they are freed */
+    hand->mem_alloc = plain;
+    jhn__buf_free(hand->decode_buf);
+    jhn__validator_free(hand->validator);
+    set_tracking_funcs(hand);
+    hand->decode_buf = decode_buf;
+    hand->validator = validator;
+    return 1;
+}
+
 jhn_parser_t *
 jhn_parser_alloc(const jhn_parser_callbacks_t *callbacks,
                  jhn_alloc_funcs_t *afs, void *ctx)
@@ -543,22 +997,67 @@ jhn_parser_alloc(const jhn_parser_callbacks_t *callbacks,
     }
 
     hand = JO_MALLOC(afs, sizeof(jhn_parser_t));
+    if (!hand) {
+        return NULL;
+    }
 
     /* copy in pointers to allocation routines */
     hand->alloc = *afs;
+#if JHN__TRACK_MEMORY
+    set_tracking_funcs(hand);
+#else
+    hand->mem_alloc = *afs;
+#endif
+    hand->memory = sizeof(jhn_parser_t);
 
     hand->callbacks = callbacks;
     hand->ctx = ctx;
     hand->lexer = NULL; 
     hand->bytes_consumed = 0;
-    hand->decode_buf = jhn__buf_alloc(&(hand->alloc));
+    hand->decode_buf = jhn__buf_alloc(&(hand->mem_alloc));
+    if (!hand->decode_buf) {
+        JO_FREE(afs, hand);
+        return NULL;
+    }
     hand->flags	= 0;
-    jhn__bs_init(hand->state_stack, &(hand->alloc));
+    hand->in_string = 0;
+    hand->raw_key_escapes = 0;
+    hand->keyset = NULL;
+    hand->intern = NULL;
+    hand->validator = NULL;
+    hand->paused = 0;
+    hand->resuming = 0;
+    hand->chunks = 0;
+    hand->decode_bytes = 0;
+    hand->allocs = 0;
+    hand->alloc_bytes = 0;
+    /* the handle itself */
+    JHN__STAT(hand->allocs = 1; hand->alloc_bytes = sizeof(jhn_parser_t));
+    hand->max_depth = 0;
+    hand->callback_seconds = 0;
+    hand->total_seconds = 0;
+    hand->callback_started = 0;
+    hand->entered = 0;
+    hand->max_depth_limit = (size_t) -1;
+    hand->max_token_limit = (size_t) -1;
+    hand->max_bytes_limit = (size_t) -1;
+    hand->max_memory_limit = (size_t) -1;
+    hand->consumed = 0;
+    hand->exceeded = (jhn_parser_option) 0;
+    hand->reformat = NULL;
+    jhn__bs_init(hand->state_stack, &(hand->mem_alloc));
     jhn__bs_push(hand->state_stack, parser_state_start);
 
     return hand;
 }
 
+/* a limit passed to jhn_parser_config, zero means there is none */
+static size_t
+limit_arg(size_t limit)
+{
+    return limit ? limit : (size_t) -1;
+}
+
 int
 jhn_parser_config(jhn_parser_t *h, jhn_parser_option opt, ...)
 {
@@ -572,12 +1071,46 @@ jhn_parser_config(jhn_parser_t *h, jhn_parser_option opt, ...)
         case jhn_allow_trailing_garbage:
         case jhn_allow_multiple_values:
         case jhn_allow_partial_values:
+        case jhn_raw_strings:
             if (va_arg(ap, int)) {
                 h->flags |= opt;
             } else {
                 h->flags &= ~opt;
             }
             break;
+        case jhn_key_set:
+            h->keyset = va_arg(ap, const jhn_keyset_t *);
+            break;
+        case jhn_intern_keys:
+            h->intern = va_arg(ap, jhn_intern_t *);
+            break;
+        case jhn_validate_schema: {
+            const jhn_schema_t *schema = va_arg(ap, const jhn_schema_t *);
+            jhn__validator_free(h->validator);
+            h->validator = schema ?
+                jhn__validator_alloc(&(h->mem_alloc), schema) : NULL;
+            rv = !schema || h->validator;
+            break;
+        }
+        case jhn_max_depth:
+            h->max_depth_limit = limit_arg(va_arg(ap, size_t));
+            break;
+        case jhn_max_token_size:
+            h->max_token_limit = limit_arg(va_arg(ap, size_t));
+            if (h->lexer) {
+                jhn_lexer_config(h->lexer, jhn_lexer_max_token_size,
+                                 h->max_token_limit);
+            }
+            break;
+        case jhn_max_bytes:
+            h->max_bytes_limit = limit_arg(va_arg(ap, size_t));
+            break;
+        case jhn_max_memory:
+            h->max_memory_limit = limit_arg(va_arg(ap, size_t));
+            if (h->max_memory_limit != (size_t) -1) {
+                rv = track_memory(h);
+            }
+            break;
         default:
             rv = 0;
     }
@@ -592,6 +1125,7 @@ jhn_parser_free(jhn_parser_t *handle)
     if (handle) {
         jhn__bs_free(handle->state_stack);
         jhn__buf_free(handle->decode_buf);
+        jhn__validator_free(handle->validator);
         if (handle->lexer) {
             jhn_lexer_free(handle->lexer);
             handle->lexer = NULL;
@@ -600,19 +1134,55 @@ jhn_parser_free(jhn_parser_t *handle)
     }
 }
 
+/* zero if there is no memory for the lexer */
+static int
+ensure_lexer(jhn_parser_t *hand)
+{
+    if (hand->lexer == NULL) {
+        hand->lexer = jhn_lexer_alloc(&(hand->mem_alloc),
+                                      hand->flags & jhn_allow_comments,
+                                      !(hand->flags & jhn_dont_validate_strings));
+        if (!hand->lexer) {
+            return 0;
+        }
+        if (hand->callbacks && hand->callbacks->jhn_string_chunk) {
+            jhn_lexer_config(hand->lexer, jhn_lexer_stream_strings, 1);
+        }
+        jhn_lexer_config(hand->lexer, jhn_lexer_max_token_size,
+                         hand->max_token_limit);
+    }    return 1;
+}
+
 jhn_parser_status_t
 jhn_parser_parse(jhn_parser_t *hand, const char *json_text, size_t length)
 {
     jhn_parser_status_t status;
+    /* the part of the chunk that stays within max_bytes_limit */
+    size_t allowed = length;
 
     /* lazy allocation of the lexer */
-    if (hand->lexer == NULL) {
-        hand->lexer = jhn_lexer_alloc(&(hand->alloc),
-                                    hand->flags & jhn_allow_comments,
-                                    !(hand->flags & jhn_dont_validate_strings));
+    if (!ensure_lexer(hand)) {
+        return out_of_memory(hand);
     }
 
-    status = do_parse(hand, json_text, length);
+    JHN__TRACE2(parse__chunk, hand, length);
+    if (!hand->resuming) {
+        hand->chunks++;
+    }
+    if (length > hand->max_bytes_limit - hand->consumed) {
+        allowed = hand->max_bytes_limit - hand->consumed;
+    }
+    JHN__STAT(hand->entered = stats_clock());
+    status = parse_chunk(hand, json_text, allowed);
+    JHN__STAT(hand->total_seconds += stats_clock() - hand->entered);
+    hand->consumed += hand->bytes_consumed;
+    hand->resuming = status == jhn_parser_status_paused;
+
+    if (status == jhn_parser_status_ok && allowed < length) {
+        status = jhn__parser_limit_exceeded(hand, jhn_max_bytes,
+                                            "maximum input size exceeded");
+    }
+    JHN__TRACE2(parse__chunk__done, hand, status);
     return status;
 }
 
@@ -620,19 +1190,23 @@ jhn_parser_parse(jhn_parser_t *hand, const char *json_text, size_t length)
 jhn_parser_status_t
 jhn_parser_finish(jhn_parser_t *hand)
 {
+    jhn_parser_status_t status;
+
     /* The lexer is lazy allocated in the first call to parse.  if parse is
        never called, then no data was provided to parse at all.  This is a
        "premature EOF" error unless jhn_allow_partial_values is specified.
        allocating the lexer now is the simplest possible way to handle this
        case while preserving all the other semantics of the parser
        (multiple values, partial values, etc). */
-    if (hand->lexer == NULL) {
-        hand->lexer = jhn_lexer_alloc(&(hand->alloc),
-                                      hand->flags & jhn_allow_comments,
-                                      !(hand->flags & jhn_dont_validate_strings));
+    if (!ensure_lexer(hand)) {
+        return out_of_memory(hand);
     }
 
-    return do_finish(hand);
+    JHN__STAT(hand->entered = stats_clock());
+    status = do_finish(hand);
+    JHN__STAT(hand->total_seconds += stats_clock() - hand->entered);
+    JHN__TRACE2(parse__finish, hand, status);
+    return status;
 }
 
 char *
@@ -647,3 +1221,42 @@ jhn_parser_get_bytes_consumed(jhn_parser_t *hand)
 {
     return hand->bytes_consumed;
 }
+
+jhn_parser_option
+jhn_parser_get_exceeded_limit(jhn_parser_t *hand)
+{
+    if (hand->lexer &&
+        jhn__bs_current(hand->state_stack) == parser_state_lexical_error &&
+        jhn_lexer_get_error(hand->lexer) == jhn_lexer_token_too_large) {
+        return jhn_max_token_size;
+    }
+    return hand->exceeded;
+}
+
+void
+jhn_parser_pause(jhn_parser_t *hand)
+{
+    hand->paused = 1;
+}
+
+void
+jhn_parser_get_stats(jhn_parser_t *hand, jhn_parser_stats_t *stats)
+{
+    jhn_lexer_stats_t lexer_stats;
+
+    memset(&lexer_stats, 0, sizeof(lexer_stats));
+    if (hand->lexer) {
+        jhn_lexer_get_stats(hand->lexer, &lexer_stats);
+    }
+    stats->callback_seconds = hand->callback_seconds;
+    stats->library_seconds = hand->total_seconds - hand->callback_seconds;
+    stats->chunks = hand->chunks;
+    stats->bytes = hand->consumed;
+    stats->buffer_appends = lexer_stats.buffer_appends;
+    stats->buffer_bytes = lexer_stats.buffer_bytes;
+    memcpy(stats->tokens, lexer_stats.tokens, sizeof(stats->tokens));
+    stats->decode_bytes = hand->decode_bytes;
+    stats->allocs = hand->allocs;
+    stats->alloc_bytes = hand->alloc_bytes;
+    stats->max_depth = hand->max_depth;
+}
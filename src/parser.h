@@ -0,0 +1,148 @@
+#ifndef JHN_PARSER_H_INCLUDED
+#define JHN_PARSER_H_INCLUDED
+
+#include "common.h"
+
+#include "buf.h"
+#include "bytestack.h"
+#include "schema.h"
+#include "trace.h"
+
+/* the parser's internals, shared by parser.c and the reformatter */
+
+typedef enum {
+    parser_state_start = 0,
+    parser_state_parse_complete,
+    parser_state_parse_error,
+    parser_state_lexical_error,
+    parser_state_map_start,
+    parser_state_map_sep,
+    parser_state_map_need_val,
+    parser_state_map_got_val,
+    parser_state_map_need_key,
+    parser_state_array_start,
+    parser_state_array_got_val,
+    parser_state_array_need_val,
+    parser_state_got_value,
+} parser_state;
+
+struct jhn_parser_s {
+    /* memory allocation routines.  This needs to be first in the struct
+       so that jhn_free() works! */
+    jhn_alloc_funcs_t alloc;
+
+    const jhn_parser_callbacks_t *callbacks;
+    void *ctx;
+    jhn_lexer_t *lexer;
+    const char *parse_error;
+    /* the number of bytes consumed from the last client buffer,
+       in the case of an error this will be an error offset, in the
+       case of an error this can be used as the error offset */
+    size_t bytes_consumed;
+    /* temporary storage for decoded strings */
+    jhn__buf_t *decode_buf;
+    /* a stack of states.  access with parser_state_XXX routines */
+    jhn__bytestack_t state_stack;
+    /* bitfield */
+    unsigned int flags;
+    /* set while a string is reported in fragments (see
+       jhn_string_chunk).  For map keys the fragments are collected in
+       the decode_buf. */
+    unsigned int in_string;
+    /* set if the map key being lexed had escapes that jhn_raw_strings
+       passes on as written */
+    unsigned int raw_key_escapes;
+    /* known keys reported to jhn_map_key_id, may be NULL */
+    const jhn_keyset_t *keyset;
+    /* table the map keys are interned in, may be NULL */
+    jhn_intern_t *intern;
+    /* checks the input against a schema, may be NULL */
+    jhn__validator_t *validator;
+    /* set by jhn_parser_pause, makes do_parse return once the current
+       event has been reported */
+    unsigned int paused;
+    /* set if the last call to jhn_parser_parse paused, the next one
+       goes on with the rest of its chunk */
+    unsigned int resuming;
+    /* the chunks passed to jhn_parser_parse, for jhn_parser_get_stats */
+    size_t chunks;
+    /* the counters that are only kept with JHN_STATS, see stats.h */
+    size_t decode_bytes;
+    size_t allocs;
+    size_t alloc_bytes;
+    size_t max_depth;
+    double callback_seconds;
+    double total_seconds;
+    /* when the current callback and the current call into the parser
+       started */
+    double callback_started;
+    double entered;
+    /* the allocation routines for the lexer, the buffers and the schema
+       validator.  A copy of alloc, or routines that forward to it and
+       keep track of the memory the parser holds, its handle included,
+       if that is needed (see track_memory() in parser.c). */
+    jhn_alloc_funcs_t mem_alloc;
+    size_t memory;
+    /* the limits set with jhn_parser_config, (size_t) -1 if there is
+       none */
+    size_t max_depth_limit;
+    size_t max_token_limit;
+    size_t max_bytes_limit;
+    size_t max_memory_limit;
+    /* the bytes parsed so far, checked against max_bytes_limit */
+    size_t consumed;
+    /* the limit that stopped the parse, zero if none did */
+    jhn_parser_option exceeded;
+    /* the generator a parser from jhn_reformat_alloc copies its input
+       to, NULL for any other parser */
+    jhn_gen_t *reformat;
+};
+
+/* stops the parse because the limit set with opt was exceeded */
+jhn_parser_status_t jhn__parser_limit_exceeded(jhn_parser_t *hand,
+                                               jhn_parser_option opt,
+                                               const char *msg);
+
+#define _LIMIT_ERROR(opt, msg) \
+    return jhn__parser_limit_exceeded(hand, (opt), (msg))
+
+/* closes an array or map.  Closing the outermost one ends the
+   document. */
+#define _POP_STATE do {                                             \
+    jhn__bs_pop(hand->state_stack);                                 \
+    if (hand->state_stack.used == 1) {                              \
+        JHN__TRACE2(doc__end, hand, hand->consumed + *offset);      \
+    }                                                               \
+} while (0)
+
+/* checks that another array or map may be opened */
+#define _DEPTH_CHK do {                                             \
+    if (hand->state_stack.used > hand->max_depth_limit) {           \
+        _LIMIT_ERROR(jhn_max_depth,                                 \
+                     "maximum nesting depth exceeded");             \
+    }                                                               \
+} while (0)
+
+/* the output of a parser from jhn_reformat_alloc, see reformat.c.
+   do_parse calls them as it goes through the tokens of json_text.  A
+   value or key token is printed with its quotes. */
+void jhn__reformat_token(jhn_parser_t *hand, const char *json_text,
+                         size_t length, const char *str, size_t len);
+void jhn__reformat_open(jhn_parser_t *hand, const char *bracket);
+void jhn__reformat_close(jhn_parser_t *hand, const char *bracket);
+/* a comma or a colon */
+void jhn__reformat_separator(jhn_parser_t *hand, jhn_tok_t tok);
+/* after a document that is a single scalar */
+void jhn__reformat_scalar_end(jhn_parser_t *hand);
+/* at the end of every chunk, returns the status of the parse */
+jhn_parser_status_t jhn__reformat_done(jhn_parser_t *hand,
+                                       jhn_parser_status_t status);
+
+/* calls one of the above for a reformatter */
+#define _REFORMAT(x) do {                                           \
+    if (hand->reformat) {                                           \
+        x;                                                          \
+    }                                                               \
+} while (0)
+
+#endif
@@ -0,0 +1,151 @@
+#include "common.h"
+
+#include "gen.h"
+#include "parser.h"
+
+#include <assert.h>
+
+/* the reformatter goes from the lexer's tokens straight to the
+   generator's output.  do_parse in parser.c runs through the states as
+   for any other parser and calls the functions below for each token,
+   but a reformatter has no callbacks, so nothing is decoded: strings
+   (quotes included), numbers and literals are printed as they were
+   written, and only the whitespace between the tokens is replaced. */
+
+/* the whitespace in front of a value or key, the way the generator
+   puts it there */
+static void
+print_before(jhn_parser_t *hand, jhn_print_t print, void *ctx)
+{
+    jhn_gen_t *g = hand->reformat;
+
+    switch (jhn__bs_current(hand->state_stack)) {
+    case parser_state_start:
+    case parser_state_map_need_val:
+        break;
+    case parser_state_got_value:
+        /* beautified values already end in a newline */
+        if (!jhn__gen_beautify(g)) {
+            print(ctx, "\n", 1);
+        }
+        break;
+    default:
+        if (jhn__gen_beautify(g)) {
+            jhn__gen_newline_indent(g, hand->state_stack.used - 1);
+        }
+    }
+}
+
+/* prints the bracket that closes the innermost array or map */
+static void
+print_close(jhn_parser_t *hand, jhn_print_t print, void *ctx,
+            const char *bracket)
+{
+    jhn_gen_t *g = hand->reformat;
+    parser_state s = jhn__bs_current(hand->state_stack);
+
+    if (jhn__gen_beautify(g)) {
+        if (s == parser_state_map_start || s == parser_state_array_start) {
+            print(ctx, "\n", 1);
+        }
+        jhn__gen_newline_indent(g, hand->state_stack.used - 2);
+    }
+    print(ctx, bracket, 1);
+    if (jhn__gen_beautify(g) && hand->state_stack.used == 2) {
+        print(ctx, "\n", 1);
+    }
+}
+
+void
+jhn__reformat_token(jhn_parser_t *hand, const char *json_text,
+                    size_t length, const char *str, size_t len)
+{
+    jhn_gen_t *g = hand->reformat;
+    jhn_print_t print;
+    void *ctx;
+
+    jhn__gen_printer(g, &print, &ctx);
+    print_before(hand, print, ctx);
+    print(ctx, str, len);
+    /* the fd sink may reference long tokens instead of copying them,
+       which it must not do beyond the next lex if the token was carried
+       over from the previous chunk in the lexer's buffer */
+    if (str < json_text || str >= json_text + length) {
+        jhn__gen_flush_references(g);
+    }
+}
+
+void
+jhn__reformat_open(jhn_parser_t *hand, const char *bracket)
+{
+    jhn_print_t print;
+    void *ctx;
+
+    jhn__gen_printer(hand->reformat, &print, &ctx);
+    print_before(hand, print, ctx);
+    print(ctx, bracket, 1);
+}
+
+void
+jhn__reformat_close(jhn_parser_t *hand, const char *bracket)
+{
+    jhn_print_t print;
+    void *ctx;
+
+    jhn__gen_printer(hand->reformat, &print, &ctx);
+    print_close(hand, print, ctx, bracket);
+}
+
+void
+jhn__reformat_separator(jhn_parser_t *hand, jhn_tok_t tok)
+{
+    jhn_gen_t *g = hand->reformat;
+    jhn_print_t print;
+    void *ctx;
+
+    jhn__gen_printer(g, &print, &ctx);
+    if (tok == jhn_tok_comma) {
+        print(ctx, ",", 1);
+    } else if (jhn__gen_beautify(g)) {
+        print(ctx, ": ", 2);
+    } else {
+        print(ctx, ":", 1);
+    }
+}
+
+void
+jhn__reformat_scalar_end(jhn_parser_t *hand)
+{
+    jhn_print_t print;
+    void *ctx;
+
+    if (jhn__gen_beautify(hand->reformat)) {
+        jhn__gen_printer(hand->reformat, &print, &ctx);
+        print(ctx, "\n", 1);
+    }
+}
+
+jhn_parser_status_t
+jhn__reformat_done(jhn_parser_t *hand, jhn_parser_status_t status)
+{
+    /* json_text belongs to the caller again once we return */
+    jhn__gen_flush_references(hand->reformat);
+    if (jhn__gen_full(hand->reformat) &&
+        jhn__bs_current(hand->state_stack) != parser_state_parse_error &&
+        jhn__bs_current(hand->state_stack) != parser_state_lexical_error) {
+        jhn__bs_set(hand->state_stack, parser_state_parse_error);
+        hand->parse_error = "the generator's output buffer is full";
+        return jhn_parser_status_client_cancelled;
+    }
+    return status;
+}
+
+jhn_parser_t *
+jhn_reformat_alloc(jhn_gen_t *gen, jhn_alloc_funcs_t *afs)
+{
+    jhn_parser_t *hand = jhn_parser_alloc(NULL, afs, NULL);
+    if (hand) {
+        hand->reformat = gen;
+    }
+    return hand;
+}
@@ -0,0 +1,1065 @@
+#include "common.h"
+
+#include "alloc.h"
+#include "buf.h"
+#include "encode.h"
+#include "schema.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A schema is compiled into a tree of nodes, one per (sub)schema that
+   constrains anything.  Subschemas that allow any value are left out
+   (NULL) so that the validator can skip over the values they describe
+   without looking at them.  The properties of an object are found
+   through a key set, so every key costs one hash and one compare. */
+
+#define TYPE_NULL    0x01
+#define TYPE_BOOL    0x02
+#define TYPE_INTEGER 0x04
+#define TYPE_NUMBER  0x08
+#define TYPE_STRING  0x10
+#define TYPE_OBJECT  0x20
+#define TYPE_ARRAY   0x40
+/* the false schema, nothing is allowed */
+#define TYPE_NOTHING 0x80
+
+#define NO_LIMIT ((size_t) -1)
+
+#define WRONG_TYPE "schema violation: value has the wrong type"
+#define NOT_IN_ENUM "schema violation: value not in enum"
+#define OUT_OF_MEMORY "out of memory"
+
+/* the literals listed in an enum */
+#define ENUM_NULL  0x01
+#define ENUM_TRUE  0x02
+#define ENUM_FALSE 0x04
+
+typedef struct schema_node_s schema_node;
+
+typedef struct {
+    /* NULL if any value is allowed */
+    const schema_node *node;
+    /* bit in the set of required keys seen, -1 if not required */
+    long required;
+    /* zero if the key is only listed in required */
+    int declared;
+} schema_property;
+
+struct schema_node_s {
+    /* all nodes of a schema, for freeing */
+    schema_node *next_node;
+
+    /* allowed types, zero if all are */
+    unsigned int types;
+    int has_minimum;
+    int has_maximum;
+    int exclusive_minimum;
+    int exclusive_maximum;
+    double minimum;
+    double maximum;
+    size_t min_length;
+    size_t max_length;
+    size_t min_items;
+    size_t max_items;
+
+    /* names of the properties and required keys, NULL if there are
+       none.  The ids index properties. */
+    jhn_keyset_t *keys;
+    schema_property *properties;
+    size_t nrequired;
+    int additional_allowed;
+    const schema_node *additional;
+
+    const schema_node *items;
+
+    /* the values of enum if it is given, which are all scalars: the
+       literals as ENUM_ bits, the numbers and the strings (NULL if
+       there are none) */
+    int has_enum;
+    unsigned int enum_literals;
+    double *enum_numbers;
+    size_t enum_count;
+    jhn_keyset_t *enum_strings;
+};
+
+struct jhn_schema_s {
+    /* memory allocation routines.  This needs to be first in the struct
+       so that jhn_free() works! */
+    jhn_alloc_funcs_t alloc;
+
+    const schema_node *root;
+    schema_node *nodes;
+};
+
+typedef struct {
+    jhn_schema_t *schema;
+    const void *image;
+} compiler;
+
+#define KEYWORD(s) (len == sizeof(s) - 1 && memcmp(name, s, len) == 0)
+
+static int
+type_bits(const char *name, size_t len, unsigned int *types)
+{
+    if (KEYWORD("null")) {
+        *types |= TYPE_NULL;
+    } else if (KEYWORD("boolean")) {
+        *types |= TYPE_BOOL;
+    } else if (KEYWORD("integer")) {
+        *types |= TYPE_INTEGER;
+    } else if (KEYWORD("number")) {
+        *types |= TYPE_NUMBER;
+    } else if (KEYWORD("string")) {
+        *types |= TYPE_STRING;
+    } else if (KEYWORD("object")) {
+        *types |= TYPE_OBJECT;
+    } else if (KEYWORD("array")) {
+        *types |= TYPE_ARRAY;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int
+compile_types(compiler *c, size_t v, unsigned int *types)
+{
+    const char *name;
+    size_t len;
+
+    if (jhn_image_type(c->image, v) == jhn_image_array) {
+        for (v = jhn_image_first(c->image, v); v;
+             v = jhn_image_next(c->image, v)) {
+            name = jhn_image_get_string(c->image, v, &len);
+            if (!name || !type_bits(name, len, types)) {
+                return 0;
+            }
+        }
+        /* an empty list allows nothing */
+        if (*types == 0) {
+            *types = TYPE_NOTHING;
+        }
+        return 1;
+    }
+    name = jhn_image_get_string(c->image, v, &len);
+    return name && type_bits(name, len, types);
+}
+
+static int
+compile_number(compiler *c, size_t v, double *d)
+{
+    jhn_image_type_t t = jhn_image_type(c->image, v);
+
+    if (t != jhn_image_integer && t != jhn_image_double) {
+        return 0;
+    }
+    *d = jhn_image_get_double(c->image, v);
+    return 1;
+}
+
+static int
+compile_size(compiler *c, size_t v, size_t *size)
+{
+    long long n;
+
+    if (jhn_image_type(c->image, v) != jhn_image_integer) {
+        return 0;
+    }
+    n = jhn_image_get_integer(c->image, v);
+    if (n < 0) {
+        return 0;
+    }
+    *size = (size_t) n;
+    return 1;
+}
+
+/* compiles the values of enum, which have to be scalars */
+static int
+compile_enum(compiler *c, schema_node *node, size_t values)
+{
+    jhn_alloc_funcs_t *afs = &(c->schema->alloc);
+    const char **names;
+    size_t *lens;
+    size_t count = 0;
+    size_t nstrings = 0;
+    size_t k;
+    size_t i;
+    int ok = 1;
+
+    for (k = jhn_image_first(c->image, values); k;
+         k = jhn_image_next(c->image, k)) {
+        count++;
+    }
+    names = JO_MALLOC(afs, (count + 1) * sizeof(const char *));
+    lens = JO_MALLOC(afs, (count + 1) * sizeof(size_t));
+    node->enum_numbers = JO_MALLOC(afs, (count + 1) * sizeof(double));
+    node->has_enum = 1;
+    /* enum_numbers goes with the node */
+    ok = names && lens && node->enum_numbers;
+
+    for (k = jhn_image_first(c->image, values); ok && k;
+         k = jhn_image_next(c->image, k)) {
+        switch (jhn_image_type(c->image, k)) {
+        case jhn_image_null:
+            node->enum_literals |= ENUM_NULL;
+            break;
+        case jhn_image_bool:
+            node->enum_literals |= jhn_image_get_bool(c->image, k) ?
+                                   ENUM_TRUE : ENUM_FALSE;
+            break;
+        case jhn_image_integer:
+        case jhn_image_double:
+            node->enum_numbers[node->enum_count++] =
+                jhn_image_get_double(c->image, k);
+            break;
+        case jhn_image_string:
+            names[nstrings] = jhn_image_get_string(c->image, k,
+                                                   &(lens[nstrings]));
+            /* the key set does not take duplicates */
+            for (i = 0; i < nstrings; i++) {
+                if (lens[i] == lens[nstrings] &&
+                    memcmp(names[i], names[nstrings], lens[i]) == 0) {
+                    break;
+                }
+            }
+            if (i == nstrings) {
+                nstrings++;
+            }
+            break;
+        default:
+            /* maps and arrays are not supported */
+            ok = 0;
+        }
+    }
+
+    if (ok && nstrings) {
+        node->enum_strings = jhn_keyset_alloc(names, lens, nstrings, afs);
+        ok = node->enum_strings != NULL;
+    }
+    if (names) JO_FREE(afs, names);
+    if (lens) JO_FREE(afs, lens);
+    return ok;
+}
+
+static int compile(compiler *c, size_t v, const schema_node **out);
+
+/* builds the key set of an object schema from its properties and
+   required keywords, either of which may be zero */
+static int
+compile_properties(compiler *c, schema_node *node, size_t props,
+                   size_t required)
+{
+    jhn_alloc_funcs_t *afs = &(c->schema->alloc);
+    const char **names;
+    size_t *lens;
+    size_t count = 0;
+    size_t n;
+    size_t k;
+    size_t i;
+    int ok = 1;
+
+    for (k = props ? jhn_image_first(c->image, props) : 0; k;
+         k = jhn_image_next(c->image, jhn_image_next(c->image, k))) {
+        count++;
+    }
+    for (k = required ? jhn_image_first(c->image, required) : 0; k;
+         k = jhn_image_next(c->image, k)) {
+        count++;
+    }
+    if (count == 0) {
+        return 1;
+    }
+
+    names = JO_MALLOC(afs, count * sizeof(const char *));
+    lens = JO_MALLOC(afs, count * sizeof(size_t));
+    node->properties = JO_MALLOC(afs, count * sizeof(schema_property));
+    /* properties goes with the node */
+    ok = names && lens && node->properties;
+
+    n = 0;
+    for (k = props ? jhn_image_first(c->image, props) : 0; ok && k;
+         k = jhn_image_next(c->image, jhn_image_next(c->image, k))) {
+        names[n] = jhn_image_get_string(c->image, k, &(lens[n]));
+        node->properties[n].required = -1;
+        node->properties[n].declared = 1;
+        ok = compile(c, jhn_image_next(c->image, k),
+                     &(node->properties[n].node));
+        n++;
+    }
+    for (k = required ? jhn_image_first(c->image, required) : 0; ok && k;
+         k = jhn_image_next(c->image, k)) {
+        const char *name = jhn_image_get_string(c->image, k, &(lens[n]));
+
+        if (!name) {
+            ok = 0;
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (lens[i] == lens[n] && memcmp(names[i], name, lens[n]) == 0) {
+                break;
+            }
+        }
+        if (i == n) {
+            names[n] = name;
+            node->properties[n].node = NULL;
+            node->properties[n].declared = 0;
+            node->properties[n].required = -1;
+            n++;
+        }
+        if (node->properties[i].required < 0) {
+            node->properties[i].required = (long) node->nrequired++;
+        }
+    }
+
+    if (ok) {
+        node->keys = jhn_keyset_alloc(names, lens, n, afs);
+        ok = node->keys != NULL;
+    }
+    if (names) JO_FREE(afs, names);
+    if (lens) JO_FREE(afs, lens);
+    return ok;
+}
+
+/* compiles the subschema at v.  *out is set to NULL if the subschema
+   allows any value.  Returns zero if the subschema is not valid. */
+static int
+compile(compiler *c, size_t v, const schema_node **out)
+{
+    jhn_alloc_funcs_t *afs = &(c->schema->alloc);
+    schema_node *node;
+    size_t k;
+    size_t val = 0;
+    size_t props = 0;
+    size_t required = 0;
+    int exclusive_min_flag = 0;
+    int exclusive_max_flag = 0;
+    int ok = 1;
+
+    *out = NULL;
+    if (jhn_image_type(c->image, v) == jhn_image_bool &&
+        jhn_image_get_bool(c->image, v)) {
+        return 1;
+    }
+
+    node = JO_MALLOC(afs, sizeof(schema_node));
+    if (!node) {
+        return 0;
+    }
+    memset(node, 0, sizeof(schema_node));
+    node->max_length = NO_LIMIT;
+    node->max_items = NO_LIMIT;
+    node->additional_allowed = 1;
+    node->next_node = c->schema->nodes;
+    c->schema->nodes = node;
+
+    if (jhn_image_type(c->image, v) == jhn_image_bool) {
+        node->types = TYPE_NOTHING;
+        *out = node;
+        return 1;
+    }
+    if (jhn_image_type(c->image, v) != jhn_image_map) {
+        return 0;
+    }
+
+    for (k = jhn_image_first(c->image, v); ok && k;
+         k = jhn_image_next(c->image, val)) {
+        size_t len;
+        const char *name = jhn_image_get_string(c->image, k, &len);
+        jhn_image_type_t t;
+
+        val = jhn_image_next(c->image, k);
+        t = jhn_image_type(c->image, val);
+        if (KEYWORD("type")) {
+            ok = compile_types(c, val, &(node->types));
+        } else if (KEYWORD("minimum")) {
+            ok = compile_number(c, val, &(node->minimum));
+            node->has_minimum = 1;
+        } else if (KEYWORD("maximum")) {
+            ok = compile_number(c, val, &(node->maximum));
+            node->has_maximum = 1;
+        } else if (KEYWORD("exclusiveMinimum") && t == jhn_image_bool) {
+            exclusive_min_flag = jhn_image_get_bool(c->image, val);
+        } else if (KEYWORD("exclusiveMaximum") && t == jhn_image_bool) {
+            exclusive_max_flag = jhn_image_get_bool(c->image, val);
+        } else if (KEYWORD("exclusiveMinimum")) {
+            double d = 0;
+            ok = compile_number(c, val, &d);
+            if (!node->has_minimum || d >= node->minimum) {
+                node->minimum = d;
+                node->has_minimum = 1;
+                node->exclusive_minimum = 1;
+            }
+        } else if (KEYWORD("exclusiveMaximum")) {
+            double d = 0;
+            ok = compile_number(c, val, &d);
+            if (!node->has_maximum || d <= node->maximum) {
+                node->maximum = d;
+                node->has_maximum = 1;
+                node->exclusive_maximum = 1;
+            }
+        } else if (KEYWORD("minLength")) {
+            ok = compile_size(c, val, &(node->min_length));
+        } else if (KEYWORD("maxLength")) {
+            ok = compile_size(c, val, &(node->max_length));
+        } else if (KEYWORD("minItems")) {
+            ok = compile_size(c, val, &(node->min_items));
+        } else if (KEYWORD("maxItems")) {
+            ok = compile_size(c, val, &(node->max_items));
+        } else if (KEYWORD("properties")) {
+            ok = t == jhn_image_map;
+            props = val;
+        } else if (KEYWORD("required")) {
+            ok = t == jhn_image_array;
+            required = val;
+        } else if (KEYWORD("additionalProperties")) {
+            if (t == jhn_image_bool && !jhn_image_get_bool(c->image, val)) {
+                node->additional_allowed = 0;
+            } else {
+                ok = compile(c, val, &(node->additional));
+            }
+        } else if (KEYWORD("items")) {
+            /* the tuple form is not supported */
+            ok = t != jhn_image_array && compile(c, val, &(node->items));
+        } else if (KEYWORD("enum")) {
+            ok = t == jhn_image_array && !node->has_enum &&
+                 compile_enum(c, node, val);
+        }
+        /* other keywords are ignored */
+    }
+
+    /* the draft 4 form modifies minimum and maximum */
+    if (exclusive_min_flag && node->has_minimum) {
+        node->exclusive_minimum = 1;
+    }
+    if (exclusive_max_flag && node->has_maximum) {
+        node->exclusive_maximum = 1;
+    }
+    if (ok && (props || required)) {
+        ok = compile_properties(c, node, props, required);
+    }
+
+    if (node->types || node->has_minimum || node->has_maximum ||
+        node->min_length || node->max_length != NO_LIMIT ||
+        node->min_items || node->max_items != NO_LIMIT ||
+        node->keys || !node->additional_allowed || node->additional ||
+        node->items || node->has_enum) {
+        *out = node;
+    }
+    return ok;
+}
+
+static void
+tape_print(void *ctx, const char *str, size_t len)
+{
+    jhn__buf_append((jhn__buf_t *) ctx, str, len);
+}
+
+jhn_schema_t *
+jhn_schema_alloc(const char *schema, size_t len, jhn_alloc_funcs_t *afs)
+{
+    jhn_schema_t *s = NULL;
+    jhn_alloc_funcs_t afs_buffer;
+    jhn_tape_t *tape;
+    jhn_parser_t *parser;
+    jhn__buf_t *image;
+    compiler c;
+    int ok;
+
+    if (!afs) {
+        jhn__set_default_alloc_funcs(&afs_buffer);
+        afs = &afs_buffer;
+    }
+
+    s = JO_MALLOC(afs, sizeof(struct jhn_schema_s));
+    if (!s)
+        return NULL;
+
+    s->alloc = *afs;
+    s->root = NULL;
+    s->nodes = NULL;
+
+    /* the schema is recorded and turned into an image so that it can be
+       walked in any order */
+    tape = jhn_tape_alloc(&(s->alloc));
+    parser = tape ? jhn_tape_recorder_alloc(tape, &(s->alloc)) : NULL;
+    image = parser ? jhn__buf_alloc(&(s->alloc)) : NULL;
+    ok = image &&
+         jhn_parser_parse(parser, schema, len) == jhn_parser_status_ok &&
+         jhn_parser_finish(parser) == jhn_parser_status_ok &&
+         jhn_tape_write_image(tape, 0, tape_print, image);
+    if (ok) {
+        c.schema = s;
+        c.image = jhn__buf_data(image);
+        ok = compile(&c, jhn_image_root(c.image), &(s->root));
+    }
+    if (image) {
+        jhn__buf_free(image);
+    }
+    jhn_parser_free(parser);
+    jhn_tape_free(tape);
+
+    if (!ok) {
+        jhn_schema_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void
+jhn_schema_free(jhn_schema_t *s)
+{
+    if (s) {
+        while (s->nodes) {
+            schema_node *next = s->nodes->next_node;
+            jhn_keyset_free(s->nodes->keys);
+            jhn_keyset_free(s->nodes->enum_strings);
+            if (s->nodes->enum_numbers) {
+                JO_FREE(&(s->alloc), s->nodes->enum_numbers);
+            }
+            if (s->nodes->properties) {
+                JO_FREE(&(s->alloc), s->nodes->properties);
+            }
+            JO_FREE(&(s->alloc), s->nodes);
+            s->nodes = next;
+        }
+        JO_FREE(&(s->alloc), s);
+    }
+}
+
+typedef struct {
+    /* the schema of the map or array */
+    const schema_node *node;
+    int is_map;
+    /* in maps the schema of the value that follows the current key */
+    const schema_node *next;
+    /* the number of items or keys */
+    size_t count;
+    /* the required keys seen, tracked by a bitset in seen */
+    size_t required_seen;
+    size_t bits;
+} validator_frame;
+
+struct jhn__validator_s {
+    jhn_alloc_funcs_t *alloc;
+    const jhn_schema_t *schema;
+
+    /* open maps and arrays with a schema */
+    validator_frame *stack;
+    size_t depth;
+    size_t stack_size;
+    unsigned char *seen;
+    size_t seen_used;
+    size_t seen_size;
+    /* nesting depth inside a value that is not constrained */
+    size_t skip;
+    /* the schema of a string that is reported in fragments and the
+       number of characters so far */
+    const schema_node *string_node;
+    size_t chars;
+    /* set if a fragment could not be collected for the enum */
+    unsigned int string_lost;
+    /* strings decoded or collected for a lookup in an enum and keys
+       decoded for a lookup in the properties */
+    jhn__buf_t *enum_buf;
+};
+
+jhn__validator_t *
+jhn__validator_alloc(jhn_alloc_funcs_t *alloc, const jhn_schema_t *schema)
+{
+    jhn__validator_t *v = JO_MALLOC(alloc, sizeof(jhn__validator_t));
+
+    if (!v) {
+        return NULL;
+    }
+    memset(v, 0, sizeof(jhn__validator_t));
+    v->alloc = alloc;
+    v->schema = schema;
+    return v;
+}
+
+void
+jhn__validator_free(jhn__validator_t *v)
+{
+    if (v) {
+        if (v->stack) {
+            JO_FREE(v->alloc, v->stack);
+        }
+        if (v->seen) {
+            JO_FREE(v->alloc, v->seen);
+        }
+        if (v->enum_buf) {
+            jhn__buf_free(v->enum_buf);
+        }
+        JO_FREE(v->alloc, v);
+    }
+}
+
+const jhn_schema_t *
+jhn__validator_schema(const jhn__validator_t *v)
+{
+    return v->schema;
+}
+
+/* finds the schema of the value that starts now, NULL if it is not
+   constrained */
+static const char *
+enter_value(jhn__validator_t *v, const schema_node **node)
+{
+    validator_frame *top;
+
+    if (v->depth == 0) {
+        *node = v->schema->root;
+        return NULL;
+    }
+    top = &(v->stack[v->depth - 1]);
+    if (top->is_map) {
+        *node = top->next;
+        return NULL;
+    }
+    if (++top->count > top->node->max_items) {
+        return "schema violation: too many items";
+    }
+    *node = top->node->items;
+    return NULL;
+}
+
+static const char *
+check_type(const schema_node *node, unsigned int type)
+{
+    if (node->types && !(node->types & type)) {
+        return WRONG_TYPE;
+    }
+    return NULL;
+}
+
+/* null and the booleans, literal is the ENUM_ bit of the value */
+static const char *
+simple_value(jhn__validator_t *v, unsigned int type, unsigned int literal)
+{
+    const schema_node *node;
+    const char *err;
+
+    if (v->skip) {
+        return NULL;
+    }
+    if ((err = enter_value(v, &node)) != NULL || !node) {
+        return err;
+    }
+    if ((err = check_type(node, type)) != NULL) {
+        return err;
+    }
+    if (node->has_enum && !(node->enum_literals & literal)) {
+        return NOT_IN_ENUM;
+    }
+    return NULL;
+}
+
+const char *
+jhn__validate_null(jhn__validator_t *v)
+{
+    return simple_value(v, TYPE_NULL, ENUM_NULL);
+}
+
+const char *
+jhn__validate_bool(jhn__validator_t *v, int value)
+{
+    return simple_value(v, TYPE_BOOL, value ? ENUM_TRUE : ENUM_FALSE);
+}
+
+/* converts a number of the JSON text, zero if there was no memory for
+   a long one */
+static int
+number_value(jhn__validator_t *v, const char *num, size_t len, double *d)
+{
+    char tmp[64];
+    char *str = tmp;
+
+    if (len >= sizeof(tmp)) {
+        str = JO_MALLOC(v->alloc, len + 1);
+        if (!str) {
+            return 0;
+        }
+    }
+    memcpy(str, num, len);
+    str[len] = 0;
+    *d = strtod(str, NULL);
+    if (str != tmp) {
+        JO_FREE(v->alloc, str);
+    }
+    return 1;
+}
+
+const char *
+jhn__validate_number(jhn__validator_t *v, const char *num, size_t len,
+                     int is_integer)
+{
+    const schema_node *node;
+    const char *err;
+    double d = 0.0;
+    int have_value = 0;
+
+    if (v->skip) {
+        return NULL;
+    }
+    if ((err = enter_value(v, &node)) != NULL || !node) {
+        return err;
+    }
+    if (node->types &&
+        !(node->types & (TYPE_NUMBER | (is_integer ? TYPE_INTEGER : 0)))) {
+        /* a number with a fractional part of zero is an integer too */
+        if (is_integer || !(node->types & TYPE_INTEGER)) {
+            return WRONG_TYPE;
+        }
+        if (!number_value(v, num, len, &d)) {
+            return OUT_OF_MEMORY;
+        }
+        have_value = 1;
+        if (d != floor(d)) {
+            return WRONG_TYPE;
+        }
+    }
+    if (node->has_minimum || node->has_maximum) {
+        if (!have_value && !number_value(v, num, len, &d)) {
+            return OUT_OF_MEMORY;
+        }
+        if ((node->has_minimum &&
+             (d < node->minimum ||
+              (node->exclusive_minimum && d == node->minimum))) ||
+            (node->has_maximum &&
+             (d > node->maximum ||
+              (node->exclusive_maximum && d == node->maximum)))) {
+            return "schema violation: number out of range";
+        }
+        have_value = 1;
+    }
+    if (node->has_enum) {
+        size_t i;
+
+        if (!have_value && !number_value(v, num, len, &d)) {
+            return OUT_OF_MEMORY;
+        }
+        for (i = 0; i < node->enum_count; i++) {
+            if (node->enum_numbers[i] == d) {
+                return NULL;
+            }
+        }
+        return NOT_IN_ENUM;
+    }
+    return NULL;
+}
+
+/* the number of characters of UTF8 text */
+static size_t
+utf8_chars(const char *str, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) str;
+    size_t chars = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        chars += (p[i] & 0xc0) != 0x80;
+    }
+    return chars;
+}
+
+/* the number of characters of an escaped string without decoding it */
+static size_t
+escaped_chars(const char *str, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) str;
+    size_t chars = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        if (p[i] == '\\' && i + 1 < len) {
+            if (p[i + 1] == 'u') {
+                /* a surrogate pair is a single character */
+                if (i + 11 < len && (p[i + 2] == 'd' || p[i + 2] == 'D') &&
+                    strchr("89abAB", p[i + 3]) && p[i + 6] == '\\') {
+                    i += 6;
+                }
+                i += 6;
+            } else {
+                i += 2;
+            }
+            chars++;
+        } else {
+            chars += (p[i] & 0xc0) != 0x80;
+            i++;
+        }
+    }
+    return chars;
+}
+
+static const char *
+check_length(const schema_node *node, size_t chars)
+{
+    if (chars < node->min_length || chars > node->max_length) {
+        return "schema violation: string length out of range";
+    }
+    return NULL;
+}
+
+/* looks up an unescaped string in the enum of node */
+static const char *
+check_enum(const schema_node *node, const char *str, size_t len)
+{
+    /* an empty buffer has no data */
+    if (!str) {
+        str = "";
+    }
+    if (!node->enum_strings ||
+        jhn_keyset_lookup(node->enum_strings, str, len) < 0) {
+        return NOT_IN_ENUM;
+    }
+    return NULL;
+}
+
+/* the emptied buffer strings and keys are decoded or collected in,
+   NULL if there is no memory for it */
+static jhn__buf_t *
+enum_buf(jhn__validator_t *v)
+{
+    if (!v->enum_buf) {
+        v->enum_buf = jhn__buf_alloc(v->alloc);
+        if (!v->enum_buf) {
+            return NULL;
+        }
+    }
+    jhn__buf_clear(v->enum_buf);
+    return v->enum_buf;
+}
+
+const char *
+jhn__validate_string(jhn__validator_t *v, const char *str, size_t len,
+                     int has_escapes)
+{
+    const schema_node *node;
+    const char *err;
+
+    if (v->skip) {
+        return NULL;
+    }
+    if ((err = enter_value(v, &node)) != NULL || !node) {
+        return err;
+    }
+    if ((err = check_type(node, TYPE_STRING)) != NULL) {
+        return err;
+    }
+    if (node->min_length || node->max_length != NO_LIMIT) {
+        err = check_length(node, has_escapes ? escaped_chars(str, len)
+                                             : utf8_chars(str, len));
+        if (err) {
+            return err;
+        }
+    }
+    if (node->has_enum && has_escapes) {
+        jhn__buf_t *decoded = enum_buf(v);
+
+        if (!decoded || !jhn__buf_reserve(decoded, len)) {
+            return OUT_OF_MEMORY;
+        }
+        /* decoding never makes a string longer */
+        jhn__string_decode(decoded, str, len);
+        return check_enum(node, jhn__buf_data(decoded),
+                          jhn__buf_len(decoded));
+    }
+    if (node->has_enum) {
+        return check_enum(node, str, len);
+    }
+    return NULL;
+}
+
+const char *
+jhn__validate_string_begin(jhn__validator_t *v)
+{
+    const schema_node *node;
+    const char *err;
+
+    v->string_node = NULL;
+    v->chars = 0;
+    if (v->skip) {
+        return NULL;
+    }
+    if ((err = enter_value(v, &node)) != NULL || !node) {
+        return err;
+    }
+    v->string_node = node;
+    v->string_lost = 0;
+    if (node->has_enum && !enum_buf(v)) {
+        v->string_node = NULL;
+        return OUT_OF_MEMORY;
+    }
+    return check_type(node, TYPE_STRING);
+}
+
+void
+jhn__validate_string_part(jhn__validator_t *v, const char *str, size_t len)
+{
+    if (v->string_node) {
+        v->chars += utf8_chars(str, len);
+        if (v->string_node->has_enum) {
+            if (jhn__buf_reserve(v->enum_buf, len)) {
+                jhn__buf_append(v->enum_buf, str, len);
+            } else {
+                v->string_lost = 1;
+            }
+        }
+    }
+}
+
+const char *
+jhn__validate_string_end(jhn__validator_t *v)
+{
+    const schema_node *node = v->string_node;
+
+    const char *err;
+
+    v->string_node = NULL;
+    if (!node) {
+        return NULL;
+    }
+    if ((err = check_length(node, v->chars)) != NULL) {
+        return err;
+    }
+    if (node->has_enum) {
+        if (v->string_lost) {
+            return OUT_OF_MEMORY;
+        }
+        return check_enum(node, jhn__buf_data(v->enum_buf),
+                          jhn__buf_len(v->enum_buf));
+    }
+    return NULL;
+}
+
+const char *
+jhn__validate_key(jhn__validator_t *v, const char *key, size_t len,
+                  int has_escapes)
+{
+    validator_frame *top;
+    const schema_node *node;
+    int id;
+
+    if (v->skip) {
+        return NULL;
+    }
+    if (has_escapes) {
+        jhn__buf_t *decoded = enum_buf(v);
+
+        if (!decoded || !jhn__buf_reserve(decoded, len)) {
+            return OUT_OF_MEMORY;
+        }
+        jhn__string_decode(decoded, key, len);
+        key = jhn__buf_data(decoded);
+        len = jhn__buf_len(decoded);
+    }
+    top = &(v->stack[v->depth - 1]);
+    node = top->node;
+    top->count++;
+    id = node->keys ? jhn_keyset_lookup(node->keys, key, len) : -1;
+    if (id >= 0) {
+        const schema_property *p = &(node->properties[id]);
+        if (p->required >= 0) {
+            unsigned char *byte = v->seen + top->bits + p->required / 8;
+            unsigned char bit = (unsigned char) (1 << (p->required % 8));
+            if (!(*byte & bit)) {
+                *byte |= bit;
+                top->required_seen++;
+            }
+        }
+        if (p->declared) {
+            top->next = p->node;
+            return NULL;
+        }
+    }
+    if (!node->additional_allowed) {
+        return "schema violation: key not allowed";
+    }
+    top->next = node->additional;
+    return NULL;
+}
+
+const char *
+jhn__validate_start(jhn__validator_t *v, int is_map)
+{
+    const schema_node *node;
+    const char *err;
+    validator_frame *top;
+    size_t bytes;
+
+    if (v->skip) {
+        v->skip++;
+        return NULL;
+    }
+    if ((err = enter_value(v, &node)) != NULL) {
+        return err;
+    }
+    if (!node) {
+        v->skip = 1;
+        return NULL;
+    }
+    if ((err = check_type(node, is_map ? TYPE_OBJECT : TYPE_ARRAY)) != NULL) {
+        return err;
+    }
+
+    if (v->depth == v->stack_size) {
+        size_t size = v->stack_size ? v->stack_size * 2 : 16;
+        validator_frame *stack = JO_REALLOC(v->alloc, v->stack,
+                                            size * sizeof(validator_frame));
+        if (!stack) {
+            return OUT_OF_MEMORY;
+        }
+        v->stack = stack;
+        v->stack_size = size;
+    }
+    bytes = is_map ? (node->nrequired + 7) / 8 : 0;
+    if (v->seen_size - v->seen_used < bytes) {
+        size_t size = v->seen_size;
+        unsigned char *seen;
+
+        while (size - v->seen_used < bytes) {
+            size = size ? size * 2 : 64;
+        }
+        seen = JO_REALLOC(v->alloc, v->seen, size);
+        if (!seen) {
+            return OUT_OF_MEMORY;
+        }
+        v->seen = seen;
+        v->seen_size = size;
+    }
+    top = &(v->stack[v->depth++]);
+    top->node = node;
+    top->is_map = is_map;
+    top->next = NULL;
+    top->count = 0;
+    top->required_seen = 0;
+    top->bits = v->seen_used;
+    if (bytes) {
+        memset(v->seen + v->seen_used, 0, bytes);
+        v->seen_used += bytes;
+    }
+    return NULL;
+}
+
+const char *
+jhn__validate_end(jhn__validator_t *v)
+{
+    validator_frame *top;
+
+    if (v->skip) {
+        v->skip--;
+        return NULL;
+    }
+    top = &(v->stack[--v->depth]);
+    v->seen_used = top->bits;
+    if (top->is_map) {
+        if (top->required_seen < top->node->nrequired) {
+            return "schema violation: required key missing";
+        }
+    } else if (top->count < top->node->min_items) {
+        return "schema violation: too few items";
+    }
+    return NULL;
+}
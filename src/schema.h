@@ -0,0 +1,48 @@
+#ifndef JHN_SCHEMA_H_INCLUDED
+#define JHN_SCHEMA_H_INCLUDED
+
+#include "common.h"
+
+#include "alloc.h"
+
+/* A validator follows the events of a parse and checks them against a
+   schema.  Every function returns NULL if the event is allowed and a
+   statically allocated description of the violation otherwise, which
+   is "out of memory" if the validator could not allocate what it
+   needs. */
+typedef struct jhn__validator_s jhn__validator_t;
+
+jhn__validator_t *jhn__validator_alloc(jhn_alloc_funcs_t *alloc,
+                                       const jhn_schema_t *schema);
+
+void jhn__validator_free(jhn__validator_t *v);
+
+/* the schema the validator was allocated for */
+const jhn_schema_t *jhn__validator_schema(const jhn__validator_t *v);
+
+const char *jhn__validate_null(jhn__validator_t *v);
+const char *jhn__validate_bool(jhn__validator_t *v, int value);
+
+/* num is the number as it appears in the JSON text */
+const char *jhn__validate_number(jhn__validator_t *v, const char *num,
+                                 size_t len, int is_integer);
+
+/* a complete string, still escaped if has_escapes is set */
+const char *jhn__validate_string(jhn__validator_t *v, const char *str,
+                                 size_t len, int has_escapes);
+
+/* a string that is reported in fragments: begin, the unescaped
+   fragments and end */
+const char *jhn__validate_string_begin(jhn__validator_t *v);
+void jhn__validate_string_part(jhn__validator_t *v, const char *str,
+                               size_t len);
+const char *jhn__validate_string_end(jhn__validator_t *v);
+
+/* a map key, still escaped if has_escapes is set */
+const char *jhn__validate_key(jhn__validator_t *v, const char *key,
+                              size_t len, int has_escapes);
+
+const char *jhn__validate_start(jhn__validator_t *v, int is_map);
+const char *jhn__validate_end(jhn__validator_t *v);
+
+#endif
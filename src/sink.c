@@ -0,0 +1,246 @@
+#include "common.h"
+
+#include "sink.h"
+#include "buf.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(WIN32)
+#  include <io.h>
+#else
+#  include <sys/uio.h>
+#  include <unistd.h>
+#endif
+
+/* the number of pieces that are collected before they are written out
+   with a single writev call */
+#define JHN_FDSINK_IOVECS 16
+/* the size of the buffer small writes are collected in */
+#define JHN_FDSINK_BUF_SIZE 4096
+/* writes of at least this size are not copied but referenced */
+#define JHN_FDSINK_REF_SIZE 512
+
+#if defined(_WIN32) || defined(WIN32)
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+
+static long
+writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    /* no writev on windows, write the pieces one by one and stop at the
+       first one that is not written completely */
+    long total = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        int rv = _write(fd, iov[i].iov_base, (unsigned int)iov[i].iov_len);
+        if (rv < 0) {
+            return total > 0 ? total : rv;
+        }
+        total += rv;
+        if ((size_t)rv < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+#endif
+
+#if defined(EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
+#  define WOULD_BLOCK(e) ((e) == EAGAIN || (e) == EWOULDBLOCK)
+#else
+#  define WOULD_BLOCK(e) ((e) == EAGAIN)
+#endif
+
+struct jhn__fdsink_s {
+    jhn_alloc_funcs_t *alloc;
+    int fd;
+    int failed;
+    int references;
+    int iov_used;
+    struct iovec iov[JHN_FDSINK_IOVECS];
+    size_t buf_used;
+    char buf[JHN_FDSINK_BUF_SIZE];
+    /* output that was not written because a non-blocking fd was full.
+       It is written out before the pieces in iov, starting at
+       blocked_off. */
+    jhn__buf_t *blocked;
+    size_t blocked_off;
+};
+
+jhn__fdsink_t *
+jhn__fdsink_alloc(jhn_alloc_funcs_t *alloc, int fd)
+{
+    jhn__fdsink_t *sink = JO_MALLOC(alloc, sizeof(struct jhn__fdsink_s));
+    if (!sink) {
+        return NULL;
+    }
+    memset(sink, 0, sizeof(struct jhn__fdsink_s));
+    sink->alloc = alloc;
+    sink->fd = fd;
+    return sink;
+}
+
+void
+jhn__fdsink_free(jhn__fdsink_t *sink)
+{
+    assert(sink);
+    if (sink->blocked) {
+        jhn__buf_free(sink->blocked);
+    }
+    JO_FREE(sink->alloc, sink);
+}
+
+void
+jhn__fdsink_append(jhn__fdsink_t *sink, const void *data, size_t len)
+{
+    struct iovec *last;
+
+    if (len == 0 || sink->failed) {
+        return;
+    }
+
+    if (len >= JHN_FDSINK_REF_SIZE) {
+        if (sink->iov_used == JHN_FDSINK_IOVECS) {
+            jhn__fdsink_flush(sink);
+        }
+        sink->iov[sink->iov_used].iov_base = (void *)data;
+        sink->iov[sink->iov_used].iov_len = len;
+        sink->iov_used++;
+        sink->references = 1;
+        return;
+    }
+
+    if (sink->buf_used + len > JHN_FDSINK_BUF_SIZE) {
+        jhn__fdsink_flush(sink);
+    }
+
+    /* extend the last piece if it ends where we continue to copy */
+    last = sink->iov_used ? &sink->iov[sink->iov_used - 1] : NULL;
+    if (last && (char *)last->iov_base + last->iov_len ==
+                sink->buf + sink->buf_used) {
+        last->iov_len += len;
+    } else {
+        if (sink->iov_used == JHN_FDSINK_IOVECS) {
+            jhn__fdsink_flush(sink);
+        }
+        sink->iov[sink->iov_used].iov_base = sink->buf + sink->buf_used;
+        sink->iov[sink->iov_used].iov_len = len;
+        sink->iov_used++;
+    }
+    memcpy(sink->buf + sink->buf_used, data, len);
+    sink->buf_used += len;
+}
+
+/* writes the pieces until all of them are written or writev fails.
+   The pieces that are left are passed back through iov and iovcnt. */
+static jhn__fdsink_status_t
+write_pieces(int fd, struct iovec **iov_p, int *iovcnt_p)
+{
+    struct iovec *iov = *iov_p;
+    int iovcnt = *iovcnt_p;
+    jhn__fdsink_status_t status = jhn__fdsink_ok;
+
+    while (iovcnt > 0) {
+        long written = (long)writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = WOULD_BLOCK(errno) ? jhn__fdsink_blocked
+                                        : jhn__fdsink_failed;
+            break;
+        }
+        /* skip what was written, partial writes can stop anywhere */
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= (long)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+
+    *iov_p = iov;
+    *iovcnt_p = iovcnt;
+    return status;
+}
+
+/* writes out what was blocked earlier */
+static jhn__fdsink_status_t
+write_blocked(jhn__fdsink_t *sink)
+{
+    struct iovec piece;
+    struct iovec *iov = &piece;
+    int iovcnt = 1;
+    jhn__fdsink_status_t status;
+    size_t len = sink->blocked ? jhn__buf_len(sink->blocked) : 0;
+
+    if (sink->blocked_off == len) {
+        return jhn__fdsink_ok;
+    }
+    piece.iov_base = (char *)jhn__buf_data(sink->blocked) + sink->blocked_off;
+    piece.iov_len = len - sink->blocked_off;
+    status = write_pieces(sink->fd, &iov, &iovcnt);
+    if (iovcnt == 0) {
+        jhn__buf_clear(sink->blocked);
+        sink->blocked_off = 0;
+    } else {
+        sink->blocked_off = len - piece.iov_len;
+    }
+    return status;
+}
+
+jhn__fdsink_status_t
+jhn__fdsink_flush(jhn__fdsink_t *sink)
+{
+    struct iovec *iov = sink->iov;
+    int iovcnt = sink->iov_used;
+    jhn__fdsink_status_t status = jhn__fdsink_failed;
+
+    if (!sink->failed) {
+        status = write_blocked(sink);
+    }
+    if (status == jhn__fdsink_ok) {
+        status = write_pieces(sink->fd, &iov, &iovcnt);
+    }
+
+    if (status == jhn__fdsink_blocked) {
+        /* keep a copy of what is left since the pieces may reference
+           memory of the caller */
+        if (!sink->blocked) {
+            sink->blocked = jhn__buf_alloc(sink->alloc);
+        }
+        if (!sink->blocked) {
+            /* the output would be lost, which is a failed write */
+            status = jhn__fdsink_failed;
+        }
+        for (; sink->blocked && iovcnt > 0; iov++, iovcnt--) {
+            jhn__buf_append(sink->blocked, iov->iov_base, iov->iov_len);
+        }
+    }
+    if (status == jhn__fdsink_failed) {
+        sink->failed = 1;
+        if (sink->blocked) {
+            jhn__buf_clear(sink->blocked);
+            sink->blocked_off = 0;
+        }
+    }
+
+    sink->iov_used = 0;
+    sink->buf_used = 0;
+    sink->references = 0;
+    return status;
+}
+
+int
+jhn__fdsink_has_references(jhn__fdsink_t *sink)
+{
+    return sink->references;
+}
@@ -0,0 +1,39 @@
+#ifndef JHN_SINK_H_INCLUDED
+#define JHN_SINK_H_INCLUDED
+
+#include "common.h"
+
+#include "alloc.h"
+
+typedef struct jhn__fdsink_s jhn__fdsink_t;
+
+typedef enum {
+    /* everything was written */
+    jhn__fdsink_ok,
+    /* the fd is non-blocking and full.  What was not written is kept
+       and goes out with the next flush. */
+    jhn__fdsink_blocked,
+    /* writing failed now or at an earlier point, output is discarded */
+    jhn__fdsink_failed
+} jhn__fdsink_status_t;
+
+/* allocate a sink that writes to a file descriptor, NULL if there is
+   no memory for it */
+jhn__fdsink_t *jhn__fdsink_alloc(jhn_alloc_funcs_t *alloc, int fd);
+
+/* free the sink.  This does not flush and does not close the fd */
+void jhn__fdsink_free(jhn__fdsink_t *sink);
+
+/* queue a number of bytes for writing.  Small writes are copied into
+   an internal buffer, large ones are referenced and need to be flushed
+   before the memory goes away (see jhn__fdsink_has_references). */
+void jhn__fdsink_append(jhn__fdsink_t *sink, const void *data, size_t len);
+
+/* write out everything that is queued */
+jhn__fdsink_status_t jhn__fdsink_flush(jhn__fdsink_t *sink);
+
+/* non zero if queued data references memory that was passed to
+   jhn__fdsink_append instead of being copied */
+int jhn__fdsink_has_references(jhn__fdsink_t *sink);
+
+#endif
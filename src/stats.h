@@ -0,0 +1,17 @@
+#ifndef JHN_STATS_H_INCLUDED
+#define JHN_STATS_H_INCLUDED
+
+#include "common.h"
+
+/* the counters that cost something on the hot path (tokens by type,
+   decoded bytes, allocations, nesting depth, callback time and the
+   generator's output) are only kept if the library is compiled with
+   JHN_STATS defined.  Otherwise JHN__STAT(x) drops the statement x and
+   these fields of the stats structs stay zero. */
+#ifdef JHN_STATS
+#  define JHN__STAT(x) do { x; } while (0)
+#else
+#  define JHN__STAT(x) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,861 @@
+#include "common.h"
+
+#include "alloc.h"
+#include "buf.h"
+#include "encode.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* every event on the tape is a single tag byte followed by its payload.
+   Integers and doubles are stored as 8 little endian bytes, strings and
+   keys as their length (a little endian base 128 varint) followed by
+   the unescaped bytes. */
+typedef enum {
+    tape_null = 1,
+    tape_false,
+    tape_true,
+    tape_integer,
+    tape_double,
+    tape_string,
+    tape_map_key,
+    tape_start_map,
+    tape_end_map,
+    tape_start_array,
+    tape_end_array
+} tape_tag;
+
+struct jhn_tape_s {
+    /* memory allocation routines.  This needs to be first in the struct
+       so that jhn_free() works! */
+    jhn_alloc_funcs_t alloc;
+
+    jhn__buf_t *buf;
+};
+
+/* a single decoded event */
+typedef struct {
+    tape_tag tag;
+    long long integer;
+    double number;
+    const char *str;
+    size_t len;
+    /* offset just past the end of a map or array in an image */
+    size_t end;
+} tape_event;
+
+/* an image starts with a fixed size header, all fields little endian:
+
+      0  magic "JHNI"
+      4  format version (32 bit)
+      8  key chosen by the writer (64 bit)
+     16  length of the events following the header (64 bit)
+     24  FNV-1a checksum of those events (64 bit)
+
+   The events are those of the tape except that the tag of every map and
+   array start is followed by the 64 bit offset of the first byte after
+   its end tag, counted from the start of the image. */
+#define IMAGE_MAGIC "JHNI"
+#define IMAGE_VERSION 1
+#define IMAGE_HEADER_SIZE 32
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+jhn_tape_t *
+jhn_tape_alloc(jhn_alloc_funcs_t *afs)
+{
+    jhn_tape_t *tape = NULL;
+    jhn_alloc_funcs_t afs_buffer;
+
+    if (!afs) {
+        jhn__set_default_alloc_funcs(&afs_buffer);
+        afs = &afs_buffer;
+    }
+
+    tape = JO_MALLOC(afs, sizeof(struct jhn_tape_s));
+    if (!tape)
+        return NULL;
+
+    tape->alloc = *afs;
+    tape->buf = jhn__buf_alloc(&(tape->alloc));
+    if (!tape->buf) {
+        JO_FREE(afs, tape);
+        return NULL;
+    }
+
+    return tape;
+}
+
+void
+jhn_tape_free(jhn_tape_t *tape)
+{
+    if (tape) {
+        jhn__buf_free(tape->buf);
+        JO_FREE(&(tape->alloc), tape);
+    }
+}
+
+void
+jhn_tape_clear(jhn_tape_t *tape)
+{
+    jhn__buf_clear(tape->buf);
+}
+
+void
+jhn_tape_get_buf(const jhn_tape_t *tape, const char **buf, size_t *len)
+{
+    if (buf) {
+        *buf = jhn__buf_data(tape->buf);
+    }
+    if (len) {
+        *len = jhn__buf_len(tape->buf);
+    }
+}
+
+static void
+put_tag(jhn_tape_t *tape, tape_tag tag)
+{
+    unsigned char c = (unsigned char) tag;
+    jhn__buf_append(tape->buf, &c, 1);
+}
+
+static void
+store_u64(unsigned char *out, unsigned long long v)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        out[i] = (unsigned char) (v & 0xff);
+        v >>= 8;
+    }
+}
+
+static unsigned long long
+load_u64(const unsigned char *in)
+{
+    unsigned long long v = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+        v = (v << 8) | in[i];
+    }
+    return v;
+}
+
+static void
+put_u64(jhn_tape_t *tape, tape_tag tag, unsigned long long v)
+{
+    unsigned char bytes[9];
+
+    bytes[0] = (unsigned char) tag;
+    store_u64(bytes + 1, v);
+    jhn__buf_append(tape->buf, bytes, sizeof(bytes));
+}
+
+static void
+put_string(jhn_tape_t *tape, tape_tag tag, const char *str, size_t len)
+{
+    unsigned char bytes[1 + 10];
+    size_t n = 1;
+    size_t v = len;
+
+    bytes[0] = (unsigned char) tag;
+    do {
+        bytes[n] = (unsigned char) (v & 0x7f);
+        v >>= 7;
+        if (v) {
+            bytes[n] |= 0x80;
+        }
+        n++;
+    } while (v);
+    jhn__buf_append(tape->buf, bytes, n);
+    jhn__buf_append(tape->buf, str, len);
+}
+
+static int
+record_null(void *ctx)
+{
+    put_tag((jhn_tape_t *)ctx, tape_null);
+    return 1;
+}
+
+static int
+record_boolean(void *ctx, int val)
+{
+    put_tag((jhn_tape_t *)ctx, val ? tape_true : tape_false);
+    return 1;
+}
+
+static int
+record_integer(void *ctx, long long val)
+{
+    put_u64((jhn_tape_t *)ctx, tape_integer, (unsigned long long) val);
+    return 1;
+}
+
+static int
+record_double(void *ctx, double val)
+{
+    unsigned long long bits;
+    memcpy(&bits, &val, sizeof(bits));
+    put_u64((jhn_tape_t *)ctx, tape_double, bits);
+    return 1;
+}
+
+static int
+record_string(void *ctx, const char *val, size_t len)
+{
+    put_string((jhn_tape_t *)ctx, tape_string, val, len);
+    return 1;
+}
+
+static int
+record_map_key(void *ctx, const char *val, size_t len)
+{
+    put_string((jhn_tape_t *)ctx, tape_map_key, val, len);
+    return 1;
+}
+
+static int
+record_start_map(void *ctx)
+{
+    put_tag((jhn_tape_t *)ctx, tape_start_map);
+    return 1;
+}
+
+static int
+record_end_map(void *ctx)
+{
+    put_tag((jhn_tape_t *)ctx, tape_end_map);
+    return 1;
+}
+
+static int
+record_start_array(void *ctx)
+{
+    put_tag((jhn_tape_t *)ctx, tape_start_array);
+    return 1;
+}
+
+static int
+record_end_array(void *ctx)
+{
+    put_tag((jhn_tape_t *)ctx, tape_end_array);
+    return 1;
+}
+
+static const jhn_parser_callbacks_t recorder_callbacks = {
+    record_null,
+    record_boolean,
+    record_integer,
+    record_double,
+    NULL,
+    record_string,
+    record_start_map,
+    record_map_key,
+    record_end_map,
+    record_start_array,
+    record_end_array,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+jhn_parser_t *
+jhn_tape_recorder_alloc(jhn_tape_t *tape, jhn_alloc_funcs_t *afs)
+{
+    return jhn_parser_alloc(&recorder_callbacks, afs, tape);
+}
+
+/* decodes the event at *pos and moves *pos past it.  If image is set
+   the events are those of an image.  Returns zero at the end of the
+   data or if it is truncated. */
+static int
+next_event(const unsigned char *data, size_t len, size_t *pos,
+           tape_event *ev, int image)
+{
+    size_t p = *pos;
+    unsigned long long v;
+
+    if (p >= len) {
+        return 0;
+    }
+    ev->tag = (tape_tag) data[p++];
+    switch (ev->tag) {
+        case tape_integer:
+        case tape_double:
+            if (len - p < 8) {
+                return 0;
+            }
+            v = load_u64(data + p);
+            p += 8;
+            if (ev->tag == tape_integer) {
+                ev->integer = (long long) v;
+            } else {
+                memcpy(&(ev->number), &v, sizeof(v));
+            }
+            break;
+        case tape_string:
+        case tape_map_key: {
+            size_t n = 0;
+            int shift = 0;
+            do {
+                if (p >= len || shift >= 64) {
+                    return 0;
+                }
+                n |= (size_t) (data[p] & 0x7f) << shift;
+                shift += 7;
+            } while (data[p++] & 0x80);
+            if (len - p < n) {
+                return 0;
+            }
+            ev->str = (const char *) data + p;
+            ev->len = n;
+            p += n;
+            break;
+        }
+        case tape_start_map:
+        case tape_start_array:
+            if (image) {
+                if (len - p < 8) {
+                    return 0;
+                }
+                v = load_u64(data + p);
+                p += 8;
+                if (v < p || v > len) {
+                    return 0;
+                }
+                ev->end = (size_t) v;
+            }
+            break;
+        default:
+            break;
+    }
+    *pos = p;
+    return 1;
+}
+
+static size_t
+format_number(char *out, const tape_event *ev)
+{
+    if (ev->tag == tape_integer) {
+        return sprintf(out, "%lld", ev->integer);
+    }
+    return jhn__double_format(out, ev->number);
+}
+
+#define REPLAY_CB(func, args) do {                                      \
+    if (cb && cb->func && !cb->func args) {                             \
+        return jhn_parser_status_client_cancelled;                      \
+    }                                                                   \
+} while (0)
+
+static jhn_parser_status_t
+replay(const unsigned char *data, size_t pos, size_t len, int image,
+       const jhn_parser_callbacks_t *cb, void *ctx)
+{
+    tape_event ev;
+    char num[32];
+
+    while (next_event(data, len, &pos, &ev, image)) {
+        switch (ev.tag) {
+            case tape_null:
+                REPLAY_CB(jhn_null, (ctx));
+                break;
+            case tape_false:
+            case tape_true:
+                REPLAY_CB(jhn_boolean, (ctx, ev.tag == tape_true));
+                break;
+            case tape_integer:
+            case tape_double:
+                if (cb && cb->jhn_number) {
+                    REPLAY_CB(jhn_number,
+                              (ctx, num, format_number(num, &ev)));
+                } else if (ev.tag == tape_integer) {
+                    REPLAY_CB(jhn_integer, (ctx, ev.integer));
+                } else {
+                    REPLAY_CB(jhn_double, (ctx, ev.number));
+                }
+                break;
+            case tape_string:
+                if (cb && !cb->jhn_string && cb->jhn_string_chunk) {
+                    /* a client that only takes streamed strings gets
+                       every string as a single fragment */
+                    REPLAY_CB(jhn_string_begin, (ctx));
+                    if (ev.len > 0) {
+                        REPLAY_CB(jhn_string_chunk, (ctx, ev.str, ev.len));
+                    }
+                    REPLAY_CB(jhn_string_end, (ctx));
+                } else {
+                    REPLAY_CB(jhn_string, (ctx, ev.str, ev.len));
+                }
+                break;
+            case tape_map_key:
+                if (cb && cb->jhn_map_key_id) {
+                    REPLAY_CB(jhn_map_key_id, (ctx, -1, ev.str, ev.len));
+                } else {
+                    REPLAY_CB(jhn_map_key, (ctx, ev.str, ev.len));
+                }
+                break;
+            case tape_start_map:
+                REPLAY_CB(jhn_start_map, (ctx));
+                break;
+            case tape_end_map:
+                REPLAY_CB(jhn_end_map, (ctx));
+                break;
+            case tape_start_array:
+                REPLAY_CB(jhn_start_array, (ctx));
+                break;
+            case tape_end_array:
+                REPLAY_CB(jhn_end_array, (ctx));
+                break;
+            default:
+                return jhn_parser_status_error;
+        }
+    }
+
+    return pos == len ? jhn_parser_status_ok : jhn_parser_status_error;
+}
+
+static jhn_gen_status_t
+replay_gen(const unsigned char *data, size_t pos, size_t len, int image,
+           jhn_gen_t *gen)
+{
+    tape_event ev;
+    char num[32];
+    jhn_gen_status_t status = jhn_gen_status_ok;
+
+    while (status == jhn_gen_status_ok &&
+           next_event(data, len, &pos, &ev, image)) {
+        switch (ev.tag) {
+            case tape_null:
+                status = jhn_gen_null(gen);
+                break;
+            case tape_false:
+            case tape_true:
+                status = jhn_gen_bool(gen, ev.tag == tape_true);
+                break;
+            case tape_integer:
+            case tape_double:
+                status = jhn_gen_number(gen, num, format_number(num, &ev));
+                break;
+            case tape_string:
+            case tape_map_key:
+                status = jhn_gen_string(gen, ev.str, ev.len);
+                break;
+            case tape_start_map:
+                status = jhn_gen_map_open(gen);
+                break;
+            case tape_end_map:
+                status = jhn_gen_map_close(gen);
+                break;
+            case tape_start_array:
+                status = jhn_gen_array_open(gen);
+                break;
+            case tape_end_array:
+                status = jhn_gen_array_close(gen);
+                break;
+            default:
+                return jhn_gen_in_error_state;
+        }
+    }
+
+    if (status == jhn_gen_status_ok && pos != len) {
+        return jhn_gen_in_error_state;
+    }
+    return status;
+}
+
+jhn_parser_status_t
+jhn_tape_replay(const jhn_tape_t *tape, const jhn_parser_callbacks_t *cb,
+                void *ctx)
+{
+    return replay((const unsigned char *) jhn__buf_data(tape->buf), 0,
+                  jhn__buf_len(tape->buf), 0, cb, ctx);
+}
+
+jhn_gen_status_t
+jhn_tape_replay_gen(const jhn_tape_t *tape, jhn_gen_t *gen)
+{
+    return replay_gen((const unsigned char *) jhn__buf_data(tape->buf), 0,
+                      jhn__buf_len(tape->buf), 0, gen);
+}
+
+static void
+checksum_print(void *ctx, const char *str, size_t len)
+{
+    unsigned long long *hash = (unsigned long long *) ctx;
+    const unsigned char *p = (const unsigned char *) str;
+    unsigned long long h = *hash;
+
+    while (len--) {
+        h ^= *p++;
+        h *= FNV_PRIME;
+    }
+    *hash = h;
+}
+
+/* prints the events of the tape with the end offsets of the containers
+   inserted, in the order the containers start */
+static void
+print_image_events(const unsigned char *data, size_t len, const size_t *ends,
+                   jhn_print_t print, void *ctx)
+{
+    size_t pos = 0;
+    size_t from = 0;
+    size_t n = 0;
+    tape_event ev;
+    unsigned char offset[8];
+
+    while (next_event(data, len, &pos, &ev, 0)) {
+        if (ev.tag == tape_start_map || ev.tag == tape_start_array) {
+            print(ctx, (const char *) data + from, pos - from);
+            store_u64(offset, ends[n++]);
+            print(ctx, (const char *) offset, sizeof(offset));
+            from = pos;
+        }
+    }
+    if (from < len) {
+        print(ctx, (const char *) data + from, len - from);
+    }
+}
+
+int
+jhn_tape_write_image(const jhn_tape_t *tape, unsigned long long key,
+                     jhn_print_t print, void *ctx)
+{
+    jhn_alloc_funcs_t afs = tape->alloc;
+    const unsigned char *data =
+        (const unsigned char *) jhn__buf_data(tape->buf);
+    size_t len = jhn__buf_len(tape->buf);
+    size_t pos = 0;
+    tape_event ev;
+    /* end offset of every container, in the order they start */
+    size_t *ends = NULL;
+    size_t ends_size = 0;
+    size_t count = 0;
+    /* indices into ends of the containers that are still open */
+    size_t *open = NULL;
+    size_t open_size = 0;
+    size_t depth = 0;
+    /* the values at the top level, there has to be exactly one */
+    size_t values = 0;
+    unsigned long long checksum = FNV_OFFSET_BASIS;
+    unsigned char header[IMAGE_HEADER_SIZE];
+    int ok = 1;
+
+    while (ok && next_event(data, len, &pos, &ev, 0)) {
+        if (depth == 0 && ev.tag != tape_end_map &&
+            ev.tag != tape_end_array && ++values > 1) {
+            ok = 0;
+            break;
+        }
+        switch (ev.tag) {
+            case tape_start_map:
+            case tape_start_array:
+                if (count == ends_size) {
+                    size_t size = ends_size ? ends_size * 2 : 64;
+                    size_t *p = JO_REALLOC(&afs, ends, size * sizeof(size_t));
+                    if (!p) {
+                        ok = 0;
+                        break;
+                    }
+                    ends = p;
+                    ends_size = size;
+                }
+                if (depth == open_size) {
+                    size_t size = open_size ? open_size * 2 : 16;
+                    size_t *p = JO_REALLOC(&afs, open, size * sizeof(size_t));
+                    if (!p) {
+                        ok = 0;
+                        break;
+                    }
+                    open = p;
+                    open_size = size;
+                }
+                open[depth++] = count++;
+                break;
+            case tape_map_key:
+                if (depth == 0) {
+                    ok = 0;
+                }
+                break;
+            case tape_end_map:
+            case tape_end_array:
+                if (depth == 0) {
+                    ok = 0;
+                    break;
+                }
+                /* every container started so far adds an offset in
+                   front of this position */
+                ends[open[--depth]] = IMAGE_HEADER_SIZE + pos + 8 * count;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (ok && pos == len && depth == 0 && values == 1) {
+        print_image_events(data, len, ends, checksum_print, &checksum);
+
+        memcpy(header, IMAGE_MAGIC, 4);
+        header[4] = IMAGE_VERSION;
+        header[5] = header[6] = header[7] = 0;
+        store_u64(header + 8, key);
+        store_u64(header + 16, (unsigned long long) (len + 8 * count));
+        store_u64(header + 24, checksum);
+        print(ctx, (const char *) header, sizeof(header));
+        print_image_events(data, len, ends, print, ctx);
+    } else {
+        ok = 0;
+    }
+
+    if (ends) {
+        JO_FREE(&afs, ends);
+    }
+    if (open) {
+        JO_FREE(&afs, open);
+    }
+    return ok;
+}
+
+int
+jhn_image_check(const void *image, size_t len, unsigned long long key)
+{
+    const unsigned char *data = (const unsigned char *) image;
+    unsigned long long body;
+    unsigned long long checksum = FNV_OFFSET_BASIS;
+
+    if (len < IMAGE_HEADER_SIZE ||
+        memcmp(data, IMAGE_MAGIC, 4) != 0 ||
+        data[4] != IMAGE_VERSION || data[5] || data[6] || data[7] ||
+        load_u64(data + 8) != key) {
+        return 0;
+    }
+    body = load_u64(data + 16);
+    if (body > len - IMAGE_HEADER_SIZE) {
+        return 0;
+    }
+    checksum_print(&checksum, (const char *) data + IMAGE_HEADER_SIZE,
+                   (size_t) body);
+    return checksum == load_u64(data + 24);
+}
+
+/* total length of a checked image */
+static size_t
+image_len(const unsigned char *data)
+{
+    return IMAGE_HEADER_SIZE + (size_t) load_u64(data + 16);
+}
+
+/* decodes the value at offset v and returns the offset just past it,
+   zero if there is no value at v */
+static size_t
+read_value(const unsigned char *data, size_t v, tape_event *ev)
+{
+    size_t pos = v;
+
+    if (v < IMAGE_HEADER_SIZE ||
+        !next_event(data, image_len(data), &pos, ev, 1)) {
+        return 0;
+    }
+    switch (ev->tag) {
+        case tape_null:
+        case tape_false:
+        case tape_true:
+        case tape_integer:
+        case tape_double:
+        case tape_string:
+        case tape_map_key:
+            return pos;
+        case tape_start_map:
+        case tape_start_array:
+            return ev->end;
+        default:
+            return 0;
+    }
+}
+
+size_t
+jhn_image_root(const void *image)
+{
+    const unsigned char *data = (const unsigned char *) image;
+    return image_len(data) > IMAGE_HEADER_SIZE ? IMAGE_HEADER_SIZE : 0;
+}
+
+jhn_image_type_t
+jhn_image_type(const void *image, size_t v)
+{
+    tape_event ev;
+
+    if (!read_value((const unsigned char *) image, v, &ev)) {
+        return jhn_image_none;
+    }
+    switch (ev.tag) {
+        case tape_null:
+            return jhn_image_null;
+        case tape_false:
+        case tape_true:
+            return jhn_image_bool;
+        case tape_integer:
+            return jhn_image_integer;
+        case tape_double:
+            return jhn_image_double;
+        case tape_start_map:
+            return jhn_image_map;
+        case tape_start_array:
+            return jhn_image_array;
+        default:
+            return jhn_image_string;
+    }
+}
+
+size_t
+jhn_image_first(const void *image, size_t container)
+{
+    const unsigned char *data = (const unsigned char *) image;
+    tape_event ev;
+    size_t end = read_value(data, container, &ev);
+    size_t child = container + 9;
+
+    if (!end || (ev.tag != tape_start_map && ev.tag != tape_start_array) ||
+        child >= end ||
+        data[child] == tape_end_map || data[child] == tape_end_array) {
+        return 0;
+    }
+    return child;
+}
+
+size_t
+jhn_image_next(const void *image, size_t v)
+{
+    const unsigned char *data = (const unsigned char *) image;
+    tape_event ev;
+    size_t next = read_value(data, v, &ev);
+
+    if (!next || next >= image_len(data) ||
+        data[next] == tape_end_map || data[next] == tape_end_array) {
+        return 0;
+    }
+    return next;
+}
+
+size_t
+jhn_image_lookup(const void *image, size_t map, const char *key,
+                 size_t len)
+{
+    const unsigned char *data = (const unsigned char *) image;
+    tape_event ev;
+    size_t k;
+    size_t v = 0;
+
+    if (jhn_image_type(image, map) != jhn_image_map) {
+        return 0;
+    }
+    for (k = jhn_image_first(image, map); k; k = jhn_image_next(image, v)) {
+        if (!read_value(data, k, &ev) || ev.tag != tape_map_key) {
+            return 0;
+        }
+        v = jhn_image_next(image, k);
+        if (!v) {
+            return 0;
+        }
+        if (ev.len == len && memcmp(ev.str, key, len) == 0) {
+            return v;
+        }
+    }
+    return 0;
+}
+
+size_t
+jhn_image_index(const void *image, size_t array, size_t index)
+{
+    size_t v;
+
+    if (jhn_image_type(image, array) != jhn_image_array) {
+        return 0;
+    }
+    for (v = jhn_image_first(image, array); v && index;
+         v = jhn_image_next(image, v)) {
+        index--;
+    }
+    return v;
+}
+
+int
+jhn_image_get_bool(const void *image, size_t v)
+{
+    tape_event ev;
+    return read_value((const unsigned char *) image, v, &ev) &&
+           ev.tag == tape_true;
+}
+
+long long
+jhn_image_get_integer(const void *image, size_t v)
+{
+    tape_event ev;
+
+    if (!read_value((const unsigned char *) image, v, &ev) ||
+        ev.tag != tape_integer) {
+        return 0;
+    }
+    return ev.integer;
+}
+
+double
+jhn_image_get_double(const void *image, size_t v)
+{
+    tape_event ev;
+
+    if (!read_value((const unsigned char *) image, v, &ev)) {
+        return 0.0;
+    }
+    if (ev.tag == tape_integer) {
+        return (double) ev.integer;
+    }
+    return ev.tag == tape_double ? ev.number : 0.0;
+}
+
+const char *
+jhn_image_get_string(const void *image, size_t v, size_t *len)
+{
+    tape_event ev;
+
+    if (!read_value((const unsigned char *) image, v, &ev) ||
+        (ev.tag != tape_string && ev.tag != tape_map_key)) {
+        return NULL;
+    }
+    if (len) {
+        *len = ev.len;
+    }
+    return ev.str;
+}
+
+jhn_parser_status_t
+jhn_image_replay(const void *image, size_t v,
+                 const jhn_parser_callbacks_t *cb, void *ctx)
+{
+    const unsigned char *data = (const unsigned char *) image;
+    tape_event ev;
+    size_t end = read_value(data, v, &ev);
+
+    if (!end) {
+        return jhn_parser_status_error;
+    }
+    return replay(data, v, end, 1, cb, ctx);
+}
+
+jhn_gen_status_t
+jhn_image_replay_gen(const void *image, size_t v, jhn_gen_t *gen)
+{
+    const unsigned char *data = (const unsigned char *) image;
+    tape_event ev;
+    size_t end = read_value(data, v, &ev);
+
+    if (!end) {
+        return jhn_gen_in_error_state;
+    }
+    return replay_gen(data, v, end, 1, gen);
+}
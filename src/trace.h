@@ -0,0 +1,60 @@
+#ifndef JHN_TRACE_H_INCLUDED
+#define JHN_TRACE_H_INCLUDED
+
+#include "common.h"
+
+/* With JHN_ENABLE_USDT defined the library carries static tracepoints
+   in the format of systemtap's sys/sdt.h, which perf, bpftrace and
+   friends list as usdt:johanson:NAME.  A tracepoint nobody attached to
+   is a single nop, without JHN_ENABLE_USDT they are not compiled in at
+   all.  The tracepoints and their arguments:
+
+     parse__chunk(parser, length)       jhn_parser_parse was called
+     parse__chunk__done(parser, status) and returns
+     parse__finish(parser, status)      jhn_parser_finish returns
+     doc__start(parser, offset)         a top level value starts
+     doc__end(parser, offset)           and ends, offset is the input
+                                        position just past the token
+     parser__malloc(parser, size, memory)
+     parser__realloc(parser, size, memory)
+     parser__free(parser, size, memory) the parser, its lexer or
+                                        buffers allocated or freed a
+                                        block, memory is the total
+                                        the parser holds afterwards.
+                                        Only while the parser counts
+                                        its memory, which is with
+                                        jhn_max_memory or JHN_STATS
+     lexer__carry(lexer, length, buffered)
+                                        part of a token was copied into
+                                        the lexer's buffer because it
+                                        continues in the next chunk
+     gen__start(generator)              a top level value starts
+     gen__end(generator)                and is complete
+     gen__indent(generator, size)       the cached indentation was
+                                        allocated with size bytes
+     buf__grow(buffer, size)            a generator's output buffer or
+                                        a parser's decode buffer grew
+                                        to size bytes */
+#ifdef JHN_ENABLE_USDT
+#  include <sys/sdt.h>
+#  define JHN__TRACE1(name, a) DTRACE_PROBE1(johanson, name, a)
+#  define JHN__TRACE2(name, a, b) DTRACE_PROBE2(johanson, name, a, b)
+#  define JHN__TRACE3(name, a, b, c) DTRACE_PROBE3(johanson, name, a, b, c)
+#else
+#  define JHN__TRACE1(name, a) do {} while (0)
+#  define JHN__TRACE2(name, a, b) do {} while (0)
+#  define JHN__TRACE3(name, a, b, c) do {} while (0)
+#endif
+
+/* With JHN_PROFILE defined the functions most of the time is spent in
+   are never inlined, so that a profile attributes the time to them and
+   not to whatever they were inlined into. */
+#if defined(JHN_PROFILE) && defined(__GNUC__)
+#  define JHN__PROFILED __attribute__((noinline))
+#elif defined(JHN_PROFILE) && defined(_MSC_VER)
+#  define JHN__PROFILED __declspec(noinline)
+#else
+#  define JHN__PROFILED
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+#include "common.h"
+
+#include "alloc.h"
+
+#include <string.h>
+
+/* Every block handed out is preceded by a header that holds its size
+   and how often it was reallocated (see alloc.h), so that frees and
+   reallocs know what they release without a lookup. */
+
+struct jhn_tracker_s {
+    /* the tracking allocation routines.  This needs to be first in the
+       struct so that jhn_free() works on blocks allocated through
+       them! */
+    jhn_alloc_funcs_t alloc;
+    /* the routines the tracker forwards to */
+    jhn_alloc_funcs_t target;
+    jhn_alloc_report_t report;
+};
+
+static void
+add_live(jhn_tracker_t *t, size_t sz)
+{
+    t->report.live_bytes += sz;
+    if (t->report.live_bytes > t->report.peak_bytes) {
+        t->report.peak_bytes = t->report.live_bytes;
+    }
+    if (sz > t->report.largest_block) {
+        t->report.largest_block = sz;
+    }
+}
+
+static void *
+tracker_malloc(void *ctx, size_t sz)
+{
+    jhn_tracker_t *t = (jhn_tracker_t *) ctx;
+    jhn__alloc_header_t *hdr = JO_MALLOC(&(t->target),
+                                         JHN__HEADER_SIZE + sz);
+
+    if (!hdr) {
+        return NULL;
+    }
+    hdr->info.size = sz;
+    hdr->info.reallocs = 0;
+    t->report.mallocs++;
+    t->report.total_bytes += sz;
+    t->report.live_blocks++;
+    add_live(t, sz);
+    return JHN__BLOCK_OF(hdr);
+}
+
+static void
+tracker_free(void *ctx, void *ptr)
+{
+    jhn_tracker_t *t = (jhn_tracker_t *) ctx;
+    jhn__alloc_header_t *hdr;
+
+    if (!ptr) {
+        return;
+    }
+    hdr = JHN__HEADER_OF(ptr);
+    t->report.frees++;
+    t->report.live_blocks--;
+    t->report.live_bytes -= hdr->info.size;
+    JO_FREE(&(t->target), hdr);
+}
+
+static void *
+tracker_realloc(void *ctx, void *ptr, size_t sz)
+{
+    jhn_tracker_t *t = (jhn_tracker_t *) ctx;
+    jhn__alloc_header_t *hdr;
+    size_t old;
+
+    /* the realloc corner cases are treated as what they stand for */
+    if (!ptr) {
+        return tracker_malloc(ctx, sz);
+    }
+    if (sz == 0) {
+        tracker_free(ctx, ptr);
+        return NULL;
+    }
+
+    old = JHN__HEADER_OF(ptr)->info.size;
+    hdr = JO_REALLOC(&(t->target), JHN__HEADER_OF(ptr),
+                     JHN__HEADER_SIZE + sz);
+    if (!hdr) {
+        return NULL;
+    }
+    hdr->info.size = sz;
+    hdr->info.reallocs++;
+    t->report.reallocs++;
+    if (sz > old) {
+        t->report.grows++;
+        t->report.grow_bytes += sz - old;
+        t->report.total_bytes += sz - old;
+    }
+    if (hdr->info.reallocs > t->report.longest_chain) {
+        t->report.longest_chain = hdr->info.reallocs;
+    }
+    t->report.live_bytes -= old;
+    add_live(t, sz);
+    return JHN__BLOCK_OF(hdr);
+}
+
+jhn_tracker_t *
+jhn_tracker_alloc(const jhn_alloc_funcs_t *afs)
+{
+    jhn_tracker_t *t = NULL;
+    jhn_alloc_funcs_t afs_buffer;
+
+    if (!afs) {
+        jhn__set_default_alloc_funcs(&afs_buffer);
+        afs = &afs_buffer;
+    }
+
+    t = JO_MALLOC(afs, sizeof(struct jhn_tracker_s));
+    if (!t)
+        return NULL;
+
+    t->target = *afs;
+    t->alloc.malloc_func = tracker_malloc;
+    t->alloc.realloc_func = tracker_realloc;
+    t->alloc.free_func = tracker_free;
+    t->alloc.ctx = t;
+    memset(&(t->report), 0, sizeof(t->report));
+
+    return t;
+}
+
+void
+jhn_tracker_free(jhn_tracker_t *t)
+{
+    if (t) {
+        JO_FREE(&(t->target), t);
+    }
+}
+
+jhn_alloc_funcs_t *
+jhn_tracker_funcs(jhn_tracker_t *t)
+{
+    return &(t->alloc);
+}
+
+void
+jhn_tracker_get_report(const jhn_tracker_t *t, jhn_alloc_report_t *report)
+{
+    *report = t->report;
+}
+
+void
+jhn_tracker_reset(jhn_tracker_t *t)
+{
+    size_t live_blocks = t->report.live_blocks;
+    size_t live_bytes = t->report.live_bytes;
+
+    memset(&(t->report), 0, sizeof(t->report));
+    t->report.live_blocks = live_blocks;
+    t->report.live_bytes = live_bytes;
+    t->report.peak_bytes = live_bytes;
+}
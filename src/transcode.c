@@ -0,0 +1,439 @@
+#include "common.h"
+
+#include "alloc.h"
+#include "buf.h"
+
+#include <float.h>
+#include <string.h>
+
+/* Encodes parser events as CBOR (RFC 8949) or MessagePack.
+
+   CBOR maps and arrays use indefinite length encoding so every event
+   can be written out as soon as it arrives and strings that span input
+   chunks become indefinite length text strings.  MessagePack needs the
+   number of entries up front, so containers are written with a map32 /
+   array32 header that is patched when the container closes and each
+   top level value is passed to the print callback once complete. */
+
+/* an open MessagePack container */
+typedef struct {
+    size_t header_pos;
+    unsigned long count;
+    int is_map;
+} open_container;
+
+struct jhn_encoder_s {
+    /* memory allocation routines.  This needs to be first in the struct
+       so that jhn_free() works! */
+    jhn_alloc_funcs_t alloc;
+
+    jhn_encoding_t encoding;
+    jhn_print_t print;
+    void *ctx;
+    jhn__buf_t *buf;
+
+    open_container *stack;
+    size_t depth;
+    size_t stack_size;
+};
+
+jhn_encoder_t *
+jhn_encoder_alloc(jhn_encoding_t encoding, jhn_alloc_funcs_t *afs)
+{
+    jhn_encoder_t *enc = NULL;
+    jhn_alloc_funcs_t afs_buffer;
+
+    if (!afs) {
+        jhn__set_default_alloc_funcs(&afs_buffer);
+        afs = &afs_buffer;
+    }
+
+    enc = JO_MALLOC(afs, sizeof(struct jhn_encoder_s));
+    if (!enc)
+        return NULL;
+
+    memset(enc, 0, sizeof(struct jhn_encoder_s));
+    enc->alloc = *afs;
+    enc->encoding = encoding;
+    enc->buf = jhn__buf_alloc(&(enc->alloc));
+    if (!enc->buf) {
+        JO_FREE(&(enc->alloc), enc);
+        return NULL;
+    }
+
+    return enc;
+}
+
+void
+jhn_encoder_free(jhn_encoder_t *enc)
+{
+    if (enc) {
+        jhn__buf_free(enc->buf);
+        if (enc->stack) {
+            JO_FREE(&(enc->alloc), enc->stack);
+        }
+        JO_FREE(&(enc->alloc), enc);
+    }
+}
+
+void
+jhn_encoder_set_print(jhn_encoder_t *enc, jhn_print_t print, void *ctx)
+{
+    enc->print = print;
+    enc->ctx = ctx;
+}
+
+void
+jhn_encoder_get_buf(jhn_encoder_t *enc, const char **buf, size_t *len)
+{
+    if (buf) {
+        *buf = jhn__buf_data(enc->buf);
+    }
+    if (len) {
+        *len = jhn__buf_len(enc->buf);
+    }
+}
+
+void
+jhn_encoder_clear(jhn_encoder_t *enc)
+{
+    jhn__buf_clear(enc->buf);
+}
+
+static void
+emit(jhn_encoder_t *enc, const void *data, size_t len)
+{
+    if (enc->print && enc->encoding == jhn_encoding_cbor) {
+        enc->print(enc->ctx, (const char *) data, len);
+    } else {
+        jhn__buf_append(enc->buf, data, len);
+    }
+}
+
+/* writes a big endian integer of the given size after a prefix byte */
+static void
+emit_be(jhn_encoder_t *enc, unsigned char prefix, unsigned long long v,
+        int size)
+{
+    unsigned char bytes[9];
+    int i;
+
+    bytes[0] = prefix;
+    for (i = size; i > 0; i--) {
+        bytes[i] = (unsigned char) (v & 0xff);
+        v >>= 8;
+    }
+    emit(enc, bytes, size + 1);
+}
+
+/* CBOR item header: major type plus argument in the shortest form */
+static void
+cbor_head(jhn_encoder_t *enc, int major, unsigned long long v)
+{
+    unsigned char m = (unsigned char) (major << 5);
+    if (v < 24) {
+        m |= (unsigned char) v;
+        emit(enc, &m, 1);
+    } else if (v <= 0xff) {
+        emit_be(enc, m | 24, v, 1);
+    } else if (v <= 0xffff) {
+        emit_be(enc, m | 25, v, 2);
+    } else if (v <= 0xffffffffUL) {
+        emit_be(enc, m | 26, v, 4);
+    } else {
+        emit_be(enc, m | 27, v, 8);
+    }
+}
+
+/* MessagePack: every value inside a container adds to its count, in
+   maps only the keys do */
+static void
+msgpack_count(jhn_encoder_t *enc, int is_key)
+{
+    if (enc->depth > 0 && (is_key || !enc->stack[enc->depth - 1].is_map)) {
+        enc->stack[enc->depth - 1].count++;
+    }
+}
+
+/* called after a complete value, hands finished MessagePack documents
+   to the print callback */
+static void
+value_done(jhn_encoder_t *enc)
+{
+    if (enc->depth == 0 && enc->print &&
+        enc->encoding == jhn_encoding_msgpack) {
+        enc->print(enc->ctx, jhn__buf_data(enc->buf),
+                   jhn__buf_len(enc->buf));
+        jhn__buf_clear(enc->buf);
+    }
+}
+
+/* returns zero for a string too long for MessagePack's str32 */
+static int
+encode_string(jhn_encoder_t *enc, const char *str, size_t len)
+{
+    if (enc->encoding == jhn_encoding_cbor) {
+        cbor_head(enc, 3, len);
+    } else if (len < 32) {
+        unsigned char m = (unsigned char) (0xa0 | len);
+        emit(enc, &m, 1);
+    } else if (len <= 0xff) {
+        emit_be(enc, 0xd9, len, 1);
+    } else if (len <= 0xffff) {
+        emit_be(enc, 0xda, len, 2);
+    } else if ((unsigned long long) len <= 0xffffffffUL) {
+        emit_be(enc, 0xdb, len, 4);
+    } else {
+        return 0;
+    }
+    emit(enc, str, len);
+    return 1;
+}
+
+static int
+encode_null(void *ctx)
+{
+    jhn_encoder_t *enc = (jhn_encoder_t *) ctx;
+    unsigned char m = enc->encoding == jhn_encoding_cbor ? 0xf6 : 0xc0;
+    msgpack_count(enc, 0);
+    emit(enc, &m, 1);
+    value_done(enc);
+    return 1;
+}
+
+static int
+encode_boolean(void *ctx, int val)
+{
+    jhn_encoder_t *enc = (jhn_encoder_t *) ctx;
+    unsigned char m;
+    if (enc->encoding == jhn_encoding_cbor) {
+        m = val ? 0xf5 : 0xf4;
+    } else {
+        m = val ? 0xc3 : 0xc2;
+    }
+    msgpack_count(enc, 0);
+    emit(enc, &m, 1);
+    value_done(enc);
+    return 1;
+}
+
+static int
+encode_integer(void *ctx, long long val)
+{
+    jhn_encoder_t *enc = (jhn_encoder_t *) ctx;
+    msgpack_count(enc, 0);
+    if (enc->encoding == jhn_encoding_cbor) {
+        if (val >= 0) {
+            cbor_head(enc, 0, (unsigned long long) val);
+        } else {
+            cbor_head(enc, 1, (unsigned long long) (-(val + 1)));
+        }
+    } else if (val >= 0) {
+        unsigned long long v = (unsigned long long) val;
+        if (v < 128) {
+            unsigned char m = (unsigned char) v;
+            emit(enc, &m, 1);
+        } else if (v <= 0xff) {
+            emit_be(enc, 0xcc, v, 1);
+        } else if (v <= 0xffff) {
+            emit_be(enc, 0xcd, v, 2);
+        } else if (v <= 0xffffffffUL) {
+            emit_be(enc, 0xce, v, 4);
+        } else {
+            emit_be(enc, 0xcf, v, 8);
+        }
+    } else if (val >= -32) {
+        unsigned char m = (unsigned char) (val & 0xff);
+        emit(enc, &m, 1);
+    } else if (val >= -128) {
+        emit_be(enc, 0xd0, (unsigned long long) val & 0xff, 1);
+    } else if (val >= -32768) {
+        emit_be(enc, 0xd1, (unsigned long long) val & 0xffff, 2);
+    } else if (val >= -2147483647L - 1) {
+        emit_be(enc, 0xd2, (unsigned long long) val & 0xffffffffUL, 4);
+    } else {
+        emit_be(enc, 0xd3, (unsigned long long) val, 8);
+    }
+    value_done(enc);
+    return 1;
+}
+
+static int
+encode_double(void *ctx, double val)
+{
+    jhn_encoder_t *enc = (jhn_encoder_t *) ctx;
+    int cbor = enc->encoding == jhn_encoding_cbor;
+    msgpack_count(enc, 0);
+    /* doubles that survive the conversion are written as floats */
+    if (val >= -FLT_MAX && val <= FLT_MAX && (double) (float) val == val) {
+        float f = (float) val;
+        unsigned int bits;
+        memcpy(&bits, &f, sizeof(bits));
+        emit_be(enc, cbor ? 0xfa : 0xca, bits, 4);
+    } else {
+        unsigned long long bits;
+        memcpy(&bits, &val, sizeof(bits));
+        emit_be(enc, cbor ? 0xfb : 0xcb, bits, 8);
+    }
+    value_done(enc);
+    return 1;
+}
+
+static int
+encode_string_value(void *ctx, const char *str, size_t len)
+{
+    jhn_encoder_t *enc = (jhn_encoder_t *) ctx;
+    msgpack_count(enc, 0);
+    if (!encode_string(enc, str, len)) {
+        return 0;
+    }
+    value_done(enc);
+    return 1;
+}
+
+static int
+encode_map_key(void *ctx, const char *str, size_t len)
+{
+    jhn_encoder_t *enc = (jhn_encoder_t *) ctx;
+    msgpack_count(enc, 1);
+    return encode_string(enc, str, len);
+}
+
+/* opens a container.  For MessagePack the position of the header is
+   remembered so the count can be filled in later. */
+static int
+start_container(jhn_encoder_t *enc, int is_map)
+{
+    if (enc->encoding == jhn_encoding_cbor) {
+        unsigned char m = is_map ? 0xbf : 0x9f;
+        emit(enc, &m, 1);
+        return 1;
+    }
+    msgpack_count(enc, 0);
+    if (enc->depth == enc->stack_size) {
+        size_t size = enc->stack_size ? enc->stack_size * 2 : 16;
+        open_container *stack = JO_REALLOC(&(enc->alloc), enc->stack,
+                                           size * sizeof(open_container));
+        if (!stack) {
+            return 0;
+        }
+        enc->stack = stack;
+        enc->stack_size = size;
+    }
+    enc->stack[enc->depth].header_pos = jhn__buf_len(enc->buf);
+    enc->stack[enc->depth].count = 0;
+    enc->stack[enc->depth].is_map = is_map;
+    enc->depth++;
+    emit_be(enc, is_map ? 0xdf : 0xdd, 0, 4);
+    return 1;
+}
+
+static int
+end_container(jhn_encoder_t *enc)
+{
+    if (enc->encoding == jhn_encoding_cbor) {
+        unsigned char m = 0xff;
+        emit(enc, &m, 1);
+    } else {
+        open_container *c = &(enc->stack[--enc->depth]);
+        unsigned char *header = (unsigned char *) jhn__buf_data(enc->buf)
+            + c->header_pos;
+        if ((unsigned long long) c->count > 0xffffffffUL) {
+            return 0;
+        }
+        header[1] = (unsigned char) ((c->count >> 24) & 0xff);
+        header[2] = (unsigned char) ((c->count >> 16) & 0xff);
+        header[3] = (unsigned char) ((c->count >> 8) & 0xff);
+        header[4] = (unsigned char) (c->count & 0xff);
+    }
+    value_done(enc);
+    return 1;
+}
+
+static int
+encode_start_map(void *ctx)
+{
+    return start_container((jhn_encoder_t *) ctx, 1);
+}
+
+static int
+encode_start_array(void *ctx)
+{
+    return start_container((jhn_encoder_t *) ctx, 0);
+}
+
+static int
+encode_end_container(void *ctx)
+{
+    return end_container((jhn_encoder_t *) ctx);
+}
+
+/* strings that span input chunks, CBOR only */
+static int
+encode_string_begin(void *ctx)
+{
+    unsigned char m = 0x7f;
+    emit((jhn_encoder_t *) ctx, &m, 1);
+    return 1;
+}
+
+static int
+encode_string_chunk(void *ctx, const char *str, size_t len)
+{
+    jhn_encoder_t *enc = (jhn_encoder_t *) ctx;
+    cbor_head(enc, 3, len);
+    emit(enc, str, len);
+    return 1;
+}
+
+static int
+encode_string_end(void *ctx)
+{
+    unsigned char m = 0xff;
+    emit((jhn_encoder_t *) ctx, &m, 1);
+    return 1;
+}
+
+static const jhn_parser_callbacks_t cbor_callbacks = {
+    encode_null,
+    encode_boolean,
+    encode_integer,
+    encode_double,
+    NULL,
+    encode_string_value,
+    encode_start_map,
+    encode_map_key,
+    encode_end_container,
+    encode_start_array,
+    encode_end_container,
+    encode_string_begin,
+    encode_string_chunk,
+    encode_string_end,
+    NULL
+};
+
+static const jhn_parser_callbacks_t msgpack_callbacks = {
+    encode_null,
+    encode_boolean,
+    encode_integer,
+    encode_double,
+    NULL,
+    encode_string_value,
+    encode_start_map,
+    encode_map_key,
+    encode_end_container,
+    encode_start_array,
+    encode_end_container,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+jhn_parser_t *
+jhn_encoder_parser_alloc(jhn_encoder_t *enc, jhn_alloc_funcs_t *afs)
+{
+    return jhn_parser_alloc(enc->encoding == jhn_encoding_cbor ?
+                            &cbor_callbacks : &msgpack_callbacks,
+                            afs, enc);
+}
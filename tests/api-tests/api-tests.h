@@ -0,0 +1,87 @@
+#ifndef API_TESTS_H_INCLUDED
+#define API_TESTS_H_INCLUDED
+
+#include <johanson.h>
+
+#include <stdio.h>
+
+/* the allocation routines for the running test.  They go through a
+   tracker and the runner fails the test if anything allocated through
+   them is still live when it returns. */
+extern jhn_alloc_funcs_t *api_test_afs;
+
+/* allocation routines that pass on to api_test_afs for the given
+   number of allocations and reallocations and fail all later ones */
+jhn_alloc_funcs_t *api_test_limited_afs(size_t allocations);
+
+/* the number of checks that failed in the running test */
+extern int api_test_failures;
+
+void api_test_fail(const char *file, int line, const char *what);
+
+/* fails the running test if cond does not hold but goes on with it */
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+        api_test_fail(__FILE__, __LINE__, #cond);                       \
+    }                                                                   \
+} while (0)
+
+/* fails the running test and returns from it if cond does not hold */
+#define REQUIRE(cond) do {                                              \
+    if (!(cond)) {                                                      \
+        api_test_fail(__FILE__, __LINE__, #cond);                       \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+#define TEST(name) void name(void)
+
+/* test_gen.c */
+TEST(test_gen_fixed_rollback);
+TEST(test_gen_fixed_reset);
+TEST(test_gen_fixed_too_large);
+TEST(test_gen_raw_value);
+TEST(test_gen_keys);
+TEST(test_gen_indent_out_of_memory);
+TEST(test_gen_deep_nesting);
+TEST(test_gen_fd_out_of_memory);
+#if !defined(_WIN32) && !defined(WIN32)
+TEST(test_gen_fd_would_block);
+TEST(test_gen_fd_write_failed);
+#endif
+
+/* test_parser.c */
+TEST(test_parser_pause);
+TEST(test_parser_pause_finish);
+TEST(test_parser_max_memory);
+TEST(test_parser_schema_out_of_memory);
+
+/* test_keyset.c */
+TEST(test_keyset_lookup);
+TEST(test_keyset_duplicates);
+TEST(test_keyset_parser);
+TEST(test_keyset_out_of_memory);
+
+/* test_intern.c */
+TEST(test_intern_strings);
+TEST(test_intern_keys);
+TEST(test_intern_out_of_memory);
+
+/* test_reformat.c */
+TEST(test_reformat_minify);
+TEST(test_reformat_beautify);
+TEST(test_reformat_errors);
+
+/* test_tape.c */
+TEST(test_tape_replay);
+TEST(test_tape_image);
+TEST(test_tape_image_single_value);
+
+/* test_cbor.c */
+TEST(test_cbor_decode);
+TEST(test_cbor_generator_full);
+TEST(test_cbor_round_trip);
+TEST(test_msgpack_encode);
+TEST(test_cbor_out_of_memory);
+
+#endif
@@ -1,4 +1,5 @@
 import os
+import re
 import sys
 import subprocess
 
@@ -10,6 +11,20 @@ here = os.path.abspath(os.path.dirname(__file__))
 base = os.path.normpath(os.path.join(here, os.path.pardir, os.path.pardir))
 ffi = FFI()
 
+
+def own_declarations(header, preprocessed):
+    """Drops what the system headers declared, which cffi cannot parse"""
+    lines = []
+    own = True
+    for line in preprocessed.decode().splitlines():
+        match = re.match(r'# \d+ "([^"]*)"', line)
+        if match is not None:
+            own = match.group(1) == header
+        elif own:
+            lines.append(line)
+    return '\n'.join(lines)
+
+
 include = os.path.join(base, 'include')
 header = os.path.join(include, 'johanson.h')
 
@@ -26,6 +41,12 @@ elif sys.platform == 'win32':
     ffi.cdef(subprocess.Popen([
         'cl', '/EP', '/DJHN_API=', '/DJHN_NOINCLUDE',
         header], stdout=subprocess.PIPE).communicate()[0].replace('\r', ''))
+elif sys.platform.startswith('linux'):
+    debug_builds = os.path.join(base, 'build/debug/native')
+    lib_name = 'libjohanson-d.so'
+    ffi.cdef(own_declarations(header, subprocess.Popen([
+        'cc', '-E', '-DJHN_API=',
+        header], stdout=subprocess.PIPE).communicate()[0]))
 else:
     raise NotImplementedError()
 
@@ -0,0 +1,216 @@
+#include "api-tests.h"
+
+#include <string.h>
+
+/* decodes CBOR in one piece and split in two at every byte, returns
+   zero unless the JSON is the expected one each time */
+static int
+decodes_to(const char *cbor, size_t len, const char *expected)
+{
+    size_t split;
+
+    for (split = 0; split <= len; split++) {
+        jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+        jhn_cbor_decoder_t *dec = jhn_cbor_decoder_alloc(g, api_test_afs);
+        const unsigned char *data = (const unsigned char *) cbor;
+        const char *buf;
+        size_t buf_len;
+        int ok;
+
+        ok = jhn_cbor_decoder_parse(dec, data, split) == jhn_parser_status_ok
+            && jhn_cbor_decoder_parse(dec, data + split, len - split)
+               == jhn_parser_status_ok
+            && jhn_cbor_decoder_finish(dec) == jhn_parser_status_ok;
+        jhn_gen_get_buf(g, &buf, &buf_len);
+        ok = ok && buf_len == strlen(expected)
+            && !memcmp(buf, expected, buf_len);
+        jhn_cbor_decoder_free(dec);
+        jhn_gen_free(g);
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* whether decoding fails with the given message */
+static int
+decode_fails(const char *cbor, size_t len, const char *error)
+{
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+    jhn_cbor_decoder_t *dec = jhn_cbor_decoder_alloc(g, api_test_afs);
+    int failed = jhn_cbor_decoder_parse(dec, (const unsigned char *) cbor,
+                                        len) != jhn_parser_status_ok
+        || jhn_cbor_decoder_finish(dec) != jhn_parser_status_ok;
+
+    failed = failed && !strcmp(jhn_cbor_decoder_get_error(dec), error);
+    jhn_cbor_decoder_free(dec);
+    jhn_gen_free(g);
+    return failed;
+}
+
+/* encodes JSON that is fed to the parser in chunks of the given size */
+static int
+encode(jhn_encoder_t *enc, const char *json, size_t chunk)
+{
+    jhn_parser_t *p = jhn_encoder_parser_alloc(enc, api_test_afs);
+    size_t len = strlen(json);
+    size_t i;
+    int ok = 1;
+
+    for (i = 0; ok && i < len; i += chunk) {
+        ok = jhn_parser_parse(p, json + i, len - i < chunk ? len - i : chunk)
+            == jhn_parser_status_ok;
+    }
+    ok = ok && jhn_parser_finish(p) == jhn_parser_status_ok;
+    jhn_parser_free(p);
+    return ok;
+}
+
+#define DECODES_TO(cbor, json) decodes_to((cbor), sizeof(cbor) - 1, (json))
+
+TEST(test_cbor_decode)
+{
+    /* half, single and double precision floats */
+    CHECK(DECODES_TO("\xf9\x3c\x00", "1.0"));
+    CHECK(DECODES_TO("\xf9\xc4\x00", "-4.0"));
+    CHECK(DECODES_TO("\xf9\x00\x01", "5.9604644775390625e-08"));
+    CHECK(DECODES_TO("\xf9\x7c\x00", "null"));
+    CHECK(DECODES_TO("\xfa\x47\xc3\x50\x00", "100000.0"));
+    CHECK(DECODES_TO("\xfa\x7f\x80\x00\x00", "null"));
+    CHECK(DECODES_TO("\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a", "1.1"));
+
+    /* integers beyond long long */
+    CHECK(DECODES_TO("\x1b\xff\xff\xff\xff\xff\xff\xff\xff",
+                     "18446744073709551615"));
+    CHECK(DECODES_TO("\x3b\x7f\xff\xff\xff\xff\xff\xff\xff",
+                     "-9223372036854775808"));
+    CHECK(DECODES_TO("\x3b\xff\xff\xff\xff\xff\xff\xff\xff",
+                     "-18446744073709551616"));
+
+    /* byte strings, also of indefinite length */
+    CHECK(DECODES_TO("\x44\x01\x02\x03\x04", "\"AQIDBA\""));
+    CHECK(DECODES_TO("\x5f\x42\x01\x02\x43\x03\x04\x05\xff",
+                     "\"AQIDBAU\""));
+    CHECK(DECODES_TO("\x7f\x65strea\x64ming\xff", "\"streaming\""));
+    CHECK(DECODES_TO("\x7f\xff", "\"\""));
+
+    /* containers of indefinite length and tags */
+    CHECK(DECODES_TO("\x9f\x01\x82\x02\x03\x9f\x04\x05\xff\xff",
+                     "[1,[2,3],[4,5]]"));
+    CHECK(DECODES_TO("\xbf\x61\x61\x01\x61\x62\x9f\x02\x03\xff\xff",
+                     "{\"a\":1,\"b\":[2,3]}"));
+    CHECK(DECODES_TO("\xc1\x1a\x51\x4b\x67\xb0", "1363896240"));
+    CHECK(DECODES_TO("\xd8\x20\x62" "ab", "\"ab\""));
+    CHECK(DECODES_TO("\xa2\x01\x02\xf5\x80", "{\"1\":2,\"true\":[]}"));
+
+    /* a sequence of values */
+    CHECK(DECODES_TO("\x01\x82\x02\x03\x61x", "1\n[2,3]\n\"x\""));
+
+    CHECK(decode_fails("\xff", 1, "unexpected break"));
+    CHECK(decode_fails("\x82\x01", 2, "premature end of input"));
+    CHECK(decode_fails("\x7f\x01\xff", 3,
+                       "invalid chunk in indefinite length string"));
+    CHECK(decode_fails("\xa1\x80\x01", 3, "unsupported map key"));
+}
+
+TEST(test_cbor_generator_full)
+{
+    char frame[4];
+    jhn_gen_t *g = jhn_gen_alloc_into(api_test_afs, frame, sizeof(frame));
+    jhn_cbor_decoder_t *dec = jhn_cbor_decoder_alloc(g, api_test_afs);
+
+    /* the separator of the third value does not fit */
+    REQUIRE(g && dec);
+    CHECK(jhn_cbor_decoder_parse(dec, (const unsigned char *) "\x01\x02\x03",
+                                 3) == jhn_parser_status_error);
+    CHECK(!strcmp(jhn_cbor_decoder_get_error(dec), "generator error"));
+    CHECK(!strcmp(frame, "1\n2"));
+
+    jhn_cbor_decoder_free(dec);
+    jhn_gen_free(g);
+}
+
+TEST(test_cbor_round_trip)
+{
+    const char *json = "{\"int\":[0,23,24,-1,-25,9223372036854775807,"
+        "-9223372036854775807],\"float\":[1.5,-0.25,1.1,1e+300],"
+        "\"long string\":\"0123456789abcdefghijklmnopqrstuvwxyz\","
+        "\"nested\":[[],{},[{\"a\":null}],true,false]}";
+    size_t chunk;
+
+    /* small chunks split the strings, which become indefinite length
+       strings */
+    for (chunk = 1; chunk <= strlen(json); chunk += 7) {
+        jhn_encoder_t *enc = jhn_encoder_alloc(jhn_encoding_cbor,
+                                               api_test_afs);
+        const char *cbor;
+        size_t len;
+
+        REQUIRE(enc);
+        CHECK(encode(enc, json, chunk));
+        jhn_encoder_get_buf(enc, &cbor, &len);
+        CHECK(decodes_to(cbor, len, json));
+        jhn_encoder_free(enc);
+    }
+}
+
+TEST(test_msgpack_encode)
+{
+    static const char expected[] =
+        "\xdf\x00\x00\x00\x01"
+        "\xa1" "a"
+        "\xdd\x00\x00\x00\x0b"
+        "\x01" "\xff" "\xe0" "\xcd\x01\x2c" "\xd2\xff\xfe\x79\x60"
+        "\xcf\x00\x00\x00\x01\x00\x00\x00\x00"
+        "\xca\x3f\xc0\x00\x00"
+        "\xcb\x3f\xf1\x99\x99\x99\x99\x99\x9a"
+        "\xa2" "xy" "\xc3" "\xc0";
+    char long_key[40];
+    jhn_encoder_t *enc = jhn_encoder_alloc(jhn_encoding_msgpack,
+                                           api_test_afs);
+    const char *buf;
+    size_t len;
+
+    REQUIRE(enc);
+    CHECK(encode(enc, "{\"a\":[1,-1,-32,300,-100000,4294967296,1.5,1.1,"
+                 "\"xy\",true,null]}", 5));
+    jhn_encoder_get_buf(enc, &buf, &len);
+    CHECK(len == sizeof(expected) - 1 && !memcmp(buf, expected, len));
+
+    /* str8 once a string does not fit a fixstr */
+    jhn_encoder_clear(enc);
+    memset(long_key, 'k', sizeof(long_key));
+    memcpy(long_key, "\"", 1);
+    memcpy(long_key + 33, "\"", 2);
+    CHECK(encode(enc, long_key, 3));
+    jhn_encoder_get_buf(enc, &buf, &len);
+    CHECK(len == 34 && !memcmp(buf, "\xd9\x20kkkk", 6));
+
+    jhn_encoder_free(enc);
+}
+
+TEST(test_cbor_out_of_memory)
+{
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+    jhn_cbor_decoder_t *dec;
+    jhn_encoder_t *enc;
+    size_t n;
+
+    REQUIRE(g);
+    /* the decoder and its three buffers, the encoder and its buffer */
+    for (n = 0; n < 4; n++) {
+        CHECK(jhn_cbor_decoder_alloc(g, api_test_limited_afs(n)) == NULL);
+    }
+    dec = jhn_cbor_decoder_alloc(g, api_test_limited_afs(4));
+    CHECK(dec != NULL);
+    jhn_cbor_decoder_free(dec);
+    for (n = 0; n < 2; n++) {
+        CHECK(jhn_encoder_alloc(jhn_encoding_cbor,
+                                api_test_limited_afs(n)) == NULL);
+    }
+    enc = jhn_encoder_alloc(jhn_encoding_cbor, api_test_limited_afs(2));
+    CHECK(enc != NULL);
+    jhn_encoder_free(enc);
+    jhn_gen_free(g);
+}
@@ -0,0 +1,397 @@
+#include "api-tests.h"
+
+#include <string.h>
+
+#if !defined(_WIN32) && !defined(WIN32)
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/socket.h>
+#endif
+
+/* generates an array of long strings, which the fd sink references,
+   and small numbers, which it copies */
+static jhn_gen_status_t
+generate_strings(jhn_gen_t *g, const char *big, size_t len)
+{
+    jhn_gen_status_t s = jhn_gen_array_open(g);
+    int i;
+
+    for (i = 0; s == jhn_gen_status_ok && i < 24; i++) {
+        s = jhn_gen_string(g, big + i, len - i);
+        if (s == jhn_gen_status_ok) {
+            s = jhn_gen_integer(g, i);
+        }
+    }
+    return s == jhn_gen_status_ok ? jhn_gen_array_close(g) : s;
+}
+
+TEST(test_gen_fixed_rollback)
+{
+    char frame[16];
+    const char *buf;
+    size_t len;
+    jhn_gen_t *g = jhn_gen_alloc_into(api_test_afs, frame, sizeof(frame));
+
+    REQUIRE(g);
+    CHECK(jhn_gen_array_open(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_string(g, "abcdef", 6) == jhn_gen_status_ok);
+    CHECK(jhn_gen_string(g, "ghijkl", 6) == jhn_gen_buffer_full);
+    CHECK(jhn_gen_get_buf(g, &buf, &len) == jhn_gen_status_ok);
+    CHECK(buf == frame && len == 9 && !strcmp(frame, "[\"abcdef\""));
+
+    /* nothing of the value was written, it goes out after a clear */
+    jhn_gen_clear(g);
+    CHECK(jhn_gen_string(g, "ghijkl", 6) == jhn_gen_status_ok);
+    CHECK(!strcmp(frame, ",\"ghijkl\""));
+
+    /* a container that did not fit is not opened */
+    CHECK(jhn_gen_map_open(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_string(g, "k", 1) == jhn_gen_status_ok);
+    CHECK(jhn_gen_array_open(g) == jhn_gen_buffer_full);
+    CHECK(!strcmp(frame, ",\"ghijkl\",{\"k\""));
+    jhn_gen_clear(g);
+    CHECK(jhn_gen_integer(g, 1) == jhn_gen_status_ok);
+    CHECK(jhn_gen_map_close(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_array_close(g) == jhn_gen_status_ok);
+    CHECK(!strcmp(frame, ":1}]"));
+
+    jhn_gen_free(g);
+}
+
+TEST(test_gen_fixed_reset)
+{
+    char frame[8];
+    jhn_gen_t *g = jhn_gen_alloc_into(api_test_afs, frame, sizeof(frame));
+
+    REQUIRE(g);
+    CHECK(jhn_gen_string(g, "abcd", 4) == jhn_gen_status_ok);
+    CHECK(jhn_gen_reset(g, "\n\n") == jhn_gen_buffer_full);
+    CHECK(!strcmp(frame, "\"abcd\""));
+
+    /* the generator was not reset */
+    CHECK(jhn_gen_integer(g, 1) == jhn_gen_generation_complete);
+    jhn_gen_clear(g);
+    CHECK(jhn_gen_reset(g, "\n\n") == jhn_gen_status_ok);
+    CHECK(jhn_gen_integer(g, 12) == jhn_gen_status_ok);
+    CHECK(!strcmp(frame, "\n\n12"));
+
+    /* a separator that did not fit does not spoil the next one */
+    CHECK(jhn_gen_reset(g, "\n\n\n\n") == jhn_gen_buffer_full);
+    CHECK(jhn_gen_reset(g, "\n") == jhn_gen_status_ok);
+    CHECK(jhn_gen_integer(g, 3) == jhn_gen_status_ok);
+    CHECK(!strcmp(frame, "\n\n12\n3"));
+
+    CHECK(jhn_gen_reset(g, "\n\n\n\n\n\n\n\n") == jhn_gen_value_too_large);
+    CHECK(!strcmp(frame, "\n\n12\n3"));
+
+    jhn_gen_free(g);
+}
+
+TEST(test_gen_fixed_too_large)
+{
+    char frame[8];
+    jhn_gen_stats_t stats;
+    jhn_gen_t *g = jhn_gen_alloc_into(api_test_afs, frame, sizeof(frame));
+
+    REQUIRE(g);
+    CHECK(jhn_gen_array_open(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_string(g, "abcdefgh", 8) == jhn_gen_value_too_large);
+    CHECK(!strcmp(frame, "["));
+
+    /* clearing the buffer does not help such a value */
+    jhn_gen_clear(g);
+    CHECK(jhn_gen_string(g, "abcdefgh", 8) == jhn_gen_value_too_large);
+    CHECK(jhn_gen_string(g, "abcd", 4) == jhn_gen_status_ok);
+
+    /* but one that only fits into an empty buffer is just full */
+    CHECK(jhn_gen_string(g, "abcd", 4) == jhn_gen_buffer_full);
+    jhn_gen_clear(g);
+    CHECK(jhn_gen_string(g, "abcd", 4) == jhn_gen_status_ok);
+    CHECK(!strcmp(frame, ",\"abcd\""));
+    CHECK(jhn_gen_array_close(g) == jhn_gen_buffer_full);
+    jhn_gen_clear(g);
+    CHECK(jhn_gen_array_close(g) == jhn_gen_status_ok);
+    CHECK(!strcmp(frame, "]"));
+
+    /* only what was written is counted */
+    jhn_gen_get_stats(g, &stats);
+    CHECK(stats.values == 0 || stats.values == 3);
+    CHECK(stats.bytes == 0 || stats.bytes == 15);
+
+    jhn_gen_free(g);
+}
+
+TEST(test_gen_raw_value)
+{
+    const char *buf;
+    size_t len;
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+
+    REQUIRE(g);
+    CHECK(jhn_gen_array_open(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_raw_value(g, "1", 1) == jhn_gen_status_ok);
+    CHECK(jhn_gen_raw_value(g, "", 0) == jhn_gen_invalid_string);
+    CHECK(jhn_gen_raw_value(g, "{\"a\":[]}", 8) == jhn_gen_status_ok);
+    CHECK(jhn_gen_map_open(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_raw_value(g, "", 0) == jhn_gen_invalid_string);
+    CHECK(jhn_gen_raw_value(g, "2", 1) == jhn_gen_keys_must_be_strings);
+    CHECK(jhn_gen_raw_value(g, "\"k\"", 3) == jhn_gen_status_ok);
+    CHECK(jhn_gen_raw_value(g, "", 0) == jhn_gen_invalid_string);
+    CHECK(jhn_gen_raw_value(g, "null", 4) == jhn_gen_status_ok);
+    CHECK(jhn_gen_map_close(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_array_close(g) == jhn_gen_status_ok);
+
+    jhn_gen_get_buf(g, &buf, &len);
+    CHECK(!strcmp(buf, "[1,{\"a\":[]},{\"k\":null}]"));
+
+    jhn_gen_free(g);
+}
+
+TEST(test_gen_keys)
+{
+    const char *buf;
+    size_t len;
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+    jhn_gen_key_t *plain, *escaped;
+
+    REQUIRE(g);
+    jhn_gen_config(g, jhn_gen_escape_solidus, 1);
+    plain = jhn_gen_key_alloc(g, "id", 2);
+    escaped = jhn_gen_key_alloc(g, "a\"b/\n", 5);
+    REQUIRE(plain && escaped);
+    /* invalid UTF8 is refused while it is validated */
+    jhn_gen_config(g, jhn_gen_validate_utf8, 1);
+    CHECK(jhn_gen_key_alloc(g, "\xff", 1) == NULL);
+
+    /* keys are placed like strings, with the separators and indentation
+       of beautify mode, and also work as values */
+    jhn_gen_config(g, jhn_gen_beautify, 1);
+    CHECK(jhn_gen_map_open(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_key(g, plain) == jhn_gen_status_ok);
+    CHECK(jhn_gen_integer(g, 1) == jhn_gen_status_ok);
+    CHECK(jhn_gen_key(g, escaped) == jhn_gen_status_ok);
+    CHECK(jhn_gen_key(g, plain) == jhn_gen_status_ok);
+    CHECK(jhn_gen_encoded_key(g, "\"n\"", 3) == jhn_gen_status_ok);
+    CHECK(jhn_gen_array_open(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_key(g, escaped) == jhn_gen_status_ok);
+    CHECK(jhn_gen_encoded_key(g, "\"v\"", 3) == jhn_gen_status_ok);
+    CHECK(jhn_gen_array_close(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_map_close(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_key(g, plain) == jhn_gen_generation_complete);
+
+    jhn_gen_get_buf(g, &buf, &len);
+    CHECK(!strcmp(buf, "{\n"
+                       "  \"id\": 1,\n"
+                       "  \"a\\\"b\\/\\n\": \"id\",\n"
+                       "  \"n\": [\n"
+                       "    \"a\\\"b\\/\\n\",\n"
+                       "    \"v\"\n"
+                       "  ]\n"
+                       "}\n"));
+
+    jhn_gen_key_free(plain);
+    jhn_gen_key_free(escaped);
+    jhn_gen_key_free(NULL);
+    jhn_gen_free(g);
+}
+
+/* a few nested containers in beautify mode */
+static void
+generate_nested(jhn_gen_t *g)
+{
+    jhn_gen_config(g, jhn_gen_beautify, 1);
+    jhn_gen_map_open(g);
+    jhn_gen_string(g, "a", 1);
+    jhn_gen_array_open(g);
+    jhn_gen_integer(g, 1);
+    jhn_gen_array_open(g);
+    jhn_gen_array_close(g);
+    jhn_gen_map_open(g);
+    jhn_gen_string(g, "b", 1);
+    jhn_gen_null(g);
+    jhn_gen_map_close(g);
+    jhn_gen_array_close(g);
+    jhn_gen_map_close(g);
+}
+
+TEST(test_gen_indent_out_of_memory)
+{
+    char expected[128];
+    char out[128];
+    const char *buf;
+    size_t len;
+    jhn_gen_t *g = jhn_gen_alloc_into(api_test_afs, expected,
+                                      sizeof(expected));
+
+    REQUIRE(g);
+    generate_nested(g);
+    jhn_gen_free(g);
+
+    /* without memory for the cached indentation every line is indented
+       level by level, to the same result */
+    g = jhn_gen_alloc_into(api_test_limited_afs(1), out, sizeof(out));
+    REQUIRE(g);
+    generate_nested(g);
+    CHECK(jhn_gen_get_buf(g, &buf, &len) == jhn_gen_status_ok);
+    CHECK(!strcmp(buf, expected));
+    CHECK(strstr(buf, "\n    1,\n") != NULL);
+    jhn_gen_free(g);
+}
+
+TEST(test_gen_deep_nesting)
+{
+    char out[16];
+    const char *buf;
+    size_t len, i;
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+
+    /* the state stack keeps growing, and a reset generator starts over
+       with it */
+    REQUIRE(g);
+    for (i = 0; i < 1000; i++) {
+        CHECK(jhn_gen_array_open(g) == jhn_gen_status_ok);
+    }
+    for (i = 0; i < 1000; i++) {
+        CHECK(jhn_gen_array_close(g) == jhn_gen_status_ok);
+    }
+    jhn_gen_get_buf(g, &buf, &len);
+    CHECK(len == 2000 && buf[999] == '[' && buf[1000] == ']');
+    CHECK(jhn_gen_reset(g, "\n") == jhn_gen_status_ok);
+    CHECK(jhn_gen_array_open(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_integer(g, 1) == jhn_gen_status_ok);
+    CHECK(jhn_gen_array_close(g) == jhn_gen_status_ok);
+    jhn_gen_get_buf(g, &buf, &len);
+    CHECK(len == 2004 && !strcmp(buf + 2000, "\n[1]"));
+    jhn_gen_free(g);
+
+    /* without memory to grow the stack the generator is in the error
+       state until it is reset */
+    g = jhn_gen_alloc_into(api_test_limited_afs(1), out, sizeof(out));
+    REQUIRE(g);
+    for (i = 0; i < 15; i++) {
+        CHECK(jhn_gen_array_open(g) == jhn_gen_status_ok);
+    }
+    CHECK(jhn_gen_array_open(g) == jhn_gen_in_error_state);
+    CHECK(jhn_gen_array_close(g) == jhn_gen_in_error_state);
+    jhn_gen_clear(g);
+    CHECK(jhn_gen_reset(g, NULL) == jhn_gen_status_ok);
+    CHECK(jhn_gen_null(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_get_buf(g, &buf, &len) == jhn_gen_status_ok);
+    CHECK(len == 4 && !strcmp(buf, "null"));
+    jhn_gen_free(g);
+}
+
+TEST(test_gen_fd_out_of_memory)
+{
+    char out[16];
+    const char *buf;
+    size_t len;
+    /* room for the generator and nothing else */
+    jhn_gen_t *g = jhn_gen_alloc_into(api_test_limited_afs(1), out,
+                                      sizeof(out));
+
+    REQUIRE(g);
+    CHECK(jhn_gen_array_open(g) == jhn_gen_status_ok);
+    /* the sink cannot be allocated, so the output stays where it was */
+    CHECK(!jhn_gen_config(g, jhn_gen_output_fd, 1));
+    CHECK(jhn_gen_array_close(g) == jhn_gen_status_ok);
+    CHECK(jhn_gen_get_buf(g, &buf, &len) == jhn_gen_status_ok);
+    CHECK(len == 2 && !strcmp(buf, "[]"));
+
+    jhn_gen_free(g);
+}
+
+#if !defined(_WIN32) && !defined(WIN32)
+
+/* reads what is available from fd and appends it to out */
+static size_t
+drain(int fd, char *out, size_t used, size_t cap, size_t max)
+{
+    while (used < cap && max > 0) {
+        ssize_t rd = read(fd, out + used,
+                          cap - used < max ? cap - used : max);
+        if (rd <= 0) {
+            break;
+        }
+        used += (size_t)rd;
+        max -= (size_t)rd;
+    }
+    return used;
+}
+
+TEST(test_gen_fd_would_block)
+{
+    enum { BIG = 20000, OUT = 600000 };
+    static char big[BIG];
+    static char out[OUT];
+    const char *expected;
+    size_t expected_len;
+    size_t used = 0;
+    int fds[2];
+    int size = 4096;
+    int rounds = 0;
+    jhn_gen_status_t s;
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+    jhn_gen_t *ref = jhn_gen_alloc(api_test_afs);
+
+    REQUIRE(g && ref);
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    REQUIRE(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+    REQUIRE(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+
+    memset(big, 'a', sizeof(big));
+    big[100] = 'b';
+    big[BIG - 1] = 'c';
+
+    /* nobody reads while the output is generated, so the socket fills
+       up in the middle of a writev and the rest is kept */
+    jhn_gen_config(g, jhn_gen_output_fd, fds[0]);
+    CHECK(generate_strings(g, big, BIG) == jhn_gen_status_ok);
+    CHECK(jhn_gen_flush(g) == jhn_gen_write_would_block);
+    CHECK(jhn_gen_flush(g) == jhn_gen_write_would_block);
+
+    /* a little at a time, so that the flushes write partially */
+    do {
+        used = drain(fds[1], out, used, OUT, 3000);
+        s = jhn_gen_flush(g);
+        rounds++;
+    } while (s == jhn_gen_write_would_block && rounds < 10000);
+    CHECK(s == jhn_gen_status_ok);
+    CHECK(rounds > 1);
+    used = drain(fds[1], out, used, OUT, OUT);
+
+    CHECK(generate_strings(ref, big, BIG) == jhn_gen_status_ok);
+    jhn_gen_get_buf(ref, &expected, &expected_len);
+    CHECK(used == expected_len);
+    CHECK(!memcmp(out, expected, expected_len < used ? expected_len : used));
+
+    close(fds[0]);
+    close(fds[1]);
+    jhn_gen_free(g);
+    jhn_gen_free(ref);
+}
+
+TEST(test_gen_fd_write_failed)
+{
+    static char big[4000];
+    int fds[2];
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+
+    REQUIRE(g);
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    memset(big, 'x', sizeof(big));
+
+    /* a closed descriptor is an error that sticks */
+    close(fds[0]);
+    close(fds[1]);
+    jhn_gen_config(g, jhn_gen_output_fd, fds[0]);
+    CHECK(generate_strings(g, big, sizeof(big)) == jhn_gen_status_ok);
+    CHECK(jhn_gen_flush(g) == jhn_gen_write_failed);
+    CHECK(jhn_gen_flush(g) == jhn_gen_write_failed);
+
+    jhn_gen_free(g);
+}
+
+#endif
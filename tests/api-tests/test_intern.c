@@ -0,0 +1,163 @@
+#include "api-tests.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* the keys a parse reported, as the pointers that were passed */
+typedef struct {
+    const char *keys[8];
+    size_t count;
+} key_log;
+
+static int
+log_key(void *ctx, const char *key, size_t len)
+{
+    key_log *log = (key_log *) ctx;
+
+    (void) len;
+    if (log->count < sizeof(log->keys) / sizeof(log->keys[0])) {
+        log->keys[log->count++] = key;
+    }
+    return 1;
+}
+
+static const jhn_parser_callbacks_t key_callbacks = {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    log_key,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+/* parses text with the keys interned in table */
+static jhn_parser_status_t
+parse_interned(jhn_intern_t *table, const char *text, key_log *log)
+{
+    jhn_parser_t *hand = jhn_parser_alloc(&key_callbacks, api_test_afs,
+                                          log);
+    jhn_parser_status_t s;
+
+    if (!hand) {
+        return jhn_parser_status_error;
+    }
+    jhn_parser_config(hand, jhn_intern_keys, table);
+    s = jhn_parser_parse(hand, text, strlen(text));
+    if (s == jhn_parser_status_ok) {
+        s = jhn_parser_finish(hand);
+    }
+    jhn_parser_free(hand);
+    return s;
+}
+
+TEST(test_intern_strings)
+{
+    static char big[20000];
+    jhn_intern_t *in = jhn_intern_alloc(api_test_afs);
+    const char *a, *b, *first[600];
+    char name[16];
+    size_t i;
+
+    REQUIRE(in);
+
+    a = jhn_intern(in, "abc", 3);
+    REQUIRE(a);
+    CHECK(!strcmp(a, "abc"));
+    CHECK(jhn_interned_len(a) == 3);
+    /* the same string gives the same pointer, whatever it came from */
+    CHECK(jhn_intern(in, "xabcx" + 1, 3) == a);
+    b = jhn_intern(in, "ab", 2);
+    CHECK(b && b != a && !strcmp(b, "ab"));
+    CHECK(jhn_interned_hash(b) != jhn_interned_hash(a));
+    /* the empty string and strings with a zero byte */
+    CHECK(jhn_intern(in, "", 0) &&
+          jhn_interned_len(jhn_intern(in, "", 0)) == 0);
+    CHECK(jhn_interned_len(jhn_intern(in, "a\0b", 3)) == 3);
+    CHECK(jhn_intern_count(in) == 4);
+
+    /* enough strings to grow the table, and one too large for a block,
+       none of which moves the earlier ones */
+    for (i = 0; i < 600; i++) {
+        snprintf(name, sizeof(name), "key%u", (unsigned int) i);
+        first[i] = jhn_intern(in, name, strlen(name));
+        REQUIRE(first[i]);
+    }
+    memset(big, 'x', sizeof(big));
+    CHECK(jhn_interned_len(jhn_intern(in, big, sizeof(big))) ==
+          sizeof(big));
+    for (i = 0; i < 600; i++) {
+        snprintf(name, sizeof(name), "key%u", (unsigned int) i);
+        CHECK(jhn_intern(in, name, strlen(name)) == first[i]);
+        CHECK(jhn_interned_hash(first[i]) ==
+              jhn_interned_hash(jhn_intern(in, name, strlen(name))));
+    }
+    CHECK(jhn_intern(in, "abc", 3) == a);
+    CHECK(jhn_intern_count(in) == 605);
+
+    /* a cleared table starts over and can be used again */
+    jhn_intern_clear(in);
+    CHECK(jhn_intern_count(in) == 0);
+    a = jhn_intern(in, "abc", 3);
+    CHECK(a && !strcmp(a, "abc") && jhn_intern_count(in) == 1);
+
+    jhn_intern_free(in);
+}
+
+TEST(test_intern_keys)
+{
+    jhn_intern_t *in = jhn_intern_alloc(api_test_afs);
+    key_log first, second;
+
+    REQUIRE(in);
+    memset(&first, 0, sizeof(first));
+    memset(&second, 0, sizeof(second));
+
+    /* equal keys get the same pointer, within a document and across
+       parsers sharing the table, escaped or not */
+    CHECK(parse_interned(in, "{\"a\": {\"b\": 1, \"a\": 2}}", &first) ==
+          jhn_parser_status_ok);
+    CHECK(parse_interned(in, "[{\"b\": 1}, {\"\\u0061\": 2}]", &second) ==
+          jhn_parser_status_ok);
+    REQUIRE(first.count == 3 && second.count == 2);
+    CHECK(first.keys[0] == first.keys[2]);
+    CHECK(second.keys[0] == first.keys[1]);
+    CHECK(second.keys[1] == first.keys[0]);
+    CHECK(!strcmp(first.keys[0], "a") && !strcmp(first.keys[1], "b"));
+    CHECK(jhn_intern_count(in) == 2);
+
+    jhn_intern_free(in);
+}
+
+TEST(test_intern_out_of_memory)
+{
+    jhn_intern_t *in;
+    key_log log;
+
+    /* no room for the table, then none for the first block */
+    in = jhn_intern_alloc(api_test_limited_afs(1));
+    REQUIRE(in);
+    CHECK(jhn_intern(in, "abc", 3) == NULL);
+    CHECK(jhn_intern_count(in) == 0);
+    jhn_intern_free(in);
+
+    in = jhn_intern_alloc(api_test_limited_afs(2));
+    REQUIRE(in);
+    CHECK(jhn_intern(in, "abc", 3) == NULL);
+    CHECK(jhn_intern_count(in) == 0);
+
+    /* the parse fails instead of passing NULL on as the key */
+    memset(&log, 0, sizeof(log));
+    CHECK(parse_interned(in, "{\"a\": 1}", &log) ==
+          jhn_parser_status_error);
+    CHECK(log.count == 0);
+    jhn_intern_free(in);
+}
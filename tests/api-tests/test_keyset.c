@@ -0,0 +1,155 @@
+#include "api-tests.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* the key ids a parse reported, in order */
+typedef struct {
+    int ids[16];
+    size_t count;
+} id_log;
+
+static int
+log_key_id(void *ctx, int key_id, const char *key, size_t len)
+{
+    id_log *log = (id_log *) ctx;
+
+    (void) key;
+    (void) len;
+    if (log->count < sizeof(log->ids) / sizeof(log->ids[0])) {
+        log->ids[log->count++] = key_id;
+    }
+    return 1;
+}
+
+static const jhn_parser_callbacks_t id_callbacks = {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    log_key_id
+};
+
+TEST(test_keyset_lookup)
+{
+    static const char *const fields[] = { "id", "name", "price", "tags" };
+    static const char *const prefixed[] = { "ab", "a", "a\0b", "" };
+    static const size_t prefixed_lens[] = { 2, 1, 3, 0 };
+    const char *many[300];
+    char names[300][8];
+    jhn_keyset_t *ks;
+    size_t i;
+
+    ks = jhn_keyset_alloc(fields, NULL, 4, api_test_afs);
+    REQUIRE(ks);
+    CHECK(jhn_keyset_count(ks) == 4);
+    for (i = 0; i < 4; i++) {
+        CHECK(jhn_keyset_lookup(ks, fields[i], strlen(fields[i])) ==
+              (int) i);
+    }
+    CHECK(jhn_keyset_lookup(ks, "nam", 3) == -1);
+    CHECK(jhn_keyset_lookup(ks, "names", 5) == -1);
+    CHECK(jhn_keyset_lookup(ks, "", 0) == -1);
+    jhn_keyset_free(ks);
+
+    /* keys that are prefixes of each other or contain a zero byte */
+    ks = jhn_keyset_alloc(prefixed, prefixed_lens, 4, api_test_afs);
+    REQUIRE(ks);
+    for (i = 0; i < 4; i++) {
+        CHECK(jhn_keyset_lookup(ks, prefixed[i], prefixed_lens[i]) ==
+              (int) i);
+    }
+    CHECK(jhn_keyset_lookup(ks, "a\0", 2) == -1);
+    jhn_keyset_free(ks);
+
+    for (i = 0; i < 300; i++) {
+        snprintf(names[i], sizeof(names[i]), "k%u", (unsigned int) i);
+        many[i] = names[i];
+    }
+    ks = jhn_keyset_alloc(many, NULL, 300, api_test_afs);
+    REQUIRE(ks);
+    for (i = 0; i < 300; i++) {
+        CHECK(jhn_keyset_lookup(ks, many[i], strlen(many[i])) == (int) i);
+    }
+    CHECK(jhn_keyset_lookup(ks, "k300", 4) == -1);
+    jhn_keyset_free(ks);
+
+    /* an empty set knows no keys */
+    ks = jhn_keyset_alloc(NULL, NULL, 0, api_test_afs);
+    REQUIRE(ks);
+    CHECK(jhn_keyset_count(ks) == 0);
+    CHECK(jhn_keyset_lookup(ks, "id", 2) == -1);
+    jhn_keyset_free(ks);
+}
+
+TEST(test_keyset_duplicates)
+{
+    static const char *const keys[] = { "a", "b", "a" };
+    static const char *const same_prefix[] = { "ab", "ac" };
+    static const size_t lens[] = { 1, 1 };
+
+    CHECK(jhn_keyset_alloc(keys, NULL, 3, api_test_afs) == NULL);
+    /* only the given lengths count */
+    CHECK(jhn_keyset_alloc(same_prefix, lens, 2, api_test_afs) == NULL);
+}
+
+TEST(test_keyset_parser)
+{
+    static const char *const keys[] = { "a", "bc", "d" };
+    static const char text[] =
+        "{\"bc\": 1, \"x\": {\"d\": [{\"\\u0061\": 2}]}, \"a\": 3}";
+    jhn_keyset_t *ks = jhn_keyset_alloc(keys, NULL, 3, api_test_afs);
+    jhn_parser_t *hand;
+    id_log log;
+
+    REQUIRE(ks);
+    memset(&log, 0, sizeof(log));
+    hand = jhn_parser_alloc(&id_callbacks, api_test_afs, &log);
+    REQUIRE(hand);
+    CHECK(jhn_parser_config(hand, jhn_key_set, ks));
+    CHECK(jhn_parser_parse(hand, text, sizeof(text) - 1) ==
+          jhn_parser_status_ok);
+    CHECK(jhn_parser_finish(hand) == jhn_parser_status_ok);
+    REQUIRE(log.count == 5);
+    CHECK(log.ids[0] == 1 && log.ids[1] == -1 && log.ids[2] == 2);
+    /* escaped keys are looked up decoded */
+    CHECK(log.ids[3] == 0 && log.ids[4] == 0);
+    jhn_parser_free(hand);
+
+    /* without a key set every id is -1 */
+    memset(&log, 0, sizeof(log));
+    hand = jhn_parser_alloc(&id_callbacks, api_test_afs, &log);
+    REQUIRE(hand);
+    CHECK(jhn_parser_parse(hand, "{\"a\": 1}", 8) == jhn_parser_status_ok);
+    CHECK(jhn_parser_finish(hand) == jhn_parser_status_ok);
+    CHECK(log.count == 1 && log.ids[0] == -1);
+    jhn_parser_free(hand);
+
+    jhn_keyset_free(ks);
+}
+
+TEST(test_keyset_out_of_memory)
+{
+    static const char *const keys[] = { "a", "b", "c", "d", "e" };
+    jhn_keyset_t *ks;
+    size_t allocations;
+
+    /* the set itself and six blocks of scratch space while building */
+    for (allocations = 0; allocations < 7; allocations++) {
+        CHECK(jhn_keyset_alloc(keys, NULL, 5,
+                               api_test_limited_afs(allocations)) == NULL);
+    }
+    ks = jhn_keyset_alloc(keys, NULL, 5, api_test_limited_afs(7));
+    CHECK(ks && jhn_keyset_lookup(ks, "e", 1) == 4);
+    jhn_keyset_free(ks);
+}
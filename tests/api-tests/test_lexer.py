@@ -1,2 +1,117 @@
+from conftest import ffi
+
+
 def test_basic_api(jhn):
     pass
+
+
+class Lexer(object):
+    """A lexer over buffers the test keeps alive"""
+
+    def __init__(self, jhn):
+        self.jhn = jhn
+        self.lexer = jhn.jhn_lexer_alloc(ffi.NULL, 0, 1)
+        self.offset = ffi.new('size_t *')
+        self.buf = ffi.new('const char **')
+        self.len = ffi.new('size_t *')
+        assert self.lexer != ffi.NULL
+
+    def peek(self, text, length, offset):
+        return self.jhn.jhn_lexer_peek(self.lexer, text, length, offset)
+
+    def lex(self, text, length):
+        return self.jhn.jhn_lexer_lex(self.lexer, text, length, self.offset,
+                                      self.buf, self.len)
+
+    def token(self):
+        return ffi.buffer(self.buf[0], self.len[0])[:]
+
+    def free(self):
+        self.jhn.jhn_lexer_free(self.lexer)
+
+
+def test_lexer_peek_then_lex(jhn):
+    text = ffi.new('char[]', b'[1, "ab"]')
+    size = len(text) - 1
+    lexer = Lexer(jhn)
+
+    # peeking does not move the lexer and peeking twice is the same
+    assert lexer.peek(text, size, 0) == jhn.jhn_tok_left_brace
+    assert lexer.peek(text, size, 0) == jhn.jhn_tok_left_brace
+    assert lexer.lex(text, size) == jhn.jhn_tok_left_brace
+    assert lexer.offset[0] == 1
+
+    # the lex hands out what the peek lexed
+    assert lexer.peek(text, size, lexer.offset[0]) == jhn.jhn_tok_integer
+    assert lexer.lex(text, size) == jhn.jhn_tok_integer
+    assert lexer.token() == b'1'
+    assert lexer.offset[0] == 2
+
+    assert lexer.lex(text, size) == jhn.jhn_tok_comma
+    assert lexer.peek(text, size, lexer.offset[0]) == jhn.jhn_tok_string
+    assert lexer.lex(text, size) == jhn.jhn_tok_string
+    assert lexer.token() == b'ab'
+
+    # a peek that is not followed by a lex of the same spot is undone
+    assert lexer.peek(text, size, lexer.offset[0]) == \
+        jhn.jhn_tok_right_brace
+    assert lexer.peek(text, size, 0) == jhn.jhn_tok_left_brace
+    assert lexer.lex(text, size) == jhn.jhn_tok_right_brace
+    assert lexer.lex(text, size) == jhn.jhn_tok_eof
+
+    lexer.free()
+
+
+def test_lexer_peek_split_token(jhn):
+    # the same chunk at two addresses, so that the lex does not match
+    # the peek
+    chunk = ffi.new('char[]', b'["ab')
+    copy = ffi.new('char[]', b'["ab')
+    rest = ffi.new('char[]', b'c"]')
+    stats = ffi.new('jhn_lexer_stats_t *')
+    lexer = Lexer(jhn)
+
+    assert lexer.lex(chunk, 4) == jhn.jhn_tok_left_brace
+    assert lexer.peek(chunk, 4, lexer.offset[0]) == jhn.jhn_tok_eof
+    assert lexer.lex(copy, 4) == jhn.jhn_tok_eof
+
+    # the string was carried into the lexer's buffer once, which is
+    # only counted with JHN_STATS
+    jhn.jhn_lexer_get_stats(lexer.lexer, stats)
+    assert stats.buffer_appends in (0, 1)
+    assert stats.buffer_bytes in (0, 3)
+    assert (stats.buffer_appends == 0) == (stats.buffer_bytes == 0)
+
+    lexer.offset[0] = 0
+    assert lexer.lex(rest, 3) == jhn.jhn_tok_string
+    assert lexer.token() == b'abc'
+    assert lexer.lex(rest, 3) == jhn.jhn_tok_right_brace
+
+    lexer.free()
+
+
+def test_lexer_peek_refill(jhn):
+    chunk = ffi.new('char[8]')
+    lexer = Lexer(jhn)
+
+    # a read buffer refilled in place after a peek
+    ffi.memmove(chunk, b'[1]', 3)
+    assert lexer.peek(chunk, 3, 0) == jhn.jhn_tok_left_brace
+    ffi.memmove(chunk, b'{ }', 3)
+    jhn.jhn_lexer_discard_peek(lexer.lexer)
+    assert lexer.peek(chunk, 3, 0) == jhn.jhn_tok_left_bracket
+    ffi.memmove(chunk, b'123', 3)
+    jhn.jhn_lexer_discard_peek(lexer.lexer)
+    assert lexer.lex(chunk, 3) == jhn.jhn_tok_eof
+
+    # a discarded peek of a token that spans chunks leaves nothing
+    # behind in the lexer's buffer
+    ffi.memmove(chunk, b'4 ', 2)
+    lexer.offset[0] = 0
+    assert lexer.peek(chunk, 2, 0) == jhn.jhn_tok_integer
+    jhn.jhn_lexer_discard_peek(lexer.lexer)
+    jhn.jhn_lexer_discard_peek(lexer.lexer)
+    assert lexer.lex(chunk, 2) == jhn.jhn_tok_integer
+    assert lexer.token() == b'1234'
+
+    lexer.free()
@@ -0,0 +1,228 @@
+#include "api-tests.h"
+
+#include <string.h>
+
+/* the events seen so far, one letter each, and whether to pause after
+   every one of them */
+typedef struct {
+    char events[64];
+    size_t count;
+    int pause;
+    jhn_parser_t *hand;
+} pause_log;
+
+static int
+log_event(void *ctx, char c)
+{
+    pause_log *log = (pause_log *) ctx;
+
+    if (log->count < sizeof(log->events) - 1) {
+        log->events[log->count++] = c;
+    }
+    if (log->pause) {
+        jhn_parser_pause(log->hand);
+    }
+    return 1;
+}
+
+static int log_null(void *ctx) { return log_event(ctx, 'n'); }
+
+static int log_integer(void *ctx, long long i)
+{
+    return log_event(ctx, (char) ('0' + i % 10));
+}
+
+static int log_string(void *ctx, const char *s, size_t len)
+{
+    (void) len;
+    return log_event(ctx, *s);
+}
+
+static int log_map_key(void *ctx, const char *s, size_t len)
+{
+    (void) len;
+    return log_event(ctx, *s);
+}
+
+static int log_start_map(void *ctx) { return log_event(ctx, '{'); }
+static int log_end_map(void *ctx) { return log_event(ctx, '}'); }
+static int log_start_array(void *ctx) { return log_event(ctx, '['); }
+static int log_end_array(void *ctx) { return log_event(ctx, ']'); }
+
+static const jhn_parser_callbacks_t log_callbacks = {
+    log_null,
+    NULL,
+    log_integer,
+    NULL,
+    NULL,
+    log_string,
+    log_start_map,
+    log_map_key,
+    log_end_map,
+    log_start_array,
+    log_end_array,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+TEST(test_parser_pause)
+{
+    static const char text[] = "{\"a\":[1,null,\"s\"],\"b\":{}} [2]";
+    const char *chunk = text;
+    size_t len = sizeof(text) - 1;
+    size_t events = 0;
+    jhn_parser_status_t s;
+    jhn_parser_stats_t stats;
+    pause_log log;
+    jhn_parser_t *hand;
+
+    memset(&log, 0, sizeof(log));
+    log.pause = 1;
+    hand = jhn_parser_alloc(&log_callbacks, api_test_afs, &log);
+    REQUIRE(hand);
+    log.hand = hand;
+    jhn_parser_config(hand, jhn_allow_multiple_values, 1);
+
+    /* every event pauses the parse, which goes on with what was not
+       consumed yet */
+    for (;;) {
+        s = jhn_parser_parse(hand, chunk, len);
+        if (s != jhn_parser_status_paused) {
+            break;
+        }
+        CHECK(log.count == ++events);
+        CHECK(jhn_parser_get_bytes_consumed(hand) <= len);
+        chunk += jhn_parser_get_bytes_consumed(hand);
+        len -= jhn_parser_get_bytes_consumed(hand);
+    }
+    CHECK(s == jhn_parser_status_ok);
+    CHECK(jhn_parser_finish(hand) == jhn_parser_status_ok);
+    CHECK(!strcmp(log.events, "{a[1ns]b{}}[2]"));
+
+    /* resuming does not count as another chunk */
+    jhn_parser_get_stats(hand, &stats);
+    CHECK(stats.chunks == 1);
+    CHECK(stats.bytes == sizeof(text) - 1);
+    CHECK(stats.tokens[jhn_tok_count] == 0 &&
+          stats.tokens[JHN_TOKEN_STATS - 1] == 0);
+
+    jhn_parser_free(hand);
+}
+
+TEST(test_parser_pause_finish)
+{
+    pause_log log;
+    jhn_parser_t *hand;
+
+    memset(&log, 0, sizeof(log));
+    log.pause = 1;
+    hand = jhn_parser_alloc(&log_callbacks, api_test_afs, &log);
+    REQUIRE(hand);
+    log.hand = hand;
+
+    /* a number at the end of the input is only complete at the end */
+    CHECK(jhn_parser_parse(hand, "17", 2) == jhn_parser_status_ok);
+    CHECK(log.count == 0);
+    CHECK(jhn_parser_finish(hand) == jhn_parser_status_paused);
+    CHECK(log.count == 1 && log.events[0] == '7');
+    CHECK(jhn_parser_finish(hand) == jhn_parser_status_ok);
+    CHECK(log.count == 1);
+
+    jhn_parser_free(hand);
+}
+
+TEST(test_parser_max_memory)
+{
+    static const char schema_text[] = "{\"type\": \"array\"}";
+    jhn_schema_t *schema;
+    pause_log log;
+    jhn_parser_t *hand;
+
+    schema = jhn_schema_alloc(schema_text, sizeof(schema_text) - 1,
+                              api_test_afs);
+    REQUIRE(schema);
+    memset(&log, 0, sizeof(log));
+    hand = jhn_parser_alloc(&log_callbacks, api_test_afs, &log);
+    REQUIRE(hand);
+    log.hand = hand;
+
+    /* the validator allocated so far moves to the counted memory */
+    CHECK(jhn_parser_config(hand, jhn_validate_schema, schema));
+    CHECK(jhn_parser_config(hand, jhn_max_memory, (size_t) 100000));
+    CHECK(jhn_parser_config(hand, jhn_max_memory, (size_t) 50000));
+    CHECK(jhn_parser_parse(hand, "[1, \"s\"", 7) == jhn_parser_status_ok);
+    CHECK(jhn_parser_finish(hand) == jhn_parser_status_error);
+    CHECK(!strcmp(log.events, "[1s"));
+    jhn_parser_free(hand);
+
+    /* once the parse started it is too late to start counting */
+    memset(&log, 0, sizeof(log));
+    hand = jhn_parser_alloc(&log_callbacks, api_test_afs, &log);
+    REQUIRE(hand);
+    CHECK(jhn_parser_parse(hand, "[1", 2) == jhn_parser_status_ok);
+    CHECK(jhn_parser_config(hand, jhn_max_memory, (size_t) 0));
+#ifndef JHN_STATS
+    CHECK(!jhn_parser_config(hand, jhn_max_memory, (size_t) 100000));
+#endif
+    jhn_parser_free(hand);
+
+    jhn_schema_free(schema);
+}
+
+/* the schema exercises every allocation of the compiler */
+static const char oom_schema[] =
+    "{\"type\": \"object\", \"required\": [\"ab\"],"
+    " \"properties\": {\"ab\": {\"enum\": [\"x\", 2, null]},"
+    " \"c\": {\"items\": {\"multipleOf\": 2}}}}";
+
+TEST(test_parser_schema_out_of_memory)
+{
+    static const char text[] = "{\"a\\u0062\": \"x\"}";
+    jhn_schema_t *schema = NULL;
+    jhn_parser_t *hand;
+    jhn_parser_status_t s;
+    char *error;
+    size_t n;
+
+    /* the first 13 allocations parse the schema text, every one after
+       them that fails makes the compiler give up cleanly */
+    for (n = 13; !schema && n < 1000; n++) {
+        schema = jhn_schema_alloc(oom_schema, sizeof(oom_schema) - 1,
+                                  api_test_limited_afs(n));
+    }
+    REQUIRE(schema);
+
+    /* the validator reports running out of memory as the violation,
+       here for its stack, the required keys seen and the buffer the
+       escaped key is decoded in */
+    for (n = 0; n < 1000; n++) {
+        hand = jhn_parser_alloc(NULL, api_test_limited_afs((size_t) -1),
+                                NULL);
+        REQUIRE(hand);
+        CHECK(jhn_parser_config(hand, jhn_validate_schema, schema));
+        CHECK(jhn_parser_config(hand, jhn_raw_strings, 1));
+        /* the lexer is allocated with the first chunk */
+        CHECK(jhn_parser_parse(hand, "", 0) == jhn_parser_status_ok);
+        api_test_limited_afs(n);
+        s = jhn_parser_parse(hand, text, sizeof(text) - 1);
+        if (s == jhn_parser_status_ok) {
+            s = jhn_parser_finish(hand);
+        }
+        if (s == jhn_parser_status_ok) {
+            jhn_parser_free(hand);
+            break;
+        }
+        CHECK(s == jhn_parser_status_error);
+        api_test_limited_afs(1);
+        error = jhn_parser_get_error(hand, 0, text, sizeof(text) - 1);
+        CHECK(error && strstr(error, "out of memory"));
+        if (error) {
+            jhn_free(hand, error);
+        }
+        jhn_parser_free(hand);
+    }
+    CHECK(n == 4);
+    jhn_schema_free(schema);
+}
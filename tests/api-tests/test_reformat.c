@@ -0,0 +1,144 @@
+#include "api-tests.h"
+
+#include <string.h>
+
+/* reformats text fed in chunks of the given size into g */
+static jhn_parser_status_t
+reformat(jhn_gen_t *g, const char *text, size_t chunk, unsigned int flags)
+{
+    jhn_parser_t *p = jhn_reformat_alloc(g, api_test_afs);
+    jhn_parser_status_t s = jhn_parser_status_ok;
+    size_t len = strlen(text);
+    size_t i;
+
+    if (!p) {
+        return jhn_parser_status_error;
+    }
+    if (flags) {
+        jhn_parser_config(p, (jhn_parser_option) flags, 1);
+    }
+    for (i = 0; i < len && s == jhn_parser_status_ok; i += chunk) {
+        s = jhn_parser_parse(p, text + i, len - i < chunk ? len - i : chunk);
+    }
+    if (s == jhn_parser_status_ok) {
+        s = jhn_parser_finish(p);
+    }
+    jhn_parser_free(p);
+    return s;
+}
+
+/* whether text reformats to expected in chunks of every size */
+static int
+reformats_to(const char *text, const char *expected, int beautify,
+             unsigned int flags)
+{
+    size_t chunk;
+
+    for (chunk = 1; chunk <= strlen(text); chunk++) {
+        jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+        const char *buf;
+        size_t len;
+        int ok;
+
+        jhn_gen_config(g, jhn_gen_beautify, beautify);
+        ok = reformat(g, text, chunk, flags) == jhn_parser_status_ok;
+        jhn_gen_get_buf(g, &buf, &len);
+        ok = ok && len == strlen(expected) && !memcmp(buf, expected, len);
+        jhn_gen_free(g);
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+TEST(test_reformat_minify)
+{
+    /* strings and numbers are copied without decoding them */
+    CHECK(reformats_to(" { \"a\\u0041\" : [ 1 , -2.50E+1, 1e400,\n"
+                       "  \"x\\ty\\/\" ] , \"b\" : { } ,\"c\":[ ],"
+                       " \"d\" : true, \"e\": null } ",
+                       "{\"a\\u0041\":[1,-2.50E+1,1e400,\"x\\ty\\/\"],"
+                       "\"b\":{},\"c\":[],\"d\":true,\"e\":null}",
+                       0, 0));
+    CHECK(reformats_to(" \"abc\" ", "\"abc\"", 0, 0));
+    CHECK(reformats_to("[1] /* c */ ", "[1]", 0, jhn_allow_comments));
+    CHECK(reformats_to(" 1 [2]{\"a\":3}\"x\" ", "1\n[2]\n{\"a\":3}\n\"x\"",
+                       0, jhn_allow_multiple_values));
+}
+
+TEST(test_reformat_beautify)
+{
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+    const char *expected;
+    size_t len;
+
+    /* the same as generating the values */
+    REQUIRE(g);
+    jhn_gen_config(g, jhn_gen_beautify, 1);
+    jhn_gen_map_open(g);
+    jhn_gen_string(g, "a", 1);
+    jhn_gen_array_open(g);
+    jhn_gen_integer(g, 1);
+    jhn_gen_map_open(g);
+    jhn_gen_map_close(g);
+    jhn_gen_array_close(g);
+    jhn_gen_string(g, "b", 1);
+    jhn_gen_array_open(g);
+    jhn_gen_array_close(g);
+    jhn_gen_string(g, "c", 1);
+    jhn_gen_null(g);
+    jhn_gen_map_close(g);
+    jhn_gen_get_buf(g, &expected, &len);
+    CHECK(reformats_to("{\"a\":[1,{}],\"b\":[],\"c\":null}", expected, 1, 0));
+    jhn_gen_free(g);
+
+    CHECK(reformats_to("1 [2]", "1\n[\n  2\n]\n", 1,
+                       jhn_allow_multiple_values));
+}
+
+TEST(test_reformat_errors)
+{
+    char frame[8];
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+    jhn_parser_t *p;
+    char *msg;
+
+    REQUIRE(g);
+    CHECK(reformat(g, "[1,}", 4, 0) == jhn_parser_status_error);
+    CHECK(reformat(g, "{\"a\" 1}", 7, 0) == jhn_parser_status_error);
+    CHECK(reformat(g, "[1", 2, 0) == jhn_parser_status_error);
+    CHECK(reformat(g, "1 2", 3, 0) == jhn_parser_status_error);
+    CHECK(reformat(g, "[1", 2, jhn_allow_partial_values)
+          == jhn_parser_status_ok);
+    jhn_gen_free(g);
+
+    /* the same messages as the parser */
+    g = jhn_gen_alloc(api_test_afs);
+    p = jhn_reformat_alloc(g, api_test_afs);
+    REQUIRE(g && p);
+    CHECK(jhn_parser_parse(p, "[1 2]", 5) == jhn_parser_status_error);
+    msg = jhn_parser_get_error(p, 0, "[1 2]", 5);
+    CHECK(msg && !strcmp(msg, "parse error: after array element, "
+                         "I expect ',' or ']'\n"));
+    jhn_free(p, msg);
+    jhn_parser_free(p);
+    jhn_gen_free(g);
+
+    /* and the same limits */
+    g = jhn_gen_alloc(api_test_afs);
+    p = jhn_reformat_alloc(g, api_test_afs);
+    REQUIRE(g && p);
+    jhn_parser_config(p, jhn_max_depth, (size_t) 2);
+    CHECK(jhn_parser_parse(p, "[[[1]]]", 7) == jhn_parser_status_error);
+    CHECK(jhn_parser_get_exceeded_limit(p) == jhn_max_depth);
+    jhn_parser_free(p);
+    jhn_gen_free(g);
+
+    /* output that does not fit a fixed buffer cancels the parse */
+    g = jhn_gen_alloc_into(api_test_afs, frame, sizeof(frame));
+    REQUIRE(g);
+    CHECK(reformat(g, "[\"abcdefgh\"]", 12, 0)
+          == jhn_parser_status_client_cancelled);
+    jhn_gen_free(g);
+}
@@ -0,0 +1,256 @@
+#include "api-tests.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* the events a replay reported, one letter and the text for each */
+typedef struct {
+    char text[256];
+    size_t len;
+} event_log;
+
+static int
+log_event(void *ctx, const char *what, const char *str, size_t len)
+{
+    event_log *log = (event_log *) ctx;
+    int n = snprintf(log->text + log->len, sizeof(log->text) - log->len,
+                     "%s%.*s ", what, (int) len, str ? str : "");
+    log->len += (size_t) n;
+    return 1;
+}
+
+static int
+log_null(void *ctx)
+{
+    return log_event(ctx, "n", NULL, 0);
+}
+
+static int
+log_boolean(void *ctx, int val)
+{
+    return log_event(ctx, val ? "t" : "f", NULL, 0);
+}
+
+static int
+log_number(void *ctx, const char *str, size_t len)
+{
+    return log_event(ctx, "#", str, len);
+}
+
+static int
+log_string(void *ctx, const char *str, size_t len)
+{
+    return log_event(ctx, "s", str, len);
+}
+
+static int
+log_map_key(void *ctx, const char *str, size_t len)
+{
+    return log_event(ctx, "k", str, len);
+}
+
+static int
+log_map_key_id(void *ctx, int id, const char *str, size_t len)
+{
+    char what[8];
+    sprintf(what, "k%d:", id);
+    return log_event(ctx, what, str, len);
+}
+
+static int
+log_start_map(void *ctx)
+{
+    return log_event(ctx, "{", NULL, 0);
+}
+
+static int
+log_end_map(void *ctx)
+{
+    return log_event(ctx, "}", NULL, 0);
+}
+
+static int
+log_start_array(void *ctx)
+{
+    return log_event(ctx, "[", NULL, 0);
+}
+
+static int
+log_end_array(void *ctx)
+{
+    return log_event(ctx, "]", NULL, 0);
+}
+
+static int
+log_string_begin(void *ctx)
+{
+    return log_event(ctx, "<", NULL, 0);
+}
+
+static int
+log_string_chunk(void *ctx, const char *str, size_t len)
+{
+    return log_event(ctx, "c", str, len);
+}
+
+static int
+log_string_end(void *ctx)
+{
+    return log_event(ctx, ">", NULL, 0);
+}
+
+static const jhn_parser_callbacks_t plain_callbacks = {
+    log_null, log_boolean, NULL, NULL, log_number, log_string,
+    log_start_map, log_map_key, log_end_map, log_start_array, log_end_array,
+    NULL, NULL, NULL, NULL
+};
+
+static const jhn_parser_callbacks_t streaming_callbacks = {
+    log_null, log_boolean, NULL, NULL, log_number, NULL,
+    log_start_map, log_map_key, log_end_map, log_start_array, log_end_array,
+    log_string_begin, log_string_chunk, log_string_end, log_map_key_id
+};
+
+/* records text on a new tape */
+static jhn_tape_t *
+record(const char *text, unsigned int flags)
+{
+    jhn_tape_t *tape = jhn_tape_alloc(api_test_afs);
+    jhn_parser_t *p = jhn_tape_recorder_alloc(tape, api_test_afs);
+    int ok;
+
+    if (flags) {
+        jhn_parser_config(p, (jhn_parser_option) flags, 1);
+    }
+    ok = jhn_parser_parse(p, text, strlen(text)) == jhn_parser_status_ok
+        && jhn_parser_finish(p) == jhn_parser_status_ok;
+
+    jhn_parser_free(p);
+    if (!ok) {
+        jhn_tape_free(tape);
+        return NULL;
+    }
+    return tape;
+}
+
+TEST(test_tape_replay)
+{
+    const char *text = "{\"a\":[null,true,1.5,\"x\\u0079\",\"\"],\"b\":-2}";
+    jhn_tape_t *tape = record(text, 0);
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+    event_log log;
+    const char *buf;
+    size_t len;
+
+    REQUIRE(tape && g);
+
+    memset(&log, 0, sizeof(log));
+    CHECK(jhn_tape_replay(tape, &plain_callbacks, &log)
+          == jhn_parser_status_ok);
+    CHECK(!strcmp(log.text, "{ ka [ n t #1.5 sxy s ] kb #-2 } "));
+
+    /* keys go to jhn_map_key_id and strings are streamed if the client
+       asks for that */
+    memset(&log, 0, sizeof(log));
+    CHECK(jhn_tape_replay(tape, &streaming_callbacks, &log)
+          == jhn_parser_status_ok);
+    CHECK(!strcmp(log.text, "{ k-1:a [ n t #1.5 < cxy > < > ] k-1:b #-2 } "));
+
+    CHECK(jhn_tape_replay_gen(tape, g) == jhn_gen_status_ok);
+    jhn_gen_get_buf(g, &buf, &len);
+    CHECK(!strcmp(buf, "{\"a\":[null,true,1.5,\"xy\",\"\"],\"b\":-2}"));
+
+    jhn_gen_free(g);
+    jhn_tape_free(tape);
+}
+
+/* collects an image */
+typedef struct {
+    char data[512];
+    size_t len;
+} image_buf;
+
+static void
+image_print(void *ctx, const char *str, size_t len)
+{
+    image_buf *image = (image_buf *) ctx;
+    if (len <= sizeof(image->data) - image->len) {
+        memcpy(image->data + image->len, str, len);
+    }
+    image->len += len;
+}
+
+TEST(test_tape_image)
+{
+    const char *text = "{\"name\":\"x\",\"list\":[1,2.5,true,null],"
+        "\"m\":{\"k\":\"v\"}}";
+    jhn_tape_t *tape = record(text, 0);
+    jhn_gen_t *g = jhn_gen_alloc(api_test_afs);
+    image_buf image;
+    size_t root, list, v, len;
+    const char *str;
+
+    REQUIRE(tape && g);
+    memset(&image, 0, sizeof(image));
+    CHECK(jhn_tape_write_image(tape, 42, image_print, &image));
+    REQUIRE(image.len < sizeof(image.data));
+    REQUIRE(jhn_image_check(image.data, image.len, 42));
+
+    root = jhn_image_root(image.data);
+    CHECK(jhn_image_type(image.data, root) == jhn_image_map);
+    str = jhn_image_get_string(image.data,
+                               jhn_image_lookup(image.data, root, "name", 4),
+                               &len);
+    CHECK(str && len == 1 && str[0] == 'x');
+    CHECK(jhn_image_lookup(image.data, root, "nam", 3) == 0);
+
+    list = jhn_image_lookup(image.data, root, "list", 4);
+    CHECK(jhn_image_type(image.data, list) == jhn_image_array);
+    CHECK(jhn_image_get_integer(image.data,
+                                jhn_image_index(image.data, list, 0)) == 1);
+    CHECK(jhn_image_get_double(image.data,
+                               jhn_image_index(image.data, list, 1)) == 2.5);
+    CHECK(jhn_image_get_bool(image.data,
+                             jhn_image_index(image.data, list, 2)));
+    CHECK(jhn_image_type(image.data, jhn_image_index(image.data, list, 3))
+          == jhn_image_null);
+    CHECK(jhn_image_index(image.data, list, 4) == 0);
+
+    /* iterating the map visits the keys and skips over the values */
+    v = jhn_image_first(image.data, root);
+    CHECK(jhn_image_get_string(image.data, v, &len) && len == 4);
+    v = jhn_image_next(image.data, jhn_image_next(image.data, v));
+    CHECK(jhn_image_get_string(image.data, v, &len) && len == 4);
+
+    CHECK(jhn_image_replay_gen(image.data,
+                               jhn_image_lookup(image.data, root, "m", 1),
+                               g) == jhn_gen_status_ok);
+    jhn_gen_get_buf(g, &str, &len);
+    CHECK(!strcmp(str, "{\"k\":\"v\"}"));
+
+    /* a stale, truncated or damaged image is refused */
+    CHECK(!jhn_image_check(image.data, image.len, 41));
+    CHECK(!jhn_image_check(image.data, image.len - 1, 42));
+    CHECK(!jhn_image_check(image.data, 16, 42));
+    image.data[image.len - 3] ^= 1;
+    CHECK(!jhn_image_check(image.data, image.len, 42));
+
+    jhn_gen_free(g);
+    jhn_tape_free(tape);
+}
+
+TEST(test_tape_image_single_value)
+{
+    jhn_tape_t *empty = jhn_tape_alloc(api_test_afs);
+    jhn_tape_t *many = record("1 [2] 3", jhn_allow_multiple_values);
+    image_buf image;
+
+    REQUIRE(empty && many);
+    memset(&image, 0, sizeof(image));
+    CHECK(!jhn_tape_write_image(empty, 1, image_print, &image));
+    CHECK(!jhn_tape_write_image(many, 1, image_print, &image));
+    CHECK(image.len == 0);
+
+    jhn_tape_free(empty);
+    jhn_tape_free(many);
+}
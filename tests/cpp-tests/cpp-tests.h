@@ -0,0 +1,48 @@
+#ifndef CPP_TESTS_H_INCLUDED
+#define CPP_TESTS_H_INCLUDED
+
+#include <johanson.hpp>
+
+#include <cstdio>
+
+/* the number of checks that failed in the running test */
+extern int cpp_test_failures;
+
+void cpp_test_fail(const char *file, int line, const char *what);
+
+/* fails the running test if cond does not hold but goes on with it */
+#define CHECK(cond) do {                                                \
+    if (!(cond)) {                                                      \
+        cpp_test_fail(__FILE__, __LINE__, #cond);                       \
+    }                                                                   \
+} while (0)
+
+/* fails the running test and returns from it if cond does not hold */
+#define REQUIRE(cond) do {                                              \
+    if (!(cond)) {                                                      \
+        cpp_test_fail(__FILE__, __LINE__, #cond);                       \
+        return;                                                         \
+    }                                                                   \
+} while (0)
+
+#define TEST(name) void name()
+
+/* test_parse.cpp */
+TEST(test_parse_handler);
+TEST(test_parse_errors);
+
+/* test_document.cpp */
+TEST(test_document_parse);
+TEST(test_document_errors);
+
+/* test_bind.cpp */
+TEST(test_bind_round_trip);
+TEST(test_bind_errors);
+
+/* test_reader.cpp, which needs coroutines */
+#ifdef JHN_HAS_COROUTINES
+TEST(test_reader_events);
+TEST(test_reader_errors);
+#endif
+
+#endif
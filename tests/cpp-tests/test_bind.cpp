@@ -0,0 +1,115 @@
+#include "cpp-tests.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct item {
+    std::string sku;
+    int qty = 0;
+    double price = 0;
+};
+JHN_FIELDS(item, sku, qty, price)
+
+struct order {
+    long long id = 0;
+    unsigned char priority = 0;
+    bool paid = false;
+    std::optional<std::string> note;
+    std::vector<item> items;
+};
+JHN_FIELDS(order, id, priority, paid, note, items)
+
+/* the text to_json writes for v */
+template <class T>
+std::string
+encode(const T &v)
+{
+    jhn_gen_t *g = jhn_gen_alloc(nullptr);
+    const char *buf;
+    size_t len;
+    std::string out;
+
+    if (johanson::to_json(g, v) == jhn_gen_status_ok &&
+        jhn_gen_get_buf(g, &buf, &len) == jhn_gen_status_ok) {
+        out.assign(buf, len);
+    }
+    jhn_gen_free(g);
+    return out;
+}
+
+} /* namespace */
+
+TEST(test_bind_round_trip)
+{
+    const char *json =
+        "{\"id\":9007199254740993,\"priority\":255,\"paid\":true,"
+        "\"note\":\"fragile\\n\",\"items\":[{\"sku\":\"A-1\",\"qty\":2,"
+        "\"price\":9.5},{\"sku\":\"B\",\"qty\":-1,\"price\":0.25}]}";
+    order o;
+    order back;
+    item i;
+    johanson::result res;
+
+    res = johanson::from_json(json, o);
+    REQUIRE(res);
+    CHECK(o.id == 9007199254740993LL);
+    CHECK(o.priority == 255);
+    CHECK(o.paid);
+    CHECK(o.note && *o.note == "fragile\n");
+    REQUIRE(o.items.size() == 2);
+    CHECK(o.items[0].sku == "A-1" && o.items[0].qty == 2);
+    CHECK(o.items[1].qty == -1 && o.items[1].price == 0.25);
+    CHECK(encode(o) == json);
+
+    /* unknown members are skipped, null resets an optional and members
+       that are not there are left alone */
+    back.priority = 7;
+    res = johanson::from_json(
+        "{\"extra\":{\"a\":[1,{\"b\":null}]},\"note\":null,\"id\":1}", back);
+    CHECK(res);
+    CHECK(back.id == 1 && back.priority == 7 && !back.note);
+    CHECK(encode(back) ==
+          "{\"id\":1,\"priority\":7,\"paid\":false,\"note\":null,"
+          "\"items\":[]}");
+
+    /* an integer is a fine double */
+    CHECK(johanson::from_json("{\"price\":3}", i) && i.price == 3.0);
+}
+
+TEST(test_bind_errors)
+{
+    order o;
+    std::vector<int> ints;
+    johanson::result res;
+
+    res = johanson::from_json("{\"id\":\"1\"}", o);
+    CHECK(res.status == jhn_parser_status_error);
+    CHECK(res.error && std::string(res.error) == "value has the wrong type");
+
+    res = johanson::from_json("{\"items\":[{\"qty\":1.5}]}", o);
+    CHECK(res.error && std::string(res.error) == "value has the wrong type");
+
+    res = johanson::from_json("[1, 2]", o);
+    CHECK(res.error && std::string(res.error) == "value has the wrong type");
+
+    /* out of the range of the member */
+    res = johanson::from_json("{\"priority\":256}", o);
+    CHECK(res.error && std::string(res.error) == "integer out of range");
+    res = johanson::from_json("{\"priority\":-1}", o);
+    CHECK(res.error && std::string(res.error) == "integer out of range");
+    res = johanson::from_json("[1, 2147483648]", ints);
+    CHECK(res.error && std::string(res.error) == "integer out of range");
+    CHECK(ints.size() == 2 && ints[0] == 1);
+
+    /* out of the range of any integer */
+    res = johanson::from_json("{\"id\":9223372036854775808}", o);
+    CHECK(res.status == jhn_parser_status_error);
+    CHECK(res.error && std::string(res.error) == "integer overflow");
+
+    res = johanson::from_json("{\"id\":1,}", o);
+    CHECK(res.status == jhn_parser_status_error);
+    CHECK(res.error != nullptr);
+}
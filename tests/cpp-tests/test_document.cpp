@@ -0,0 +1,143 @@
+#include "cpp-tests.h"
+
+#include <memory_resource>
+#include <new>
+#include <string>
+
+namespace {
+
+/* a memory resource that fails once a number of allocations is used
+   up, and counts the blocks that were not deallocated */
+class limited_resource : public std::pmr::memory_resource {
+public:
+    explicit limited_resource(int allocations) : left_(allocations) {}
+
+    int live() const { return live_; }
+
+private:
+    void *
+    do_allocate(size_t bytes, size_t align) override
+    {
+        if (left_-- <= 0) {
+            throw std::bad_alloc();
+        }
+        void *p = std::pmr::new_delete_resource()->allocate(bytes, align);
+        live_++;
+        return p;
+    }
+
+    void
+    do_deallocate(void *p, size_t bytes, size_t align) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+        live_--;
+    }
+
+    bool
+    do_is_equal(const memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    int left_;
+    int live_ = 0;
+};
+
+} /* namespace */
+
+TEST(test_document_parse)
+{
+    std::pmr::monotonic_buffer_resource pool;
+    johanson::document doc(&pool);
+    std::string big = "{";
+    johanson::result res;
+    size_t n = 0;
+
+    res = doc.parse("{\"name\": \"caf\\u00e9\", \"n\": [1, 2.5, true, null],"
+                    " \"o\": {\"k\": \"v\"}, \"name\": \"again\"}");
+    REQUIRE(res);
+    CHECK(doc.root().is_object());
+    CHECK(doc.root().size() == 4);
+    CHECK(doc["name"].as_string() == "caf\xc3\xa9");
+    CHECK(doc["n"].size() == 4);
+    CHECK(doc["n"][0].is_integer() && doc["n"][0].as_integer() == 1);
+    CHECK(doc["n"][1].is_number() && doc["n"][1].as_double() == 2.5);
+    CHECK(doc["n"][2].as_bool());
+    CHECK(doc["n"][3].is_null());
+    CHECK(doc["o"]["k"].as_string() == "v");
+    /* anything that is not there reads as null */
+    CHECK(doc["missing"]["k"][3].is_null());
+    CHECK(doc["n"][4].is_null());
+
+    /* members stay in document order */
+    for (const johanson::member &m : doc.root().members()) {
+        CHECK(m.key == (n == 0 ? "name" : n == 1 ? "n" : n == 2 ? "o"
+                                                                : "name"));
+        n++;
+    }
+    CHECK(n == 4);
+
+    /* large objects are looked up through an index */
+    for (int i = 0; i < 40; i++) {
+        big += (i ? ",\"k" : "\"k") + std::to_string(i) + "\":" +
+               std::to_string(i);
+    }
+    big += "}";
+    REQUIRE(doc.parse(big));
+    CHECK(doc.root().size() == 40);
+    CHECK(doc["k0"].as_integer() == 0);
+    CHECK(doc["k39"].as_integer() == 39);
+    CHECK(doc.root().find("k40") == nullptr);
+}
+
+TEST(test_document_errors)
+{
+    johanson::document doc;
+    johanson::result res;
+
+    res = doc.parse("{\"a\": [1, 2}");
+    CHECK(!res);
+    CHECK(res.error != nullptr);
+    CHECK(doc.root().is_null());
+
+    res = doc.parse("{\"a\": 99999999999999999999}");
+    CHECK(!res);
+    CHECK(res.error != nullptr);
+
+    res = doc.parse("[1] // done", jhn_allow_comments);
+    CHECK(res);
+    CHECK(doc[0].as_integer() == 1);
+
+    /* allocation failures come back as errors and not as exceptions */
+    for (int allocations : {0, 1}) {
+        limited_resource mr(allocations);
+        johanson::document small(&mr);
+
+        res = small.parse("[1]");
+        CHECK(!res);
+        CHECK(res.error && std::string(res.error) == "out of memory");
+    }
+
+    /* wherever building the values runs out, nothing is left allocated
+       and no exception gets through the parser */
+    static const char text[] =
+        "{\"a\\u0062\": [\"x\\n\", {\"k\\t\": [1, \"y\\t\", []]}, {}],"
+        " \"c\\n\": {\"d\\n\": [[{}]]}}";
+    for (int allocations = 0; allocations < 100; allocations++) {
+        limited_resource mr(allocations);
+        {
+            johanson::document small(&mr);
+
+            res = small.parse(text);
+            if (res) {
+                CHECK(small["ab"][1]["k\t"][1].as_string() == "y\t");
+                CHECK(small["c\n"]["d\n"][0][0].is_object());
+                break;
+            }
+            CHECK(res.error && std::string(res.error) == "out of memory");
+            CHECK(res.status == jhn_parser_status_error);
+        }
+        CHECK(mr.live() == 0);
+    }
+    CHECK(res);
+}
@@ -0,0 +1,99 @@
+#include "cpp-tests.h"
+
+#include <string>
+
+namespace {
+
+/* writes the events it gets to log, one word each */
+struct log_handler {
+    std::string log;
+    /* the number of events after which the parse is cancelled */
+    int cancel_after = -1;
+
+    bool
+    add(const std::string &event)
+    {
+        if (!log.empty()) {
+            log += ' ';
+        }
+        log += event;
+        return cancel_after < 0 || --cancel_after > 0;
+    }
+
+    bool on_null() { return add("null"); }
+    bool on_bool(bool b) { return add(b ? "true" : "false"); }
+    bool on_integer(long long i) { return add(std::to_string(i)); }
+    bool on_double(double d) { return add("d" + std::to_string(d)); }
+    bool on_string(std::string_view s) { return add("'" + std::string(s)); }
+    bool on_key(std::string_view k) { return add(std::string(k) + ":"); }
+    bool on_start_map() { return add("{"); }
+    bool on_end_map() { return add("}"); }
+    bool on_start_array() { return add("["); }
+    bool on_end_array() { return add("]"); }
+};
+
+/* only counts the strings, so nothing else is converted */
+struct string_counter {
+    int strings = 0;
+
+    void on_string(std::string_view) { strings++; }
+};
+
+} /* namespace */
+
+TEST(test_parse_handler)
+{
+    log_handler h;
+    string_counter c;
+    johanson::result res;
+
+    res = johanson::parse(
+        "{\"a\\u0062\": [1, -2.5, true, null, \"x\\ny\"], \"c\": {}}", h);
+    CHECK(res);
+    CHECK(res.error == nullptr);
+    CHECK(h.log == "{ ab: [ 1 d-2.500000 true null 'x\ny ] c: { } }");
+
+    res = johanson::parse("[\"a\", 1, {\"k\": \"b\"}, 99999999999999999999]",
+                          c);
+    CHECK(res);
+    CHECK(c.strings == 2);
+
+    h.log.clear();
+    res = johanson::parse("1 /* one */ 2", h,
+                          jhn_allow_comments | jhn_allow_multiple_values);
+    CHECK(res);
+    CHECK(h.log == "1 2");
+}
+
+TEST(test_parse_errors)
+{
+    log_handler h;
+    johanson::result res;
+
+    res = johanson::parse("[1, 2,]", h);
+    CHECK(!res);
+    CHECK(res.status == jhn_parser_status_error);
+    CHECK(res.error != nullptr);
+    CHECK(res.offset == 7);
+
+    h.log.clear();
+    res = johanson::parse("[1, 99999999999999999999]", h);
+    CHECK(res.status == jhn_parser_status_error);
+    CHECK(res.error && std::string(res.error) == "integer overflow");
+    CHECK(h.log == "[ 1");
+
+    h.log.clear();
+    h.cancel_after = 2;
+    res = johanson::parse("[1, 2, 3]", h);
+    CHECK(res.status == jhn_parser_status_client_cancelled);
+    CHECK(h.log == "[ 1");
+
+    h.log.clear();
+    h.cancel_after = -1;
+    res = johanson::parse("[1] [2]", h);
+    CHECK(res.status == jhn_parser_status_error);
+    CHECK(res.error && std::string(res.error) == "trailing garbage");
+    res = johanson::parse("{\"a\": 1", h);
+    CHECK(res.status == jhn_parser_status_error);
+    CHECK(res.offset == 7);
+}
@@ -0,0 +1,127 @@
+#include "cpp-tests.h"
+
+#include <string>
+
+#ifdef JHN_HAS_COROUTINES
+
+namespace {
+
+/* a coroutine that starts right away and is never waited for */
+struct task {
+    struct promise_type {
+        task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/* writes the events to log until end or error, one word each.  Members
+   that do not belong to the type of an event have to be empty. */
+task
+consume(johanson::reader &r, std::string &log)
+{
+    using johanson::event_type;
+
+    for (;;) {
+        johanson::event e = co_await r.next();
+        std::string word;
+
+        switch (e.type) {
+        case event_type::null_value: word = "null"; break;
+        case event_type::bool_value: word = e.boolean ? "true" : "false";
+            break;
+        case event_type::integer_value: word = std::to_string(e.integer);
+            break;
+        case event_type::double_value: word = "d"; break;
+        case event_type::string_value: word = "'" + std::string(e.string);
+            break;
+        case event_type::key: word = std::string(e.string) + ":"; break;
+        case event_type::start_map: word = "{"; break;
+        case event_type::end_map: word = "}"; break;
+        case event_type::start_array: word = "["; break;
+        case event_type::end_array: word = "]"; break;
+        case event_type::end: word = "end"; break;
+        case event_type::error: word = "error"; break;
+        }
+        if ((e.type != event_type::string_value &&
+             e.type != event_type::key && !e.string.empty()) ||
+            (e.type != event_type::bool_value && e.boolean) ||
+            (e.type != event_type::integer_value && e.integer) ||
+            (e.type != event_type::double_value && e.number != 0)) {
+            word += "!";
+        }
+        log += log.empty() ? word : " " + word;
+        if (e.type == event_type::end || e.type == event_type::error) {
+            co_return;
+        }
+    }
+}
+
+/* pushes text in chunks of the given size and finishes the input */
+void
+feed(johanson::reader &r, const std::string &text, size_t chunk)
+{
+    for (size_t i = 0; i < text.size(); i += chunk) {
+        r.push(std::string_view(text).substr(i, chunk));
+    }
+    r.finish();
+}
+
+} /* namespace */
+
+TEST(test_reader_events)
+{
+    const std::string text =
+        "{\"k\": [true, 12, 2.5, \"s\\t\", null], \"e\\u0073c\": \"long "
+        "string that crosses chunks\"}";
+    const std::string expected =
+        "{ k: [ true 12 d 's\t null ] esc: 'long string that crosses "
+        "chunks } end";
+
+    for (size_t chunk = 1; chunk <= text.size(); chunk++) {
+        johanson::reader r;
+        std::string log;
+
+        consume(r, log);
+        feed(r, text, chunk);
+        CHECK(log == expected);
+    }
+}
+
+TEST(test_reader_errors)
+{
+    std::string log;
+
+    {
+        johanson::reader r;
+
+        consume(r, log);
+        feed(r, "[1, 2 3]", 3);
+        CHECK(log == "[ 1 2 error");
+        CHECK(!r.error().empty());
+    }
+
+    /* the input ends too early */
+    log.clear();
+    {
+        johanson::reader r;
+
+        consume(r, log);
+        feed(r, "{\"a\": ", 2);
+        CHECK(log == "{ a: error");
+    }
+
+    /* several values only with the flag */
+    log.clear();
+    {
+        johanson::reader r(jhn_allow_multiple_values);
+
+        consume(r, log);
+        feed(r, "1 2 3", 1);
+        CHECK(log == "1 2 3 end");
+    }
+}
+
+#endif
@@ -27,3 +27,66 @@ project "parsing-tests"
 		targetname "parsing-tests-release"
 		links { "johanson" }
 		libdirs { "../build/native" }
+
+project "api-tests"
+	language "C"
+	kind "ConsoleApp"
+	flags { "ExtraWarnings" }
+	includedirs {
+		"../include",
+	}
+
+	files {
+		"run-api-tests.c",
+		"api-tests/*.c",
+		"api-tests/*.h",
+	}
+
+	-- IDE specific configuration
+	configuration "vs*"
+		defines { "_CRT_SECURE_NO_WARNINGS" }
+
+	configuration { "debug", "native" }
+		targetname "api-tests-debug"
+		links { "johanson-d" }
+		libdirs { "../build/native" }
+	configuration { "release", "native" }
+		targetname "api-tests-release"
+		links { "johanson" }
+		libdirs { "../build/native" }
+
+-- the C++ layer, once as C++17 and once as C++20 where the coroutine
+-- reader is available as well
+for _, std in ipairs({ "17", "20" }) do
+	project ("cpp" .. std .. "-tests")
+		language "C++"
+		kind "ConsoleApp"
+		flags { "ExtraWarnings" }
+		includedirs {
+			"../include",
+		}
+
+		files {
+			"run-cpp-tests.cpp",
+			"cpp-tests/*.cpp",
+			"cpp-tests/*.h",
+		}
+
+		if not os.is('windows') then
+			buildoptions { "-std=c++" .. std }
+		end
+
+		-- IDE specific configuration
+		configuration "vs*"
+			defines { "_CRT_SECURE_NO_WARNINGS" }
+			buildoptions { "/std:c++" .. std }
+
+		configuration { "debug", "native" }
+			targetname ("cpp" .. std .. "-tests-debug")
+			links { "johanson-d" }
+			libdirs { "../build/native" }
+		configuration { "release", "native" }
+			targetname ("cpp" .. std .. "-tests-release")
+			links { "johanson" }
+			libdirs { "../build/native" }
+end
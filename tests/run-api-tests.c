@@ -0,0 +1,152 @@
+#include "api-tests/api-tests.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SUCCESS_MARKER "\033[32mSUCCESS\033[0m"
+#define FAILURE_MARKER "\033[31mFAILURE\033[0m"
+
+jhn_alloc_funcs_t *api_test_afs = NULL;
+int api_test_failures = 0;
+
+void
+api_test_fail(const char *file, int line, const char *what)
+{
+    printf("\n  %s:%d: %s", file, line, what);
+    api_test_failures++;
+}
+
+static size_t allocations_left;
+
+static void *
+limited_malloc(void *ctx, size_t sz)
+{
+    (void) ctx;
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return api_test_afs->malloc_func(api_test_afs->ctx, sz);
+}
+
+static void *
+limited_realloc(void *ctx, void *ptr, size_t sz)
+{
+    (void) ctx;
+    if (allocations_left == 0) {
+        return NULL;
+    }
+    allocations_left--;
+    return api_test_afs->realloc_func(api_test_afs->ctx, ptr, sz);
+}
+
+static void
+limited_free(void *ctx, void *ptr)
+{
+    (void) ctx;
+    api_test_afs->free_func(api_test_afs->ctx, ptr);
+}
+
+jhn_alloc_funcs_t *
+api_test_limited_afs(size_t allocations)
+{
+    static jhn_alloc_funcs_t limited = {
+        limited_malloc,
+        limited_realloc,
+        limited_free,
+        NULL
+    };
+
+    allocations_left = allocations;
+    return &limited;
+}
+
+#define ENTRY(name) { #name, name }
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} tests[] = {
+    ENTRY(test_gen_fixed_rollback),
+    ENTRY(test_gen_fixed_reset),
+    ENTRY(test_gen_fixed_too_large),
+    ENTRY(test_gen_raw_value),
+    ENTRY(test_gen_keys),
+    ENTRY(test_gen_indent_out_of_memory),
+    ENTRY(test_gen_deep_nesting),
+    ENTRY(test_gen_fd_out_of_memory),
+#if !defined(_WIN32) && !defined(WIN32)
+    ENTRY(test_gen_fd_would_block),
+    ENTRY(test_gen_fd_write_failed),
+#endif
+    ENTRY(test_parser_pause),
+    ENTRY(test_parser_pause_finish),
+    ENTRY(test_parser_max_memory),
+    ENTRY(test_parser_schema_out_of_memory),
+    ENTRY(test_keyset_lookup),
+    ENTRY(test_keyset_duplicates),
+    ENTRY(test_keyset_parser),
+    ENTRY(test_keyset_out_of_memory),
+    ENTRY(test_intern_strings),
+    ENTRY(test_intern_keys),
+    ENTRY(test_intern_out_of_memory),
+    ENTRY(test_reformat_minify),
+    ENTRY(test_reformat_beautify),
+    ENTRY(test_reformat_errors),
+    ENTRY(test_tape_replay),
+    ENTRY(test_tape_image),
+    ENTRY(test_tape_image_single_value),
+    ENTRY(test_cbor_decode),
+    ENTRY(test_cbor_generator_full),
+    ENTRY(test_cbor_round_trip),
+    ENTRY(test_msgpack_encode),
+    ENTRY(test_cbor_out_of_memory)
+};
+
+/* runs the tests whose name contains the first argument, all of them if
+   there is none */
+int
+main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : NULL;
+    size_t tests_total = 0;
+    size_t tests_succeeded = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        jhn_tracker_t *tracker;
+        jhn_alloc_report_t report;
+
+        if (filter && !strstr(tests[i].name, filter)) {
+            continue;
+        }
+
+        printf(" test (%s): ", tests[i].name);
+        fflush(stdout);
+
+        tracker = jhn_tracker_alloc(NULL);
+        api_test_afs = jhn_tracker_funcs(tracker);
+        api_test_failures = 0;
+        tests[i].run();
+        jhn_tracker_get_report(tracker, &report);
+        jhn_tracker_free(tracker);
+        api_test_afs = NULL;
+
+        if (report.live_blocks) {
+            printf("\n  memory leaks:\t%u", (unsigned int) report.live_blocks);
+            api_test_failures++;
+        }
+        if (api_test_failures) {
+            printf("\n%s\n", FAILURE_MARKER);
+        } else {
+            printf("%s\n", SUCCESS_MARKER);
+            tests_succeeded++;
+        }
+        tests_total++;
+    }
+
+    printf("%u/%u tests successful\n", (unsigned int) tests_succeeded,
+           (unsigned int) tests_total);
+
+    return tests_succeeded == tests_total ? 0 : 1;
+}
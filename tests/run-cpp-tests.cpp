@@ -0,0 +1,70 @@
+#include "cpp-tests/cpp-tests.h"
+
+#include <cstring>
+
+#define SUCCESS_MARKER "\033[32mSUCCESS\033[0m"
+#define FAILURE_MARKER "\033[31mFAILURE\033[0m"
+
+int cpp_test_failures = 0;
+
+void
+cpp_test_fail(const char *file, int line, const char *what)
+{
+    std::printf("\n  %s:%d: %s", file, line, what);
+    cpp_test_failures++;
+}
+
+#define ENTRY(name) { #name, name }
+
+static const struct {
+    const char *name;
+    void (*run)();
+} tests[] = {
+    ENTRY(test_parse_handler),
+    ENTRY(test_parse_errors),
+    ENTRY(test_document_parse),
+    ENTRY(test_document_errors),
+    ENTRY(test_bind_round_trip),
+    ENTRY(test_bind_errors),
+#ifdef JHN_HAS_COROUTINES
+    ENTRY(test_reader_events),
+    ENTRY(test_reader_errors)
+#endif
+};
+
+/* runs the tests whose name contains the first argument, all of them if
+   there is none */
+int
+main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : nullptr;
+    size_t tests_total = 0;
+    size_t tests_succeeded = 0;
+
+    std::printf(" C++ %ld\n", static_cast<long>(__cplusplus));
+    for (const auto &t : tests) {
+        if (filter && !std::strstr(t.name, filter)) {
+            continue;
+        }
+
+        std::printf(" test (%s): ", t.name);
+        std::fflush(stdout);
+
+        cpp_test_failures = 0;
+        t.run();
+
+        if (cpp_test_failures) {
+            std::printf("\n%s\n", FAILURE_MARKER);
+        } else {
+            std::printf("%s\n", SUCCESS_MARKER);
+            tests_succeeded++;
+        }
+        tests_total++;
+    }
+
+    std::printf("%u/%u tests successful\n",
+                static_cast<unsigned int>(tests_succeeded),
+                static_cast<unsigned int>(tests_total));
+
+    return tests_succeeded == tests_total ? 0 : 1;
+}
@@ -6,41 +6,26 @@
 
 #include <assert.h>
 
-typedef struct
-{
-    unsigned int num_frees;
-    unsigned int num_mallocs;
-} jhn_test_memory_ctx;
-
-#define TEST_CTX(vptr) ((jhn_test_memory_ctx *)(vptr))
+/* allocation routines that check that the parser never frees NULL or
+   allocates zero bytes and pass the calls on to the tracker */
+#define TEST_AFS(vptr) ((jhn_alloc_funcs_t *)(vptr))
 
 static void test_free(void *ctx, void * ptr)
 {
-    (void)ctx;
     assert(ptr != NULL);
-    TEST_CTX(ctx)->num_frees++;
-    free(ptr);
+    TEST_AFS(ctx)->free_func(TEST_AFS(ctx)->ctx, ptr);
 }
 
 static void *test_malloc(void *ctx, size_t sz)
 {
-    (void)ctx;
     assert(sz != 0);
-    TEST_CTX(ctx)->num_mallocs++;
-    return malloc(sz);
+    return TEST_AFS(ctx)->malloc_func(TEST_AFS(ctx)->ctx, sz);
 }
 
 static void *test_realloc(void *ctx, void *ptr, size_t sz)
 {
-    (void)ctx;
-    if (ptr == NULL) {
-        assert(sz != 0);
-        TEST_CTX(ctx)->num_mallocs++;
-    } else if (sz == 0) {
-        TEST_CTX(ctx)->num_frees++;
-    }
-
-    return realloc(ptr, sz);
+    assert(ptr != NULL || sz != 0);
+    return TEST_AFS(ctx)->realloc_func(TEST_AFS(ctx)->ctx, ptr, sz);
 }
 
 
@@ -84,6 +69,38 @@ static int test_jhn_string(void *ctx, const char *val, size_t length)
     return 1;
 }
 
+/* streamed strings are collected and printed like regular strings so
+   that they produce the same output */
+static char *streamed_string = NULL;
+static size_t streamed_string_len = 0;
+
+static int test_jhn_string_begin(void *ctx)
+{
+    (void)ctx;
+    assert(streamed_string == NULL);
+    streamed_string = malloc(1);
+    streamed_string_len = 0;
+    return 1;
+}
+
+static int test_jhn_string_chunk(void *ctx, const char *val, size_t length)
+{
+    (void)ctx;
+    assert(streamed_string != NULL && length > 0);
+    streamed_string = realloc(streamed_string, streamed_string_len + length);
+    memcpy(streamed_string + streamed_string_len, val, length);
+    streamed_string_len += length;
+    return 1;
+}
+
+static int test_jhn_string_end(void *ctx)
+{
+    test_jhn_string(ctx, streamed_string, streamed_string_len);
+    free(streamed_string);
+    streamed_string = NULL;
+    return 1;
+}
+
 static int test_jhn_map_key(void *ctx, const char *val, size_t length)
 {
     (void)ctx;
@@ -135,9 +152,40 @@ static jhn_parser_callbacks_t callbacks = {
     test_jhn_map_key,
     test_jhn_end_map,
     test_jhn_start_array,
-    test_jhn_end_array
+    test_jhn_end_array,
+    NULL,
+    NULL,
+    NULL,
+    NULL
 };
 
+/* compiles the schema in the file at path */
+static jhn_schema_t *load_schema(const char *path, jhn_alloc_funcs_t *afs)
+{
+    static char text[65536];
+    size_t len;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        return NULL;
+    }
+    len = fread(text, 1, sizeof(text), file);
+    fclose(file);
+    return jhn_schema_alloc(text, len, afs);
+}
+
+/* the name of a limit for the error output */
+static const char *limit_name(jhn_parser_option opt)
+{
+    switch (opt) {
+        case jhn_max_depth: return "depth";
+        case jhn_max_token_size: return "token size";
+        case jhn_max_bytes: return "bytes";
+        case jhn_max_memory: return "memory";
+        default: return "unknown";
+    }
+}
+
 static void usage(const char *progname)
 {
     fprintf(stderr,
@@ -149,7 +197,14 @@ static void usage(const char *progname)
             "   -g  allow garbage after valid JSON text\n"
             "   -m  allows the parser to consume multiple JSON values\n"
             "       from a single string separated by whitespace\n"
-            "   -p  partial JSON documents should not cause errors\n",
+            "   -p  partial JSON documents should not cause errors\n"
+            "   -r  pass strings and keys on without unescaping them\n"
+            "   -s  stream strings that span multiple reads\n"
+            "   -S  validate against the schema in the given file\n"
+            "   -D  set the maximum nesting depth\n"
+            "   -T  set the maximum token size\n"
+            "   -B  set the maximum number of input bytes\n"
+            "   -M  set the maximum memory of the parser\n",
             progname);
     exit(1);
 }
@@ -158,6 +213,7 @@ int
 main(int argc, char ** argv)
 {
     jhn_parser_t *hand;
+    jhn_schema_t *schema = NULL;
     const char *filename = NULL;
     static char * file_data = NULL;
     FILE *file;
@@ -166,9 +222,10 @@ main(int argc, char ** argv)
     size_t rd;
     int i, j;
 
-    /* memory allocation debugging: allocate a structure which collects
+    /* memory allocation debugging: allocate a tracker which collects
      * statistics */
-    jhn_test_memory_ctx mem_ctx = { 0, 0 };
+    jhn_tracker_t *tracker = jhn_tracker_alloc(NULL);
+    jhn_alloc_report_t report;
 
     /* memory allocation debugging: allocate a structure which holds
      * allocation routines */
@@ -179,7 +236,7 @@ main(int argc, char ** argv)
         NULL
     };
 
-    alloc_funcs.ctx = (void *) &mem_ctx;
+    alloc_funcs.ctx = (void *) jhn_tracker_funcs(tracker);
 
     /* allocate the parser */
     hand = jhn_parser_alloc(&callbacks, &alloc_funcs, NULL);
@@ -210,6 +267,39 @@ main(int argc, char ** argv)
             jhn_parser_config(hand, jhn_allow_multiple_values, 1);
         } else if (!strcmp("-p", argv[i])) {
             jhn_parser_config(hand, jhn_allow_partial_values, 1);
+        } else if (!strcmp("-r", argv[i])) {
+            jhn_parser_config(hand, jhn_raw_strings, 1);
+        } else if (!strcmp("-s", argv[i])) {
+            callbacks.jhn_string_begin = test_jhn_string_begin;
+            callbacks.jhn_string_chunk = test_jhn_string_chunk;
+            callbacks.jhn_string_end = test_jhn_string_end;
+        } else if (!strcmp("-D", argv[i]) || !strcmp("-T", argv[i]) ||
+                   !strcmp("-B", argv[i]) || !strcmp("-M", argv[i])) {
+            jhn_parser_option opt = argv[i][1] == 'D' ? jhn_max_depth :
+                                    argv[i][1] == 'T' ? jhn_max_token_size :
+                                    argv[i][1] == 'B' ? jhn_max_bytes :
+                                                        jhn_max_memory;
+            if (++i >= argc) usage(argv[0]);
+            if (!jhn_parser_config(hand, opt,
+                                   (size_t) strtoul(argv[i], NULL, 10))) {
+                fprintf(stderr, "failed to set the %s limit\n",
+                        limit_name(opt));
+                usage(argv[0]);
+            }
+        } else if (!strcmp("-S", argv[i])) {
+            if (++i >= argc) usage(argv[0]);
+            schema = load_schema(argv[i], &alloc_funcs);
+            if (!schema) {
+                /* nothing to parse against */
+                printf("invalid schema\n");
+                jhn_parser_free(hand);
+                jhn_tracker_get_report(tracker, &report);
+                jhn_tracker_free(tracker);
+                printf("memory leaks:\t%u\n",
+                       (unsigned int) report.live_blocks);
+                return 0;
+            }
+            jhn_parser_config(hand, jhn_validate_schema, schema);
         } else {
             filename = argv[i];
             break;
@@ -254,9 +344,14 @@ main(int argc, char ** argv)
         fflush(stdout);
         fprintf(stderr, "%s", str);
         jhn_free(hand, str);
+        if (jhn_parser_get_exceeded_limit(hand)) {
+            fprintf(stderr, "exceeded limit: %s\n",
+                    limit_name(jhn_parser_get_exceeded_limit(hand)));
+        }
     }
 
     jhn_parser_free(hand);
+    jhn_schema_free(schema);
     free(file_data);
 
     if (filename) {
@@ -266,7 +361,9 @@ main(int argc, char ** argv)
 
     fflush(stderr);
     fflush(stdout);
-    printf("memory leaks:\t%u\n", mem_ctx.num_mallocs - mem_ctx.num_frees);
+    jhn_tracker_get_report(tracker, &report);
+    jhn_tracker_free(tracker);
+    printf("memory leaks:\t%u\n", (unsigned int) report.live_blocks);
 
     return 0;
 }
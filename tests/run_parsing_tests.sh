@@ -27,6 +27,10 @@ for file in $TESTPATH/parsing-cases/*.json ; do
   allow_garbage=""
   allow_multiple=""
   allow_partials=""
+  stream_strings=""
+  raw_strings=""
+  schema=""
+  limits=""
 
   # if the filename starts with dc_, we disallow comments for this test
   case $(basename $file) in
@@ -42,6 +46,19 @@ for file in $TESTPATH/parsing-cases/*.json ; do
     ap_*)
      allow_partials="-p ";
     ;;
+    as_*)
+     stream_strings="-s ";
+    ;;
+    sc_*)
+     schema="-S ${file%.json}.schema ";
+    ;;
+    sr_*)
+     raw_strings="-r ";
+     schema="-S ${file%.json}.schema ";
+    ;;
+    lm_*)
+     limits="$(cat ${file%.json}.limits) ";
+    ;;
   esac
   fileShort=`basename $file`
   testName=`echo $fileShort | sed -e 's/\.json$//'`
@@ -52,7 +69,7 @@ for file in $TESTPATH/parsing-cases/*.json ; do
 
   # parse with a read buffer size ranging from 1-31 to stress stream parsing
   while [ $iter -lt 32  ] && [ $success = $SUCCESS_MARKER ] ; do
-    $TEST_BIN $allow_partials $allow_comments $allow_garbage $allow_multiple -b $iter < $file > ${file}.test  2>&1
+    $TEST_BIN $allow_partials $allow_comments $allow_garbage $allow_multiple $stream_strings $raw_strings $schema$limits-b $iter < $file > ${file}.test  2>&1
     diff ${DIFF_FLAGS} "${file}.gold" "${file}.test" > "${file}.out"
     if [ $? -eq 0 ] ; then
       if [ $iter -eq 31 ] ; then tests_succeeded=$(( $tests_succeeded + 1 )) ; fi